@@ -49,6 +49,7 @@
 #include "fiff_coord_trans.h"
 #include "fiff_dir_tree.h"
 #include "fiff_dir_entry.h"
+#include "fiff_dir_index.h"
 #include "fiff_named_matrix.h"
 #include "fiff_tag.h"
 #include "fiff_types.h"
@@ -37,7 +37,7 @@ include(../../mne-cpp.pri)
 
 TEMPLATE = lib
 
-QT += network
+QT += network concurrent
 QT -= gui
 
 DEFINES += FIFF_LIBRARY
@@ -91,7 +91,10 @@ SOURCES += fiff.cpp \
     fiff_dir_entry.cpp \
     fiff_info_base.cpp \
     fiff_evoked.cpp \
-    fiff_evoked_set.cpp
+    fiff_evoked_set.cpp \
+    fiff_raw_writer.cpp \
+    fiff_dir_index.cpp \
+    fiff_tag_decoder.cpp
 
 HEADERS += fiff.h \
     fiff_global.h \
@@ -118,7 +121,10 @@ HEADERS += fiff.h \
     fiff_stream.h \
     fiff_info_base.h \
     fiff_evoked.h \
-    fiff_evoked_set.h
+    fiff_evoked_set.h \
+    fiff_raw_writer.h \
+    fiff_dir_index.h \
+    fiff_tag_decoder.h
 
 INCLUDEPATH += $${EIGEN_INCLUDE_DIR}
 INCLUDEPATH += $${MNE_INCLUDE_DIR}
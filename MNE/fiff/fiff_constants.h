@@ -586,12 +586,25 @@ namespace FIFFLIB
 //
 #define FIFF_MNE_RT_COMMAND         3700              /**< Fiff Real-Time Command */
 #define FIFF_MNE_RT_CLIENT_ID       3701              /**< Fiff Real-Time mne_t_server client id */
+#define FIFF_MNE_RT_SHM_KEY         3702              /**< Fiff Real-Time shared memory key, empty if the shared memory transport is refused */
+#define FIFF_MNE_RT_SHM_BUFFER      3703              /**< Fiff Real-Time raw buffer in shared memory: generation, sequence number and size in bytes */
+#define FIFF_MNE_RT_DATA_BUFFER_LE      3704          /**< Fiff Real-Time raw buffer: channels, samples and floats, little-endian */
+#define FIFF_MNE_RT_DATA_BUFFER_INT16   3705          /**< Fiff Real-Time raw buffer: channels, samples, float scale per channel and int16 samples, little-endian */
+#define FIFF_MNE_RT_DATA_BUFFER_DELTA   3706          /**< Fiff Real-Time raw buffer: channels, samples and the deflated byte planes of the sample deltas, lossless */
 
 //
 // 3710... Real-Time Blocks
 //
 #define FIFFB_MNE_RT_MEAS_INFO      3710              /**< Fiff Real-Time Measurement Info */
 
+//
+// Fiff Real-Time stream formats of the raw buffers
+//
+#define FIFFV_MNE_RT_FORMAT_FIFF        0             /**< FIFF_DATA_BUFFER of big-endian floats (default) */
+#define FIFFV_MNE_RT_FORMAT_NATIVE      1             /**< FIFF_MNE_RT_DATA_BUFFER_LE */
+#define FIFFV_MNE_RT_FORMAT_INT16       2             /**< FIFF_MNE_RT_DATA_BUFFER_INT16, lossy */
+#define FIFFV_MNE_RT_FORMAT_COMPRESSED  3             /**< FIFF_MNE_RT_DATA_BUFFER_DELTA */
+
 
 //
 // Fiff values associated with MNE computations
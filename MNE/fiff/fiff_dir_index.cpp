@@ -0,0 +1,292 @@
+//=============================================================================================================
+/**
+* @file     fiff_dir_index.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the FiffDirIndex Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_dir_index.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+bool FiffDirIndex::s_bEnabled = false;
+
+namespace
+{
+
+const quint32 INDEX_MAGIC   = 0x46494458;   /**< "FIDX" */
+const qint32  INDEX_VERSION = 1;            /**< Increase whenever the layout changes */
+const qint32  MAX_DEPTH     = 256;          /**< Guards the recursion against corrupt indices */
+
+//=============================================================================================================
+
+void write_id(QDataStream& p_Stream, const FiffId& p_Id)
+{
+    p_Stream << (qint32)p_Id.version << (qint32)p_Id.machid[0] << (qint32)p_Id.machid[1];
+    p_Stream << (qint32)p_Id.time.secs << (qint32)p_Id.time.usecs;
+}
+
+//=============================================================================================================
+
+void read_id(QDataStream& p_Stream, FiffId& p_Id)
+{
+    p_Stream >> p_Id.version >> p_Id.machid[0] >> p_Id.machid[1] >> p_Id.time.secs >> p_Id.time.usecs;
+}
+
+//=============================================================================================================
+
+bool same_id(const FiffId& p_IdA, const FiffId& p_IdB)
+{
+    return p_IdA.version == p_IdB.version
+            && p_IdA.machid[0] == p_IdB.machid[0] && p_IdA.machid[1] == p_IdB.machid[1]
+            && p_IdA.time.secs == p_IdB.time.secs && p_IdA.time.usecs == p_IdB.time.usecs;
+}
+
+//=============================================================================================================
+
+void write_dir(QDataStream& p_Stream, const QList<FiffDirEntry>& p_Dir)
+{
+    p_Stream << (qint32)p_Dir.size();
+    for(qint32 k = 0; k < p_Dir.size(); ++k)
+        p_Stream << p_Dir[k].kind << p_Dir[k].type << p_Dir[k].size << p_Dir[k].pos;
+}
+
+//=============================================================================================================
+
+bool read_dir(QDataStream& p_Stream, QList<FiffDirEntry>& p_Dir)
+{
+    qint32 nent;
+    p_Stream >> nent;
+    if(p_Stream.status() != QDataStream::Ok || nent < 0)
+        return false;
+
+    //
+    //   Every entry takes 16 bytes, don't trust counts which exceed the rest of the index
+    //
+    if((qint64)nent*16 > p_Stream.device()->bytesAvailable())
+        return false;
+
+    p_Dir.clear();
+    p_Dir.reserve(nent);
+    FiffDirEntry t_Entry;
+    for(qint32 k = 0; k < nent; ++k)
+    {
+        p_Stream >> t_Entry.kind >> t_Entry.type >> t_Entry.size >> t_Entry.pos;
+        p_Dir.append(t_Entry);
+    }
+    return p_Stream.status() == QDataStream::Ok;
+}
+
+//=============================================================================================================
+
+void write_tree(QDataStream& p_Stream, const FiffDirTree& p_Tree)
+{
+    p_Stream << p_Tree.block;
+    write_id(p_Stream, p_Tree.id);
+    write_id(p_Stream, p_Tree.parent_id);
+    p_Stream << p_Tree.nent << p_Tree.nent_tree << p_Tree.nchild;
+    write_dir(p_Stream, p_Tree.dir);
+
+    p_Stream << (qint32)p_Tree.children.size();
+    for(qint32 k = 0; k < p_Tree.children.size(); ++k)
+        write_tree(p_Stream, p_Tree.children[k]);
+}
+
+//=============================================================================================================
+
+bool read_tree(QDataStream& p_Stream, FiffDirTree& p_Tree, qint32 p_iDepth)
+{
+    if(p_iDepth > MAX_DEPTH)
+        return false;
+
+    p_Tree.clear();
+    p_Stream >> p_Tree.block;
+    read_id(p_Stream, p_Tree.id);
+    read_id(p_Stream, p_Tree.parent_id);
+    p_Stream >> p_Tree.nent >> p_Tree.nent_tree >> p_Tree.nchild;
+    if(!read_dir(p_Stream, p_Tree.dir))
+        return false;
+
+    qint32 nchildren;
+    p_Stream >> nchildren;
+    if(p_Stream.status() != QDataStream::Ok || nchildren < 0 || nchildren > p_Stream.device()->bytesAvailable())
+        return false;
+
+    for(qint32 k = 0; k < nchildren; ++k)
+    {
+        FiffDirTree t_Child;
+        if(!read_tree(p_Stream, t_Child, p_iDepth + 1))
+            return false;
+        p_Tree.children.append(t_Child);
+    }
+    return true;
+}
+
+} // NAMESPACE
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+void FiffDirIndex::setEnabled(bool p_bEnabled)
+{
+    s_bEnabled = p_bEnabled;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffDirIndex::isEnabled()
+{
+    return s_bEnabled;
+}
+
+
+//*************************************************************************************************************
+
+QString FiffDirIndex::indexFileName(const QString& p_sFileName)
+{
+    return p_sFileName + QString(".idx");
+}
+
+
+//*************************************************************************************************************
+
+bool FiffDirIndex::read(const QString& p_sFileName, const FiffId& p_FileId, QList<FiffDirEntry>& p_Dir, FiffDirTree& p_Tree)
+{
+    QFileInfo t_FileInfo(p_sFileName);
+    QFile t_IndexFile(indexFileName(p_sFileName));
+    if(!t_FileInfo.exists() || !t_IndexFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray t_Index = t_IndexFile.readAll();
+    t_IndexFile.close();
+
+    QDataStream t_Stream(t_Index);
+    t_Stream.setByteOrder(QDataStream::BigEndian);
+
+    //
+    //   Key: format, size, modification time and file id
+    //
+    quint32 magic;
+    qint32 version;
+    qint64 size, mtime;
+    FiffId t_FileId;
+    t_Stream >> magic >> version >> size >> mtime;
+    read_id(t_Stream, t_FileId);
+
+    if(t_Stream.status() != QDataStream::Ok || magic != INDEX_MAGIC || version != INDEX_VERSION)
+        return false;
+    if(size != t_FileInfo.size() || mtime != t_FileInfo.lastModified().toMSecsSinceEpoch() || !same_id(t_FileId, p_FileId))
+        return false;
+
+    QList<FiffDirEntry> t_Dir;
+    FiffDirTree t_Tree;
+    if(!read_dir(t_Stream, t_Dir) || !read_tree(t_Stream, t_Tree, 0) || t_Stream.status() != QDataStream::Ok)
+        return false;
+
+    t_Tree.make_kind_index();
+
+    p_Dir = t_Dir;
+    p_Tree = t_Tree;
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffDirIndex::write(const QString& p_sFileName, const FiffId& p_FileId, const QList<FiffDirEntry>& p_Dir, const FiffDirTree& p_Tree)
+{
+    QFileInfo t_FileInfo(p_sFileName);
+    if(!t_FileInfo.exists())
+        return false;
+
+    QByteArray t_Index;
+    QDataStream t_Stream(&t_Index, QIODevice::WriteOnly);
+    t_Stream.setByteOrder(QDataStream::BigEndian);
+
+    t_Stream << INDEX_MAGIC << INDEX_VERSION << (qint64)t_FileInfo.size() << (qint64)t_FileInfo.lastModified().toMSecsSinceEpoch();
+    write_id(t_Stream, p_FileId);
+    write_dir(t_Stream, p_Dir);
+    write_tree(t_Stream, p_Tree);
+
+    //
+    //   Write to a temporary file first, so readers never see a partial index
+    //
+    QString t_sIndexFileName = indexFileName(p_sFileName);
+    QFile t_TmpFile(t_sIndexFileName + QString(".tmp"));
+    if(!t_TmpFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    bool ok = t_TmpFile.write(t_Index) == t_Index.size();
+    t_TmpFile.close();
+
+    if(ok)
+    {
+        QFile::remove(t_sIndexFileName);
+        ok = t_TmpFile.rename(t_sIndexFileName);
+    }
+    if(!ok)
+        t_TmpFile.remove();
+
+    return ok;
+}
@@ -0,0 +1,140 @@
+//=============================================================================================================
+/**
+* @file     fiff_dir_index.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    FiffDirIndex class declaration.
+*
+*/
+
+#ifndef FIFF_DIR_INDEX_H
+#define FIFF_DIR_INDEX_H
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_types.h"
+#include "fiff_dir_entry.h"
+#include "fiff_dir_tree.h"
+#include "fiff_id.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QList>
+#include <QString>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+
+//=============================================================================================================
+/**
+* Sidecar index of a fiff file, which stores the tag directory and the directory tree next to the file
+* (<file name>.idx). The index is keyed on the file size, the modification time and the file id, so it is
+* ignored and rebuilt by FiffStream::open as soon as the fiff file changes. The index is disabled by default.
+*
+* @brief Persistent tag directory and directory tree cache
+*/
+class FIFFSHARED_EXPORT FiffDirIndex
+{
+public:
+    //=========================================================================================================
+    /**
+    * Enables or disables the use of sidecar indices in FiffStream::open.
+    *
+    * @param[in] p_bEnabled     Whether indices are read and written
+    */
+    static void setEnabled(bool p_bEnabled);
+
+    //=========================================================================================================
+    /**
+    * Returns whether sidecar indices are used by FiffStream::open.
+    *
+    * @return true if enabled, false otherwise
+    */
+    static bool isEnabled();
+
+    //=========================================================================================================
+    /**
+    * Returns the file name of the index belonging to a fiff file.
+    *
+    * @param[in] p_sFileName    The fiff file
+    *
+    * @return the index file name
+    */
+    static QString indexFileName(const QString& p_sFileName);
+
+    //=========================================================================================================
+    /**
+    * Reads the index of a fiff file. Fails if there is no index or if it does not belong to the current
+    * version of the file.
+    *
+    * @param[in] p_sFileName    The fiff file
+    * @param[in] p_FileId       The file id of the fiff file
+    * @param[out] p_Dir         The sequential tag directory
+    * @param[out] p_Tree        The directory tree
+    *
+    * @return true if a valid index was read, false otherwise
+    */
+    static bool read(const QString& p_sFileName, const FiffId& p_FileId, QList<FiffDirEntry>& p_Dir, FiffDirTree& p_Tree);
+
+    //=========================================================================================================
+    /**
+    * Writes the index of a fiff file. An existing index is replaced.
+    *
+    * @param[in] p_sFileName    The fiff file
+    * @param[in] p_FileId       The file id of the fiff file
+    * @param[in] p_Dir          The sequential tag directory
+    * @param[in] p_Tree         The directory tree
+    *
+    * @return true if succeeded, false otherwise
+    */
+    static bool write(const QString& p_sFileName, const FiffId& p_FileId, const QList<FiffDirEntry>& p_Dir, const FiffDirTree& p_Tree);
+
+private:
+    static bool s_bEnabled;     /**< Whether FiffStream::open uses sidecar indices. */
+};
+
+} // NAMESPACE
+
+#endif // FIFF_DIR_INDEX_H
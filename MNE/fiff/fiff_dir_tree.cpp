@@ -60,7 +60,8 @@ using namespace FIFFLIB;
 //=============================================================================================================
 
 FiffDirTree::FiffDirTree()
-: block(-1)
+: m_iKindIndexNent(-1)
+, block(-1)
 , nent(-1)
 , nent_tree(-1)
 , nchild(-1)
@@ -71,7 +72,9 @@ FiffDirTree::FiffDirTree()
 //*************************************************************************************************************
 
 FiffDirTree::FiffDirTree(const FiffDirTree &p_FiffDirTree)
-: block(p_FiffDirTree.block)
+: m_hashKindPos(p_FiffDirTree.m_hashKindPos)
+, m_iKindIndexNent(p_FiffDirTree.m_iKindIndexNent)
+, block(p_FiffDirTree.block)
 , id(p_FiffDirTree.id)
 , parent_id(p_FiffDirTree.parent_id)
 , dir(p_FiffDirTree.dir)
@@ -107,6 +110,8 @@ void FiffDirTree::clear()
     nent_tree = -1;
     children.clear();
     nchild = -1;
+    m_hashKindPos.clear();
+    m_iKindIndexNent = -1;
 }
 
 
@@ -281,6 +286,12 @@ qint32 FiffDirTree::make_dir_tree(FiffStream* p_pStream, QList<FiffDirEntry>& p_
     if(p_Tree.nent == 0)
         p_Tree.dir.clear();
 
+    //
+    // Children were created by the recursion, index the whole tree once at the top level
+    //
+    if(start == 0)
+        p_Tree.make_kind_index();
+
 //    qDebug() << "block =" << p_pTree->block << "nent =" << p_pTree->nent << "nchild =" << p_pTree->nchild;
 //    qDebug() << "end } " << block;
 
@@ -292,29 +303,95 @@ qint32 FiffDirTree::make_dir_tree(FiffStream* p_pStream, QList<FiffDirEntry>& p_
 
 QList<FiffDirTree> FiffDirTree::dir_tree_find(fiff_int_t p_kind) const
 {
+    QList<const FiffDirTree*> t_qListHandles = this->dir_tree_find_nodes(p_kind);
+
     QList<FiffDirTree> nodes;
-    if(this->block == p_kind)
-        nodes.append(*this);
+    nodes.reserve(t_qListHandles.size());
+    for (qint32 k = 0; k < t_qListHandles.size(); ++k)
+        nodes.append(*t_qListHandles[k]);
+
+    return nodes;
+}
+
 
-    QList<FiffDirTree>::const_iterator i;
-    for (i = this->children.begin(); i != this->children.end(); ++i)
-        nodes.append((*i).dir_tree_find(p_kind));
+//*************************************************************************************************************
 
+QList<const FiffDirTree*> FiffDirTree::dir_tree_find_nodes(fiff_int_t p_kind) const
+{
+    QList<const FiffDirTree*> nodes;
+    this->dir_tree_find_nodes(p_kind, nodes);
     return nodes;
 }
 
 
 //*************************************************************************************************************
 
-bool FiffDirTree::find_tag(FiffStream* p_pStream, fiff_int_t findkind, FiffTag::SPtr& p_pTag) const
+void FiffDirTree::dir_tree_find_nodes(fiff_int_t p_kind, QList<const FiffDirTree*>& p_Nodes) const
 {
+    if(this->block == p_kind)
+        p_Nodes.append(this);
+
+    for (qint32 k = 0; k < this->children.size(); ++k)
+        this->children.at(k).dir_tree_find_nodes(p_kind, p_Nodes);
+}
+
+
+//*************************************************************************************************************
+
+void FiffDirTree::make_kind_index()
+{
+    m_hashKindPos.clear();
+    qint32 t_iNent = qMin(this->nent, (fiff_int_t)this->dir.size());
+    m_hashKindPos.reserve(t_iNent);
+
+    //
+    //   Iterate backwards, so the first occurrence of a kind wins
+    //
+    for (qint32 p = t_iNent - 1; p >= 0; --p)
+        m_hashKindPos.insert(this->dir.at(p).kind, p);
+    m_iKindIndexNent = this->nent;
+
+    for (qint32 k = 0; k < this->children.size(); ++k)
+        this->children[k].make_kind_index();
+}
+
+
+//*************************************************************************************************************
+
+qint32 FiffDirTree::find_entry(fiff_int_t findkind) const
+{
+    if (m_iKindIndexNent == this->nent && this->nent >= 0)
+    {
+        QHash<fiff_int_t, qint32>::const_iterator it = m_hashKindPos.constFind(findkind);
+        if (it != m_hashKindPos.constEnd())
+        {
+            if (it.value() < this->dir.size() && this->dir.at(it.value()).kind == findkind)
+                return it.value();
+        }
+        else if (this->dir.size() == this->nent)
+            return -1;
+    }
+
+    //
+    //   No index or a stale one: dir is public and may have been modified after the index was built
+    //
     for (qint32 p = 0; p < this->nent; ++p)
+        if (this->dir.at(p).kind == findkind)
+            return p;
+
+    return -1;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffDirTree::find_tag(FiffStream* p_pStream, fiff_int_t findkind, FiffTag::SPtr& p_pTag) const
+{
+    qint32 p = this->find_entry(findkind);
+    if (p >= 0)
     {
-       if (this->dir[p].kind == findkind)
-       {
-          FiffTag::read_tag(p_pStream,p_pTag,this->dir[p].pos);
-          return true;
-       }
+        FiffTag::read_tag(p_pStream,p_pTag,this->dir[p].pos);
+        return true;
     }
     if (p_pTag)
         p_pTag.clear();
@@ -327,9 +404,6 @@ bool FiffDirTree::find_tag(FiffStream* p_pStream, fiff_int_t findkind, FiffTag::
 
 bool FiffDirTree::has_tag(fiff_int_t findkind)
 {
-    for(qint32 p = 0; p < this->nent; ++p)
-        if(this->dir.at(p).kind == findkind)
-            return true;
-   return false;
+    return this->find_entry(findkind) >= 0;
 }
 
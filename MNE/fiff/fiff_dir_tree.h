@@ -55,6 +55,7 @@
 
 #include <QDebug>
 #include <QFile>
+#include <QHash>
 #include <QList>
 #include <QSharedPointer>
 #include <QStringList>
@@ -162,6 +163,26 @@ public:
     */
     QList<FiffDirTree> dir_tree_find(fiff_int_t p_kind) const;
 
+    //=========================================================================================================
+    /**
+    * Find nodes of the given kind from a directory tree structure without copying them. The returned handles
+    * point into this tree and stay valid as long as the tree is neither modified nor destroyed.
+    *
+    * @param[in] p_kind the given kind
+    *
+    * @return list of handles to the found nodes
+    */
+    QList<const FiffDirTree*> dir_tree_find_nodes(fiff_int_t p_kind) const;
+
+    //=========================================================================================================
+    /**
+    * Builds the kind to position hash of this node and all of its children, which is used by find_tag and
+    * has_tag. make_dir_tree does this for the trees it creates; call it again after modifying dir. An index
+    * built for a different nent or dir size is not trusted and dir is scanned instead; entries replaced in place
+    * are only found again after rebuilding the index.
+    */
+    void make_kind_index();
+
     //=========================================================================================================
     /**
     * Implementation of the find_tag function in various files e.g. fiff_read_named_matrix.m
@@ -188,6 +209,31 @@ public:
     */
     bool has_tag(fiff_int_t findkind);
 
+private:
+    //=========================================================================================================
+    /**
+    * Appends the handles of all nodes of the given kind to a list.
+    *
+    * @param[in] p_kind the given kind
+    * @param[in, out] p_Nodes the list the found nodes are appended to
+    */
+    void dir_tree_find_nodes(fiff_int_t p_kind, QList<const FiffDirTree*>& p_Nodes) const;
+
+    //=========================================================================================================
+    /**
+    * Returns the position of a tag of the given kind in dir. A hit in the kind index is checked against dir, a
+    * miss is trusted while the index matches nent and the size of dir. Without a matching index the directory
+    * is scanned.
+    *
+    * @param[in] findkind kind to find
+    *
+    * @return the position in dir, -1 if there is no such tag
+    */
+    qint32 find_entry(fiff_int_t findkind) const;
+
+    QHash<fiff_int_t, qint32>   m_hashKindPos;      /**< Position of the first tag of each kind in dir */
+    qint32                      m_iKindIndexNent;   /**< Number of entries m_hashKindPos was built for, -1 if none */
+
 public:
     fiff_int_t          block;      /**< Block type for this directory */
     FiffId              id;         /**< Id of this block if any */
@@ -43,6 +43,18 @@
 #include "fiff_stream.h"
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QMutexLocker>
+#include <QQueue>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -51,6 +63,163 @@
 using namespace FIFFLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+namespace
+{
+
+//=============================================================================================================
+/**
+* Reads one big endian sample from (possibly unaligned) file memory.
+*/
+template<typename T>
+inline T read_be_sample(const uchar* p_pData)
+{
+    return qFromBigEndian<T>(p_pData);
+}
+
+template<>
+inline float read_be_sample<float>(const uchar* p_pData)
+{
+    quint32 t_iBits = qFromBigEndian<quint32>(p_pData);
+    float t_fValue;
+    memcpy(&t_fValue, &t_iBits, sizeof(float));
+    return t_fValue;
+}
+
+
+//=============================================================================================================
+/**
+* Decodes big endian samples of type T (nchan x nsamp, sample major) into Scalar precision and applies the per
+* channel calibration in the same pass. Rows are picked according to sel, when sel is empty all channels are
+* decoded. pickCals holds one calibration factor per output row, when it is empty no calibration is applied.
+*/
+template<typename T, typename Scalar>
+void decode_be_samples(const uchar* p_pData, qint32 nchan, qint32 nsamp, const RowVectorXi& sel, const RowVectorXd& pickCals, Matrix<Scalar, Dynamic, Dynamic>& one)
+{
+    qint32 nrow = sel.size() > 0 ? sel.size() : nchan;
+    one.resize(nrow, nsamp);
+
+    for(qint32 c = 0; c < nsamp; ++c)
+    {
+        const uchar* t_pSample = p_pData + (qint64)c*nchan*sizeof(T);
+        for(qint32 r = 0; r < nrow; ++r)
+        {
+            qint32 ch = sel.size() > 0 ? sel[r] : r;
+            Scalar value = (Scalar)read_be_sample<T>(t_pSample + ch*sizeof(T));
+            one(r,c) = pickCals.size() > 0 ? (Scalar)pickCals[r]*value : value;
+        }
+    }
+}
+
+
+//=============================================================================================================
+/**
+* Size in bytes of one raw sample of the given FIFF type, 0 if the type is not a raw data type.
+*/
+inline qint32 raw_sample_size(fiff_int_t type)
+{
+    if (type == FIFFT_DAU_PACK16)
+        return sizeof(qint16);
+    else if(type == FIFFT_INT)
+        return sizeof(qint32);
+    else if(type == FIFFT_FLOAT)
+        return sizeof(float);
+    return 0;
+}
+
+
+//=============================================================================================================
+/**
+* Type dispatch for decode_be_samples.
+*/
+template<typename Scalar>
+bool decode_be_buffer(const uchar* p_pData, fiff_int_t type, qint32 nchan, qint32 nsamp, const RowVectorXi& sel, const RowVectorXd& pickCals, Matrix<Scalar, Dynamic, Dynamic>& one)
+{
+    if (type == FIFFT_DAU_PACK16)
+        decode_be_samples<qint16, Scalar>(p_pData, nchan, nsamp, sel, pickCals, one);
+    else if(type == FIFFT_INT)
+        decode_be_samples<qint32, Scalar>(p_pData, nchan, nsamp, sel, pickCals, one);
+    else if(type == FIFFT_FLOAT)
+        decode_be_samples<float, Scalar>(p_pData, nchan, nsamp, sel, pickCals, one);
+    else
+    {
+        printf("Data Storage Format not known jet [4]!! Type: %d\n", type);
+        return false;
+    }
+    return true;
+}
+
+
+//=============================================================================================================
+/**
+* Converts native samples of type T (nchan x nsamp) to Scalar precision, picks the rows given by sel (all if
+* empty) and scales each output row by pickCals (no calibration if empty).
+*/
+template<typename T, typename Scalar>
+void decode_samples(const T* p_pData, qint32 nchan, qint32 nsamp, const RowVectorXi& sel, const RowVectorXd& pickCals, Matrix<Scalar, Dynamic, Dynamic>& one)
+{
+    Map< const Matrix<T, Dynamic, Dynamic> > t_rawData(p_pData, nchan, nsamp);
+
+    if (sel.size() == 0)
+    {
+        if (pickCals.size() > 0)
+            one = pickCals.template cast<Scalar>().asDiagonal()*t_rawData.template cast<Scalar>();
+        else
+            one = t_rawData.template cast<Scalar>();
+    }
+    else
+    {
+        one.resize(sel.size(), nsamp);
+        for(qint32 r = 0; r < sel.size(); ++r)
+        {
+            if (pickCals.size() > 0)
+                one.row(r) = (Scalar)pickCals[r]*t_rawData.row(sel[r]).template cast<Scalar>();
+            else
+                one.row(r) = t_rawData.row(sel[r]).template cast<Scalar>();
+        }
+    }
+}
+
+
+//=============================================================================================================
+/**
+* Type dispatch for decode_samples.
+*/
+template<typename Scalar>
+bool decode_buffer(const FiffTag::SPtr& p_pTag, qint32 nchan, qint32 nsamp, const RowVectorXi& sel, const RowVectorXd& pickCals, Matrix<Scalar, Dynamic, Dynamic>& one)
+{
+    if (p_pTag->type == FIFFT_DAU_PACK16)
+        decode_samples<qint16, Scalar>(p_pTag->toDauPack16(), nchan, nsamp, sel, pickCals, one);
+    else if(p_pTag->type == FIFFT_INT)
+        decode_samples<qint32, Scalar>(p_pTag->toInt(), nchan, nsamp, sel, pickCals, one);
+    else if(p_pTag->type == FIFFT_FLOAT)
+        decode_samples<float, Scalar>(p_pTag->toFloat(), nchan, nsamp, sel, pickCals, one);
+    else
+    {
+        printf("Data Storage Format not known jet [1]!! Type: %d\n", p_pTag->type);
+        return false;
+    }
+    return true;
+}
+
+
+//=============================================================================================================
+/**
+* Exact comparison of two matrices including their dimensions.
+*/
+template<typename T>
+inline bool is_same_matrix(const T& a, const T& b)
+{
+    return a.rows() == b.rows() && a.cols() == b.cols() && (a.size() == 0 || a == b);
+}
+
+} // NAMESPACE
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -59,6 +228,10 @@ using namespace FIFFLIB;
 FiffRawData::FiffRawData()
 : first_samp(-1)
 , last_samp(-1)
+, m_iReadCursor(-1)
+, m_iRawDirHint(-1)
+, m_bMultValid(false)
+, m_iPrefetch(0)
 {
 
 }
@@ -69,6 +242,10 @@ FiffRawData::FiffRawData()
 FiffRawData::FiffRawData(QIODevice &p_IODevice)
 : first_samp(-1)
 , last_samp(-1)
+, m_iReadCursor(-1)
+, m_iRawDirHint(-1)
+, m_bMultValid(false)
+, m_iPrefetch(0)
 {
     if(!FiffStream::setup_read_raw(p_IODevice, *this))
     {
@@ -85,10 +262,14 @@ FiffRawData::FiffRawData(const FiffRawData &p_FiffRawData)
 , info(p_FiffRawData.info)
 , first_samp(p_FiffRawData.first_samp)
 , last_samp(p_FiffRawData.last_samp)
-, cals(p_FiffRawData.cals)
 , rawdir(p_FiffRawData.rawdir)
-, proj(p_FiffRawData.proj)
-, comp(p_FiffRawData.comp)
+, m_vecCals(p_FiffRawData.m_vecCals)
+, m_matProj(p_FiffRawData.m_matProj)
+, m_comp(p_FiffRawData.m_comp)
+, m_iReadCursor(p_FiffRawData.m_iReadCursor)
+, m_iRawDirHint(p_FiffRawData.m_iRawDirHint)
+, m_bMultValid(false)
+, m_iPrefetch(p_FiffRawData.m_iPrefetch)
 {
 
 }
@@ -98,7 +279,32 @@ FiffRawData::FiffRawData(const FiffRawData &p_FiffRawData)
 
 FiffRawData::~FiffRawData()
 {
+    drop_prefetch();
+}
+
+
+//*************************************************************************************************************
 
+FiffRawData& FiffRawData::operator= (const FiffRawData &rhs)
+{
+    if (this != &rhs)
+    {
+        drop_prefetch();
+        invalidate_mult();
+
+        file = rhs.file;
+        info = rhs.info;
+        first_samp = rhs.first_samp;
+        last_samp = rhs.last_samp;
+        rawdir = rhs.rawdir;
+        m_vecCals = rhs.m_vecCals;
+        m_matProj = rhs.m_matProj;
+        m_comp = rhs.m_comp;
+        m_iReadCursor = rhs.m_iReadCursor;
+        m_iRawDirHint = rhs.m_iRawDirHint;
+        m_iPrefetch = rhs.m_iPrefetch;
+    }
+    return *this;
 }
 
 
@@ -109,10 +315,62 @@ void FiffRawData::clear()
     info.clear();
     first_samp = -1;
     last_samp = -1;
-    cals = RowVectorXd();
     rawdir.clear();
-    proj = MatrixXd();
-    comp.clear();
+    m_vecCals = RowVectorXd();
+    m_matProj = MatrixXd();
+    m_comp.clear();
+    m_iReadCursor = -1;
+    m_iRawDirHint = -1;
+    drop_prefetch();
+    invalidate_mult();
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::invalidate_mult()
+{
+    m_bMultValid = false;
+    m_matMult = SparseMatrix<double>();
+    m_matMultFloat = SparseMatrix<float>();
+    m_vecPickCals = RowVectorXd();
+    m_vecMultSel = RowVectorXi();
+}
+
+
+//*************************************************************************************************************
+
+template<>
+QMap<qint32, QFuture<MatrixXd> >& FiffRawData::prefetch_map<double>()
+{
+    return m_mapPrefetch;
+}
+
+
+//*************************************************************************************************************
+
+template<>
+QMap<qint32, QFuture<MatrixXf> >& FiffRawData::prefetch_map<float>()
+{
+    return m_mapPrefetchFloat;
+}
+
+
+//*************************************************************************************************************
+
+template<>
+const SparseMatrix<double>& FiffRawData::mult<double>() const
+{
+    return m_matMult;
+}
+
+
+//*************************************************************************************************************
+
+template<>
+const SparseMatrix<float>& FiffRawData::mult<float>() const
+{
+    return m_matMultFloat;
 }
 
 
@@ -120,11 +378,23 @@ void FiffRawData::clear()
 
 bool FiffRawData::read_raw_segment(MatrixXd& data, MatrixXd& times, fiff_int_t from, fiff_int_t to, const RowVectorXi& sel)
 {
-    bool projAvailable = true;
+    return this->read_segment<double>(data, times, from, to, sel);
+}
+
+
+//*************************************************************************************************************
 
-    if (this->proj.size() == 0)
-        projAvailable = false;
+bool FiffRawData::read_raw_segment(MatrixXf& data, MatrixXd& times, fiff_int_t from, fiff_int_t to, const RowVectorXi& sel)
+{
+    return this->read_segment<float>(data, times, from, to, sel);
+}
+
+
+//*************************************************************************************************************
 
+template<typename T>
+bool FiffRawData::read_segment(Matrix<T, Dynamic, Dynamic>& data, MatrixXd& times, fiff_int_t from, fiff_int_t to, const RowVectorXi& sel)
+{
     if(from == -1)
         from = this->first_samp;
     if(to == -1)
@@ -144,209 +414,82 @@ bool FiffRawData::read_raw_segment(MatrixXd& data, MatrixXd& times, fiff_int_t f
     }
     printf("Reading %d ... %d  =  %9.3f ... %9.3f secs...", from, to, ((float)from)/this->info.sfreq, ((float)to)/this->info.sfreq);
     //
-    //  Initialize the data and calibration vector
+    //  Initialize the data and make sure the calibration/projection operator is up to date
     //
     qint32 nchan = this->info.nchan;
     qint32 dest  = 0;//1;
-    qint32 i, k, r;
-
-    typedef Eigen::Triplet<double> T;
-    std::vector<T> tripletList;
-    tripletList.reserve(nchan);
-    for(i = 0; i < nchan; ++i)
-        tripletList.push_back(T(i, i, this->cals[i]));
-
-    SparseMatrix<double> cal(nchan, nchan);
-    cal.setFromTriplets(tripletList.begin(), tripletList.end());
-//    cal.makeCompressed();
+    qint32 i, k;
 
-    MatrixXd mult_full;
-    //
-    if (sel.size() == 0)
-    {
-        data = MatrixXd(nchan, to-from+1);
-//            data->setZero();
-        if (projAvailable || this->comp.kind != -1)
-        {
-            if (!projAvailable)
-                mult_full = this->comp.data->data*cal;
-            else if (this->comp.kind == -1)
-                mult_full = this->proj*cal;
-            else
-                mult_full = this->proj*this->comp.data->data*cal;
-        }
-    }
-    else
-    {
-        data = MatrixXd(sel.size(),to-from+1);
-//            data->setZero();
+    this->update_mult(sel);
 
-        MatrixXd selVect(sel.size(), nchan);
+    data = Matrix<T, Dynamic, Dynamic>(sel.size() == 0 ? nchan : sel.size(), to-from+1);
 
-        selVect.setZero();
+    bool do_debug = false;
 
-        if (!projAvailable && this->comp.kind == -1)
-        {
-            tripletList.clear();
-            tripletList.reserve(sel.size());
-            for(i = 0; i < sel.size(); ++i)
-                tripletList.push_back(T(i, i, this->cals[sel[i]]));
-            cal = SparseMatrix<double>(sel.size(), sel.size());
-            cal.setFromTriplets(tripletList.begin(), tripletList.end());
-        }
-        else
+    if (!this->file->isMapped() && !this->file->device()->isOpen())
+    {
+        if (!this->file->device()->open(QIODevice::ReadOnly))
         {
-            if (!projAvailable)
-            {
-                qDebug() << "This has to be debugged! #1";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->comp.data->data.block(sel[i],0,1,nchan);
-                mult_full = selVect*cal;
-            }
-            else if (this->comp.kind == -1)
-            {
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
-
-                mult_full = selVect*cal;
-            }
-            else
-            {
-                qDebug() << "This has to be debugged! #3";
-                for( i = 0; i  < sel.size(); ++i)
-                    selVect.row(i) = this->proj.block(sel[i],0,1,nchan);
-
-                mult_full = selVect*this->comp.data->data*cal;
-            }
+            printf("Cannot open file %s",this->info.filename.toUtf8().constData());
         }
     }
 
-    bool do_debug = false;
+    Matrix<T, Dynamic, Dynamic> one;
+    bool doing_whole;
+    fiff_int_t first_pick, last_pick, picksamp;
     //
-    // Make mult sparse
+    //  Start right at the buffer containing the first sample
     //
-    tripletList.clear();
-    tripletList.reserve(mult_full.rows()*mult_full.cols());
-    for(i = 0; i < mult_full.rows(); ++i)
-        for(k = 0; k < mult_full.cols(); ++k)
-            if(mult_full(i,k) != 0)
-                tripletList.push_back(T(i, k, mult_full(i,k)));
-
-    SparseMatrix<double> mult(mult_full.rows(),mult_full.cols());
-    if(tripletList.size() > 0)
-        mult.setFromTriplets(tripletList.begin(), tripletList.end());
-//    mult.makeCompressed();
-
+    qint32 first_dir = this->locate_raw_dir(from);
+    qint32 last_dir = this->locate_raw_dir(to);
+    if (first_dir < 0 || last_dir < 0)
+    {
+        printf("No data in this range\n");
+        return false;
+    }
+    bool sequential = m_iRawDirHint >= 0 && (first_dir == m_iRawDirHint || first_dir == m_iRawDirHint + 1);
     //
+    //  Read, decode and project the buffers in parallel, prefetched ones are already underway. Only a window of
+    //  buffers is in flight, the next one is submitted as soon as the oldest is consumed.
+    //
+    qint32 t_iWindow = qMax(qMax(QThread::idealThreadCount(), m_iPrefetch), 1);
+    QQueue< QFuture< Matrix<T, Dynamic, Dynamic> > > t_qQueueBuffers;
+    qint32 t_iNextDir = first_dir;
 
-    FiffStream::SPtr fid;
-    if (!this->file->device()->isOpen())
+    for(k = first_dir; k <= last_dir; ++k)
     {
-        if (!this->file->device()->open(QIODevice::ReadOnly))
+        while (t_iNextDir <= last_dir && t_qQueueBuffers.size() < t_iWindow)
         {
-            printf("Cannot open file %s",this->info.filename.toUtf8().constData());
+            t_qQueueBuffers.enqueue(this->take_raw_buffer<T>(t_iNextDir));
+            ++t_iNextDir;
+
+            if (t_iNextDir > last_dir && sequential && m_iPrefetch > 0)
+                for(i = last_dir + 1; i <= last_dir + m_iPrefetch && i < this->rawdir.size(); ++i)
+                    if (!this->prefetch_map<T>().contains(i))
+                        this->prefetch_map<T>().insert(i, QtConcurrent::run(this, &FiffRawData::read_raw_buffer<T>, this->rawdir.at(i)));
         }
-        fid = this->file;
-    }
-    else
-    {
-        fid = this->file;
-    }
+        QFuture< Matrix<T, Dynamic, Dynamic> > t_futureBuffer = t_qQueueBuffers.dequeue();
 
-    MatrixXd one;
-    bool doing_whole;
-    fiff_int_t first_pick, last_pick, picksamp;
-    for(k = 0; k < this->rawdir.size(); ++k)
-    {
-        FiffRawDir thisRawDir = this->rawdir[k];
+        const FiffRawDir& thisRawDir = this->rawdir.at(k);
         //
         //  Do we need this buffer
         //
-        if (thisRawDir.last > from)
+        if (thisRawDir.last >= from)
         {
-            if (thisRawDir.ent.kind == -1)
+            //
+            //  Collect the processed buffer (in order)
+            //
+            one = t_futureBuffer.result();
+            if (one.cols() != thisRawDir.nsamp)
             {
-                //
-                //  Take the easy route: skip is translated to zeros
-                //
-                if(do_debug)
-                    printf("S");
-                doing_whole = false;
-                if (sel.cols() <= 0)
-                    one.resize(nchan,thisRawDir.nsamp);
-                else
-                    one.resize(sel.cols(),thisRawDir.nsamp);
-
-                one.setZero();
-            }
-            else
-            {
-                FiffTag::SPtr t_pTag;
-                FiffTag::read_tag(fid.data(), t_pTag, thisRawDir.ent.pos);
-                //
-                //   Depending on the state of the projection and selection
-                //   we proceed a little bit differently
-                //
-                if (mult.cols() == 0)
-                {
-                    if (sel.cols() == 0)
-                    {
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                            one = cal*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_INT)
-                            one = cal*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                            one = cal*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                        else
-                            printf("Data Storage Format not known jet [1]!! Type: %d\n", t_pTag->type);
-                    }
-                    else
-                    {
-
-                        //ToDo find a faster solution for this!! --> make cal and mul sparse like in MATLAB
-                        MatrixXd newData(sel.cols(), thisRawDir.nsamp); //ToDo this can be done much faster, without newData
-
-                        if (t_pTag->type == FIFFT_DAU_PACK16)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixDau16 > ( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_INT)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else if(t_pTag->type == FIFFT_FLOAT)
-                        {
-                            MatrixXd tmp_data = (Map< MatrixXf > ( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-
-                            for(r = 0; r < sel.size(); ++r)
-                                newData.block(r,0,1,thisRawDir.nsamp) = tmp_data.block(sel[r],0,1,thisRawDir.nsamp);
-                        }
-                        else
-                        {
-                            printf("Data Storage Format not known jet [2]!! Type: %d\n", t_pTag->type);
-                        }
-
-                        one = cal*newData;
-                    }
-                }
-                else
-                {
-                    if (t_pTag->type == FIFFT_DAU_PACK16)
-                        one = mult*(Map< MatrixDau16 >( t_pTag->toDauPack16(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_INT)
-                        one = mult*(Map< MatrixXi >( t_pTag->toInt(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else if(t_pTag->type == FIFFT_FLOAT)
-                        one = mult*(Map< MatrixXf >( t_pTag->toFloat(),nchan, thisRawDir.nsamp)).cast<double>();
-                    else
-                        printf("Data Storage Format not known jet [3]!! Type: %d\n", t_pTag->type);
-                }
+                printf("Cannot read data buffer at %d\n", thisRawDir.ent.pos);
+                while (!t_qQueueBuffers.isEmpty())
+                    t_qQueueBuffers.dequeue().waitForFinished();
+                return false;
             }
+            if(do_debug && thisRawDir.ent.kind == -1)
+                printf("S");
+            doing_whole = false;
             //
             //  The picking logic is a bit complicated
             //
@@ -415,6 +558,8 @@ bool FiffRawData::read_raw_segment(MatrixXd& data, MatrixXd& times, fiff_int_t f
                 dest += picksamp;
             }
         }
+        else
+            t_futureBuffer.waitForFinished();
         //
         //  Done?
         //
@@ -424,6 +569,9 @@ bool FiffRawData::read_raw_segment(MatrixXd& data, MatrixXd& times, fiff_int_t f
             break;
         }
     }
+    while (!t_qQueueBuffers.isEmpty())
+        t_qQueueBuffers.dequeue().waitForFinished();
+    m_iRawDirHint = last_dir;
 
 //        fclose(fid);
 
@@ -450,3 +598,306 @@ bool FiffRawData::read_raw_segment_times(MatrixXd& data, MatrixXd& times, float
     //
     return this->read_raw_segment(data, times, (qint32)from, (qint32)to, sel);
 }
+
+
+//*************************************************************************************************************
+
+qint32 FiffRawData::find_raw_dir(fiff_int_t sample) const
+{
+    if (this->rawdir.size() == 0 || sample < this->rawdir.first().first || sample > this->rawdir.last().last)
+        return -1;
+    //
+    //  rawdir is contiguous and sorted -> lower bound on the last sample of each entry
+    //
+    qint32 lo = 0;
+    qint32 hi = this->rawdir.size() - 1;
+    while (lo < hi)
+    {
+        qint32 mid = lo + (hi - lo)/2;
+        if (this->rawdir.at(mid).last < sample)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::seek_raw(fiff_int_t sample)
+{
+    m_iReadCursor = sample;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawData::read_raw_next(MatrixXd& data, MatrixXd& times, fiff_int_t nsamp, const RowVectorXi& sel)
+{
+    return this->read_next<double>(data, times, nsamp, sel);
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawData::read_raw_next(MatrixXf& data, MatrixXd& times, fiff_int_t nsamp, const RowVectorXi& sel)
+{
+    return this->read_next<float>(data, times, nsamp, sel);
+}
+
+
+//*************************************************************************************************************
+
+template<typename T>
+bool FiffRawData::read_next(Matrix<T, Dynamic, Dynamic>& data, MatrixXd& times, fiff_int_t nsamp, const RowVectorXi& sel)
+{
+    if (m_iReadCursor < this->first_samp)
+        m_iReadCursor = this->first_samp;
+
+    if (nsamp <= 0 || m_iReadCursor > this->last_samp)
+        return false;
+
+    fiff_int_t to = qMin(m_iReadCursor + nsamp - 1, this->last_samp);
+
+    if (!this->read_segment<T>(data, times, m_iReadCursor, to, sel))
+        return false;
+
+    m_iReadCursor = to + 1;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+qint32 FiffRawData::locate_raw_dir(fiff_int_t sample) const
+{
+    //
+    //  Sequential reads continue in the buffer of the previous read or in the next one
+    //
+    for (qint32 k = m_iRawDirHint; k >= 0 && k < this->rawdir.size() && k <= m_iRawDirHint + 1; ++k)
+        if (this->rawdir.at(k).first <= sample && sample <= this->rawdir.at(k).last)
+            return k;
+
+    return this->find_raw_dir(sample);
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::update_mult(const RowVectorXi& sel)
+{
+    bool projAvailable = this->m_matProj.size() > 0;
+    bool compAvailable = this->m_comp.kind != -1;
+
+    if (m_bMultValid && is_same_matrix(sel, m_vecMultSel))
+        return;
+    //
+    //  Prefetched buffers were processed with the old operator
+    //
+    drop_prefetch();
+
+    MatrixXd t_matNoComp;
+    const MatrixXd& t_matComp = compAvailable ? this->m_comp.data.constData()->data : t_matNoComp;
+
+    qint32 nchan = this->info.nchan;
+    qint32 i;
+    //
+    //  Calibration of the picked channels: this is all we need without projection and compensation
+    //
+    if (sel.size() == 0)
+        m_vecPickCals = this->m_vecCals;
+    else
+    {
+        m_vecPickCals.resize(sel.size());
+        for(i = 0; i < sel.size(); ++i)
+            m_vecPickCals[i] = this->m_vecCals[sel[i]];
+    }
+    //
+    //  Combined operator (sel) x proj x comp x cal
+    //
+    m_matMult = SparseMatrix<double>();
+    if (projAvailable || compAvailable)
+    {
+        MatrixXd mult_full;
+        if (!projAvailable)
+            mult_full = t_matComp;
+        else if (!compAvailable)
+            mult_full = this->m_matProj;
+        else if (sel.size() == 0)
+            mult_full = this->m_matProj*t_matComp;
+
+        if (sel.size() > 0)
+        {
+            const MatrixXd& t_matRows = projAvailable ? this->m_matProj : t_matComp;
+            MatrixXd selVect(sel.size(), nchan);
+            for(i = 0; i < sel.size(); ++i)
+                selVect.row(i) = t_matRows.row(sel[i]);
+
+            if (projAvailable && compAvailable)
+                mult_full = selVect*t_matComp;
+            else
+                mult_full = selVect;
+        }
+        //
+        //  Apply the calibration to the columns and make it sparse
+        //
+        mult_full = mult_full*this->m_vecCals.asDiagonal();
+        m_matMult = mult_full.sparseView();
+    }
+    m_matMultFloat = m_matMult.cast<float>();
+
+    m_vecMultSel = sel;
+    m_bMultValid = true;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::set_prefetch(qint32 nbuffers)
+{
+    m_iPrefetch = nbuffers > 0 ? nbuffers : 0;
+    if (m_iPrefetch == 0)
+        drop_prefetch();
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::set_proj(const MatrixXd& p_matProj)
+{
+    drop_prefetch();
+    invalidate_mult();
+    this->m_matProj = p_matProj;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::set_comp(const FiffCtfComp& p_comp)
+{
+    drop_prefetch();
+    invalidate_mult();
+    this->m_comp = p_comp;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::set_cals(const RowVectorXd& p_vecCals)
+{
+    drop_prefetch();
+    invalidate_mult();
+    this->m_vecCals = p_vecCals;
+}
+
+
+//*************************************************************************************************************
+
+template<typename T>
+Matrix<T, Dynamic, Dynamic> FiffRawData::read_raw_buffer(const FiffRawDir& p_RawDir) const
+{
+    qint32 nchan = this->info.nchan;
+    Matrix<T, Dynamic, Dynamic> one;
+
+    if (p_RawDir.ent.kind == -1)
+    {
+        //
+        //  Take the easy route: skip is translated to zeros
+        //
+        one = Matrix<T, Dynamic, Dynamic>::Zero(m_vecPickCals.size(), p_RawDir.nsamp);
+    }
+    else if (this->file->isMapped())
+    {
+        //
+        //   Read straight from the mapped file, byte swapping is done
+        //   while calibrating or right before projecting
+        //
+        fiff_int_t t_iKind, t_iType, t_iSize;
+        const uchar* t_pData;
+        if (!this->file->read_tag_view(p_RawDir.ent.pos, t_iKind, t_iType, t_iSize, t_pData))
+            return Matrix<T, Dynamic, Dynamic>();
+
+        //
+        //   Skips are already translated to zeros above, anything else has to be
+        //   a complete data buffer before the samples are touched
+        //
+        if (t_iKind != FIFF_DATA_BUFFER
+                || (qint64)t_iSize != (qint64)nchan*p_RawDir.nsamp*raw_sample_size(t_iType)
+                || raw_sample_size(t_iType) == 0)
+        {
+            printf("Invalid raw data buffer at %lld (kind %d, type %d, size %d).\n", (qint64)p_RawDir.ent.pos, t_iKind, t_iType, t_iSize);
+            return Matrix<T, Dynamic, Dynamic>();
+        }
+
+        if (m_matMult.cols() == 0)
+            decode_be_buffer<T>(t_pData, t_iType, nchan, p_RawDir.nsamp, m_vecMultSel, m_vecPickCals, one);
+        else
+        {
+            Matrix<T, Dynamic, Dynamic> t_rawData;
+            decode_be_buffer<T>(t_pData, t_iType, nchan, p_RawDir.nsamp, defaultRowVectorXi, RowVectorXd(), t_rawData);
+            one = this->mult<T>()*t_rawData;
+        }
+    }
+    else
+    {
+        FiffTag::SPtr t_pTag;
+        {
+            QMutexLocker locker(this->file->mutex());
+            FiffTag::read_tag(this->file.data(), t_pTag, p_RawDir.ent.pos);
+        }
+        //
+        //   Depending on the state of the projection and selection
+        //   we proceed a little bit differently
+        //
+        if (m_matMult.cols() == 0)
+            decode_buffer<T>(t_pTag, nchan, p_RawDir.nsamp, m_vecMultSel, m_vecPickCals, one);
+        else
+        {
+            Matrix<T, Dynamic, Dynamic> t_rawData;
+            decode_buffer<T>(t_pTag, nchan, p_RawDir.nsamp, defaultRowVectorXi, RowVectorXd(), t_rawData);
+            one = this->mult<T>()*t_rawData;
+        }
+    }
+
+    return one;
+}
+
+
+//*************************************************************************************************************
+
+template<typename T>
+QFuture< Matrix<T, Dynamic, Dynamic> > FiffRawData::take_raw_buffer(qint32 k)
+{
+    QMap<qint32, QFuture< Matrix<T, Dynamic, Dynamic> > >& t_mapPrefetch = this->prefetch_map<T>();
+    //
+    //  Prefetches behind the requested buffer won't be used anymore
+    //
+    while (!t_mapPrefetch.isEmpty() && t_mapPrefetch.firstKey() < k)
+    {
+        t_mapPrefetch.first().waitForFinished();
+        t_mapPrefetch.erase(t_mapPrefetch.begin());
+    }
+
+    if (t_mapPrefetch.contains(k))
+        return t_mapPrefetch.take(k);
+
+    return QtConcurrent::run(this, &FiffRawData::read_raw_buffer<T>, this->rawdir.at(k));
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawData::drop_prefetch()
+{
+    QMap<qint32, QFuture<MatrixXd> >::Iterator it;
+    for (it = m_mapPrefetch.begin(); it != m_mapPrefetch.end(); ++it)
+        it.value().waitForFinished();
+    m_mapPrefetch.clear();
+
+    QMap<qint32, QFuture<MatrixXf> >::Iterator itFloat;
+    for (itFloat = m_mapPrefetchFloat.begin(); itFloat != m_mapPrefetchFloat.end(); ++itFloat)
+        itFloat.value().waitForFinished();
+    m_mapPrefetchFloat.clear();
+}
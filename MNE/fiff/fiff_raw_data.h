@@ -62,7 +62,9 @@
 //=============================================================================================================
 
 #include <QFile>
+#include <QFuture>
 #include <QList>
+#include <QMap>
 #include <QSharedPointer>
 
 
@@ -125,6 +127,16 @@ public:
     */
     ~FiffRawData();
 
+    //=========================================================================================================
+    /**
+    * Assignment operator. Caches and pending prefetches of the assigned object are not taken over.
+    *
+    * @param[in] rhs    FIFF raw measurement which should be assigned
+    *
+    * @return this
+    */
+    FiffRawData& operator= (const FiffRawData &rhs);
+
     //=========================================================================================================
     /**
     * Initializes the fiff raw measurement data.
@@ -147,6 +159,12 @@ public:
     * ### MNE toolbox root function ###: Implementation of the fiff_read_raw_segment function
     *
     * Read a specific raw data segment
+    * If the file stream is memory mapped (see FiffStream::map_file) the data buffers are decoded in place,
+    * without creating intermediate tags.
+    * The combined calibration/projection operator is cached and only rebuilt when sel changes between calls
+    * or proj, comp or cals were replaced through set_proj, set_comp or set_cals. The buffers of the segment
+    * are decoded and projected in parallel on the global thread pool; during sequential reads the following
+    * buffers are prefetched (see set_prefetch).
     *
     * @param[out] data      returns the data matrix (channels x samples)
     * @param[out] times     returns the time values corresponding to the samples
@@ -158,6 +176,21 @@ public:
     */
     bool read_raw_segment(MatrixXd& data, MatrixXd& times, fiff_int_t from = -1, fiff_int_t to = -1, const RowVectorXi& sel = defaultRowVectorXi);
 
+    //=========================================================================================================
+    /**
+    * Single precision version of read_raw_segment. The data buffers are converted, calibrated and projected
+    * straight into float, which halves the memory footprint compared to reading doubles and casting.
+    *
+    * @param[out] data      returns the data matrix (channels x samples)
+    * @param[out] times     returns the time values corresponding to the samples
+    * @param[in] from       first sample to include. If omitted, defaults to the first sample in data (optional)
+    * @param[in] to         last sample to include. If omitted, defaults to the last sample in data (optional)
+    * @param[in] sel        channel selection vector (optional)
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool read_raw_segment(MatrixXf& data, MatrixXd& times, fiff_int_t from = -1, fiff_int_t to = -1, const RowVectorXi& sel = defaultRowVectorXi);
+
     //=========================================================================================================
     /**
     * ### MNE toolbox root function ###: Implementation of the fiff_read_raw_segment function
@@ -174,17 +207,264 @@ public:
     */
     bool read_raw_segment_times(MatrixXd& data, MatrixXd& times, float from, float to, const RowVectorXi& sel = defaultRowVectorXi);
 
+    //=========================================================================================================
+    /**
+    * Looks up the raw directory entry (data buffer or skip) which contains the given sample.
+    * Since rawdir is sorted by sample this is a binary search, O(log n) in the number of buffers.
+    *
+    * @param[in] sample     the sample to look for
+    *
+    * @return index into rawdir, -1 if the sample is out of range
+    */
+    qint32 find_raw_dir(fiff_int_t sample) const;
+
+    //=========================================================================================================
+    /**
+    * Sets the read cursor used by read_raw_next.
+    *
+    * @param[in] sample     the next sample to be read by read_raw_next
+    */
+    void seek_raw(fiff_int_t sample);
+
+    //=========================================================================================================
+    /**
+    * Returns the current position of the read cursor.
+    *
+    * @return the next sample to be read by read_raw_next
+    */
+    inline fiff_int_t tell_raw() const;
+
+    //=========================================================================================================
+    /**
+    * Reads the next nsamp samples starting at the read cursor and advances the cursor.
+    * Consecutive calls continue from the buffer the previous call stopped in, without a directory lookup.
+    *
+    * @param[out] data      returns the data matrix (channels x samples)
+    * @param[out] times     returns the time values corresponding to the samples
+    * @param[in] nsamp      number of samples to read
+    * @param[in] sel        channel selection vector (optional)
+    *
+    * @return true if succeeded, false otherwise (e.g. end of data)
+    */
+    bool read_raw_next(MatrixXd& data, MatrixXd& times, fiff_int_t nsamp, const RowVectorXi& sel = defaultRowVectorXi);
+
+    //=========================================================================================================
+    /**
+    * Single precision version of read_raw_next.
+    *
+    * @param[out] data      returns the data matrix (channels x samples)
+    * @param[out] times     returns the time values corresponding to the samples
+    * @param[in] nsamp      number of samples to read
+    * @param[in] sel        channel selection vector (optional)
+    *
+    * @return true if succeeded, false otherwise (e.g. end of data)
+    */
+    bool read_raw_next(MatrixXf& data, MatrixXd& times, fiff_int_t nsamp, const RowVectorXi& sel = defaultRowVectorXi);
+
+    //=========================================================================================================
+    /**
+    * Sets the number of data buffers which are read, decoded and projected in the background once a read
+    * continues where the previous one stopped. 0 disables prefetching (default).
+    *
+    * @param[in] nbuffers   number of buffers to prefetch
+    */
+    void set_prefetch(qint32 nbuffers);
+
+    //=========================================================================================================
+    /**
+    * Sets the SSP operator which is applied to the data and drops the cached calibration/projection operator.
+    *
+    * @param[in] p_matProj  the new SSP operator, empty for none
+    */
+    void set_proj(const MatrixXd& p_matProj);
+
+    //=========================================================================================================
+    /**
+    * Sets the compensator which is applied to the data and drops the cached calibration/projection operator.
+    *
+    * @param[in] p_comp     the new compensator
+    */
+    void set_comp(const FiffCtfComp& p_comp);
+
+    //=========================================================================================================
+    /**
+    * Sets the calibration factors and drops the cached calibration/projection operator.
+    *
+    * @param[in] p_vecCals  the new calibration factors, one per channel
+    */
+    void set_cals(const RowVectorXd& p_vecCals);
+
+    //=========================================================================================================
+    /**
+    * Returns the SSP operator which is applied to the data, see set_proj.
+    *
+    * @return the SSP operator, empty if none
+    */
+    inline const MatrixXd& proj() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the compensator which is applied to the data, see set_comp.
+    *
+    * @return the compensator
+    */
+    inline const FiffCtfComp& comp() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the calibration factors, see set_cals.
+    *
+    * @return the calibration factors, one per channel
+    */
+    inline const RowVectorXd& cals() const;
+
+private:
+    //=========================================================================================================
+    /**
+    * Implementation of read_raw_segment for double and float precision.
+    */
+    template<typename T>
+    bool read_segment(Matrix<T, Dynamic, Dynamic>& data, MatrixXd& times, fiff_int_t from, fiff_int_t to, const RowVectorXi& sel);
+
+    //=========================================================================================================
+    /**
+    * Implementation of read_raw_next for double and float precision.
+    */
+    template<typename T>
+    bool read_next(Matrix<T, Dynamic, Dynamic>& data, MatrixXd& times, fiff_int_t nsamp, const RowVectorXi& sel);
+
+    //=========================================================================================================
+    /**
+    * Returns the rawdir index containing sample, checks the buffer of the previous read and its successor first.
+    *
+    * @param[in] sample     the sample to look for
+    *
+    * @return index into rawdir, -1 if the sample is out of range
+    */
+    qint32 locate_raw_dir(fiff_int_t sample) const;
+
+    //=========================================================================================================
+    /**
+    * Makes sure the cached calibration/projection operator matches the given channel selection. The operator
+    * is only rebuilt if the selection changed since the last call or it was dropped by invalidate_mult.
+    *
+    * @param[in] sel        channel selection vector
+    */
+    void update_mult(const RowVectorXi& sel);
+
+    //=========================================================================================================
+    /**
+    * Drops the cached calibration/projection operator.
+    */
+    void invalidate_mult();
+
+    //=========================================================================================================
+    /**
+    * Reads, decodes, calibrates and projects one raw directory entry with the cached operator.
+    * Runs in the thread pool; device access is serialized through the stream mutex.
+    *
+    * @param[in] p_RawDir   the raw directory entry to read
+    *
+    * @return the processed buffer (rows x nsamp), empty matrix on failure
+    */
+    template<typename T>
+    Matrix<T, Dynamic, Dynamic> read_raw_buffer(const FiffRawDir& p_RawDir) const;
+
+    //=========================================================================================================
+    /**
+    * Returns the (possibly prefetched) pending result of rawdir entry k, starts reading it if necessary.
+    *
+    * @param[in] k      index into rawdir
+    *
+    * @return the future of the processed buffer
+    */
+    template<typename T>
+    QFuture< Matrix<T, Dynamic, Dynamic> > take_raw_buffer(qint32 k);
+
+    //=========================================================================================================
+    /**
+    * Returns the pending prefetches of the given precision.
+    *
+    * @return the prefetched buffers, keyed by rawdir index
+    */
+    template<typename T>
+    QMap<qint32, QFuture< Matrix<T, Dynamic, Dynamic> > >& prefetch_map();
+
+    //=========================================================================================================
+    /**
+    * Returns the cached calibration/projection operator in the given precision.
+    *
+    * @return the cached operator
+    */
+    template<typename T>
+    const SparseMatrix<T>& mult() const;
+
+    //=========================================================================================================
+    /**
+    * Waits for and drops all pending prefetches.
+    */
+    void drop_prefetch();
+
 public:
     FiffStream::SPtr file;      /**< replaces fid */
     FiffInfo info;              /**< Fiff measurement information */
     fiff_int_t first_samp;      /**< Do we have a skip ToDo... */
     fiff_int_t last_samp;       /**< Do we have a skip ToDo... */
-    RowVectorXd cals;              /**< Calibration matrix: ToDo Check if RowVectorXd is enough */
     QList<FiffRawDir> rawdir;   /**< Special fiff diretory entry for raw data. */
-    MatrixXd proj;              /**< SSP operator to apply to the data. */
-    FiffCtfComp comp;           /**< Comepnsator. */
+
+private:
+    RowVectorXd m_vecCals;      /**< Calibration factors, private so that the cached operator can't go stale. */
+    MatrixXd m_matProj;         /**< SSP operator to apply to the data. */
+    FiffCtfComp m_comp;         /**< Compensator. */
+
+    fiff_int_t m_iReadCursor;   /**< Next sample to be read by read_raw_next. */
+    qint32 m_iRawDirHint;       /**< rawdir index the last read stopped in. */
+
+    bool m_bMultValid;                  /**< Whether the cached operator below is valid. */
+    SparseMatrix<double> m_matMult;     /**< Cached combined (sel x) proj x comp x cal operator, empty if calibration only. */
+    SparseMatrix<float> m_matMultFloat; /**< Single precision copy of m_matMult. */
+    RowVectorXd m_vecPickCals;          /**< Cached calibration factors of the selected channels. */
+    RowVectorXi m_vecMultSel;           /**< Channel selection the cached operator was built with. */
+
+    qint32 m_iPrefetch;                             /**< Number of buffers to prefetch during sequential reads. */
+    QMap<qint32, QFuture<MatrixXd> > m_mapPrefetch; /**< Pending prefetched buffers, keyed by rawdir index. */
+    QMap<qint32, QFuture<MatrixXf> > m_mapPrefetchFloat;    /**< Pending prefetched single precision buffers. */
 };
 
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline fiff_int_t FiffRawData::tell_raw() const
+{
+    return m_iReadCursor;
+}
+
+
+//*************************************************************************************************************
+
+inline const MatrixXd& FiffRawData::proj() const
+{
+    return m_matProj;
+}
+
+
+//*************************************************************************************************************
+
+inline const FiffCtfComp& FiffRawData::comp() const
+{
+    return m_comp;
+}
+
+
+//*************************************************************************************************************
+
+inline const RowVectorXd& FiffRawData::cals() const
+{
+    return m_vecCals;
+}
+
 } // NAMESPACE
 
 #endif // FIFF_RAW_DATA_H
@@ -0,0 +1,322 @@
+//=============================================================================================================
+/**
+* @file     fiff_raw_writer.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Implementation of the FiffRawWriter Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_raw_writer.h"
+
+#include <utils/ioutils.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QtEndian>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace UTILSLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define RAW_WRITER_FLUSH_INTERVAL 500   /**< Maximal time in ms a buffer stays in an incomplete batch. */
+#define RAW_WRITER_ALIGNMENT 4096       /**< File offset alignment of the end of full batches in bytes. */
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffRawWriter::FiffRawWriter(FiffStream::SPtr p_pStream, const RowVectorXd& p_vecCals, qint32 p_iMaxBuffers, qint32 p_iBatchSize, QObject *parent)
+: QThread(parent)
+, m_pStream(p_pStream)
+, m_vecCals(p_vecCals)
+, m_iMaxBuffers(p_iMaxBuffers > 0 ? p_iMaxBuffers : 1)
+, m_iBatchSize(p_iBatchSize > 0 ? p_iBatchSize : 1)
+, m_bIsRunning(false)
+, m_bError(0)
+{
+    m_vecInvCals = m_vecCals.cwiseInverse();
+    m_vecInvCalsFloat = m_vecInvCals.cast<float>();
+}
+
+
+//*************************************************************************************************************
+
+FiffRawWriter::~FiffRawWriter()
+{
+    stop();
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawWriter::start()
+{
+    if(!m_pStream || !m_pStream->device())
+    {
+        printf("No stream to write to\n");
+        return false;
+    }
+
+    QMutexLocker locker(&m_qMutex);
+    if(m_bIsRunning)
+        return true;
+
+    m_bIsRunning = true;
+    m_bError.storeRelease(0);
+    QThread::start();
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawWriter::stop()
+{
+    m_qMutex.lock();
+    m_bIsRunning = false;
+    m_qNotEmpty.wakeAll();
+    m_qNotFull.wakeAll();
+    m_qMutex.unlock();
+
+    QThread::wait();
+
+    return !hasError();
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawWriter::write_raw_buffer(const MatrixXd& buf, bool p_bBlock)
+{
+    if (buf.rows() != m_vecCals.cols())
+    {
+        printf("buffer and calibration sizes do not match\n");
+        return false;
+    }
+
+    MatrixXf tmp = (m_vecInvCals.asDiagonal()*buf).cast<float>();
+    return enqueue(tmp, p_bBlock);
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawWriter::write_raw_buffer(const MatrixXf& buf, bool p_bBlock)
+{
+    if (buf.rows() != m_vecCals.cols())
+    {
+        printf("buffer and calibration sizes do not match\n");
+        return false;
+    }
+
+    MatrixXf tmp = m_vecInvCalsFloat.asDiagonal()*buf;
+    return enqueue(tmp, p_bBlock);
+}
+
+
+//*************************************************************************************************************
+
+qint32 FiffRawWriter::queued()
+{
+    QMutexLocker locker(&m_qMutex);
+    return m_qQueue.size();
+}
+
+
+//*************************************************************************************************************
+
+bool FiffRawWriter::enqueue(const MatrixXf& p_matBuf, bool p_bBlock)
+{
+    QMutexLocker locker(&m_qMutex);
+
+    while(m_bIsRunning && m_qQueue.size() >= m_iMaxBuffers)
+    {
+        if(!p_bBlock)
+            return false;
+        m_qNotFull.wait(&m_qMutex);
+    }
+
+    if(!m_bIsRunning)
+    {
+        printf("Raw writer is not running\n");
+        return false;
+    }
+
+    m_qQueue.enqueue(p_matBuf);
+    m_qNotEmpty.wakeOne();
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawWriter::append_tag(const MatrixXf& p_matBuf, QByteArray& p_Batch)
+{
+    qint32 nel = p_matBuf.rows()*p_matBuf.cols();
+    qint32 offset = p_Batch.size();
+
+    p_Batch.resize(offset + 16 + nel*4);
+    uchar* t_pTag = reinterpret_cast<uchar*>(p_Batch.data()) + offset;
+
+    qToBigEndian<qint32>(FIFF_DATA_BUFFER, t_pTag);
+    qToBigEndian<qint32>(FIFFT_FLOAT, t_pTag + 4);
+    qToBigEndian<qint32>(nel*4, t_pTag + 8);
+    qToBigEndian<qint32>(FIFFV_NEXT_SEQ, t_pTag + 12);
+
+    float* t_pData = reinterpret_cast<float*>(t_pTag + 16);
+    memcpy(t_pData, p_matBuf.data(), nel*sizeof(float));
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    IOUtils::swap_float_array(t_pData, nel);
+#endif
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawWriter::flush_batch(QByteArray& p_Batch, bool p_bAll)
+{
+    if(p_Batch.isEmpty())
+        return;
+
+    QIODevice* t_pDevice = m_pStream->device();
+
+    //
+    //   Let the write end on an aligned file offset and carry the tail over to the next batch
+    //
+    qint64 t_iSize = p_Batch.size();
+    if(!p_bAll && !t_pDevice->isSequential())
+    {
+        qint64 t_iEnd = (t_pDevice->pos() + t_iSize) & ~((qint64)RAW_WRITER_ALIGNMENT - 1);
+        t_iSize = t_iEnd - t_pDevice->pos();
+        if(t_iSize <= 0)
+            return;
+    }
+
+    if(!hasError() && t_pDevice->write(p_Batch.constData(), t_iSize) != t_iSize)
+    {
+        printf("Error while writing raw data buffers: %s\n", t_pDevice->errorString().toUtf8().constData());
+        m_bError.storeRelease(1);
+    }
+
+    if(t_iSize == p_Batch.size())
+        p_Batch.resize(0);
+    else
+        p_Batch.remove(0, (int)t_iSize);
+}
+
+
+//*************************************************************************************************************
+
+void FiffRawWriter::run()
+{
+    QByteArray t_Batch;
+    t_Batch.reserve(m_iBatchSize);
+
+    MatrixXf t_matBuf;
+    QElapsedTimer t_timerBatch;
+    bool t_bIsRunning;
+
+    while(true)
+    {
+        m_qMutex.lock();
+        while(m_bIsRunning && m_qQueue.isEmpty())
+        {
+            if(t_Batch.isEmpty())
+                m_qNotEmpty.wait(&m_qMutex);
+            else
+            {
+                //
+                //   Don't keep a started batch around for longer than the flush interval
+                //
+                qint64 t_iRemaining = RAW_WRITER_FLUSH_INTERVAL - t_timerBatch.elapsed();
+                if(t_iRemaining <= 0 || !m_qNotEmpty.wait(&m_qMutex, (unsigned long)t_iRemaining))
+                    break;
+            }
+        }
+
+        t_bIsRunning = m_bIsRunning;
+
+        if(m_qQueue.isEmpty())
+        {
+            m_qMutex.unlock();
+            if(!t_bIsRunning)
+                break;
+
+            flush_batch(t_Batch);
+            continue;
+        }
+
+        t_matBuf = m_qQueue.dequeue();
+        m_qNotFull.wakeAll();
+        m_qMutex.unlock();
+
+        if(t_Batch.isEmpty())
+            t_timerBatch.start();
+
+        append_tag(t_matBuf, t_Batch);
+
+        if(t_Batch.size() >= m_iBatchSize)
+        {
+            flush_batch(t_Batch, false);
+            if(!t_Batch.isEmpty())
+                t_timerBatch.start();
+        }
+        else if(t_timerBatch.elapsed() >= RAW_WRITER_FLUSH_INTERVAL)
+            flush_batch(t_Batch);
+    }
+
+    flush_batch(t_Batch);
+}
@@ -0,0 +1,249 @@
+//=============================================================================================================
+/**
+* @file     fiff_raw_writer.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    FiffRawWriter class declaration.
+*
+*/
+
+#ifndef FIFF_RAW_WRITER_H
+#define FIFF_RAW_WRITER_H
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_types.h"
+#include "fiff_stream.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QMutex>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QThread>
+#include <QWaitCondition>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+
+
+//=============================================================================================================
+/**
+* Writes raw data buffers asynchronously to a stream which was set up by FiffStream::start_writing_raw.
+* Buffers are handed over through a bounded queue, so acquisition is not stalled by the disk. The writer
+* thread encodes the buffers to big endian FIFF_DATA_BUFFER tags and writes them in large batches. A batch is
+* written once it reaches the batch size, when the writer is stopped or at the latest half a second after its
+* first buffer was queued. Full batches end on a 4 KiB file offset, the rest is carried over to the next batch,
+* so that the file system does not have to merge partially written pages.
+* While the writer is running it is the only one allowed to write to the stream. After stop() returned the
+* file has to be closed by FiffStream::finish_writing_raw.
+*
+* @brief Asynchronous raw data writer
+*/
+class FIFFSHARED_EXPORT FiffRawWriter : public QThread
+{
+    Q_OBJECT
+public:
+    typedef QSharedPointer<FiffRawWriter> SPtr;             /**< Shared pointer type for FiffRawWriter. */
+    typedef QSharedPointer<const FiffRawWriter> ConstSPtr;  /**< Const shared pointer type for FiffRawWriter. */
+
+    //=========================================================================================================
+    /**
+    * Creates the asynchronous raw data writer.
+    *
+    * @param[in] p_pStream      Stream returned by FiffStream::start_writing_raw
+    * @param[in] p_vecCals      Calibration factors returned by FiffStream::start_writing_raw
+    * @param[in] p_iMaxBuffers  Maximal number of buffers which are queued before write_raw_buffer blocks
+    * @param[in] p_iBatchSize   Number of bytes which are collected before they are written to the device
+    * @param[in] parent         Parent QObject (optional)
+    */
+    explicit FiffRawWriter(FiffStream::SPtr p_pStream, const RowVectorXd& p_vecCals, qint32 p_iMaxBuffers = 32, qint32 p_iBatchSize = 4*1024*1024, QObject *parent = 0);
+
+    //=========================================================================================================
+    /**
+    * Destroys the writer. All queued buffers are written before the thread terminates.
+    */
+    ~FiffRawWriter();
+
+    //=========================================================================================================
+    /**
+    * Starts the writer thread.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool start();
+
+    //=========================================================================================================
+    /**
+    * Writes all queued buffers and stops the writer thread.
+    *
+    * @return true if all buffers were written, false otherwise
+    */
+    bool stop();
+
+    //=========================================================================================================
+    /**
+    * Queues a calibrated data buffer. The inverse calibration is applied on the calling thread.
+    *
+    * @param[in] buf        The buffer to write
+    * @param[in] p_bBlock   If true the call waits for free space in the queue, otherwise it returns false
+    *                       when the queue is full
+    *
+    * @return true if the buffer was queued, false otherwise
+    */
+    bool write_raw_buffer(const MatrixXd& buf, bool p_bBlock = true);
+
+    //=========================================================================================================
+    /**
+    * Queues a calibrated single precision data buffer.
+    *
+    * @param[in] buf        The buffer to write
+    * @param[in] p_bBlock   If true the call waits for free space in the queue, otherwise it returns false
+    *                       when the queue is full
+    *
+    * @return true if the buffer was queued, false otherwise
+    */
+    bool write_raw_buffer(const MatrixXf& buf, bool p_bBlock = true);
+
+    //=========================================================================================================
+    /**
+    * Returns the number of buffers which are waiting to be written.
+    *
+    * @return the number of queued buffers
+    */
+    qint32 queued();
+
+    //=========================================================================================================
+    /**
+    * Returns true if a write to the device failed.
+    *
+    * @return true if an error occured, false otherwise
+    */
+    inline bool hasError() const;
+
+protected:
+    //=========================================================================================================
+    /**
+    * The starting point for the thread. After calling start(), the newly created thread calls this function.
+    * Returning from this method will end the execution of the thread.
+    * Pure virtual method inherited by QThread.
+    */
+    virtual void run();
+
+private:
+    //=========================================================================================================
+    /**
+    * Appends an uncalibrated buffer to the queue.
+    *
+    * @param[in] p_matBuf   The buffer to queue
+    * @param[in] p_bBlock   If true the call waits for free space in the queue
+    *
+    * @return true if the buffer was queued, false otherwise
+    */
+    bool enqueue(const MatrixXf& p_matBuf, bool p_bBlock);
+
+    //=========================================================================================================
+    /**
+    * Encodes a buffer as FIFF_DATA_BUFFER tag and appends it to the batch.
+    *
+    * @param[in] p_matBuf       The uncalibrated buffer
+    * @param[in, out] p_Batch   The batch the tag is appended to
+    */
+    static void append_tag(const MatrixXf& p_matBuf, QByteArray& p_Batch);
+
+    //=========================================================================================================
+    /**
+    * Writes the batch to the device. If p_bAll is false, only the part up to the last 4 KiB file offset is
+    * written and the rest is kept in the batch.
+    *
+    * @param[in, out] p_Batch   The batch to write
+    * @param[in] p_bAll         Whether the whole batch has to be written
+    */
+    void flush_batch(QByteArray& p_Batch, bool p_bAll = true);
+
+    FiffStream::SPtr    m_pStream;          /**< The stream which was set up for writing raw data. */
+    RowVectorXd         m_vecCals;          /**< Calibration factors of the channels. */
+    RowVectorXd         m_vecInvCals;       /**< Inverse calibration factors of the channels. */
+    RowVectorXf         m_vecInvCalsFloat;  /**< Single precision inverse calibration factors. */
+    qint32              m_iMaxBuffers;      /**< Maximal number of queued buffers. */
+    qint32              m_iBatchSize;       /**< Number of bytes which are written at once. */
+
+    QMutex              m_qMutex;           /**< Serializes the access to the queue. */
+    QWaitCondition      m_qNotEmpty;        /**< Signals the writer thread that a buffer was queued. */
+    QWaitCondition      m_qNotFull;         /**< Signals waiting producers that a buffer was taken. */
+    QQueue<MatrixXf>    m_qQueue;           /**< Uncalibrated buffers waiting to be written. */
+    bool                m_bIsRunning;       /**< Holds whether the writer accepts buffers. */
+    QAtomicInt          m_bError;           /**< Holds whether a write to the device failed (bool), set by the writer thread. */
+};
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline bool FiffRawWriter::hasError() const
+{
+    return m_bError.loadAcquire() != 0;
+}
+
+} // NAMESPACE
+
+#endif // FIFF_RAW_WRITER_H
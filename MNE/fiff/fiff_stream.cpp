@@ -41,6 +41,7 @@
 #include "fiff_stream.h"
 #include "fiff_tag.h"
 #include "fiff_dir_tree.h"
+#include "fiff_dir_index.h"
 #include "fiff_ctf_comp.h"
 #include "fiff_info.h"
 #include "fiff_info_base.h"
@@ -50,12 +51,25 @@
 #include <utils/mnemath.h>
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // Qt INCLUDES
 //=============================================================================================================
 
 #include <QFile>
+#include <QtEndian>
+#include <QtNumeric>
+#include <QVector>
 
 
 //*************************************************************************************************************
@@ -67,6 +81,15 @@ using namespace FIFFLIB;
 using namespace UTILSLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define RT_BUFFER_INT16_MAX     32767       /**< Largest magnitude of an int16 raw buffer sample */
+#define RT_BUFFER_DEFLATE_LEVEL 1           /**< zlib level of the compressed stream format, fast over small */
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -74,6 +97,8 @@ using namespace UTILSLIB;
 
 FiffStream::FiffStream(QIODevice *p_pIODevice)
 : QDataStream(p_pIODevice)
+, m_pMappedData(NULL)
+, m_iMappedSize(0)
 {
     this->setFloatingPointPrecision(QDataStream::SinglePrecision);
     this->setByteOrder(QDataStream::BigEndian);
@@ -85,6 +110,8 @@ FiffStream::FiffStream(QIODevice *p_pIODevice)
 
 FiffStream::FiffStream(QByteArray * a, QIODevice::OpenMode mode)
 : QDataStream(a, mode)
+, m_pMappedData(NULL)
+, m_iMappedSize(0)
 {
     this->setFloatingPointPrecision(QDataStream::SinglePrecision);
     this->setByteOrder(QDataStream::BigEndian);
@@ -196,6 +223,40 @@ bool FiffStream::get_evoked_entries(const QList<FiffDirTree> &evoked_node, QStri
 }
 
 
+//*************************************************************************************************************
+
+bool FiffStream::map_file()
+{
+    if(m_pMappedData)
+        return true;
+
+    QFile* t_pFile = qobject_cast<QFile*>(this->device());
+    if(!t_pFile)
+    {
+        printf("Memory mapping is only available for files.\n");
+        return false;
+    }
+
+    if(!t_pFile->isOpen() && !t_pFile->open(QIODevice::ReadOnly))
+    {
+        printf("Cannot open %s\n", t_pFile->fileName().toUtf8().constData());
+        return false;
+    }
+
+    m_iMappedSize = t_pFile->size();
+    m_pMappedData = t_pFile->map(0, m_iMappedSize);
+
+    if(!m_pMappedData)
+    {
+        printf("Cannot map %s (%s)\n", t_pFile->fileName().toUtf8().constData(), t_pFile->errorString().toUtf8().constData());
+        m_iMappedSize = 0;
+        return false;
+    }
+
+    return true;
+}
+
+
 //*************************************************************************************************************
 
 bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
@@ -209,7 +270,7 @@ bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
     }
 
     FiffTag::SPtr t_pTag;
-    FiffTag::read_tag_info(this, t_pTag);
+    FiffTag::read_tag(this, t_pTag);
 
     if (t_pTag->kind != FIFF_FILE_ID)
     {
@@ -228,6 +289,8 @@ bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
         return false;
     }
 
+    FiffId t_FileId = t_pTag->toFiffID();
+
     FiffTag::read_tag(this, t_pTag);
 
     if (t_pTag->kind != FIFF_DIR_POINTER)
@@ -236,6 +299,17 @@ bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
         return false;
     }
 
+    //
+    //   Try the sidecar index first
+    //
+    bool t_bUseIndex = FiffDirIndex::isEnabled() && qobject_cast<QFile*>(this->device()) != NULL;
+    if (t_bUseIndex && FiffDirIndex::read(t_sFileName, t_FileId, p_Dir, p_Tree))
+    {
+        printf("\nRead tag directory index for %s\n", t_sFileName.toUtf8().constData());
+        this->device()->seek(0);
+        return true;
+    }
+
     //
     //   Read or create the directory tree
     //
@@ -272,6 +346,9 @@ bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
 
     printf("[done]\n");
 
+    if (t_bUseIndex && !FiffDirIndex::write(t_sFileName, t_FileId, p_Dir, p_Tree))
+        printf("Could not write tag directory index %s\n", FiffDirIndex::indexFileName(t_sFileName).toUtf8().constData());
+
     //
     //   Back to the beginning
     //
@@ -284,13 +361,13 @@ bool FiffStream::open(FiffDirTree& p_Tree, QList<FiffDirEntry>& p_Dir)
 
 QStringList FiffStream::read_bad_channels(const FiffDirTree& p_Node)
 {
-    QList<FiffDirTree> node = p_Node.dir_tree_find(FIFFB_MNE_BAD_CHANNELS);
+    QList<const FiffDirTree*> node = p_Node.dir_tree_find_nodes(FIFFB_MNE_BAD_CHANNELS);
     FiffTag::SPtr t_pTag;
 
     QStringList bads;
 
     if (node.size() > 0)
-        if(node[0].find_tag(this, FIFF_MNE_CH_NAME_LIST, t_pTag))
+        if(node[0]->find_tag(this, FIFF_MNE_CH_NAME_LIST, t_pTag))
             bads = split_name_list(t_pTag->toString());
 
     return bads;
@@ -522,14 +599,14 @@ bool FiffStream::read_cov(const FiffDirTree& p_Node, fiff_int_t cov_kind, FiffCo
 QList<FiffCtfComp> FiffStream::read_ctf_comp(const FiffDirTree& p_Node, const QList<FiffChInfo>& p_Chs)
 {
     QList<FiffCtfComp> compdata;
-    QList<FiffDirTree> t_qListComps = p_Node.dir_tree_find(FIFFB_MNE_CTF_COMP_DATA);
+    QList<const FiffDirTree*> t_qListComps = p_Node.dir_tree_find_nodes(FIFFB_MNE_CTF_COMP_DATA);
 
     qint32 i, k, p, col, row;
     fiff_int_t kind, pos;
     FiffTag::SPtr t_pTag;
     for (k = 0; k < t_qListComps.size(); ++k)
     {
-        FiffDirTree* node = &t_qListComps[k];
+        const FiffDirTree* node = t_qListComps[k];
         //
         //   Read the data we need
         //
@@ -750,7 +827,7 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
     //
     //   Find the desired blocks
     //
-    QList<FiffDirTree> meas = p_Node.dir_tree_find(FIFFB_MEAS);
+    QList<const FiffDirTree*> meas = p_Node.dir_tree_find_nodes(FIFFB_MEAS);
 
     if (meas.size() == 0)
     {
@@ -758,7 +835,7 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
         return false;
     }
     //
-    QList<FiffDirTree> meas_info = meas[0].dir_tree_find(FIFFB_MEAS_INFO);
+    QList<const FiffDirTree*> meas_info = meas[0]->dir_tree_find_nodes(FIFFB_MEAS_INFO);
     if (meas_info.count() == 0)
     {
         printf("Could not find measurement info\n");
@@ -789,10 +866,10 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
     fiff_int_t kind = -1;
     fiff_int_t pos = -1;
 
-    for (qint32 k = 0; k < meas_info[0].nent; ++k)
+    for (qint32 k = 0; k < meas_info[0]->nent; ++k)
     {
-        kind = meas_info[0].dir[k].kind;
-        pos  = meas_info[0].dir[k].pos;
+        kind = meas_info[0]->dir[k].kind;
+        pos  = meas_info[0]->dir[k].pos;
         switch (kind)
         {
             case FIFF_NCHAN:
@@ -857,13 +934,13 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
 
     if (dev_head_t.isEmpty() || ctf_head_t.isEmpty())
     {
-        QList<FiffDirTree> hpi_result = meas_info[0].dir_tree_find(FIFFB_HPI_RESULT);
+        QList<const FiffDirTree*> hpi_result = meas_info[0]->dir_tree_find_nodes(FIFFB_HPI_RESULT);
         if (hpi_result.size() == 1)
         {
-            for( qint32 k = 0; k < hpi_result[0].nent; ++k)
+            for( qint32 k = 0; k < hpi_result[0]->nent; ++k)
             {
-                kind = hpi_result[0].dir[k].kind;
-                pos  = hpi_result[0].dir[k].pos;
+                kind = hpi_result[0]->dir[k].kind;
+                pos  = hpi_result[0]->dir[k].pos;
                 if (kind == FIFF_COORD_TRANS)
                 {
                     FiffTag::read_tag(this, t_pTag, pos);
@@ -879,7 +956,7 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
     //
     //   Locate the Polhemus data
     //
-    QList<FiffDirTree> isotrak = meas_info[0].dir_tree_find(FIFFB_ISOTRAK);
+    QList<const FiffDirTree*> isotrak = meas_info[0]->dir_tree_find_nodes(FIFFB_ISOTRAK);
 
     QList<FiffDigPoint> dig;
     fiff_int_t coord_frame = FIFFV_COORD_HEAD;
@@ -888,10 +965,10 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
 
     if (isotrak.size() == 1)
     {
-        for (k = 0; k < isotrak[0].nent; ++k)
+        for (k = 0; k < isotrak[0]->nent; ++k)
         {
-            kind = isotrak[0].dir[k].kind;
-            pos  = isotrak[0].dir[k].pos;
+            kind = isotrak[0]->dir[k].kind;
+            pos  = isotrak[0]->dir[k].pos;
             if (kind == FIFF_DIG_POINT)
             {
                 FiffTag::read_tag(this, t_pTag, pos);
@@ -924,15 +1001,15 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
     //
     //   Locate the acquisition information
     //
-    QList<FiffDirTree> acqpars = meas_info[0].dir_tree_find(FIFFB_DACQ_PARS);
+    QList<const FiffDirTree*> acqpars = meas_info[0]->dir_tree_find_nodes(FIFFB_DACQ_PARS);
     QString acq_pars;
     QString acq_stim;
     if (acqpars.size() == 1)
     {
-        for( k = 0; k < acqpars[0].nent; ++k)
+        for( k = 0; k < acqpars[0]->nent; ++k)
         {
-            kind = acqpars[0].dir.at(k).kind;
-            pos  = acqpars[0].dir.at(k).pos;
+            kind = acqpars[0]->dir.at(k).kind;
+            pos  = acqpars[0]->dir.at(k).pos;
             if (kind == FIFF_DACQ_PARS)
             {
                 FiffTag::read_tag(this, t_pTag, pos);
@@ -948,11 +1025,11 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
     //
     //   Load the SSP data
     //
-    QList<FiffProj> projs = this->read_proj(meas_info[0]);//ToDo Member Function
+    QList<FiffProj> projs = this->read_proj(*meas_info[0]);//ToDo Member Function
     //
     //   Load the CTF compensation data
     //
-    QList<FiffCtfComp> comps = this->read_ctf_comp(meas_info[0], chs);//ToDo Member Function
+    QList<FiffCtfComp> comps = this->read_ctf_comp(*meas_info[0], chs);//ToDo Member Function
     //
     //   Load the bad channel list
     //
@@ -969,25 +1046,25 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
     //
     //  Make the most appropriate selection for the measurement id
     //
-    if (meas_info[0].parent_id.version == -1)
+    if (meas_info[0]->parent_id.version == -1)
     {
-        if (meas_info[0].id.version == -1)
+        if (meas_info[0]->id.version == -1)
         {
-            if (meas[0].id.version == -1)
+            if (meas[0]->id.version == -1)
             {
-                if (meas[0].parent_id.version == -1)
+                if (meas[0]->parent_id.version == -1)
                     info.meas_id = info.file_id;
                 else
-                    info.meas_id = meas[0].parent_id;
+                    info.meas_id = meas[0]->parent_id;
             }
             else
-                info.meas_id = meas[0].id;
+                info.meas_id = meas[0]->id;
         }
         else
-            info.meas_id = meas_info[0].id;
+            info.meas_id = meas_info[0]->id;
     }
     else
-        info.meas_id = meas_info[0].parent_id;
+        info.meas_id = meas_info[0]->parent_id;
 
     if (meas_date[0] == -1)
     {
@@ -1047,7 +1124,7 @@ bool FiffStream::read_meas_info(const FiffDirTree& p_Node, FiffInfo& info, FiffD
     info.acq_pars = acq_pars;
     info.acq_stim = acq_stim;
 
-    p_NodeInfo = meas[0];
+    p_NodeInfo = *meas[0];
 
     return true;
 }
@@ -1154,26 +1231,26 @@ QList<FiffProj> FiffStream::read_proj(const FiffDirTree& p_Node)
     //
     //   Locate the projection data
     //
-    QList<FiffDirTree> t_qListNodes = p_Node.dir_tree_find(FIFFB_PROJ);
+    QList<const FiffDirTree*> t_qListNodes = p_Node.dir_tree_find_nodes(FIFFB_PROJ);
     if ( t_qListNodes.size() == 0 )
         return projdata;
 
 
     FiffTag::SPtr t_pTag;
-    t_qListNodes[0].find_tag(this, FIFF_NCHAN, t_pTag);
+    t_qListNodes[0]->find_tag(this, FIFF_NCHAN, t_pTag);
     fiff_int_t global_nchan;
     if (t_pTag)
         global_nchan = *t_pTag->toInt();
 
 
     fiff_int_t nchan;
-    QList<FiffDirTree> t_qListItems = t_qListNodes[0].dir_tree_find(FIFFB_PROJ_ITEM);
+    QList<const FiffDirTree*> t_qListItems = t_qListNodes[0]->dir_tree_find_nodes(FIFFB_PROJ_ITEM);
     for ( qint32 i = 0; i < t_qListItems.size(); ++i)
     {
         //
         //   Find all desired tags in one item
         //
-        FiffDirTree* t_pFiffDirTreeItem = &t_qListItems[i];
+        const FiffDirTree* t_pFiffDirTreeItem = t_qListItems[i];
         t_pFiffDirTreeItem->find_tag(this, FIFF_NCHAN, t_pTag);
         if (t_pTag)
             nchan = *t_pTag->toInt();
@@ -1297,6 +1374,33 @@ QList<FiffProj> FiffStream::read_proj(const FiffDirTree& p_Node)
 }
 
 
+//*************************************************************************************************************
+
+bool FiffStream::read_tag_view(qint64 pos, fiff_int_t& kind, fiff_int_t& type, fiff_int_t& size, const uchar*& data) const
+{
+    const qint64 t_iTagInfoSize = 4*sizeof(fiff_int_t);
+
+    if(!m_pMappedData || pos < 0 || pos + t_iTagInfoSize > m_iMappedSize)
+        return false;
+
+    const uchar* t_pTag = m_pMappedData + pos;
+
+    kind = qFromBigEndian<qint32>(t_pTag);
+    type = qFromBigEndian<qint32>(t_pTag + 4);
+    size = qFromBigEndian<qint32>(t_pTag + 8);
+
+    if(size < 0 || pos + t_iTagInfoSize + size > m_iMappedSize)
+    {
+        printf("Tag at %lld exceeds the mapped file.\n", pos);
+        return false;
+    }
+
+    data = t_pTag + t_iTagInfoSize;
+
+    return true;
+}
+
+
 //*************************************************************************************************************
 
 bool FiffStream::setup_read_raw(QIODevice &p_IODevice, FiffRawData& data, bool allow_maxshield)
@@ -1479,7 +1583,7 @@ bool FiffStream::setup_read_raw(QIODevice &p_IODevice, FiffRawData& data, bool a
     for (qint32 k = 0; k < data.info.nchan; ++k)
         cals(0,k) = data.info.chs.at(k).range*data.info.chs[k].cal;
     //
-    data.cals       = cals;
+    data.set_cals(cals);
     data.rawdir     = rawdir;
     //data->proj       = [];
     //data.comp       = [];
@@ -1711,6 +1815,22 @@ QString FiffStream::streamName()
 }
 
 
+//*************************************************************************************************************
+
+void FiffStream::unmap_file()
+{
+    if(!m_pMappedData)
+        return;
+
+    QFile* t_pFile = qobject_cast<QFile*>(this->device());
+    if(t_pFile)
+        t_pFile->unmap(m_pMappedData);
+
+    m_pMappedData = NULL;
+    m_iMappedSize = 0;
+}
+
+
 //*************************************************************************************************************
 
 void FiffStream::write_ch_info(FiffChInfo* ch)
@@ -2487,3 +2607,136 @@ void FiffStream::write_rt_command(fiff_int_t command, const QString& data)
 
     this->writeRawData(data.toUtf8().constData(),datasize);
 }
+
+
+//*************************************************************************************************************
+
+void FiffStream::write_rt_raw_buffer(const MatrixXf& data, fiff_int_t format)
+{
+    qint32 nchan = data.rows();
+    qint32 nsamp = data.cols();
+    qint32 nel = nchan*nsamp;
+    const float* t_pData = data.data();
+
+    if(format != FIFFV_MNE_RT_FORMAT_NATIVE && format != FIFFV_MNE_RT_FORMAT_INT16 && format != FIFFV_MNE_RT_FORMAT_COMPRESSED)
+    {
+        this->write_float(FIFF_DATA_BUFFER, t_pData, nel);
+        return;
+    }
+
+    //
+    // Payload: number of channels and samples followed by the samples, all little-endian
+    //
+    fiff_int_t kind;
+    QByteArray t_blobPayload;
+    qint32 k, c, s;
+
+    if(format == FIFFV_MNE_RT_FORMAT_NATIVE)
+    {
+        kind = FIFF_MNE_RT_DATA_BUFFER_LE;
+        t_blobPayload.resize(8 + 4*nel);
+        uchar* t_pOut = (uchar*)t_blobPayload.data() + 8;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        memcpy(t_pOut, t_pData, 4*nel);
+#else
+        quint32 t_iBits;
+        for(k = 0; k < nel; ++k)
+        {
+            memcpy(&t_iBits, t_pData + k, 4);
+            qToLittleEndian<quint32>(t_iBits, t_pOut + 4*k);
+        }
+#endif
+    }
+    else if(format == FIFFV_MNE_RT_FORMAT_INT16)
+    {
+        //
+        // Per channel scaling like FIFFT_DAU_PACK16: sample = int16 * scale. The scale is taken from the finite
+        // samples, infinite samples are clamped to the largest int16 and NaNs are sent as zero.
+        //
+        kind = FIFF_MNE_RT_DATA_BUFFER_INT16;
+        t_blobPayload.resize(8 + 4*nchan + 2*nel);
+        uchar* t_pOut = (uchar*)t_blobPayload.data() + 8;
+
+        VectorXd t_vecInvScale = VectorXd::Zero(nchan);
+        float t_fValue;
+        double t_dValue;
+        for(c = 0; c < nchan; ++c)
+        {
+            float t_fMax = 0.0f;
+            for(s = 0; s < nsamp; ++s)
+            {
+                t_fValue = qAbs(t_pData[s*nchan + c]);
+                if(qIsFinite(t_fValue) && t_fValue > t_fMax)
+                    t_fMax = t_fValue;
+            }
+
+            // rounded up, so the largest sample stays within the int16 range
+            float t_fScale = t_fMax / RT_BUFFER_INT16_MAX;
+            if(t_fScale*RT_BUFFER_INT16_MAX < t_fMax)
+                t_fScale = nextafterf(t_fScale, FLT_MAX);
+            if(t_fScale > 0.0f)
+                t_vecInvScale[c] = 1.0 / t_fScale;
+
+            quint32 t_iBits;
+            memcpy(&t_iBits, &t_fScale, 4);
+            qToLittleEndian<quint32>(t_iBits, t_pOut + 4*c);
+        }
+
+        t_pOut += 4*nchan;
+        for(s = 0, k = 0; s < nsamp; ++s)
+        {
+            for(c = 0; c < nchan; ++c, ++k)
+            {
+                t_dValue = t_pData[k]*t_vecInvScale[c];
+                if(qIsNaN(t_dValue))
+                    t_dValue = 0.0;
+                t_dValue = qBound(-(double)RT_BUFFER_INT16_MAX, t_dValue, (double)RT_BUFFER_INT16_MAX);
+                qToLittleEndian<qint16>((qint16)qRound(t_dValue), t_pOut + 2*k);
+            }
+        }
+    }
+    else
+    {
+        //
+        // Lossless: the float bits are mapped to integers of the same order, so the differences to the previous
+        // sample of the channel are small and their zigzag code has mostly zero high bytes. Separated into byte
+        // planes they deflate well.
+        //
+        kind = FIFF_MNE_RT_DATA_BUFFER_DELTA;
+        QByteArray t_blobPlanes(4*nel, 0);
+        uchar* t_pPlanes = (uchar*)t_blobPlanes.data();
+
+        QVector<quint32> t_vecPrevBits(nchan, 0);
+        quint32 t_iBits, t_iDelta;
+        for(s = 0, k = 0; s < nsamp; ++s)
+        {
+            for(c = 0; c < nchan; ++c, ++k)
+            {
+                memcpy(&t_iBits, t_pData + k, 4);
+                t_iBits = (t_iBits >> 31) ? ~t_iBits : (t_iBits | 0x80000000u);
+
+                t_iDelta = t_iBits - t_vecPrevBits[c];
+                t_iDelta = (t_iDelta << 1) ^ (0u - (t_iDelta >> 31));
+                t_vecPrevBits[c] = t_iBits;
+
+                t_pPlanes[k]         = (uchar)t_iDelta;
+                t_pPlanes[nel + k]   = (uchar)(t_iDelta >> 8);
+                t_pPlanes[2*nel + k] = (uchar)(t_iDelta >> 16);
+                t_pPlanes[3*nel + k] = (uchar)(t_iDelta >> 24);
+            }
+        }
+
+        t_blobPayload.resize(8);
+        t_blobPayload.append(qCompress(t_blobPlanes, RT_BUFFER_DEFLATE_LEVEL));
+    }
+
+    qToLittleEndian<qint32>(nchan, (uchar*)t_blobPayload.data());
+    qToLittleEndian<qint32>(nsamp, (uchar*)t_blobPayload.data() + 4);
+
+    *this << (qint32)kind;
+    *this << (qint32)FIFFT_VOID;
+    *this << (qint32)t_blobPayload.size();
+    *this << (qint32)FIFFV_NEXT_SEQ;
+
+    this->writeRawData(t_blobPayload.constData(), t_blobPayload.size());
+}
@@ -81,6 +81,7 @@
 #include <QFile>
 #include <QIODevice>
 #include <QList>
+#include <QMutex>
 #include <QSharedPointer>
 #include <QString>
 #include <QStringList>
@@ -196,6 +197,33 @@ public:
     */
     bool get_evoked_entries(const QList<FiffDirTree> &evoked_node, QStringList &comments, QList<fiff_int_t> &aspect_kinds, QString &t);
 
+    //=========================================================================================================
+    /**
+    * True if the underlying file is mapped into memory (see map_file).
+    *
+    * @return true if the stream is memory mapped
+    */
+    inline bool isMapped() const;
+
+    //=========================================================================================================
+    /**
+    * Maps the whole underlying file read-only into memory. Once mapped, tags can be accessed in place via
+    * read_tag_view without any copy. This is only available when the stream operates on a QFile; the mapping
+    * stays valid until unmap_file is called or the QFile is destroyed.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool map_file();
+
+    //=========================================================================================================
+    /**
+    * Mutex which serializes device access of readers working on this stream from other threads, e.g. the
+    * FiffRawData buffer readers. Seek and read of one tag have to happen while holding it.
+    *
+    * @return the device mutex
+    */
+    inline QMutex* mutex();
+
     //=========================================================================================================
     /**
     * QFile::open
@@ -211,6 +239,7 @@ public:
     * ### MNE toolbox root function ###
     *
     * Opens a fif file and provides the directory of tags
+    * If FiffDirIndex is enabled, the directory is read from the sidecar index, which is (re)built when missing or stale.
     *
     * @param[out] p_Tree    tag directory organized into a tree
     * @param[out] p_Dir     the sequential tag directory
@@ -328,6 +357,22 @@ public:
     */
     QList<FiffProj> read_proj(const FiffDirTree& p_Node);
 
+    //=========================================================================================================
+    /**
+    * Read the header of a tag located at pos and return a read-only view of its data inside the mapped file.
+    * The data is NOT converted, i.e. it is in file (big endian) byte order and not necessarily aligned.
+    * Requires a mapped stream (see map_file).
+    *
+    * @param[in] pos        position of the tag inside the fif file
+    * @param[out] kind      tag kind
+    * @param[out] type      tag data type
+    * @param[out] size      size of the tag data in bytes
+    * @param[out] data      pointer to the first byte of the tag data inside the mapping
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool read_tag_view(qint64 pos, fiff_int_t& kind, fiff_int_t& type, fiff_int_t& size, const uchar*& data) const;
+
     //=========================================================================================================
     /**
     * fiff_setup_read_raw
@@ -411,6 +456,12 @@ public:
     */
     QString streamName();
 
+    //=========================================================================================================
+    /**
+    * Releases the memory mapping created by map_file.
+    */
+    void unmap_file();
+
     //=========================================================================================================
     /**
     * fiff_write_ch_info
@@ -663,8 +714,42 @@ public:
     * @param[in] data       The string data to write
     */
     void write_rt_command(fiff_int_t command, const QString& data);
+
+    //=========================================================================================================
+    /**
+    * Writes a real-time raw buffer in one of the stream formats. FIFFV_MNE_RT_FORMAT_FIFF writes a
+    * FIFF_DATA_BUFFER, the other formats write the corresponding FIFF_MNE_RT_DATA_BUFFER_* tag. The tags are
+    * decoded by FiffTag::toRawBuffer.
+    *
+    * @param[in] data       The raw buffer, channels x samples
+    * @param[in] format     The stream format, FIFFV_MNE_RT_FORMAT_*
+    */
+    void write_rt_raw_buffer(const MatrixXf& data, fiff_int_t format);
+
+private:
+    uchar*  m_pMappedData;  /**< Start of the memory mapped file, NULL if not mapped. */
+    qint64  m_iMappedSize;  /**< Size of the memory mapped region in bytes. */
+    QMutex  m_qMutex;       /**< Serializes device access of concurrent readers. */
 };
 
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline bool FiffStream::isMapped() const
+{
+    return m_pMappedData != NULL;
+}
+
+
+//*************************************************************************************************************
+
+inline QMutex* FiffStream::mutex()
+{
+    return &m_qMutex;
+}
+
 } // NAMESPACE
 
 #endif // FIFF_STREAM_H
@@ -49,6 +49,16 @@
 //=============================================================================================================
 
 #include <QTcpSocket>
+#include <QtEndian>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <limits.h>
+#include <string.h>
 
 
 //*************************************************************************************************************
@@ -60,6 +70,14 @@ using namespace UTILSLIB;
 using namespace FIFFLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define DEFLATE_MAX_RATIO   1032    /**< Largest expansion of deflate compressed data */
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -183,14 +201,19 @@ bool FiffTag::read_tag_info(FiffStream* p_pStream, FiffTag::SPtr &p_pTag, bool p
 
 bool FiffTag::read_rt_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag)
 {
+    //
+    // Wait for the data instead of polling, fails if the device does not deliver any more
+    //
     while(p_pStream->device()->bytesAvailable() < 16)
-        p_pStream->device()->waitForReadyRead(10);
+        if(!p_pStream->device()->waitForReadyRead(-1))
+            return false;
 
     if(!FiffTag::read_tag_info(p_pStream, p_pTag, false))
         return false;
 
     while(p_pStream->device()->bytesAvailable() < p_pTag->size())
-        p_pStream->device()->waitForReadyRead(10);
+        if(!p_pStream->device()->waitForReadyRead(-1))
+            return false;
 
     if(!FiffTag::read_tag_data(p_pStream, p_pTag))
         return false;
@@ -238,6 +261,134 @@ bool FiffTag::read_tag(FiffStream* p_pStream, FiffTag::SPtr& p_pTag, qint64 pos)
 }
 
 
+//*************************************************************************************************************
+
+bool FiffTag::toRawBuffer(qint32 p_nChannels, MatrixXf& p_matData) const
+{
+    if(this->kind == FIFF_DATA_BUFFER)
+    {
+        if(this->getType() != FIFFT_FLOAT || p_nChannels <= 0)
+            return false;
+
+        qint32 nsamp = (this->size()/4)/p_nChannels;
+        p_matData = Map<const MatrixXf>((const float*)this->constData(), p_nChannels, nsamp);
+        return true;
+    }
+
+    if(this->kind != FIFF_MNE_RT_DATA_BUFFER_LE && this->kind != FIFF_MNE_RT_DATA_BUFFER_INT16 && this->kind != FIFF_MNE_RT_DATA_BUFFER_DELTA)
+        return false;
+
+    //
+    // Number of channels and samples, followed by the samples, all little-endian
+    //
+    if(this->size() < 8)
+        return false;
+
+    const uchar* t_pIn = (const uchar*)this->constData();
+    qint32 nchan = qFromLittleEndian<qint32>(t_pIn);
+    qint32 nsamp = qFromLittleEndian<qint32>(t_pIn + 4);
+    if(nchan < 0 || nsamp < 0 || (nchan > 0 && nsamp > INT_MAX/4/nchan))
+        return false;
+    //
+    // Uncompressed formats hold at least 4 bytes per channel, nothing is allocated before the size is checked
+    //
+    if(this->kind != FIFF_MNE_RT_DATA_BUFFER_DELTA && nchan > (this->size() - 8)/4)
+        return false;
+
+    qint32 nel = nchan*nsamp;
+    qint32 k, c, s;
+    t_pIn += 8;
+
+    if(this->kind == FIFF_MNE_RT_DATA_BUFFER_LE)
+    {
+        if((qint64)this->size() < 8 + 4*(qint64)nel)
+            return false;
+
+        p_matData.resize(nchan, nsamp);
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        memcpy(p_matData.data(), t_pIn, 4*nel);
+#else
+        quint32 t_iBits;
+        for(k = 0; k < nel; ++k)
+        {
+            t_iBits = qFromLittleEndian<quint32>(t_pIn + 4*k);
+            memcpy(p_matData.data() + k, &t_iBits, 4);
+        }
+#endif
+    }
+    else if(this->kind == FIFF_MNE_RT_DATA_BUFFER_INT16)
+    {
+        if((qint64)this->size() < 8 + 4*(qint64)nchan + 2*(qint64)nel)
+            return false;
+
+        VectorXf t_vecScale(nchan);
+        quint32 t_iBits;
+        for(c = 0; c < nchan; ++c)
+        {
+            t_iBits = qFromLittleEndian<quint32>(t_pIn + 4*c);
+            memcpy(t_vecScale.data() + c, &t_iBits, 4);
+        }
+
+        t_pIn += 4*nchan;
+        p_matData.resize(nchan, nsamp);
+        float* t_pData = p_matData.data();
+        for(s = 0, k = 0; s < nsamp; ++s)
+            for(c = 0; c < nchan; ++c, ++k)
+                t_pData[k] = qFromLittleEndian<qint16>(t_pIn + 2*k) * t_vecScale[c];
+    }
+    else
+    {
+        //
+        // Undo the deflate, the byte planes, the zigzag code, the differences and the order preserving map
+        //
+        // qCompress prefixes the big-endian uncompressed size, check it before anything is inflated
+        qint32 t_iCompressed = this->size() - 8;
+        if(t_iCompressed < 4)
+            return false;
+
+        quint32 t_iUncompressed = qFromBigEndian<quint32>(t_pIn);
+        if((qint64)t_iUncompressed != 4*(qint64)nel || (qint64)t_iUncompressed > (qint64)t_iCompressed*DEFLATE_MAX_RATIO)
+            return false;
+
+        if(nel == 0)
+        {
+            p_matData.resize(nchan, 0);
+            return true;
+        }
+
+        QByteArray t_blobPlanes = qUncompress(t_pIn, t_iCompressed);
+        if(t_blobPlanes.size() != 4*nel)
+            return false;
+
+        const uchar* t_pPlanes = (const uchar*)t_blobPlanes.constData();
+        p_matData.resize(nchan, nsamp);
+        float* t_pData = p_matData.data();
+
+        QVector<quint32> t_vecPrevBits(nchan, 0);
+        quint32 t_iBits, t_iDelta;
+        for(s = 0, k = 0; s < nsamp; ++s)
+        {
+            for(c = 0; c < nchan; ++c, ++k)
+            {
+                t_iDelta = (quint32)t_pPlanes[k]
+                        | ((quint32)t_pPlanes[nel + k] << 8)
+                        | ((quint32)t_pPlanes[2*nel + k] << 16)
+                        | ((quint32)t_pPlanes[3*nel + k] << 24);
+                t_iDelta = (t_iDelta >> 1) ^ (0u - (t_iDelta & 1));
+
+                t_iBits = t_vecPrevBits[c] + t_iDelta;
+                t_vecPrevBits[c] = t_iBits;
+
+                t_iBits = (t_iBits >> 31) ? (t_iBits & 0x7fffffffu) : ~t_iBits;
+                memcpy(t_pData + k, &t_iBits, 4);
+            }
+        }
+    }
+
+    return true;
+}
+
+
 //*************************************************************************************************************
 
 fiff_int_t FiffTag::getMatrixCoding() const
@@ -469,9 +620,7 @@ void FiffTag::convert_matrix_from_file_data(FiffTag::SPtr tag)
 {
     int ndim;
     int k;
-    int *dimp,*data,kind,np,nz;
-    float *fdata;
-    double *ddata;
+    int *dimp,kind,np,nz;
     unsigned int tsize = tag->size();
 
     if (fiff_type_fundamental(tag->type) != FIFFTS_FS_MATRIX)
@@ -511,26 +660,19 @@ void FiffTag::convert_matrix_from_file_data(FiffTag::SPtr tag)
         /*
          * Take care of the indices
         */
-        for (data = (int *)(tag->data())+nz, k = 0; k < np; k++)
-            IOUtils::swap_intp(data+k);
+        IOUtils::swap_int_array((int *)(tag->data())+nz, np);
         np = nz;
     }
     /*
      * Now convert data...
      */
     kind = fiff_type_base(tag->type);
-    if (kind == FIFFT_INT) {
-        for (data = (int *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_intp(data+k);
-    }
-    else if (kind == FIFFT_FLOAT) {
-        for (fdata = (float *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_floatp(fdata+k);
-    }
-    else if (kind == FIFFT_DOUBLE) {
-        for (ddata = (double *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_doublep(ddata+k);
-    }
+    if (kind == FIFFT_INT)
+        IOUtils::swap_int_array((int *)(tag->data()), np);
+    else if (kind == FIFFT_FLOAT)
+        IOUtils::swap_float_array((float *)(tag->data()), np);
+    else if (kind == FIFFT_DOUBLE)
+        IOUtils::swap_double_array((double *)(tag->data()), np);
     return;
 }
 
@@ -544,9 +686,7 @@ void FiffTag::convert_matrix_to_file_data(FiffTag::SPtr tag)
 {
     int ndim;
     int k;
-    int *dimp,*data,kind,np;
-    float *fdata;
-    double *ddata;
+    int *dimp,kind,np;
     unsigned int tsize = tag->size();
 
     if (fiff_type_fundamental(tag->type) != FIFFTS_FS_MATRIX)
@@ -588,26 +728,16 @@ void FiffTag::convert_matrix_to_file_data(FiffTag::SPtr tag)
     * Now convert data...
     */
     kind = fiff_type_base(tag->type);
-    if (kind == FIFFT_INT) {
-        for (data = (int *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_intp(data+k);
-    }
-    else if (kind == FIFFT_FLOAT) {
-        for (fdata = (float *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_floatp(fdata+k);
-    }
-    else if (kind == FIFFT_DOUBLE) {
-        for (ddata = (double *)(tag->data()), k = 0; k < np; k++)
-            IOUtils::swap_doublep(ddata+k);
-    }
-    else if (kind == FIFFT_COMPLEX_FLOAT) {
-        for (fdata = (float *)(tag->data()), k = 0; k < 2*np; k++)
-            IOUtils::swap_floatp(fdata+k);
-    }
-    else if (kind == FIFFT_COMPLEX_DOUBLE) {
-        for (ddata = (double *)(tag->data()), k = 0; k < 2*np; k++)
-            IOUtils::swap_doublep(ddata+k);
-    }
+    if (kind == FIFFT_INT)
+        IOUtils::swap_int_array((int *)(tag->data()), np);
+    else if (kind == FIFFT_FLOAT)
+        IOUtils::swap_float_array((float *)(tag->data()), np);
+    else if (kind == FIFFT_DOUBLE)
+        IOUtils::swap_double_array((double *)(tag->data()), np);
+    else if (kind == FIFFT_COMPLEX_FLOAT)
+        IOUtils::swap_float_array((float *)(tag->data()), 2*np);
+    else if (kind == FIFFT_COMPLEX_DOUBLE)
+        IOUtils::swap_double_array((double *)(tag->data()), 2*np);
     return;
 }
 
@@ -621,9 +751,7 @@ void FiffTag::convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian
     char           *offset;
     fiff_int_t     *ithis;
     fiff_short_t   *sthis;
-    fiff_long_t    *lthis;
     float          *fthis;
-    double         *dthis;
 //    fiffDirEntry   dethis;
 //    fiffId         idthis;
 //    fiffChInfoRec* chthis;//FiffChInfo*     chthis;//ToDo adapt parsing to the new class
@@ -657,37 +785,32 @@ void FiffTag::convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian
     case FIFFT_JULIAN :
     case FIFFT_UINT :
         np = tag->size()/sizeof(fiff_int_t);
-        for (ithis = (fiff_int_t *)tag->data(), k = 0; k < np; k++, ithis++)
-            IOUtils::swap_intp(ithis);
+        IOUtils::swap_int_array((fiff_int_t *)tag->data(), np);
         break;
 
     case FIFFT_LONG :
     case FIFFT_ULONG :
         np = tag->size()/sizeof(fiff_long_t);
-        for (lthis = (fiff_long_t *)tag->data(), k = 0; k < np; k++, lthis++)
-            IOUtils::swap_longp(lthis);
+        IOUtils::swap_long_array((fiff_long_t *)tag->data(), np);
         break;
 
     case FIFFT_SHORT :
     case FIFFT_DAU_PACK16 :
     case FIFFT_USHORT :
         np = tag->size()/sizeof(fiff_short_t);
-        for (sthis = (fiff_short_t *)tag->data(), k = 0; k < np; k++, sthis++)
-            *sthis = IOUtils::swap_short(*sthis);
+        IOUtils::swap_short_array((fiff_short_t *)tag->data(), np);
         break;
 
     case FIFFT_FLOAT :
     case FIFFT_COMPLEX_FLOAT :
         np = tag->size()/sizeof(fiff_float_t);
-        for (fthis = (fiff_float_t *)tag->data(), k = 0; k < np; k++, fthis++)
-            IOUtils::swap_floatp(fthis);
+        IOUtils::swap_float_array((fiff_float_t *)tag->data(), np);
         break;
 
     case FIFFT_DOUBLE :
     case FIFFT_COMPLEX_DOUBLE :
         np = tag->size()/sizeof(fiff_double_t);
-        for (dthis = (fiff_double_t *)tag->data(), k = 0; k < np; k++, dthis++)
-            IOUtils::swap_doublep(dthis);
+        IOUtils::swap_double_array((fiff_double_t *)tag->data(), np);
         break;
 
     case FIFFT_OLD_PACK :
@@ -699,8 +822,7 @@ void FiffTag::convert_tag_data(FiffTag::SPtr tag, int from_endian, int to_endian
         IOUtils::swap_floatp(fthis+1);
         sthis = (short *)(fthis+2);
         np = (tag->size() - 2*sizeof(float))/sizeof(short);
-        for (k = 0; k < np; k++,sthis++)
-            *sthis = IOUtils::swap_short(*sthis);
+        IOUtils::swap_short_array(sthis, np);
         break;
 
     case FIFFT_DIR_ENTRY_STRUCT :
@@ -218,6 +218,7 @@ public:
     /**
     * Read one tag from a fif real-time stream.
     * difference to the other read tag functions is: that this function has blocking behaviour (waitForReadyRead)
+    * For non-blocking reading of a socket use FiffTagDecoder.
     *
     * @param[in] p_pStream opened fif file
     * @param[out] p_pTag the read tag
@@ -495,6 +496,21 @@ public:
     */
     inline SparseMatrix<double> toSparseFloatMatrix() const;
 
+    //=========================================================================================================
+    /**
+    * to real-time raw buffer
+    *
+    * Decodes a FIFF_DATA_BUFFER or one of the FIFF_MNE_RT_DATA_BUFFER_* tags written by
+    * FiffStream::write_rt_raw_buffer. The dimensions in the header are checked against the payload, and the
+    * announced uncompressed size against the compressed one, before anything is allocated.
+    *
+    * @param[in] p_nChannels    Number of channels, needed to reshape a FIFF_DATA_BUFFER
+    * @param[out] p_matData     The raw buffer, channels x samples
+    *
+    * @return true if the tag is a raw buffer and could be decoded, false otherwise
+    */
+    bool toRawBuffer(qint32 p_nChannels, MatrixXf& p_matData) const;
+
     //
     //from fiff_combat.c
     //
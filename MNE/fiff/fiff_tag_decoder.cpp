@@ -0,0 +1,241 @@
+//=============================================================================================================
+/**
+* @file     fiff_tag_decoder.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Contains the FiffTagDecoder class definition.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_tag_decoder.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QtEndian>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <string.h>
+#include <stdio.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffTagDecoder::FiffTagDecoder(qint32 p_iPoolSize, qint32 p_iMaxTagSize)
+: m_iHeaderBytes(0)
+, m_iDataBytes(0)
+, m_bError(false)
+, m_iPoolSize(p_iPoolSize)
+, m_iMaxTagSize(p_iMaxTagSize)
+{
+}
+
+
+//*************************************************************************************************************
+
+bool FiffTagDecoder::feed(const char* p_pData, qint64 p_iSize)
+{
+    if(m_bError)
+        return false;
+
+    while(p_iSize > 0)
+    {
+        qint64 t_iMaxSize;
+        char* t_pTarget = nextTarget(t_iMaxSize);
+        qint64 t_iSize = qMin(t_iMaxSize, p_iSize);
+
+        memcpy(t_pTarget, p_pData, t_iSize);
+        p_pData += t_iSize;
+        p_iSize -= t_iSize;
+
+        if(!advance(t_iSize))
+            return false;
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+qint64 FiffTagDecoder::readFrom(QIODevice* p_pDevice)
+{
+    if(m_bError)
+        return -1;
+
+    qint64 t_iTotal = 0;
+    while(p_pDevice->bytesAvailable() > 0)
+    {
+        qint64 t_iMaxSize;
+        char* t_pTarget = nextTarget(t_iMaxSize);
+
+        qint64 t_iSize = p_pDevice->read(t_pTarget, t_iMaxSize);
+        if(t_iSize < 0)
+            return -1;
+        if(t_iSize == 0)
+            break;
+
+        t_iTotal += t_iSize;
+
+        if(!advance(t_iSize))
+            return -1;
+    }
+
+    return t_iTotal;
+}
+
+
+//*************************************************************************************************************
+
+FiffTag::SPtr FiffTagDecoder::takeTag()
+{
+    if(m_qQueueTags.isEmpty())
+        return FiffTag::SPtr();
+
+    return m_qQueueTags.dequeue();
+}
+
+
+//*************************************************************************************************************
+
+void FiffTagDecoder::recycle(const FiffTag::SPtr& p_pTag)
+{
+    //
+    // Complex tags cache their converted data, they are not reused
+    //
+    if(!p_pTag || m_qListPool.size() >= m_iPoolSize
+            || p_pTag->getType() == FIFFT_COMPLEX_FLOAT || p_pTag->getType() == FIFFT_COMPLEX_DOUBLE)
+        return;
+
+    m_qListPool.append(p_pTag);
+}
+
+
+//*************************************************************************************************************
+
+void FiffTagDecoder::clear()
+{
+    m_iHeaderBytes = 0;
+    m_pTag.clear();
+    m_iDataBytes = 0;
+    m_bError = false;
+    m_qQueueTags.clear();
+}
+
+
+//*************************************************************************************************************
+
+char* FiffTagDecoder::nextTarget(qint64& p_iMaxSize)
+{
+    if(!m_pTag)
+    {
+        p_iMaxSize = sizeof(m_pHeader) - m_iHeaderBytes;
+        return m_pHeader + m_iHeaderBytes;
+    }
+
+    p_iMaxSize = m_pTag->size() - m_iDataBytes;
+    return m_pTag->data() + m_iDataBytes;
+}
+
+
+//*************************************************************************************************************
+
+bool FiffTagDecoder::advance(qint64 p_iSize)
+{
+    if(!m_pTag)
+    {
+        m_iHeaderBytes += p_iSize;
+        if(m_iHeaderBytes < (qint32)sizeof(m_pHeader))
+            return true;
+
+        //
+        // Complete header: take a recycled tag, its buffer keeps its capacity when resized
+        //
+        fiff_int_t t_iSize = qFromBigEndian<qint32>((const uchar*)m_pHeader + 8);
+        if(t_iSize < 0)
+        {
+            printf("Error in FiffTagDecoder: invalid tag size %d\n", t_iSize);
+            m_bError = true;
+            return false;
+        }
+        if(t_iSize > m_iMaxTagSize)
+        {
+            printf("Error in FiffTagDecoder: tag size %d exceeds the maximum of %d\n", t_iSize, m_iMaxTagSize);
+            m_bError = true;
+            return false;
+        }
+
+        m_pTag = m_qListPool.isEmpty() ? FiffTag::SPtr(new FiffTag()) : m_qListPool.takeLast();
+        m_pTag->kind = qFromBigEndian<qint32>((const uchar*)m_pHeader);
+        m_pTag->type = qFromBigEndian<qint32>((const uchar*)m_pHeader + 4);
+        m_pTag->next = qFromBigEndian<qint32>((const uchar*)m_pHeader + 12);
+        m_pTag->resize(t_iSize);
+
+        m_iHeaderBytes = 0;
+        m_iDataBytes = 0;
+    }
+    else
+        m_iDataBytes += p_iSize;
+
+    //
+    // Complete payload
+    //
+    if(m_iDataBytes == m_pTag->size())
+    {
+        FiffTag::convert_tag_data(m_pTag, FIFFV_BIG_ENDIAN, FIFFV_NATIVE_ENDIAN);
+        m_qQueueTags.enqueue(m_pTag);
+        m_pTag.clear();
+    }
+
+    return true;
+}
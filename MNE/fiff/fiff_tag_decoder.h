@@ -0,0 +1,221 @@
+//=============================================================================================================
+/**
+* @file     fiff_tag_decoder.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Contains the FiffTagDecoder class declaration.
+*
+*/
+
+#ifndef FIFF_TAG_DECODER_H
+#define FIFF_TAG_DECODER_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiff_global.h"
+#include "fiff_types.h"
+#include "fiff_tag.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QSharedPointer>
+#include <QQueue>
+#include <QList>
+#include <QIODevice>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE FIFFLIB
+//=============================================================================================================
+
+namespace FIFFLIB
+{
+
+//=============================================================================================================
+/**
+* Incremental decoder of a FIFF tag stream, e.g. of a socket. Bytes are fed as they arrive, in pieces of any
+* size, complete tags are queued and can be taken out. The decoder never waits for data. Tags which are not
+* needed anymore can be recycled, their payload buffers are reused for the following tags.
+*
+* @brief Push style FIFF tag decoder
+*/
+class FIFFSHARED_EXPORT FiffTagDecoder
+{
+public:
+    typedef QSharedPointer<FiffTagDecoder> SPtr;            /**< Shared pointer type for FiffTagDecoder. */
+    typedef QSharedPointer<const FiffTagDecoder> ConstSPtr; /**< Const shared pointer type for FiffTagDecoder. */
+
+    //=========================================================================================================
+    /**
+    * Constructs the decoder.
+    *
+    * @param[in] p_iPoolSize    Maximal number of recycled tags kept for reuse.
+    * @param[in] p_iMaxTagSize  Maximal accepted payload size in bytes, larger tags are treated as invalid stream.
+    */
+    FiffTagDecoder(qint32 p_iPoolSize = 8, qint32 p_iMaxTagSize = 64*1024*1024);
+
+    //=========================================================================================================
+    /**
+    * Sets the maximal accepted payload size. A header announcing a larger tag puts the decoder into the error
+    * state, instead of allocating whatever the peer asks for.
+    *
+    * @param[in] p_iMaxTagSize  Maximal payload size in bytes.
+    */
+    inline void setMaxTagSize(qint32 p_iMaxTagSize);
+
+    //=========================================================================================================
+    /**
+    * Returns the maximal accepted payload size.
+    *
+    * @return the maximal payload size in bytes
+    */
+    inline qint32 maxTagSize() const;
+
+    //=========================================================================================================
+    /**
+    * Feeds received bytes.
+    *
+    * @param[in] p_pData    The received bytes.
+    * @param[in] p_iSize    Number of bytes.
+    *
+    * @return false if the bytes are not a valid tag stream, true otherwise
+    */
+    bool feed(const char* p_pData, qint64 p_iSize);
+
+    //=========================================================================================================
+    /**
+    * Reads all bytes which are available at a device, directly into the tag being decoded. Does not wait.
+    *
+    * @param[in] p_pDevice  The device, e.g. a socket.
+    *
+    * @return the number of bytes read, -1 on a read error or if the bytes are not a valid tag stream
+    */
+    qint64 readFrom(QIODevice* p_pDevice);
+
+    //=========================================================================================================
+    /**
+    * Returns whether a complete tag is available.
+    *
+    * @return true if a tag can be taken
+    */
+    inline bool hasTag() const;
+
+    //=========================================================================================================
+    /**
+    * Takes the next complete tag. Its data are converted to the native byte order like by FiffTag::read_tag.
+    *
+    * @return the tag, a null pointer if no complete tag is available
+    */
+    FiffTag::SPtr takeTag();
+
+    //=========================================================================================================
+    /**
+    * Hands a taken tag back for reuse of its payload buffer. The tag must not be used after recycling.
+    *
+    * @param[in] p_pTag     The tag.
+    */
+    void recycle(const FiffTag::SPtr& p_pTag);
+
+    //=========================================================================================================
+    /**
+    * Discards the partially decoded tag and all queued tags, e.g. after the connection was reset.
+    */
+    void clear();
+
+private:
+    //=========================================================================================================
+    /**
+    * Returns where the next received bytes have to go, the tag header or the payload of the current tag.
+    *
+    * @param[out] p_iMaxSize    Number of bytes expected there.
+    *
+    * @return the destination of the next bytes
+    */
+    char* nextTarget(qint64& p_iMaxSize);
+
+    //=========================================================================================================
+    /**
+    * Accounts for bytes written to the target. Decodes a complete header and queues a complete tag.
+    *
+    * @param[in] p_iSize    Number of bytes written to the target.
+    *
+    * @return false if a header is invalid or announces a tag larger than the maximal tag size, true otherwise
+    */
+    bool advance(qint64 p_iSize);
+
+    char                    m_pHeader[16];      /**< Big-endian kind, type, size and next of the current tag */
+    qint32                  m_iHeaderBytes;     /**< Number of header bytes received */
+    FiffTag::SPtr           m_pTag;             /**< The tag whose payload is received, null while receiving the header */
+    qint32                  m_iDataBytes;       /**< Number of payload bytes received */
+    bool                    m_bError;           /**< An invalid header was received */
+
+    QQueue<FiffTag::SPtr>   m_qQueueTags;       /**< Complete tags */
+    QList<FiffTag::SPtr>    m_qListPool;        /**< Recycled tags */
+    qint32                  m_iPoolSize;        /**< Maximal number of recycled tags */
+    qint32                  m_iMaxTagSize;      /**< Maximal accepted payload size */
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline void FiffTagDecoder::setMaxTagSize(qint32 p_iMaxTagSize)
+{
+    m_iMaxTagSize = p_iMaxTagSize;
+}
+
+
+//*************************************************************************************************************
+
+inline qint32 FiffTagDecoder::maxTagSize() const
+{
+    return m_iMaxTagSize;
+}
+
+
+//*************************************************************************************************************
+
+inline bool FiffTagDecoder::hasTag() const
+{
+    return !m_qQueueTags.isEmpty();
+}
+
+} // NAMESPACE
+
+#endif // FIFF_TAG_DECODER_H
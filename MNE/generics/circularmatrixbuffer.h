@@ -46,6 +46,7 @@
 #include "buffer.h"
 
 #include <typeinfo>
+#include <string.h>
 
 
 //*************************************************************************************************************
@@ -99,7 +100,7 @@ public:
     //=========================================================================================================
     /**
     * Constructs a CircularMatrixBuffer.
-    * length of buffer = uiMaxNumMatrizes*rows*cols
+    * length of buffer = uiMaxNumMatrizes*rows*cols, the semaphores count whole matrices
     *
     * @param [in] uiMaxNumMatrices  length of buffer.
     * @param [in] uiRows            Number of rows.
@@ -156,22 +157,22 @@ public:
 private:
     //=========================================================================================================
     /**
-    * Returns the current circular index to the corresponding given index.
+    * Returns the first element of a matrix slot.
     *
-    * @param [in] index which should be mapped.
-    * @return the mapped index.
+    * @param [in] uiSlot    index of the slot.
+    * @return pointer to the first element of the slot.
     */
-    inline unsigned int mapIndex(int& index);
+    inline _Tp* slot(unsigned int uiSlot) const;
 
     unsigned int    m_uiMaxNumMatrices;         /**< Holds the maximal number of matrices.*/
     unsigned int    m_uiRows;                   /**< Holds the number rows.*/
     unsigned int    m_uiCols;                   /**< Holds the number cols.*/
-    unsigned int    m_uiMaxNumElements;         /**< Holds the maximal number of buffer elements.*/
+    size_t          m_uiSlotSize;               /**< Holds the number of elements of one matrix slot.*/
     _Tp*            m_pBuffer;                  /**< Holds the circular buffer.*/
-    int             m_iCurrentReadIndex;        /**< Holds the current read index.*/
-    int             m_iCurrentWriteIndex;       /**< Holds the current write index.*/
-    QSemaphore*     m_pFreeElements;            /**< Holds a semaphore which acquires free elements for thread safe writing. A semaphore is a generalization of a mutex.*/
-    QSemaphore*     m_pUsedElements;            /**< Holds a semaphore which acquires written semaphore for thread safe reading.*/
+    unsigned int    m_uiReadSlot;               /**< Holds the slot which is read next.*/
+    unsigned int    m_uiWriteSlot;              /**< Holds the slot which is written next.*/
+    QSemaphore*     m_pFreeElements;            /**< Holds a semaphore which acquires free matrix slots for thread safe writing. A semaphore is a generalization of a mutex.*/
+    QSemaphore*     m_pUsedElements;            /**< Holds a semaphore which acquires written matrix slots for thread safe reading.*/
 };
 
 
@@ -186,11 +187,11 @@ CircularMatrixBuffer<_Tp>::CircularMatrixBuffer(unsigned int uiMaxNumMatrices, u
 , m_uiMaxNumMatrices(uiMaxNumMatrices)
 , m_uiRows(uiRows)
 , m_uiCols(uiCols)
-, m_uiMaxNumElements(m_uiMaxNumMatrices*m_uiRows*m_uiCols)
-, m_pBuffer(new _Tp[m_uiMaxNumElements])
-, m_iCurrentReadIndex(-1)
-, m_iCurrentWriteIndex(-1)
-, m_pFreeElements(new QSemaphore(m_uiMaxNumElements))
+, m_uiSlotSize((size_t)m_uiRows*m_uiCols)
+, m_pBuffer(new _Tp[m_uiMaxNumMatrices*m_uiSlotSize])
+, m_uiReadSlot(0)
+, m_uiWriteSlot(0)
+, m_pFreeElements(new QSemaphore(m_uiMaxNumMatrices))
 , m_pUsedElements(new QSemaphore(0))
 {
 
@@ -213,13 +214,12 @@ CircularMatrixBuffer<_Tp>::~CircularMatrixBuffer()
 template<typename _Tp>
 inline void CircularMatrixBuffer<_Tp>::push(const Matrix<_Tp, Dynamic, Dynamic>* pMatrix)
 {
-    unsigned int t_size = pMatrix->size();
-    if(t_size == m_uiRows*m_uiCols)
+    if((size_t)pMatrix->size() == m_uiSlotSize)
     {
-        m_pFreeElements->acquire(t_size);
-        for(unsigned int i = 0; i < t_size; ++i)
-            m_pBuffer[mapIndex(m_iCurrentWriteIndex)] = pMatrix->data()[i];
-        m_pUsedElements->release(t_size);
+        m_pFreeElements->acquire();
+        memcpy(slot(m_uiWriteSlot), pMatrix->data(), m_uiSlotSize*sizeof(_Tp));
+        m_uiWriteSlot = (m_uiWriteSlot + 1) % m_uiMaxNumMatrices;
+        m_pUsedElements->release();
     }
 //    else
 //        printf("Error: Matrix not appended to CircularMatrixBuffer - wrong dimensions\n");
@@ -231,11 +231,11 @@ inline void CircularMatrixBuffer<_Tp>::push(const Matrix<_Tp, Dynamic, Dynamic>*
 template<typename _Tp>
 inline Matrix<_Tp, Dynamic, Dynamic> CircularMatrixBuffer<_Tp>::pop()
 {
-    m_pUsedElements->acquire(m_uiRows*m_uiCols);
+    m_pUsedElements->acquire();
     Matrix<_Tp, Dynamic, Dynamic> matrix(m_uiRows, m_uiCols);
-    for(quint32 i = 0; i < m_uiRows*m_uiCols; ++i)
-        matrix.data()[i] = m_pBuffer[mapIndex(m_iCurrentReadIndex)];
-    m_pFreeElements->release(m_uiRows*m_uiCols);
+    memcpy(matrix.data(), slot(m_uiReadSlot), m_uiSlotSize*sizeof(_Tp));
+    m_uiReadSlot = (m_uiReadSlot + 1) % m_uiMaxNumMatrices;
+    m_pFreeElements->release();
 
     return matrix;
 }
@@ -244,9 +244,9 @@ inline Matrix<_Tp, Dynamic, Dynamic> CircularMatrixBuffer<_Tp>::pop()
 //*************************************************************************************************************
 
 template<typename _Tp>
-inline unsigned int CircularMatrixBuffer<_Tp>::mapIndex(int& index)
+inline _Tp* CircularMatrixBuffer<_Tp>::slot(unsigned int uiSlot) const
 {
-    return index = ++index % m_uiMaxNumElements;
+    return m_pBuffer + uiSlot*m_uiSlotSize;
 }
 
 
@@ -256,12 +256,12 @@ template<typename _Tp>
 void CircularMatrixBuffer<_Tp>::clear()
 {
     delete m_pFreeElements;
-    m_pFreeElements = new QSemaphore(m_uiMaxNumElements);
+    m_pFreeElements = new QSemaphore(m_uiMaxNumMatrices);
     delete m_pUsedElements;
     m_pUsedElements = new QSemaphore(0);
 
-    m_iCurrentReadIndex = -1;
-    m_iCurrentWriteIndex = -1;
+    m_uiReadSlot = 0;
+    m_uiWriteSlot = 0;
 }
 
 
@@ -64,11 +64,13 @@ win32 {
 SOURCES += \ 
     circularbuffer.cpp \
     circularmatrixbuffer.cpp \
+    spscmatrixbuffer.cpp \
     observerpattern.cpp \
     buffer.cpp
 
 HEADERS += generics_global.h \
     circularmatrixbuffer.h \
+    spscmatrixbuffer.h \
     circularbuffer.h \
     observerpattern.h \
     commandpattern.h \
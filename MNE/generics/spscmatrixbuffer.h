@@ -0,0 +1,463 @@
+//=============================================================================================================
+/**
+* @file     spscmatrixbuffer.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Contains the declaration of the SpscMatrixBuffer class.
+*
+*/
+
+#ifndef SPSCMATRIXBUFFER_H
+#define SPSCMATRIXBUFFER_H
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "generics_global.h"
+#include "buffer.h"
+
+#include <string.h>
+#include <typeinfo>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QThread>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE IOBuffer
+//=============================================================================================================
+
+namespace IOBuffer
+{
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+
+
+//=============================================================================================================
+/**
+* Single producer/single consumer ring of matrix slots. Each slot holds one rows x cols matrix in column major
+* order, so a matrix is transferred with one memcpy, or without copying at all through the acquire/commit
+* functions. Synchronisation is done with two atomic counters only; blocking calls spin, yield and finally
+* sleep while waiting. Exactly one thread may write and exactly one thread may read at a time.
+*
+* @brief Lock-free single producer/single consumer matrix buffer
+*/
+template<typename _Tp>
+class SpscMatrixBuffer : public Buffer
+{
+public:
+    typedef QSharedPointer<SpscMatrixBuffer> SPtr;              /**< Shared pointer type for SpscMatrixBuffer. */
+    typedef QSharedPointer<const SpscMatrixBuffer> ConstSPtr;   /**< Const shared pointer type for SpscMatrixBuffer. */
+
+    //=========================================================================================================
+    /**
+    * Constructs a SpscMatrixBuffer.
+    * @param [in] uiNumSlots    Number of matrices the buffer can hold.
+    * @param [in] uiRows        Number of rows.
+    * @param [in] uiCols        Number of columns.
+    */
+    explicit SpscMatrixBuffer(quint32 uiNumSlots, quint32 uiRows, quint32 uiCols);
+
+    //=========================================================================================================
+    /**
+    * Destroys the SpscMatrixBuffer.
+    */
+    ~SpscMatrixBuffer();
+
+    //=========================================================================================================
+    /**
+    * Copies a whole matrix into the next free slot. Producer side.
+    * @param [in] pMatrix   pointer to the matrix which should be appended, has to be of size rows x cols.
+    * @param [in] bBlock    whether to wait for a free slot, otherwise false is returned when the buffer is full.
+    * @return true if the matrix was appended, false otherwise.
+    */
+    inline bool push(const Matrix<_Tp, Dynamic, Dynamic>* pMatrix, bool bBlock = true);
+
+    //=========================================================================================================
+    /**
+    * Copies the oldest matrix out of the buffer. Consumer side.
+    * @param [out] matrix   the popped matrix.
+    * @param [in] bBlock    whether to wait for a matrix, otherwise false is returned when the buffer is empty.
+    * @return true if a matrix was popped, false otherwise.
+    */
+    inline bool pop(Matrix<_Tp, Dynamic, Dynamic>& matrix, bool bBlock = true);
+
+    //=========================================================================================================
+    /**
+    * Returns the oldest matrix, waits until one is available (same semantics as CircularMatrixBuffer::pop).
+    * Returns an empty matrix when the buffer was aborted.
+    * @return the first matrix
+    */
+    inline Matrix<_Tp, Dynamic, Dynamic> pop();
+
+    //=========================================================================================================
+    /**
+    * Returns the next free slot for writing in place. Producer side. The slot is published by commitWriteSlot.
+    * @param [in] bBlock    whether to wait for a free slot.
+    * @return map of the slot, with NULL data if no slot is available.
+    */
+    inline Map<Matrix<_Tp, Dynamic, Dynamic> > acquireWriteSlot(bool bBlock = true);
+
+    //=========================================================================================================
+    /**
+    * Publishes the slot returned by acquireWriteSlot to the consumer.
+    */
+    inline void commitWriteSlot();
+
+    //=========================================================================================================
+    /**
+    * Returns the oldest matrix for reading in place. Consumer side. The slot is released by releaseReadSlot.
+    * @param [in] bBlock    whether to wait for a matrix.
+    * @return map of the slot, with NULL data if no matrix is available.
+    */
+    inline Map<const Matrix<_Tp, Dynamic, Dynamic> > acquireReadSlot(bool bBlock = true);
+
+    //=========================================================================================================
+    /**
+    * Hands the slot returned by acquireReadSlot back to the producer.
+    */
+    inline void releaseReadSlot();
+
+    //=========================================================================================================
+    /**
+    * Wakes up and fails all waiting and following blocking calls, e.g. to stop the threads using the buffer.
+    */
+    inline void abort();
+
+    //=========================================================================================================
+    /**
+    * Clears the buffer and resets the abort state. Must not be called while producer or consumer are active.
+    */
+    void clear();
+
+    //=========================================================================================================
+    /**
+    * Number of matrices currently stored.
+    */
+    inline quint32 count() const;
+
+    //=========================================================================================================
+    /**
+    * Size of the buffer.
+    */
+    inline quint32 size() const;
+
+    //=========================================================================================================
+    /**
+    * Rows of the stored matrices of the buffer.
+    */
+    inline quint32 rows() const;
+
+    //=========================================================================================================
+    /**
+    * Cols of the stored matrices of the buffer.
+    */
+    inline quint32 cols() const;
+
+private:
+    //=========================================================================================================
+    /**
+    * Waits until the given slot condition is met.
+    * @param [in] bForWrite whether to wait for a free slot (producer) or for a stored matrix (consumer).
+    * @param [in] bBlock    whether to wait at all.
+    * @return true if the condition is met, false if not blocking or aborted.
+    */
+    inline bool wait(bool bForWrite, bool bBlock);
+
+    //=========================================================================================================
+    /**
+    * Pointer to the slot with the given index.
+    */
+    inline _Tp* slot(quint32 uiSlot) const;
+
+    quint32     m_uiNumSlots;           /**< Holds the number of slots.*/
+    quint32     m_uiRows;               /**< Holds the number rows.*/
+    quint32     m_uiCols;               /**< Holds the number cols.*/
+    quint32     m_uiSlotSize;           /**< Holds the number of elements of one slot.*/
+    _Tp*        m_pBuffer;              /**< Holds the slots.*/
+    QAtomicInt  m_iAborted;             /**< Holds whether blocking calls are aborted.*/
+    char        m_cPad0[64];            /**< Keeps the counters on separate cache lines.*/
+    QAtomicInt  m_iWriteCounter;        /**< Number of committed matrices, only written by the producer.*/
+    quint32     m_uiWriteSlot;          /**< Slot the producer writes next, only used by the producer.*/
+    char        m_cPad1[64];            /**< Keeps the counters on separate cache lines.*/
+    QAtomicInt  m_iReadCounter;         /**< Number of released matrices, only written by the consumer.*/
+    quint32     m_uiReadSlot;           /**< Slot the consumer reads next, only used by the consumer.*/
+    char        m_cPad2[64];            /**< Keeps the counters on separate cache lines.*/
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+template<typename _Tp>
+SpscMatrixBuffer<_Tp>::SpscMatrixBuffer(quint32 uiNumSlots, quint32 uiRows, quint32 uiCols)
+: Buffer(typeid(_Tp).name())
+, m_uiNumSlots(uiNumSlots > 0 ? uiNumSlots : 1)
+, m_uiRows(uiRows)
+, m_uiCols(uiCols)
+, m_uiSlotSize(uiRows*uiCols)
+, m_pBuffer(new _Tp[(size_t)m_uiNumSlots*m_uiSlotSize])
+, m_iAborted(0)
+, m_iWriteCounter(0)
+, m_uiWriteSlot(0)
+, m_iReadCounter(0)
+, m_uiReadSlot(0)
+{
+
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+SpscMatrixBuffer<_Tp>::~SpscMatrixBuffer()
+{
+    delete [] m_pBuffer;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline bool SpscMatrixBuffer<_Tp>::push(const Matrix<_Tp, Dynamic, Dynamic>* pMatrix, bool bBlock)
+{
+    if((quint32)pMatrix->size() != m_uiSlotSize || !wait(true, bBlock))
+        return false;
+
+    memcpy(slot(m_uiWriteSlot), pMatrix->data(), m_uiSlotSize*sizeof(_Tp));
+    commitWriteSlot();
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline bool SpscMatrixBuffer<_Tp>::pop(Matrix<_Tp, Dynamic, Dynamic>& matrix, bool bBlock)
+{
+    if(!wait(false, bBlock))
+        return false;
+
+    matrix.resize(m_uiRows, m_uiCols);
+    memcpy(matrix.data(), slot(m_uiReadSlot), m_uiSlotSize*sizeof(_Tp));
+    releaseReadSlot();
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline Matrix<_Tp, Dynamic, Dynamic> SpscMatrixBuffer<_Tp>::pop()
+{
+    Matrix<_Tp, Dynamic, Dynamic> matrix;
+    pop(matrix, true);
+    return matrix;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline Map<Matrix<_Tp, Dynamic, Dynamic> > SpscMatrixBuffer<_Tp>::acquireWriteSlot(bool bBlock)
+{
+    if(!wait(true, bBlock))
+        return Map<Matrix<_Tp, Dynamic, Dynamic> >(NULL, m_uiRows, m_uiCols);
+
+    return Map<Matrix<_Tp, Dynamic, Dynamic> >(slot(m_uiWriteSlot), m_uiRows, m_uiCols);
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline void SpscMatrixBuffer<_Tp>::commitWriteSlot()
+{
+    m_uiWriteSlot = m_uiWriteSlot + 1 < m_uiNumSlots ? m_uiWriteSlot + 1 : 0;
+    m_iWriteCounter.fetchAndAddRelease(1);
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline Map<const Matrix<_Tp, Dynamic, Dynamic> > SpscMatrixBuffer<_Tp>::acquireReadSlot(bool bBlock)
+{
+    if(!wait(false, bBlock))
+        return Map<const Matrix<_Tp, Dynamic, Dynamic> >(NULL, m_uiRows, m_uiCols);
+
+    return Map<const Matrix<_Tp, Dynamic, Dynamic> >(slot(m_uiReadSlot), m_uiRows, m_uiCols);
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline void SpscMatrixBuffer<_Tp>::releaseReadSlot()
+{
+    m_uiReadSlot = m_uiReadSlot + 1 < m_uiNumSlots ? m_uiReadSlot + 1 : 0;
+    m_iReadCounter.fetchAndAddRelease(1);
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline void SpscMatrixBuffer<_Tp>::abort()
+{
+    m_iAborted.storeRelease(1);
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+void SpscMatrixBuffer<_Tp>::clear()
+{
+    m_uiWriteSlot = 0;
+    m_uiReadSlot = 0;
+    m_iWriteCounter.storeRelease(0);
+    m_iReadCounter.storeRelease(0);
+    m_iAborted.storeRelease(0);
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline quint32 SpscMatrixBuffer<_Tp>::count() const
+{
+    return (quint32)m_iWriteCounter.loadAcquire() - (quint32)m_iReadCounter.loadAcquire();
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline quint32 SpscMatrixBuffer<_Tp>::size() const
+{
+    return m_uiNumSlots;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline quint32 SpscMatrixBuffer<_Tp>::rows() const
+{
+    return m_uiRows;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline quint32 SpscMatrixBuffer<_Tp>::cols() const
+{
+    return m_uiCols;
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline bool SpscMatrixBuffer<_Tp>::wait(bool bForWrite, bool bBlock)
+{
+    //
+    //   Each side owns its counter, only the counter of the other side has to be loaded with acquire semantics
+    //
+    for(quint32 t_uiSpin = 0; ; ++t_uiSpin)
+    {
+        quint32 t_uiUsed = bForWrite ? (quint32)m_iWriteCounter.load() - (quint32)m_iReadCounter.loadAcquire()
+                                     : (quint32)m_iWriteCounter.loadAcquire() - (quint32)m_iReadCounter.load();
+        if(bForWrite ? t_uiUsed < m_uiNumSlots : t_uiUsed > 0)
+            return true;
+
+        if(!bBlock || m_iAborted.loadAcquire())
+            return false;
+
+        if(t_uiSpin < 64)
+            continue;
+        else if(t_uiSpin < 128)
+            QThread::yieldCurrentThread();
+        else
+            QThread::usleep(50);
+    }
+}
+
+
+//*************************************************************************************************************
+
+template<typename _Tp>
+inline _Tp* SpscMatrixBuffer<_Tp>::slot(quint32 uiSlot) const
+{
+    return m_pBuffer + (size_t)uiSlot*m_uiSlotSize;
+}
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// TYPEDEF
+//=============================================================================================================
+
+typedef GENERICSSHARED_EXPORT SpscMatrixBuffer<float>   _float_SpscMatrixBuffer;    /**< Defines SpscMatrixBuffer of float type.*/
+typedef GENERICSSHARED_EXPORT SpscMatrixBuffer<double>  _double_SpscMatrixBuffer;   /**< Defines SpscMatrixBuffer of double type.*/
+
+} // NAMESPACE
+
+#endif // SPSCMATRIXBUFFER_H
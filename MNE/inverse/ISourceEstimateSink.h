@@ -1,10 +1,10 @@
 //=============================================================================================================
 /**
-* @file     fiffstreamthread.h
+* @file     ISourceEstimateSink.h
 * @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
 *           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
 * @version  1.0
-* @date     July, 2012
+* @date     April, 2013
 *
 * @section  LICENSE
 *
@@ -29,111 +29,75 @@
 * POSSIBILITY OF SUCH DAMAGE.
 *
 *
-* @brief     implementation of the FiffStreamThread Class.
+* @brief    Contains declaration of ISourceEstimateSink interface class.
 *
 */
 
-#ifndef FIFFSTREAMTHREAD_H
-#define FIFFSTREAMTHREAD_H
+#ifndef ISOURCEESTIMATESINK_H
+#define ISOURCEESTIMATESINK_H
 
 //*************************************************************************************************************
 //=============================================================================================================
 // INCLUDES
 //=============================================================================================================
 
-#include <fiff/fiff_stream.h>
-#include <fiff/fiff_info.h>
-
-
-//*************************************************************************************************************
-//=============================================================================================================
-// QT INCLUDES
-//=============================================================================================================
-
-#include <QThread>
-#include <QTcpSocket>
-#include <QMutex>
 #include <QSharedPointer>
 
 
 //*************************************************************************************************************
 //=============================================================================================================
-// DEFINE NAMESPACE RTSERVER
+// DEFINE NAMESPACE INVERSE
 //=============================================================================================================
 
-namespace RTSERVER
+namespace INVERSELIB
 {
 
 //*************************************************************************************************************
 //=============================================================================================================
-// USED NAMESPACES
+// FORWARD DECLARATIONS
 //=============================================================================================================
 
-using namespace FIFFLIB;
+class SourceEstimate;
 
 
-//*************************************************************************************************************
-//=============================================================================================================
-// FORWARD DECLARATIONS
 //=============================================================================================================
-
-class FiffStreamThread : public QThread
+/**
+* Receives the source estimate of a streamed inverse computation chunk by chunk, e.g. writes it to disk or
+* reduces it. Chunks are passed in time order from a single thread.
+*
+* @brief Source estimate sink interface
+*/
+class ISourceEstimateSink
 {
-    Q_OBJECT
 public:
-    FiffStreamThread(qint32 id, int socketDescriptor, QObject *parent);
-
-    ~FiffStreamThread();
-
-    void run();
-
-    inline qint32 getID();
-
-    inline QString getAlias();
-
-//    void deactivateRawBufferSending();
-
-
-    void parseCommand(QSharedPointer<FiffTag> p_pTag);
-
-    void writeClientId();
-
-signals:
-    void error(QTcpSocket::SocketError socketError);
-
-private:
-    qint32 m_iDataClientId;
-    QString m_sDataClientAlias;
-
-    int m_iSocketDescriptor;
-
-    QMutex m_qMutex;
-    QByteArray m_qSendBlock;
-
-    bool m_bIsSendingRawBuffer;
-
-    bool m_bIsRunning;
-
-//private slots: --> in Qt 5 not anymore declared as slot
-    void startMeas(qint32 ID);
-    void stopMeas(qint32 ID);
-    void sendMeasurementInfo(qint32 ID, FiffInfo p_fiffInfo);
-    void sendRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRawData);
+    typedef QSharedPointer<ISourceEstimateSink> SPtr;             /**< Shared pointer type for ISourceEstimateSink. */
+    typedef QSharedPointer<const ISourceEstimateSink> ConstSPtr;  /**< Const shared pointer type for ISourceEstimateSink. */
+
+    //=========================================================================================================
+    /**
+    * Destroys the ISourceEstimateSink.
+    */
+    virtual ~ISourceEstimateSink() {}
+
+    //=========================================================================================================
+    /**
+    * Consumes the next chunk of the source estimate.
+    *
+    * @param[in] p_sourceEstimateChunk  Source estimate of the next samples.
+    *
+    * @return true if succeeded, false to abort the computation
+    */
+    virtual bool write(const SourceEstimate &p_sourceEstimateChunk) = 0;
+
+    //=========================================================================================================
+    /**
+    * Called after the last chunk, also when the computation was aborted.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    virtual bool finish() = 0;
 };
 
+} //NAMESPACE
 
-inline qint32 FiffStreamThread::getID()
-{
-    return m_iDataClientId;
-}
-
-
-inline QString FiffStreamThread::getAlias()
-{
-    return m_sDataClientAlias;
-}
-
-
-} // NAMESPACE
-
-#endif //FIFFSTREAMTHREAD_H
+#endif // ISOURCEESTIMATESINK_H
@@ -38,6 +38,7 @@ include(../../mne-cpp.pri)
 TEMPLATE = lib
 
 QT       -= gui
+QT       += concurrent
 
 DEFINES += INVERSE_LIBRARY
 
@@ -81,14 +82,21 @@ win32 {
 SOURCES += \
     sourceestimate.cpp \
     minimumNorm/minimumnorm.cpp \
-    rapMusic/rapmusic.cpp
+    rapMusic/rapmusic.cpp \
+    sinks/stcfilesink.cpp \
+    sinks/labeltimecoursesink.cpp \
+    sinks/callbacksink.cpp
 
 HEADERS +=\
     inverse_global.h \
     IInverseAlgorithm.h \
+    ISourceEstimateSink.h \
     sourceestimate.h \
     minimumNorm/minimumnorm.h \
-    rapMusic/rapmusic.h
+    rapMusic/rapmusic.h \
+    sinks/stcfilesink.h \
+    sinks/labeltimecoursesink.h \
+    sinks/callbacksink.h
 
 INCLUDEPATH += $${EIGEN_INCLUDE_DIR}
 INCLUDEPATH += $${MNE_INCLUDE_DIR}
@@ -103,6 +111,10 @@ header_files_minimum_norm.path = $${MNE_INCLUDE_DIR}/inverse/minimumNorm
 header_files_rap_music.files = ./rapMusic/*.h
 header_files_rap_music.path = $${MNE_INCLUDE_DIR}/inverse/rapMusic
 
+header_files_sinks.files = ./sinks/*.h
+header_files_sinks.path = $${MNE_INCLUDE_DIR}/inverse/sinks
+
 INSTALLS += header_files
 INSTALLS += header_files_minimum_norm
 INSTALLS += header_files_rap_music
+INSTALLS += header_files_sinks
@@ -40,6 +40,7 @@
 
 #include "minimumnorm.h"
 #include "../sourceestimate.h"
+#include "../ISourceEstimateSink.h"
 
 #include <fiff/fiff_evoked.h>
 #include <fs/label.h>
@@ -51,6 +52,17 @@
 //=============================================================================================================
 
 #include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrent>
 
 
 //*************************************************************************************************************
@@ -64,6 +76,85 @@ using namespace MNELIB;
 using namespace INVERSELIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE LOCAL TYPES
+//=============================================================================================================
+
+namespace
+{
+
+//=============================================================================================================
+/**
+* Applies an imaging kernel to picked data and pools the orientations if required.
+*
+* @param[in] kernel     The imaging kernel.
+* @param[in] combineXyz Whether the three orientations are pooled.
+* @param[in] noiseNorm  Noise normalization applied after pooling, empty if none.
+* @param[in] vertices   Source vertices of the kernel.
+* @param[in] picked     Picked data block.
+* @param[in] tmin       Time of the first sample in seconds.
+* @param[in] tstep      Time between two samples in seconds.
+*
+* @return the calculated source estimation
+*/
+SourceEstimate applyImagingKernel(const MatrixXd &kernel, bool combineXyz, const VectorXd &noiseNorm, const QList<VectorXi> &vertices, const MatrixXd &picked, float tmin, float tstep)
+{
+    MatrixXd sol;
+    if (combineXyz)
+        sol = MNEMath::combine_xyz_norm(kernel, picked, noiseNorm); //apply imaging kernel, pool and normalize
+    else
+        sol = kernel * picked; //apply imaging kernel
+
+    return SourceEstimate(sol, vertices, tmin, tstep);
+}
+
+
+//=============================================================================================================
+/**
+* Picked raw data chunk.
+*/
+struct RawChunk
+{
+    MatrixXd data;  /**< Picked data (channels x samples) */
+    float tmin;     /**< Time of the first sample */
+};
+
+
+//=============================================================================================================
+/**
+* Functor applying the imaging kernel to a raw data chunk, used with QtConcurrent::mapped.
+*/
+class ApplyRawChunk
+{
+public:
+    typedef SourceEstimate result_type;
+
+    ApplyRawChunk(const MatrixXd &kernel, bool combineXyz, const VectorXd &noiseNorm, const QList<VectorXi> &vertices, float tstep)
+    : m_matKernel(kernel)
+    , m_bCombineXyz(combineXyz)
+    , m_vecNoiseNorm(noiseNorm)
+    , m_qListVertices(vertices)
+    , m_fTStep(tstep)
+    {
+    }
+
+    SourceEstimate operator()(const RawChunk &chunk) const
+    {
+        return applyImagingKernel(m_matKernel, m_bCombineXyz, m_vecNoiseNorm, m_qListVertices, chunk.data, chunk.tmin, m_fTStep);
+    }
+
+private:
+    const MatrixXd &m_matKernel;                /**< The imaging kernel */
+    bool m_bCombineXyz;                         /**< Whether the three orientations are pooled */
+    const VectorXd &m_vecNoiseNorm;             /**< Noise normalization applied after pooling, empty if none */
+    const QList<VectorXi> &m_qListVertices;     /**< Source vertices of the kernel */
+    float m_fTStep;                             /**< Time between two samples */
+};
+
+} // NAMESPACE
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -71,6 +162,10 @@ using namespace INVERSELIB;
 
 MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lambda, const QString method)
 : m_inverseOperator(p_inverseOperator)
+, m_bKernelValid(false)
+, m_iKernelNave(-1)
+, m_bKernelPickNormal(false)
+, m_bKernelCombineXyz(false)
 {
     this->setRegularization(lambda);
     this->setMethod(method);
@@ -80,6 +175,10 @@ MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lamb
 
 MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lambda, bool dSPM, bool sLORETA)
 : m_inverseOperator(p_inverseOperator)
+, m_bKernelValid(false)
+, m_iKernelNave(-1)
+, m_bKernelPickNormal(false)
+, m_bKernelCombineXyz(false)
 {
     this->setRegularization(lambda);
     this->setMethod(dSPM, sLORETA);
@@ -90,68 +189,362 @@ MinimumNorm::MinimumNorm(const MNEInverseOperator &p_inverseOperator, float lamb
 
 SourceEstimate MinimumNorm::calculateInverse(const FiffEvoked &p_fiffEvoked, bool pick_normal) const
 {
+    QMutexLocker locker(&m_qMutex);
+
     //
-    //   Set up the inverse according to the parameters
+    //   Set up the inverse according to the parameters, reuses the kernel of the previous call if possible
     //
-    qint32 nave = p_fiffEvoked.nave;
+    if(!prepareKernel(p_fiffEvoked.info, p_fiffEvoked.nave, pick_normal))
+        return SourceEstimate();
 
-    if(!m_inverseOperator.check_ch_names(p_fiffEvoked.info))
+    //Results
+    float tmin = ((float)p_fiffEvoked.first) / p_fiffEvoked.info.sfreq;
+    float tstep = 1/p_fiffEvoked.info.sfreq;
+
+    return applyKernel(p_fiffEvoked.data, true, tmin, tstep);
+}
+
+
+//*************************************************************************************************************
+
+SourceEstimate MinimumNorm::calculateInverse(const MatrixXd &data, float tmin, float tstep) const
+{
+    QMutexLocker locker(&m_qMutex);
+
+    if(!m_bKernelValid)
     {
-        qWarning("Channel name check failed.");
+        qWarning("MinimumNorm::calculateInverse - inverse not set up, call doInverseSetup first.");
         return SourceEstimate();
     }
 
+    return applyKernel(data, false, tmin, tstep);
+}
+
+
+//*************************************************************************************************************
+
+QList<SourceEstimate> MinimumNorm::calculateInverse(const MatrixXd &data, float tmin, float tstep, const QList<Label> &labels) const
+{
+    QMutexLocker locker(&m_qMutex);
+
+    QList<SourceEstimate> p_qListSourceEstimates;
+
+    if(!m_bKernelValid)
+    {
+        qWarning("MinimumNorm::calculateInverse - inverse not set up, call doInverseSetup first.");
+        return p_qListSourceEstimates;
+    }
+
+    if(!prepareLabelKernels(labels))
+        return p_qListSourceEstimates;
+
+    MatrixXd t_matPicked;
+    if(!pickData(data, false, t_matPicked))
+        return p_qListSourceEstimates;
+    const MatrixXd &t_matData = t_matPicked.size() > 0 ? t_matPicked : data;
+
+    for(qint32 l = 0; l < labels.size(); ++l)
+    {
+        const LabelKernel &t_labelKernel = m_qHashLabelKernels[labelKey(labels[l])];
+        p_qListSourceEstimates.push_back(applyImagingKernel(t_labelKernel.kernel, m_bKernelCombineXyz, t_labelKernel.noiseNorm, t_labelKernel.vertices, t_matData, tmin, tstep));
+    }
+
+    return p_qListSourceEstimates;
+}
+
+
+//*************************************************************************************************************
+
+bool MinimumNorm::calculateInverse(FiffRawData &p_raw, ISourceEstimateSink &p_sink, fiff_int_t from, fiff_int_t to, qint32 chunkSize, bool pick_normal) const
+{
+    QMutexLocker locker(&m_qMutex);
+
+    if(!prepareKernel(p_raw.info, 1, pick_normal))
+        return false;
+
+    if(from < 0)
+        from = p_raw.first_samp;
+    if(to < 0)
+        to = p_raw.last_samp;
+    if(from < p_raw.first_samp || to > p_raw.last_samp || from > to || chunkSize < 1)
+    {
+        qWarning("MinimumNorm::calculateInverse - invalid sample range or chunk size.");
+        return false;
+    }
+
+    float tstep = 1/p_raw.info.sfreq;
+    qint32 t_iBatchSize = qMax(1, QThread::idealThreadCount());
+
+    ApplyRawChunk t_applyRawChunk(m_matKernel, m_bKernelCombineXyz, m_vecKernelNoiseNorm, m_qListKernelVertices, tstep);
+
+    //
+    //   Read the next batch while the previous one is processed
+    //
+    QList<RawChunk> t_qListRunning;
+    QList<RawChunk> t_qListNext;
+    QFuture<SourceEstimate> t_future;
+    bool t_bRunning = false;
+    bool t_bSuccess = true;
+
+    p_raw.seek_raw(from);
+    fiff_int_t t_iSample = from;
+
+    printf("Applying inverse to samples %d to %d in chunks of %d samples...", from, to, chunkSize);
+
+    while(true)
+    {
+        t_qListNext.clear();
+        while(t_bSuccess && t_qListNext.size() < t_iBatchSize && t_iSample <= to)
+        {
+            RawChunk t_chunk;
+            MatrixXd t_matTimes;
+            fiff_int_t t_iNumSamples = qMin(chunkSize, to - t_iSample + 1);
+            if(!p_raw.read_raw_next(t_chunk.data, t_matTimes, t_iNumSamples, m_vecKernelSel))
+            {
+                qWarning("MinimumNorm::calculateInverse - could not read samples %d to %d.", t_iSample, t_iSample + t_iNumSamples - 1);
+                t_bSuccess = false;
+                break;
+            }
+            t_chunk.tmin = (float)t_matTimes(0,0);
+            t_qListNext.push_back(t_chunk);
+            t_iSample += t_iNumSamples;
+        }
+
+        if(t_bRunning)
+        {
+            t_future.waitForFinished();
+            for(qint32 i = 0; i < t_future.resultCount() && t_bSuccess; ++i)
+                t_bSuccess = p_sink.write(t_future.resultAt(i));
+            t_bRunning = false;
+        }
+
+        if(!t_bSuccess || t_qListNext.isEmpty())
+            break;
+
+        t_qListRunning.swap(t_qListNext);
+        t_future = QtConcurrent::mapped(t_qListRunning.constBegin(), t_qListRunning.constEnd(), t_applyRawChunk);
+        t_bRunning = true;
+    }
+
+    if(!p_sink.finish())
+        t_bSuccess = false;
+
+    printf(t_bSuccess ? "[done]\n" : "[failed]\n");
+
+    return t_bSuccess;
+}
+
+
+//*************************************************************************************************************
+
+bool MinimumNorm::doInverseSetup(const FiffInfo &p_info, qint32 nave, bool pick_normal)
+{
+    QMutexLocker locker(&m_qMutex);
+    return prepareKernel(p_info, nave, pick_normal);
+}
+
+
+//*************************************************************************************************************
+
+MatrixXd MinimumNorm::getKernel() const
+{
+    QMutexLocker locker(&m_qMutex);
+    return m_bKernelValid ? m_matKernel : MatrixXd();
+}
+
+
+//*************************************************************************************************************
+
+bool MinimumNorm::prepareKernel(const FiffInfo &p_info, qint32 nave, bool pick_normal) const
+{
+    if(m_bKernelValid && m_iKernelNave == nave && m_bKernelPickNormal == pick_normal && m_qListKernelChNames == p_info.ch_names)
+        return true;
+
+    m_bKernelValid = false;
+    m_qHashLabelKernels.clear();
+
+    if(!m_inverseOperator.check_ch_names(p_info))
+    {
+        qWarning("Channel name check failed.");
+        return false;
+    }
+
     MNEInverseOperator inv = m_inverseOperator.prepare_inverse_operator(nave, m_fLambda, m_bdSPM, m_bsLORETA);
     //
     //   Pick the correct channels from the data
     //
-    FiffEvoked t_fiffEvoked = p_fiffEvoked.pick_channels(inv.noise_cov->names);
+    m_vecKernelSel = FiffInfo::pick_channels(p_info.ch_names, inv.noise_cov->names);
 
-    printf("Picked %d channels from the data\n",t_fiffEvoked.info.nchan);
-    printf("Computing inverse...");
+    printf("Picked %d channels from the data\n", (qint32)m_vecKernelSel.cols());
+    printf("Assembling imaging kernel...");
 
-    MatrixXd K;
     SparseMatrix<double> noise_norm;
     QList<VectorXi> vertno;
     Label label;
-    inv.assemble_kernel(label, m_sMethod, pick_normal, K, noise_norm, vertno);
-    MatrixXd sol = K * t_fiffEvoked.data; //apply imaging kernel
+    if(!inv.assemble_kernel(label, m_sMethod, pick_normal, m_matKernel, noise_norm, vertno))
+        return false;
 
-    if (inv.source_ori == FIFFV_MNE_FREE_ORI)
+    if(m_matKernel.cols() != m_vecKernelSel.cols())
     {
-        printf("combining the current components...");
-        MatrixXd sol1(sol.rows()/3,sol.cols());
-        for(qint32 i = 0; i < sol.cols(); ++i)
+        printf("kernel and channel selection do not match\n");
+        return false;
+    }
+
+    //
+    //   With pick_normal there is a single component per source left
+    //
+    m_bKernelCombineXyz = inv.source_ori == FIFFV_MNE_FREE_ORI && !pick_normal;
+    qint32 nsrc = m_bKernelCombineXyz ? m_matKernel.rows()/3 : m_matKernel.rows();
+
+    m_vecKernelNoiseNorm = VectorXd();
+    if (m_bdSPM || m_bsLORETA)
+    {
+        if(inv.noisenorm.rows() != nsrc)
+            printf("(noise normalization does not match the kernel, skipped)...");
+        else
         {
-            VectorXd* tmp = MNEMath::combine_xyz(sol.block(0,i,sol.rows(),1));
-            sol1.block(0,i,sol.rows()/3,1) = tmp->cwiseSqrt();
-            delete tmp;
+            VectorXd t_vecNoiseNorm = VectorXd::Zero(nsrc);
+            for (qint32 k = 0; k < inv.noisenorm.outerSize(); ++k)
+                for (SparseMatrix<double>::InnerIterator it(inv.noisenorm,k); it; ++it)
+                    if(it.row() == it.col())
+                        t_vecNoiseNorm[it.row()] = it.value();
+
+            //
+            //   Fixed orientations: the normalization is linear, fold it into the kernel
+            //
+            if(m_bKernelCombineXyz)
+                m_vecKernelNoiseNorm = t_vecNoiseNorm;
+            else
+                m_matKernel = t_vecNoiseNorm.asDiagonal() * m_matKernel;
         }
-        sol.resize(sol1.rows(),sol1.cols());
-        sol = sol1;
     }
 
-    if (m_bdSPM)
+    m_qListKernelVertices.clear();
+    for(qint32 h = 0; h < inv.src.size(); ++h)
+        m_qListKernelVertices.push_back(inv.src[h].vertno);
+
+    m_invKernel = inv;
+    m_iKernelNave = nave;
+    m_bKernelPickNormal = pick_normal;
+    m_qListKernelChNames = p_info.ch_names;
+    m_bKernelValid = true;
+
+    printf("[done]\n");
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MinimumNorm::prepareLabelKernels(const QList<Label> &labels) const
+{
+    //
+    //   Collect the labels which are not cached yet, every label only once
+    //
+    QList<Label> t_qListMissing;
+    QStringList t_qListMissingKeys;
+    for(qint32 l = 0; l < labels.size(); ++l)
     {
-        printf("(dSPM)...");
-        sol = inv.noisenorm*sol;
+        QString t_sKey = labelKey(labels[l]);
+        if(t_qListMissingKeys.contains(t_sKey))
+            continue;
+
+        QHash<QString, LabelKernel>::const_iterator it = m_qHashLabelKernels.constFind(t_sKey);
+        if(it != m_qHashLabelKernels.constEnd() && it.value().labelVertices == labels[l].vertices)
+            continue;
+
+        t_qListMissing.push_back(labels[l]);
+        t_qListMissingKeys.push_back(t_sKey);
     }
-    else if (m_bsLORETA)
+
+    if(t_qListMissing.isEmpty())
+        return true;
+
+    printf("Assembling %d label kernels...", t_qListMissing.size());
+
+    QList<MatrixXd> t_qListK;
+    QList< SparseMatrix<double> > t_qListNoiseNorm;
+    QList< QList<VectorXi> > t_qListVertno;
+    if(!m_invKernel.assemble_kernels(t_qListMissing, m_sMethod, m_bKernelPickNormal, t_qListK, t_qListNoiseNorm, t_qListVertno))
+        return false;
+
+    for(qint32 l = 0; l < t_qListMissing.size(); ++l)
     {
-        printf("(sLORETA)...");
-        sol = inv.noisenorm*sol;
+        LabelKernel t_labelKernel;
+        t_labelKernel.labelVertices = t_qListMissing[l].vertices;
+        t_labelKernel.kernel = t_qListK[l];
+        t_labelKernel.vertices = t_qListVertno[l];
+
+        //
+        //   Same treatment of the noise normalization as for the full kernel
+        //
+        if ((m_bdSPM || m_bsLORETA) && t_qListNoiseNorm[l].rows() > 0)
+        {
+            VectorXd t_vecNoiseNorm = t_qListNoiseNorm[l].diagonal();
+            if(m_bKernelCombineXyz)
+                t_labelKernel.noiseNorm = t_vecNoiseNorm;
+            else
+                t_labelKernel.kernel = t_vecNoiseNorm.asDiagonal() * t_labelKernel.kernel;
+        }
+
+        m_qHashLabelKernels.insert(t_qListMissingKeys[l], t_labelKernel);
     }
+
     printf("[done]\n");
 
-    //Results
-    float tmin = ((float)t_fiffEvoked.first) / t_fiffEvoked.info.sfreq;
-    float tstep = 1/t_fiffEvoked.info.sfreq;
+    return true;
+}
 
-    QList<VectorXi> t_qListVertices;
-    for(qint32 h = 0; h < inv.src.size(); ++h)
-        t_qListVertices.push_back(inv.src[h].vertno);
 
-    return SourceEstimate(sol, t_qListVertices, tmin, tstep);
+//*************************************************************************************************************
+
+bool MinimumNorm::pickData(const MatrixXd &data, bool p_bInfoOrder, MatrixXd &picked) const
+{
+    picked = MatrixXd();
+
+    if(!p_bInfoOrder && data.rows() == m_matKernel.cols())
+        return true;
+    else if(data.rows() == m_qListKernelChNames.size())
+    {
+        picked.resize(m_vecKernelSel.cols(), data.cols());
+        for(qint32 i = 0; i < m_vecKernelSel.cols(); ++i)
+            picked.row(i) = data.row(m_vecKernelSel[i]);
+        return true;
+    }
+
+    qWarning("MinimumNorm::calculateInverse - data does not match the prepared channels.");
+    return false;
+}
+
+
+//*************************************************************************************************************
+
+SourceEstimate MinimumNorm::applyKernel(const MatrixXd &data, bool p_bInfoOrder, float tmin, float tstep) const
+{
+    MatrixXd t_matPicked;
+    if(!pickData(data, p_bInfoOrder, t_matPicked))
+        return SourceEstimate();
+
+    return applyImagingKernel(m_matKernel, m_bKernelCombineXyz, m_vecKernelNoiseNorm, m_qListKernelVertices, t_matPicked.size() > 0 ? t_matPicked : data, tmin, tstep);
+}
+
+
+//*************************************************************************************************************
+
+QString MinimumNorm::labelKey(const Label &label)
+{
+    return QString("%1|%2|%3").arg(label.hemi).arg(label.name).arg(label.vertices.size());
+}
+
+
+//*************************************************************************************************************
+
+void MinimumNorm::invalidateKernel()
+{
+    QMutexLocker locker(&m_qMutex);
+    m_bKernelValid = false;
+    m_qHashLabelKernels.clear();
 }
 
 
@@ -195,6 +588,8 @@ void MinimumNorm::setMethod(QString method)
 
 void MinimumNorm::setMethod(bool dSPM, bool sLORETA)
 {
+    invalidateKernel();
+
     if(dSPM && sLORETA)
     {
         qWarning("Cant activate dSPM and sLORETA at the same time! - Activating dSPM");
@@ -220,5 +615,7 @@ void MinimumNorm::setMethod(bool dSPM, bool sLORETA)
 
 void MinimumNorm::setRegularization(float lambda)
 {
+    invalidateKernel();
+
     m_fLambda = lambda;
 }
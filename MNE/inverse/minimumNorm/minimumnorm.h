@@ -44,9 +44,13 @@
 #include "../inverse_global.h"
 #include "../IInverseAlgorithm.h"
 
+#include <fiff/fiff_raw_data.h>
 #include <mne/mne_inverse_operator.h>
 
+#include <QHash>
+#include <QMutex>
 #include <QSharedPointer>
+#include <QStringList>
 
 
 //*************************************************************************************************************
@@ -62,6 +66,8 @@ namespace INVERSELIB
 // FORWARD DECLARATIONS
 //=============================================================================================================
 
+class ISourceEstimateSink;
+
 
 //*************************************************************************************************************
 //=============================================================================================================
@@ -123,6 +129,71 @@ public:
     */
     virtual SourceEstimate calculateInverse(const FiffEvoked &p_fiffEvoked, bool pick_normal = false) const;
 
+    //=========================================================================================================
+    /**
+    * Applies the prepared imaging kernel to a data block, e.g. a raw data buffer. doInverseSetup has to be
+    * called first. The rows of the data either correspond to the channels of the measurement info the kernel
+    * was prepared for, or to the picked channels only. A block with as many rows as picked channels is always
+    * taken as already picked, even if the info has the same number of channels.
+    * @param[in] data   Data block (channels x samples).
+    * @param[in] tmin   Time of the first sample in seconds.
+    * @param[in] tstep  Time between two samples in seconds.
+    * @return the calculated source estimation
+    */
+    SourceEstimate calculateInverse(const MatrixXd &data, float tmin, float tstep) const;
+
+    //=========================================================================================================
+    /**
+    * Applies label restricted imaging kernels to a data block, e.g. for real-time ROI extraction.
+    * doInverseSetup has to be called first. Kernels of labels which were not requested before are assembled
+    * together in one pass and cached until the inverse setup changes.
+    * @param[in] data   Data block (channels x samples), all channels of the prepared info or the picked ones. A
+    *                   block with as many rows as picked channels is taken as already picked.
+    * @param[in] tmin   Time of the first sample in seconds.
+    * @param[in] tstep  Time between two samples in seconds.
+    * @param[in] labels The labels to restrict the estimate to.
+    * @return the calculated source estimation of each label, empty list if failed
+    */
+    QList<SourceEstimate> calculateInverse(const MatrixXd &data, float tmin, float tstep, const QList<Label> &labels) const;
+
+    //=========================================================================================================
+    /**
+    * Applies the inverse to continuous raw data chunk by chunk and passes the source estimate of every chunk
+    * to a sink, e.g. for recordings which do not fit into memory as a whole. The chunks are read sequentially
+    * while the previously read ones are processed concurrently, the sink receives them in time order. The
+    * memory is bounded by two batches of chunks, one chunk per thread in each.
+    * @param[in] p_raw          Raw data, seeked to sample from and read sequentially from there.
+    * @param[in] p_sink         Receives the source estimate chunks.
+    * @param[in] from           First sample (optional, default first sample of the raw data).
+    * @param[in] to             Last sample (optional, default last sample of the raw data).
+    * @param[in] chunkSize      Samples per chunk.
+    * @param[in] pick_normal    If True, rather than pooling the orientations by taking the norm, only the
+    *                           radial component is kept. This is only applied when working with loose orientations.
+    * @return true if all chunks were processed, false otherwise
+    */
+    bool calculateInverse(FiffRawData &p_raw, ISourceEstimateSink &p_sink, fiff_int_t from = -1, fiff_int_t to = -1, qint32 chunkSize = 1000, bool pick_normal = false) const;
+
+    //=========================================================================================================
+    /**
+    * Prepares the inverse operator and assembles the imaging kernel for the given number of averages and
+    * channel set. The kernel is cached and only rebuilt when nave, pick_normal, the channel names, the
+    * regularization or the method change. calculateInverse does this on demand.
+    * @param[in] p_info         Measurement info of the data the kernel is applied to.
+    * @param[in] nave           Number of averages (scales the noise covariance).
+    * @param[in] pick_normal    If True, rather than pooling the orientations by taking the norm, only the
+    *                           radial component is kept. This is only applied when working with loose orientations.
+    * @return true if succeeded, false otherwise
+    */
+    bool doInverseSetup(const FiffInfo &p_info, qint32 nave, bool pick_normal = false);
+
+    //=========================================================================================================
+    /**
+    * Returns the prepared imaging kernel (sources x picked channels), noise normalization included for fixed
+    * orientations. Empty if doInverseSetup was not called or failed.
+    * @return the imaging kernel
+    */
+    MatrixXd getKernel() const;
+
     virtual const char* getName() const;
 
     virtual const MNESourceSpace& getSourceSpace() const;
@@ -153,11 +224,90 @@ public:
     void setRegularization(float lambda);
 
 private:
+    //=========================================================================================================
+    /**
+    * Builds the cached kernel unless it is valid for the given parameters. Has to be called with m_qMutex locked.
+    * @param[in] p_info         Measurement info of the data the kernel is applied to.
+    * @param[in] nave           Number of averages.
+    * @param[in] pick_normal    Keep the normal component only.
+    * @return true if a valid kernel is available, false otherwise
+    */
+    bool prepareKernel(const FiffInfo &p_info, qint32 nave, bool pick_normal) const;
+
+    //=========================================================================================================
+    /**
+    * Assembles the kernels of the labels which are not cached yet. Has to be called with m_qMutex locked and a
+    * valid kernel.
+    * @param[in] labels     The labels.
+    * @return true if all label kernels are available, false otherwise
+    */
+    bool prepareLabelKernels(const QList<Label> &labels) const;
+
+    //=========================================================================================================
+    /**
+    * Picks the kernel channels from a data block. Has to be called with m_qMutex locked and a valid kernel.
+    * @param[in] data           Data block, all channels of the prepared info or the picked channels only.
+    * @param[in] p_bInfoOrder   The data is known to hold all channels of the prepared info, e.g. evoked data;
+    *                           otherwise a block with as many rows as picked channels is taken as already picked.
+    * @param[out] picked        The picked channels, left empty if data contains the picked channels only.
+    * @return true if the data matches the prepared channels, false otherwise
+    */
+    bool pickData(const MatrixXd &data, bool p_bInfoOrder, MatrixXd &picked) const;
+
+    //=========================================================================================================
+    /**
+    * Applies the cached kernel. Has to be called with m_qMutex locked and a valid kernel.
+    * @param[in] data           Data block, all channels of the prepared info or the picked channels only.
+    * @param[in] p_bInfoOrder   The data is known to hold all channels of the prepared info, see pickData.
+    * @param[in] tmin           Time of the first sample in seconds.
+    * @param[in] tstep          Time between two samples in seconds.
+    * @return the calculated source estimation
+    */
+    SourceEstimate applyKernel(const MatrixXd &data, bool p_bInfoOrder, float tmin, float tstep) const;
+
+    //=========================================================================================================
+    /**
+    * Returns the key of a label in the label kernel cache.
+    * @param[in] label  The label.
+    * @return the cache key
+    */
+    static QString labelKey(const Label &label);
+
+    //=========================================================================================================
+    /**
+    * Invalidates the cached kernel.
+    */
+    void invalidateKernel();
+
+    /**
+    * Cached imaging kernel of a label.
+    */
+    struct LabelKernel
+    {
+        VectorXi labelVertices;     /**< Vertices of the label the kernel was built for */
+        MatrixXd kernel;            /**< Imaging kernel restricted to the label sources */
+        VectorXd noiseNorm;         /**< Noise normalization applied after pooling, empty if none */
+        QList<VectorXi> vertices;   /**< Source vertices of the kernel */
+    };
+
     MNEInverseOperator m_inverseOperator;   /**< The inverse operator */
     float m_fLambda;                        /**< Regularization parameter */
     QString m_sMethod;                      /**< Selected method */
     bool m_bsLORETA;                        /**< Do sLORETA method */
     bool m_bdSPM;                           /**< Do dSPM method */
+
+    mutable QMutex m_qMutex;                        /**< Serializes the access to the cached kernel */
+    mutable bool m_bKernelValid;                    /**< Whether the cached kernel is valid */
+    mutable qint32 m_iKernelNave;                   /**< Number of averages of the cached kernel */
+    mutable bool m_bKernelPickNormal;               /**< Whether the cached kernel keeps the normal component only */
+    mutable QStringList m_qListKernelChNames;       /**< Data channel names the cached kernel was built for */
+    mutable RowVectorXi m_vecKernelSel;             /**< Data rows which are used by the cached kernel */
+    mutable MatrixXd m_matKernel;                   /**< The cached imaging kernel */
+    mutable bool m_bKernelCombineXyz;               /**< Whether the three orientations are pooled after applying the kernel */
+    mutable VectorXd m_vecKernelNoiseNorm;          /**< Noise normalization applied after pooling, empty if none */
+    mutable QList<VectorXi> m_qListKernelVertices;  /**< Source vertices of the cached kernel */
+    mutable MNEInverseOperator m_invKernel;         /**< Prepared inverse operator of the cached kernel */
+    mutable QHash<QString, LabelKernel> m_qHashLabelKernels;    /**< Cached label kernels, cleared with the kernel */
 };
 
 } //NAMESPACE
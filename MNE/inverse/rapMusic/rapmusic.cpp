@@ -33,6 +33,7 @@
 *
 */
 
+
 //*************************************************************************************************************
 //=============================================================================================================
 // INCLUDES
@@ -41,32 +42,515 @@
 #include "rapmusic.h"
 #include "../sourceestimate.h"
 
+#include <fiff/fiff_evoked.h>
+#include <utils/mnemath.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+#include <Eigen/Eigenvalues>
+#include <Eigen/SVD>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QMutexLocker>
+#include <QPair>
+#include <QThread>
+#include <QtConcurrent>
+
 
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
 //=============================================================================================================
 
+using namespace Eigen;
+using namespace FIFFLIB;
+using namespace MNELIB;
+using namespace UTILSLIB;
 using namespace INVERSELIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define RAPMUSIC_BASIS_TOL  1e-6    /**< Relative singular value below which a source orientation is considered silent */
+#define RAPMUSIC_PROJ_TOL   1e-6    /**< Remaining fraction of a basis direction below which it counts as projected out */
+#define RAPMUSIC_CHUNK_MIN  64      /**< Minimal number of sources scanned by one task */
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE LOCAL TYPES
+//=============================================================================================================
+
+namespace
+{
+
+//=========================================================================================================
+/**
+* Best source of one scanned range.
+*/
+struct RapScanResult
+{
+    qint32 source;      /**< Best source, -1 if none */
+    double corr2;       /**< Squared subspace correlation of the best source */
+    Vector3d coeff;     /**< Basis coefficients of the best orientation */
+};
+
+
+//=========================================================================================================
+/**
+* Subspace correlation scan of a range of sources. Let B_i be the orthonormal gain basis of source i, Q the
+* orthonormal basis of the already found topographies, P = I - Q*Q' and U = P*Us the projected signal subspace.
+* U is not re-orthonormalized, so directions which were almost projected out keep their small weight. The
+* projected gain P*B_i has the Gram matrix I - B_i'Q*Q'B_i and, since PU = U, the correlations U'P*B_i = U'B_i.
+* The squared subspace correlation of source i is the largest generalized eigenvalue of (B_i'U*U'B_i,
+* I - B_i'Q*Q'B_i), so the projector is never formed and the bases are reused in every recursion.
+*/
+struct RapScan
+{
+    typedef RapScanResult result_type;
+
+    RapScan(const MatrixXd* p_pBases, const MatrixXd* p_pSubspace, const MatrixXd* p_pFound, qint32 p_iNumOri)
+    : m_pBases(p_pBases)
+    , m_pSubspace(p_pSubspace)
+    , m_pFound(p_pFound)
+    , m_iNumOri(p_iNumOri)
+    {}
+
+    RapScanResult operator()(const QPair<qint32,qint32>& range) const
+    {
+        RapScanResult res;
+        res.source = -1;
+        res.corr2 = -1.0;
+        res.coeff = Vector3d::Zero();
+
+        const MatrixXd& B = *m_pBases;
+        const MatrixXd& U = *m_pSubspace;
+        const MatrixXd& Q = *m_pFound;
+        const qint32 nOri = m_iNumOri;
+
+        // B_i'U and B_i'Q as dot products of the basis columns, which stay in cache. A matrix product of all
+        // bases at once would stream them through the packing of the product kernel.
+        Matrix<double, 3, Dynamic> W = Matrix<double, 3, Dynamic>::Zero(3, U.cols());
+        Matrix<double, 3, Dynamic> C = Matrix<double, 3, Dynamic>::Zero(3, Q.cols());
+
+        SelfAdjointEigenSolver<Matrix3d> esGram, esCorr;
+        for(qint32 s = range.first; s < range.second; ++s)
+        {
+            for(qint32 o = 0; o < nOri; ++o)
+            {
+                for(qint32 j = 0; j < U.cols(); ++j)
+                    W(o,j) = B.col(s*nOri + o).dot(U.col(j));
+                for(qint32 j = 0; j < Q.cols(); ++j)
+                    C(o,j) = B.col(s*nOri + o).dot(Q.col(j));
+            }
+
+            if(nOri == 1)
+            {
+                double g = Q.cols() > 0 ? 1.0 - C.row(0).squaredNorm() : 1.0;
+                if(g <= RAPMUSIC_PROJ_TOL)
+                    continue;
+                double corr2 = W.row(0).squaredNorm() / g;
+                if(corr2 > res.corr2)
+                {
+                    res.source = s;
+                    res.corr2 = corr2;
+                    res.coeff = Vector3d(1.0, 0.0, 0.0);
+                }
+                continue;
+            }
+
+            Matrix3d Gm = Matrix3d::Identity();
+            if(Q.cols() > 0)
+                Gm -= C.lazyProduct(C.transpose());
+            Matrix3d Mc = W.lazyProduct(W.transpose());
+
+            // Whiten with the Gram matrix of the projected basis, skipping projected out directions
+            esGram.computeDirect(Gm);
+            Matrix3d Z = Matrix3d::Zero();
+            for(qint32 j = 0; j < 3; ++j)
+                if(esGram.eigenvalues()[j] > RAPMUSIC_PROJ_TOL)
+                    Z.col(j) = esGram.eigenvectors().col(j) / sqrt(esGram.eigenvalues()[j]);
+
+            esCorr.computeDirect(Z.transpose() * Mc * Z);
+            double corr2 = esCorr.eigenvalues()[2];
+            if(corr2 > res.corr2)
+            {
+                res.source = s;
+                res.corr2 = corr2;
+                res.coeff = Z * esCorr.eigenvectors().col(2);
+            }
+        }
+        return res;
+    }
+
+    const MatrixXd* m_pBases;       /**< Orthonormal gain bases (channels x m_iNumOri*nsource) */
+    const MatrixXd* m_pSubspace;    /**< Projected signal subspace */
+    const MatrixXd* m_pFound;       /**< Orthonormal basis of the found topographies */
+    qint32 m_iNumOri;               /**< Number of orientations per source */
+};
+
+} // NAMESPACE
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
 //=============================================================================================================
 
 RapMusic::RapMusic()
+: m_iN(0)
+, m_dThreshold(0)
+, m_iNumOri(1)
+, m_bSetupValid(false)
+{
+}
+
+
+//*************************************************************************************************************
+
+RapMusic::RapMusic(const MNEForwardSolution &p_forwardSolution, qint32 p_iN, double p_dThr)
+: m_iN(0)
+, m_dThreshold(0)
+, m_iNumOri(1)
+, m_bSetupValid(false)
+{
+    init(p_forwardSolution, p_iN, p_dThr);
+}
+
+
+//*************************************************************************************************************
+
+bool RapMusic::init(const MNEForwardSolution &p_forwardSolution, qint32 p_iN, double p_dThr)
+{
+    QMutexLocker locker(&m_qMutex);
+
+    m_bSetupValid = false;
+
+    if(p_forwardSolution.isEmpty() || p_iN < 1)
+    {
+        qWarning("RapMusic::init - empty forward solution or signal subspace dimension < 1.");
+        return false;
+    }
+
+    m_ForwardSolution = p_forwardSolution;
+    m_iN = p_iN;
+    m_dThreshold = p_dThr;
+    m_iNumOri = m_ForwardSolution.isFixedOrient() ? 1 : 3;
+
+    m_qListVertices.clear();
+    for(qint32 h = 0; h < m_ForwardSolution.src.size(); ++h)
+        m_qListVertices.push_back(m_ForwardSolution.src[h].vertno);
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+SourceEstimate RapMusic::calculateInverse(const FiffEvoked &p_fiffEvoked, bool pick_normal) const
+{
+    Q_UNUSED(pick_normal);
+
+    QMutexLocker locker(&m_qMutex);
+
+    if(!prepareSetup(p_fiffEvoked.info))
+        return SourceEstimate();
+
+    float tmin = ((float)p_fiffEvoked.first) / p_fiffEvoked.info.sfreq;
+    float tstep = 1/p_fiffEvoked.info.sfreq;
+
+    QList<RapDipole> dipoles;
+    MatrixXd amplitudes;
+    if(!scan(p_fiffEvoked.data, dipoles, amplitudes))
+        return SourceEstimate();
+
+    MatrixXd sol = MatrixXd::Zero(m_matBases.cols()/m_iNumOri, p_fiffEvoked.data.cols());
+    for(qint32 i = 0; i < dipoles.size(); ++i)
+        sol.row(dipoles[i].source) += amplitudes.row(i);
+
+    return SourceEstimate(sol, m_qListVertices, tmin, tstep);
+}
+
+
+//*************************************************************************************************************
+
+SourceEstimate RapMusic::calculateInverse(const MatrixXd &data, float tmin, float tstep) const
+{
+    QMutexLocker locker(&m_qMutex);
+
+    if(!m_bSetupValid)
+    {
+        qWarning("RapMusic::calculateInverse - not set up, call doInverseSetup first.");
+        return SourceEstimate();
+    }
+
+    QList<RapDipole> dipoles;
+    MatrixXd amplitudes;
+    if(!scan(data, dipoles, amplitudes))
+        return SourceEstimate();
+
+    MatrixXd sol = MatrixXd::Zero(m_matBases.cols()/m_iNumOri, data.cols());
+    for(qint32 i = 0; i < dipoles.size(); ++i)
+        sol.row(dipoles[i].source) += amplitudes.row(i);
+
+    return SourceEstimate(sol, m_qListVertices, tmin, tstep);
+}
+
+
+//*************************************************************************************************************
+
+bool RapMusic::calculateDipoles(const MatrixXd &data, QList<RapDipole> &dipoles) const
+{
+    QMutexLocker locker(&m_qMutex);
+
+    if(!m_bSetupValid)
+    {
+        qWarning("RapMusic::calculateDipoles - not set up, call doInverseSetup first.");
+        return false;
+    }
+
+    MatrixXd amplitudes;
+    return scan(data, dipoles, amplitudes);
+}
+
+
+//*************************************************************************************************************
+
+bool RapMusic::doInverseSetup(const FiffInfo &p_info)
 {
+    QMutexLocker locker(&m_qMutex);
+    return prepareSetup(p_info);
 }
 
 
 //*************************************************************************************************************
 
-SourceEstimate RapMusic::calculateInverse() const
+bool RapMusic::prepareSetup(const FiffInfo &p_info) const
 {
-    SourceEstimate p_SourceEstimate;
+    if(m_bSetupValid && m_qListSetupChNames == p_info.ch_names && m_qListSetupBads == p_info.bads)
+        return true;
+
+    m_bSetupValid = false;
+
+    if(m_ForwardSolution.isEmpty())
+    {
+        qWarning("RapMusic::prepareSetup - no forward solution, call init first.");
+        return false;
+    }
+
+    const FiffNamedMatrix& sol = *m_ForwardSolution.sol;
+
+    //
+    //   Good data channels which are part of the forward solution, in the order of the forward solution
+    //
+    QList<qint32> t_qListDataSel, t_qListGainSel;
+    for(qint32 i = 0; i < sol.row_names.size(); ++i)
+    {
+        qint32 idx = p_info.ch_names.indexOf(sol.row_names[i]);
+        if(idx >= 0 && !p_info.bads.contains(sol.row_names[i]))
+        {
+            t_qListDataSel.append(idx);
+            t_qListGainSel.append(i);
+        }
+    }
+
+    qint32 nchan = t_qListGainSel.size();
+    if(nchan < m_iN)
+    {
+        qWarning("RapMusic::prepareSetup - only %d channels of the forward solution are available in the data.", nchan);
+        return false;
+    }
+
+    m_vecDataSel.resize(nchan);
+    MatrixXd G(nchan, sol.data.cols());
+    for(qint32 i = 0; i < nchan; ++i)
+    {
+        m_vecDataSel[i] = t_qListDataSel[i];
+        G.row(i) = sol.data.row(t_qListGainSel[i]);
+    }
+
+    printf("Picked %d channels from the data\n", nchan);
+    printf("Computing the orthonormal gain bases...");
+
+    //
+    //   Orthonormal basis B_i = G_i * T_i of every source from the eigen decomposition of G_i'G_i. Silent
+    //   orientations (e.g. radial ones in MEG) get zero basis vectors.
+    //
+    qint32 nsrc = G.cols() / m_iNumOri;
+    if(nsrc < 1)
+    {
+        qWarning("RapMusic::prepareSetup - the forward solution has no sources.");
+        return false;
+    }
+
+    m_matBases = MatrixXd::Zero(nchan, nsrc*m_iNumOri);
+    m_matBasesTrafo = MatrixXd::Zero(nsrc*m_iNumOri, m_iNumOri);
+
+    SelfAdjointEigenSolver<MatrixXd> es;
+    for(qint32 i = 0; i < nsrc; ++i)
+    {
+        const MatrixXd G_i = G.middleCols(i*m_iNumOri, m_iNumOri);
+        es.compute(G_i.transpose() * G_i);
+
+        double maxEig = es.eigenvalues().maxCoeff();
+        for(qint32 j = 0; j < m_iNumOri; ++j)
+        {
+            double ev = es.eigenvalues()[j];
+            if(maxEig <= 0 || ev <= maxEig * RAPMUSIC_BASIS_TOL * RAPMUSIC_BASIS_TOL)
+                continue;
+            VectorXd t = es.eigenvectors().col(j) / sqrt(ev);
+            m_matBasesTrafo.row(i*m_iNumOri + j) = t.transpose();
+            m_matBases.col(i*m_iNumOri + j) = G_i * t;
+        }
+    }
+
+    m_qListSetupChNames = p_info.ch_names;
+    m_qListSetupBads = p_info.bads;
+    m_bSetupValid = true;
+
+    printf("[done]\n");
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool RapMusic::scan(const MatrixXd &data, QList<RapDipole> &dipoles, MatrixXd &amplitudes) const
+{
+    dipoles.clear();
+
+    const qint32 nchan = m_matBases.rows();
+    const qint32 nsrc = m_matBases.cols() / m_iNumOri;
+
+    //
+    //   Pick the selected channels, they are in the order of the forward solution. Data in info order is checked
+    //   first, the counts are equal when all info channels are good and part of the forward solution.
+    //
+    MatrixXd M;
+    if(data.rows() == m_qListSetupChNames.size())
+    {
+        M.resize(nchan, data.cols());
+        for(qint32 i = 0; i < nchan; ++i)
+            M.row(i) = data.row(m_vecDataSel[i]);
+    }
+    else if(data.rows() == nchan)
+        M = data;
+    else
+    {
+        qWarning("RapMusic::scan - data does not match the prepared channels.");
+        return false;
+    }
+
+    //
+    //   Signal subspace: the m_iN dominant left singular vectors of the data
+    //
+    VectorXd sing;
+    MatrixXd U, V;
+    MNEMath::svd_gram(M, sing, U, V);
+    qint32 rank = 0;
+    while(rank < sing.size() && rank < m_iN && sing[rank] > 0)
+        ++rank;
+    if(rank == 0)
+        return true;
+    MatrixXd Us = U.leftCols(rank);
+
+    //
+    //   Source ranges scanned concurrently
+    //
+    qint32 t_iChunk = std::max(RAPMUSIC_CHUNK_MIN, nsrc / (4*std::max(1, QThread::idealThreadCount())) + 1);
+    QList< QPair<qint32,qint32> > t_qListRanges;
+    for(qint32 first = 0; first < nsrc; first += t_iChunk)
+        t_qListRanges.append(qMakePair(first, std::min(first + t_iChunk, nsrc)));
+
+    MatrixXd Q(nchan, 0);                   // orthonormal basis of the found topographies
+    MatrixXd A(nchan, 0);                   // found topographies
+    MatrixXd Up = Us;                       // projected signal subspace
+
+    for(qint32 k = 0; k < rank; ++k)
+    {
+        RapScan t_scan(&m_matBases, &Up, &Q, m_iNumOri);
+        QList<RapScanResult> t_qListResults = QtConcurrent::blockingMapped< QList<RapScanResult> >(t_qListRanges, t_scan);
+
+        RapScanResult best = t_qListResults[0];
+        for(qint32 i = 1; i < t_qListResults.size(); ++i)
+            if(t_qListResults[i].corr2 > best.corr2)
+                best = t_qListResults[i];
+
+        double corr = best.corr2 > 0 ? sqrt(best.corr2) : 0.0;
+        if(best.source < 0 || corr < m_dThreshold)
+            break;
+
+        //
+        //   Orientation o = T_i a and topography G_i o = B_i a of the best source
+        //
+        VectorXd a = best.coeff.head(m_iNumOri);
+        VectorXd o = m_matBasesTrafo.middleRows(best.source*m_iNumOri, m_iNumOri).transpose() * a;
+        VectorXd topo = m_matBases.middleCols(best.source*m_iNumOri, m_iNumOri) * a;
+        double oNorm = o.norm();
+        if(oNorm <= 0)
+            break;
+
+        RapDipole dip;
+        dip.source = best.source;
+        dip.orientation = o / oNorm;
+        dip.topography = topo / oNorm;
+        dip.correlation = corr;
+        dipoles.append(dip);
+
+        A.conservativeResize(nchan, A.cols() + 1);
+        A.col(A.cols() - 1) = dip.topography;
+
+        //
+        //   Extend the projector basis by the new topography, project the signal subspace
+        //
+        VectorXd q = topo;
+        if(Q.cols() > 0)
+        {
+            q -= Q * (Q.transpose() * q);
+            q -= Q * (Q.transpose() * q);
+        }
+        double qNorm = q.norm();
+        if(qNorm <= 0)
+            break;
+        Q.conservativeResize(nchan, Q.cols() + 1);
+        Q.col(Q.cols() - 1) = q / qNorm;
+
+        Up = Us - Q * (Q.transpose() * Us);
+    }
+
+    //
+    //   Least squares amplitudes of the found dipoles
+    //
+    if(A.cols() > 0)
+        amplitudes = A.jacobiSvd(ComputeThinU | ComputeThinV).solve(M);
+    else
+        amplitudes.resize(0, M.cols());
 
-    return p_SourceEstimate;
+    return true;
 }
 
 
@@ -45,6 +45,20 @@
 #include "../IInverseAlgorithm.h"
 
 #include <mne/mne_forwardsolution.h>
+#include <fiff/fiff_info.h>
+
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QStringList>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
 
 
 //*************************************************************************************************************
@@ -60,29 +74,161 @@ namespace INVERSELIB
 // USED NAMESPACES
 //=============================================================================================================
 
+using namespace Eigen;
 using namespace MNELIB;
 
+
+//=============================================================================================================
+/**
+* Dipole found by one RAP MUSIC recursion
+*
+* @brief RAP MUSIC dipole
+*/
+struct RapDipole
+{
+    qint32 source;          /**< Source index (column group) in the forward solution */
+    VectorXd orientation;   /**< Unit orientation in the coordinates of the forward solution, one component for fixed orientations */
+    VectorXd topography;    /**< Field pattern of the dipole on the selected channels */
+    double correlation;     /**< Subspace correlation of the dipole with the projected signal subspace */
+};
+
+
 //=============================================================================================================
 /**
-* RAP MUSIC algorithm ToDo: Paper references.
+* Recursively applied and projected MUSIC (RAP MUSIC) after J.C. Mosher and R.M. Leahy, "Source localization
+* using recursively applied and projected (RAP) MUSIC", IEEE Trans. Signal Processing 47(2), 1999.
+* The signal subspace of the data is scanned with the gain of every source of a (clustered) forward solution.
+* After each recursion the found topographies are projected out of the gain and the signal subspace.
 *
 * @brief RAP MUSIC
 */
 class INVERSESHARED_EXPORT RapMusic : public IInverseAlgorithm
 {
 public:
+    typedef QSharedPointer<RapMusic> SPtr;             /**< Shared pointer type for RapMusic. */
+    typedef QSharedPointer<const RapMusic> ConstSPtr;  /**< Const shared pointer type for RapMusic. */
+
+    //=========================================================================================================
+    /**
+    * Default constructor, call init before use.
+    */
     RapMusic();
 
+    //=========================================================================================================
+    /**
+    * Constructs RAP MUSIC on a forward solution.
+    *
+    * @param[in] p_forwardSolution  The forward solution (or a clustered one) which should be scanned. Data and
+    *                               gain have to be on comparable scales, e.g. pick one channel type.
+    * @param[in] p_iN               Dimension of the signal subspace, i.e. maximal number of dipoles
+    * @param[in] p_dThr             Subspace correlation threshold, the recursion stops below it
+    */
+    explicit RapMusic(const MNEForwardSolution &p_forwardSolution, qint32 p_iN = 2, double p_dThr = 0.5);
+
     virtual ~RapMusic(){}
 
-    virtual SourceEstimate calculateInverse() const;
+    //=========================================================================================================
+    /**
+    * Sets the forward solution and the parameters.
+    *
+    * @param[in] p_forwardSolution  The forward solution (or a clustered one) which should be scanned
+    * @param[in] p_iN               Dimension of the signal subspace, i.e. maximal number of dipoles
+    * @param[in] p_dThr             Subspace correlation threshold, the recursion stops below it
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool init(const MNEForwardSolution &p_forwardSolution, qint32 p_iN = 2, double p_dThr = 0.5);
+
+    //=========================================================================================================
+    /**
+    * Localizes the dipoles of the evoked data. The result holds one row per source of the forward solution,
+    * the rows of the found dipoles contain their amplitudes along the found orientations, all others are zero.
+    *
+    * @param[in] p_fiffEvoked   Evoked data.
+    * @param[in] pick_normal    Not used, the orientations are part of the scan.
+    *
+    * @return the calculated source estimation
+    */
+    virtual SourceEstimate calculateInverse(const FiffEvoked &p_fiffEvoked, bool pick_normal = false) const;
+
+    //=========================================================================================================
+    /**
+    * Localizes the dipoles of a data block. doInverseSetup has to be called first. The rows of the data either
+    * correspond to the channels of the measurement info of the setup, or to the selected channels only, in the
+    * order of the forward solution. A block with as many rows as the info is always taken in info order.
+    *
+    * @param[in] data   Data block (channels x samples).
+    * @param[in] tmin   Time of the first sample in seconds.
+    * @param[in] tstep  Time between two samples in seconds.
+    *
+    * @return the calculated source estimation
+    */
+    SourceEstimate calculateInverse(const MatrixXd &data, float tmin, float tstep) const;
+
+    //=========================================================================================================
+    /**
+    * Runs the recursions on a data block and returns the found dipoles. doInverseSetup has to be called first.
+    *
+    * @param[in] data       Data block (channels x samples), all channels of the setup info or the selected ones
+    *                       in forward solution order; a block with as many rows as the info is in info order.
+    * @param[out] dipoles   The found dipoles in the order of their recursion.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool calculateDipoles(const MatrixXd &data, QList<RapDipole> &dipoles) const;
+
+    //=========================================================================================================
+    /**
+    * Selects the good channels of the measurement info which are part of the forward solution and precomputes
+    * the orthonormal gain basis of every source. The setup is cached and only rebuilt when the channel names
+    * or the bad channels change. calculateInverse(FiffEvoked) does this on demand.
+    *
+    * @param[in] p_info     Measurement info of the data.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool doInverseSetup(const FiffInfo &p_info);
 
     virtual const char* getName() const;
 
     virtual const MNESourceSpace& getSourceSpace() const;
 
 private:
-    MNEForwardSolution m_ForwardSolution; /**< The Forward operator which should be scanned through*/
+    //=========================================================================================================
+    /**
+    * Builds the cached setup unless it is valid for the given info. Has to be called with m_qMutex locked.
+    *
+    * @param[in] p_info     Measurement info of the data.
+    *
+    * @return true if a valid setup is available, false otherwise
+    */
+    bool prepareSetup(const FiffInfo &p_info) const;
+
+    //=========================================================================================================
+    /**
+    * Runs the recursions. Has to be called with m_qMutex locked and a valid setup.
+    *
+    * @param[in] data       Data block, all channels of the setup info or the selected ones.
+    * @param[out] dipoles   The found dipoles.
+    * @param[out] amplitudes Dipole amplitudes (dipoles x samples).
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool scan(const MatrixXd &data, QList<RapDipole> &dipoles, MatrixXd &amplitudes) const;
+
+    MNEForwardSolution m_ForwardSolution;   /**< The Forward operator which should be scanned through */
+    qint32 m_iN;                            /**< Dimension of the signal subspace */
+    double m_dThreshold;                    /**< Subspace correlation threshold */
+    qint32 m_iNumOri;                       /**< Number of orientations per source, 1 or 3 */
+
+    mutable QMutex m_qMutex;                        /**< Serializes the access to the cached setup */
+    mutable bool m_bSetupValid;                     /**< Whether the cached setup is valid */
+    mutable QStringList m_qListSetupChNames;        /**< Data channel names the setup was built for */
+    mutable QStringList m_qListSetupBads;           /**< Bad channels the setup was built for */
+    mutable RowVectorXi m_vecDataSel;               /**< Data rows which are used */
+    mutable MatrixXd m_matBases;                    /**< Orthonormal gain bases of all sources (channels x m_iNumOri*nsource) */
+    mutable MatrixXd m_matBasesTrafo;               /**< Maps basis coefficients to orientations, stacked (m_iNumOri*nsource x m_iNumOri) */
+    mutable QList<VectorXi> m_qListVertices;        /**< Source vertices */
 };
 
 } //NAMESPACE
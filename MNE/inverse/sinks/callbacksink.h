@@ -0,0 +1,90 @@
+//=============================================================================================================
+/**
+* @file     callbacksink.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    CallbackSink class declaration.
+*
+*/
+
+#ifndef CALLBACKSINK_H
+#define CALLBACKSINK_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "../inverse_global.h"
+#include "../ISourceEstimateSink.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE INVERSELIB
+//=============================================================================================================
+
+namespace INVERSELIB
+{
+
+//=============================================================================================================
+/**
+* Passes every chunk of a streamed source estimate to a callback function.
+*
+* @brief Passes a streamed source estimate to a callback
+*/
+class INVERSESHARED_EXPORT CallbackSink : public ISourceEstimateSink
+{
+public:
+    typedef QSharedPointer<CallbackSink> SPtr;             /**< Shared pointer type for CallbackSink. */
+    typedef QSharedPointer<const CallbackSink> ConstSPtr;  /**< Const shared pointer type for CallbackSink. */
+
+    typedef bool (*Callback)(const SourceEstimate &p_sourceEstimateChunk, void *p_pUserData);   /**< Chunk callback, returns false to abort. */
+
+    //=========================================================================================================
+    /**
+    * Constructs a callback sink.
+    *
+    * @param[in] p_callback     Function which is called for every chunk.
+    * @param[in] p_pUserData    Pointer which is passed to the callback (optional).
+    */
+    explicit CallbackSink(Callback p_callback, void *p_pUserData = NULL);
+
+    virtual bool write(const SourceEstimate &p_sourceEstimateChunk);
+
+    virtual bool finish();
+
+private:
+    Callback m_callback;    /**< The chunk callback */
+    void* m_pUserData;      /**< Pointer passed to the callback */
+};
+
+} //NAMESPACE
+
+#endif // CALLBACKSINK_H
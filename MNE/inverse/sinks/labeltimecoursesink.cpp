@@ -0,0 +1,163 @@
+//=============================================================================================================
+/**
+* @file     labeltimecoursesink.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    LabelTimeCourseSink class definition.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "labeltimecoursesink.h"
+#include "../sourceestimate.h"
+
+#include <utils/mnemath.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace UTILSLIB;
+using namespace INVERSELIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+LabelTimeCourseSink::LabelTimeCourseSink(const QList<Label> &p_qListLabels, Mode p_mode)
+: m_qListLabels(p_qListLabels)
+, m_mode(p_mode)
+, m_fTMin(0)
+, m_fTStep(-1)
+{
+}
+
+
+//*************************************************************************************************************
+
+bool LabelTimeCourseSink::write(const SourceEstimate &p_sourceEstimateChunk)
+{
+    //
+    //   Select the label sources once, the rows of the hemispheres follow each other
+    //
+    if(m_qListTimeCourses.isEmpty())
+    {
+        m_qListLabelRows.clear();
+        qint32 t_iNumSources = 0;
+        for(qint32 h = 0; h < p_sourceEstimateChunk.vertno.size(); ++h)
+            t_iNumSources += p_sourceEstimateChunk.vertno[h].size();
+
+        typedef Eigen::Triplet<double> T;
+        std::vector<T> tripletList;
+        for(qint32 l = 0; l < m_qListLabels.size(); ++l)
+        {
+            VectorXi t_vecRows;
+            qint32 h = m_qListLabels[l].hemi;
+            if(h >= 0 && h < p_sourceEstimateChunk.vertno.size())
+            {
+                MNEMath::intersect(p_sourceEstimateChunk.vertno[h], m_qListLabels[l].vertices, t_vecRows);
+                for(qint32 i = 0; i < h; ++i)
+                    t_vecRows.array() += p_sourceEstimateChunk.vertno[i].size();
+            }
+
+            if(t_vecRows.size() == 0)
+                printf("Label %s contains no sources of the estimate.\n", m_qListLabels[l].name.toLatin1().constData());
+
+            for(qint32 i = 0; i < t_vecRows.size(); ++i)
+                tripletList.push_back(T(l, t_vecRows[i], 1.0/t_vecRows.size()));
+
+            m_qListLabelRows.push_back(t_vecRows);
+        }
+
+        m_matMean = SparseMatrix<double>(m_qListLabels.size(), t_iNumSources);
+        m_matMean.setFromTriplets(tripletList.begin(), tripletList.end());
+
+        m_fTMin = p_sourceEstimateChunk.tmin;
+        m_fTStep = p_sourceEstimateChunk.tstep;
+    }
+
+    const MatrixXd &t_matData = p_sourceEstimateChunk.data;
+
+    if(t_matData.rows() != m_matMean.cols())
+    {
+        qWarning("LabelTimeCourseSink::write - chunk does not match the sources of the first chunk.");
+        return false;
+    }
+
+    MatrixXd t_matTimeCourses;
+    if(m_mode == Mean)
+        t_matTimeCourses = m_matMean * t_matData;
+    else
+    {
+        t_matTimeCourses = MatrixXd::Zero(m_qListLabelRows.size(), t_matData.cols());
+        for(qint32 l = 0; l < m_qListLabelRows.size(); ++l)
+            for(qint32 i = 0; i < m_qListLabelRows[l].size(); ++i)
+                t_matTimeCourses.row(l) = t_matTimeCourses.row(l).cwiseMax(t_matData.row(m_qListLabelRows[l][i]).cwiseAbs());
+    }
+
+    m_qListTimeCourses.push_back(t_matTimeCourses);
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool LabelTimeCourseSink::finish()
+{
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+MatrixXd LabelTimeCourseSink::getTimeCourses() const
+{
+    qint32 t_iNumSamples = 0;
+    for(qint32 i = 0; i < m_qListTimeCourses.size(); ++i)
+        t_iNumSamples += m_qListTimeCourses[i].cols();
+
+    MatrixXd p_matTimeCourses(m_qListLabels.size(), t_iNumSamples);
+    qint32 t_iCol = 0;
+    for(qint32 i = 0; i < m_qListTimeCourses.size(); ++i)
+    {
+        p_matTimeCourses.middleCols(t_iCol, m_qListTimeCourses[i].cols()) = m_qListTimeCourses[i];
+        t_iCol += m_qListTimeCourses[i].cols();
+    }
+
+    return p_matTimeCourses;
+}
@@ -0,0 +1,173 @@
+//=============================================================================================================
+/**
+* @file     labeltimecoursesink.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    LabelTimeCourseSink class declaration.
+*
+*/
+
+#ifndef LABELTIMECOURSESINK_H
+#define LABELTIMECOURSESINK_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "../inverse_global.h"
+#include "../ISourceEstimateSink.h"
+
+#include <fs/label.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+#include <Eigen/SparseCore>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QList>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE INVERSELIB
+//=============================================================================================================
+
+namespace INVERSELIB
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+using namespace FSLIB;
+
+
+//=============================================================================================================
+/**
+* Reduces a streamed source estimate to one time course per label. Only the label time courses are kept,
+* the memory does not depend on the number of sources.
+*
+* @brief Reduces a streamed source estimate to label time courses
+*/
+class INVERSESHARED_EXPORT LabelTimeCourseSink : public ISourceEstimateSink
+{
+public:
+    typedef QSharedPointer<LabelTimeCourseSink> SPtr;             /**< Shared pointer type for LabelTimeCourseSink. */
+    typedef QSharedPointer<const LabelTimeCourseSink> ConstSPtr;  /**< Const shared pointer type for LabelTimeCourseSink. */
+
+    /**
+    * Reduction of the label sources.
+    */
+    enum Mode
+    {
+        Mean,   /**< Mean of the label sources */
+        Max     /**< Maximal absolute value of the label sources */
+    };
+
+    //=========================================================================================================
+    /**
+    * Constructs a label time course sink.
+    *
+    * @param[in] p_qListLabels  The labels.
+    * @param[in] p_mode         Reduction of the label sources.
+    */
+    LabelTimeCourseSink(const QList<Label> &p_qListLabels, Mode p_mode = Mean);
+
+    virtual bool write(const SourceEstimate &p_sourceEstimateChunk);
+
+    virtual bool finish();
+
+    //=========================================================================================================
+    /**
+    * Returns the label time courses written so far.
+    *
+    * @return the time courses (labels x samples)
+    */
+    MatrixXd getTimeCourses() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the time of the first sample.
+    *
+    * @return the time of the first sample in seconds
+    */
+    inline float tmin() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the time between two samples.
+    *
+    * @return the time between two samples in seconds
+    */
+    inline float tstep() const;
+
+private:
+    QList<Label> m_qListLabels;             /**< The labels */
+    Mode m_mode;                            /**< Reduction of the label sources */
+    QList<VectorXi> m_qListLabelRows;       /**< Source estimate rows of each label, set by the first chunk */
+    SparseMatrix<double> m_matMean;         /**< Averaging operator (labels x sources), set by the first chunk */
+    QList<MatrixXd> m_qListTimeCourses;     /**< Label time courses of each chunk */
+    float m_fTMin;                          /**< Time of the first sample */
+    float m_fTStep;                         /**< Time between two samples */
+};
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline float LabelTimeCourseSink::tmin() const
+{
+    return m_fTMin;
+}
+
+
+//*************************************************************************************************************
+
+inline float LabelTimeCourseSink::tstep() const
+{
+    return m_fTStep;
+}
+
+} //NAMESPACE
+
+#endif // LABELTIMECOURSESINK_H
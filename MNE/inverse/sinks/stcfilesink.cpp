@@ -0,0 +1,244 @@
+//=============================================================================================================
+/**
+* @file     stcfilesink.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    StcFileSink class definition.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "stcfilesink.h"
+#include "../sourceestimate.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <cstring>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QByteArray>
+#include <QtEndian>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace INVERSELIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+StcFileSink::StcFileSink(const QString &p_sPrefix)
+: m_sPrefix(p_sPrefix)
+, m_iNumSamples(0)
+, m_bStarted(false)
+{
+    for(qint32 h = 0; h < 2; ++h)
+    {
+        m_iRowOffset[h] = 0;
+        m_iNumVertices[h] = 0;
+    }
+}
+
+
+//*************************************************************************************************************
+
+StcFileSink::~StcFileSink()
+{
+    finish();
+}
+
+
+//*************************************************************************************************************
+
+bool StcFileSink::write(const SourceEstimate &p_sourceEstimateChunk)
+{
+    if(!m_bStarted && !start(p_sourceEstimateChunk))
+        return false;
+
+    const MatrixXd &t_matData = p_sourceEstimateChunk.data;
+    if(t_matData.rows() != m_iNumVertices[0] + m_iNumVertices[1])
+    {
+        qWarning("StcFileSink::write - chunk does not match the vertices of the first chunk.");
+        return false;
+    }
+
+    //
+    //   Samples are stored one after the other, big endian single precision
+    //
+    QByteArray t_buffer;
+    for(qint32 h = 0; h < 2; ++h)
+    {
+        if(m_iNumVertices[h] == 0)
+            continue;
+
+        t_buffer.resize(4*m_iNumVertices[h]*t_matData.cols());
+        uchar* t_pDest = reinterpret_cast<uchar*>(t_buffer.data());
+        for(qint32 t = 0; t < t_matData.cols(); ++t)
+        {
+            for(qint32 v = 0; v < m_iNumVertices[h]; ++v)
+            {
+                float t_fValue = (float)t_matData(m_iRowOffset[h] + v, t);
+                quint32 t_iValue;
+                memcpy(&t_iValue, &t_fValue, 4);
+                qToBigEndian<quint32>(t_iValue, t_pDest);
+                t_pDest += 4;
+            }
+        }
+
+        if(m_qFile[h].write(t_buffer) != t_buffer.size())
+        {
+            qWarning("StcFileSink::write - could not write to %s.", m_qFile[h].fileName().toLatin1().constData());
+            return false;
+        }
+    }
+
+    m_iNumSamples += t_matData.cols();
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool StcFileSink::finish()
+{
+    if(!m_bStarted)
+        return true;
+
+    bool t_bSuccess = true;
+    for(qint32 h = 0; h < 2; ++h)
+    {
+        if(!m_qFile[h].isOpen())
+            continue;
+
+        //
+        //   Patch the number of samples, it follows tmin, tstep, the number of vertices and the vertices
+        //
+        uchar t_cNumSamples[4];
+        qToBigEndian<quint32>(m_iNumSamples, t_cNumSamples);
+        if(!m_qFile[h].seek(12 + 4*m_iNumVertices[h]) || m_qFile[h].write(reinterpret_cast<const char*>(t_cNumSamples), 4) != 4)
+        {
+            qWarning("StcFileSink::finish - could not write to %s.", m_qFile[h].fileName().toLatin1().constData());
+            t_bSuccess = false;
+        }
+        m_qFile[h].close();
+    }
+
+    m_bStarted = false;
+
+    return t_bSuccess;
+}
+
+
+//*************************************************************************************************************
+
+bool StcFileSink::start(const SourceEstimate &p_sourceEstimateChunk)
+{
+    const QList<VectorXi> &t_qListVertno = p_sourceEstimateChunk.vertno;
+    if(t_qListVertno.size() > 2)
+    {
+        qWarning("StcFileSink::start - STC files support two hemispheres only.");
+        return false;
+    }
+
+    QString t_sHemi[2] = {"-lh.stc", "-rh.stc"};
+    qint32 t_iOffset = 0;
+    for(qint32 h = 0; h < 2; ++h)
+    {
+        m_iRowOffset[h] = t_iOffset;
+        m_iNumVertices[h] = h < t_qListVertno.size() ? t_qListVertno[h].size() : 0;
+        t_iOffset += m_iNumVertices[h];
+
+        if(m_iNumVertices[h] == 0)
+            continue;
+
+        m_qFile[h].setFileName(m_sPrefix + t_sHemi[h]);
+        if(!m_qFile[h].open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qWarning("StcFileSink::start - could not open %s.", m_qFile[h].fileName().toLatin1().constData());
+            if(h == 1)
+                m_qFile[0].close();
+            return false;
+        }
+
+        //
+        //   Header: tmin and tstep in ms, vertices, number of samples (patched by finish)
+        //
+        QByteArray t_header(4*(4 + m_iNumVertices[h]), 0);
+        uchar* t_pDest = reinterpret_cast<uchar*>(t_header.data());
+        float t_fTime[2] = {1000.0f*p_sourceEstimateChunk.tmin, 1000.0f*p_sourceEstimateChunk.tstep};
+        for(qint32 i = 0; i < 2; ++i)
+        {
+            quint32 t_iValue;
+            memcpy(&t_iValue, &t_fTime[i], 4);
+            qToBigEndian<quint32>(t_iValue, t_pDest);
+            t_pDest += 4;
+        }
+        qToBigEndian<quint32>(m_iNumVertices[h], t_pDest);
+        t_pDest += 4;
+        for(qint32 v = 0; v < m_iNumVertices[h]; ++v)
+        {
+            qToBigEndian<quint32>(t_qListVertno[h][v], t_pDest);
+            t_pDest += 4;
+        }
+
+        if(m_qFile[h].write(t_header) != t_header.size())
+        {
+            qWarning("StcFileSink::start - could not write to %s.", m_qFile[h].fileName().toLatin1().constData());
+            m_qFile[h].close();
+            if(h == 1)
+                m_qFile[0].close();
+            return false;
+        }
+    }
+
+    m_iNumSamples = 0;
+    m_bStarted = true;
+
+    return true;
+}
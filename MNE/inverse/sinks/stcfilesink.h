@@ -0,0 +1,152 @@
+//=============================================================================================================
+/**
+* @file     stcfilesink.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    StcFileSink class declaration.
+*
+*/
+
+#ifndef STCFILESINK_H
+#define STCFILESINK_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "../inverse_global.h"
+#include "../ISourceEstimateSink.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Qt INCLUDES
+//=============================================================================================================
+
+#include <QFile>
+#include <QList>
+#include <QString>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE INVERSELIB
+//=============================================================================================================
+
+namespace INVERSELIB
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+
+
+//=============================================================================================================
+/**
+* Writes a streamed source estimate to STC files, one per hemisphere (<prefix>-lh.stc, <prefix>-rh.stc).
+* The samples are appended as they arrive, the number of samples in the header is patched by finish.
+*
+* @brief Streams a source estimate to STC files
+*/
+class INVERSESHARED_EXPORT StcFileSink : public ISourceEstimateSink
+{
+public:
+    typedef QSharedPointer<StcFileSink> SPtr;             /**< Shared pointer type for StcFileSink. */
+    typedef QSharedPointer<const StcFileSink> ConstSPtr;  /**< Const shared pointer type for StcFileSink. */
+
+    //=========================================================================================================
+    /**
+    * Constructs a STC file sink.
+    *
+    * @param[in] p_sPrefix  File name prefix, the hemisphere and the .stc extension are appended.
+    */
+    explicit StcFileSink(const QString &p_sPrefix);
+
+    //=========================================================================================================
+    /**
+    * Destroys the StcFileSink, finishes the files if this was not done before.
+    */
+    virtual ~StcFileSink();
+
+    virtual bool write(const SourceEstimate &p_sourceEstimateChunk);
+
+    virtual bool finish();
+
+    //=========================================================================================================
+    /**
+    * Returns the number of samples written so far.
+    *
+    * @return the number of samples
+    */
+    inline qint32 samples() const;
+
+private:
+    //=========================================================================================================
+    /**
+    * Opens the files and writes the headers.
+    *
+    * @param[in] p_sourceEstimateChunk  First chunk of the source estimate.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    bool start(const SourceEstimate &p_sourceEstimateChunk);
+
+    QString m_sPrefix;              /**< File name prefix */
+    QFile m_qFile[2];               /**< STC file of the left and right hemisphere */
+    qint32 m_iRowOffset[2];         /**< First source estimate row of each hemisphere */
+    qint32 m_iNumVertices[2];       /**< Number of vertices of each hemisphere, 0 if the hemisphere is not written */
+    qint32 m_iNumSamples;           /**< Number of samples written so far */
+    bool m_bStarted;                /**< Whether the headers are written */
+};
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline qint32 StcFileSink::samples() const
+{
+    return m_iNumSamples;
+}
+
+} //NAMESPACE
+
+#endif // STCFILESINK_H
@@ -37,7 +37,7 @@ include(../../mne-cpp.pri)
 
 TEMPLATE = lib
 
-QT += network
+QT += network concurrent
 QT -= gui
 
 DEFINES += MNE_LIBRARY
@@ -81,6 +81,7 @@ SOURCES += \
     mne_forwardsolution.cpp \
     mne_hemisphere.cpp \
     mne_inverse_operator.cpp \
+    mne_inverse_setup.cpp \
     mne_epoch_data.cpp \
     mne_epoch_data_list.cpp \
     mne_cluster_info.cpp
@@ -92,6 +93,7 @@ HEADERS += \
     mne_hemisphere.h \
     mne_forwardsolution.h \
     mne_inverse_operator.h \
+    mne_inverse_setup.h \
     mne_epoch_data.h \
     mne_epoch_data_list.h \
     mne_cluster_info.h
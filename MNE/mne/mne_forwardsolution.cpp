@@ -59,6 +59,15 @@
 #include <iostream>
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QHash>
+#include <QtConcurrent>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -69,6 +78,123 @@ using namespace UTILSLIB;
 using namespace FSLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STATIC DEFINITIONS
+//=============================================================================================================
+
+namespace
+{
+
+//=============================================================================================================
+/**
+* One annotation label of cluster_forward_solution: the input of the clustering and its results.
+*/
+struct ClusterRegion
+{
+    const MatrixXd* pMatLeadField;      /**< The complete lead field (free orientation). */
+    qint32 iHemi;                       /**< Hemisphere of the label. */
+    qint32 iOffset;                     /**< Source offset of the hemisphere in the lead field. */
+    qint32 iLabelId;                    /**< Id of the label. */
+    QString sName;                      /**< Structure name of the label. */
+    qint32 iClusterSize;                /**< Maximal cluster size. */
+    qint32 iSeed;                       /**< Seed of the K-Means random generator. */
+    VectorXi vecIdcs;                   /**< Hemisphere source indices belonging to the label. */
+
+    MatrixXd matLFPartial;              /**< Result: cluster centroids, 3 columns per cluster. */
+    QList<VectorXi> qListClusterIdcs;   /**< Result: source indices per cluster. */
+    QList<VectorXd> qListClusterDistances;  /**< Result: distances to the centroid per cluster. */
+    VectorXi vecSelIdcs;                /**< Result: source closest to the centroid per cluster. */
+};
+
+
+//*************************************************************************************************************
+
+/**
+* Clusters the lead field of one region with K-Means. Called concurrently, a K-Means object per call.
+*
+* @param[in] p_region   The region to cluster
+*
+* @return the region with its clustering results
+*/
+ClusterRegion clusterRegion(const ClusterRegion &p_region)
+{
+    ClusterRegion t_region(p_region);
+    const MatrixXd &t_LFAll = *t_region.pMatLeadField;
+    const VectorXi &idcs = t_region.vecIdcs;
+
+    qint32 nSens = t_LFAll.rows();
+    qint32 nSources = idcs.rows();
+    if(nSources == 0)
+        return t_region;
+
+    qint32 nClusters = ceil((double)nSources/(double)t_region.iClusterSize);
+
+    //
+    // Reshape Input data -> sources rows; sensors columns
+    //
+    MatrixXd t_sensLF(nSources, 3*nSens);
+    for(qint32 k = 0; k < nSources; ++k)
+        for(qint32 j = 0; j < nSens; ++j)
+            t_sensLF.block(k,j*3,1,3) = t_LFAll.block(j, (idcs[k]+t_region.iOffset)*3, 1, 3);
+
+    // Kmeans Reduction
+    KMeans t_kMeans(QString("sqeuclidean"), QString("sample"), 5, QString("error"), true, 100, t_region.iSeed);//QString("sqeuclidean")//QString("sample")//cityblock
+    VectorXi roiIdx;
+    MatrixXd ctrs;
+    VectorXd sumd;
+    MatrixXd D;
+
+    t_kMeans.calculate(t_sensLF, nClusters, roiIdx, ctrs, sumd, D);
+
+    //
+    // Assign the centroid for each cluster to the partial LF
+    //
+    t_region.matLFPartial = MatrixXd::Zero(nSens, nClusters*3);
+    for(qint32 j = 0; j < nSens; ++j)
+        for(qint32 k = 0; k < nClusters; ++k)
+            t_region.matLFPartial.block(j, k*3, 1, 3) = ctrs.block(k,j*3,1,3);
+
+    //
+    // Get cluster indizes and its distances to the centroid
+    //
+    for(qint32 j = 0; j < nClusters; ++j)
+    {
+        VectorXi clusterIdcs = VectorXi::Zero(roiIdx.rows());
+        VectorXd clusterDistance = VectorXd::Zero(roiIdx.rows());
+        qint32 nClusterIdcs = 0;
+        for(qint32 k = 0; k < roiIdx.rows(); ++k)
+        {
+            if(roiIdx[k] == j)
+            {
+                clusterIdcs[nClusterIdcs] = idcs[k];
+                clusterDistance[nClusterIdcs] = D(k,j);
+                ++nClusterIdcs;
+            }
+        }
+        clusterIdcs.conservativeResize(nClusterIdcs);
+        clusterDistance.conservativeResize(nClusterIdcs);
+        t_region.qListClusterIdcs.append(clusterIdcs);
+        t_region.qListClusterDistances.append(clusterDistance);
+    }
+
+    //
+    // Map the centroids to the closest source, the distance is taken in the (sources x 3*sensors) layout
+    //
+    t_region.vecSelIdcs.resize(nClusters);
+    for(qint32 k = 0; k < nClusters; ++k)
+    {
+        qint32 j_min = 0;
+        (t_sensLF.rowwise() - ctrs.row(k)).rowwise().squaredNorm().minCoeff(&j_min);
+        t_region.vecSelIdcs[k] = idcs[j_min];
+    }
+
+    return t_region;
+}
+
+} // NAMESPACE
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -223,204 +349,114 @@ MNEForwardSolution MNEForwardSolution::cluster_forward_solution(AnnotationSet &p
     //DEBUG END
 
 
-    KMeans t_kMeans(QString("sqeuclidean"), QString("sample"), 5);//QString("sqeuclidean")//QString("sample")//cityblock
-    MatrixXd t_LF_new;
-
-    qint32 count;
-    qint32 offset;
+    //
+    // Collect the regions of both hemispheres; the label -> source index map is built in one pass per hemisphere
+    //
+    QList<ClusterRegion> t_qListRegions;
+    qint32 offset = 0;
 
     for(qint32 h = 0; h < this->src.size(); ++h )//obj.sizeForwardSolution)
     {
-        count = 0;
-        offset = 0;
-
         // Offset for continuous indexing;
         if(h > 0)
-            for(qint32 j = 0; j < h; ++j)
-                offset += this->src[j].nuse;
-
-        if(h == 0)
-            printf("Cluster Left Hemisphere\n");
-        else
-            printf("Cluster Right Hemisphere\n");
+            offset += this->src[h-1].nuse;
 
         Colortable t_CurrentColorTable = p_AnnotationSet[h].getColortable();
         VectorXi label_ids = t_CurrentColorTable.getLabelIds();
 
-        // Get label ids for every vertex
-        VectorXi vertno_labeled = VectorXi::Zero(this->src[h].vertno.rows());
-
         //ToDo make this more universal -> using Label instead of annotations - obsolete when using Labels
-        for(qint32 i = 0; i < vertno_labeled.rows(); ++i)
-            vertno_labeled[i] = p_AnnotationSet[h].getLabelIds()[this->src[h].vertno[i]];
+        QHash<qint32, QList<qint32> > t_hashLabelSources;
+        for(qint32 i = 0; i < this->src[h].vertno.rows(); ++i)
+            t_hashLabelSources[p_AnnotationSet[h].getLabelIds()[this->src[h].vertno[i]]].append(i);
 
         //iterate over labels
-        MatrixXd t_LF_partial;
         for (qint32 i = 0; i < label_ids.rows(); ++i)
         {
-
             if (label_ids[i] != 0)
             {
-                QString curr_name = t_CurrentColorTable.struct_names[i];//obj.label2AtlasName(label(i));
-                printf("\tCluster %d / %d %s...", i+1, label_ids.rows(), curr_name.toUtf8().constData());
-
-                //
-                // Get source space indeces
-                //
-                VectorXi idcs = VectorXi::Zero(vertno_labeled.rows());
-                qint32 c = 0;
+                ClusterRegion t_region;
+                t_region.pMatLeadField = &this->sol.constData()->data;
+                t_region.iHemi = h;
+                t_region.iOffset = offset;
+                t_region.iLabelId = label_ids[i];
+                t_region.sName = t_CurrentColorTable.struct_names[i];
+                t_region.iClusterSize = p_iClusterSize;
+                // deterministic, independent of the scheduling
+                t_region.iSeed = (h+1) * 100003 + i;
+
+                const QList<qint32> t_qListSources = t_hashLabelSources.value(label_ids[i]);
+                t_region.vecIdcs.resize(t_qListSources.size());
+                for(qint32 j = 0; j < t_qListSources.size(); ++j)
+                    t_region.vecIdcs[j] = t_qListSources[j];
+
+                t_qListRegions.append(t_region);
+            }
+        }
+    }
 
-                //Select ROIs //change this use label info with a hash tabel
-                for(qint32 j = 0; j < vertno_labeled.rows(); ++j)
-                {
-                    if(vertno_labeled[j] == label_ids[i])
-                    {
-                        idcs[c] = j;
-                        ++c;
-                    }
-                }
-                idcs.conservativeResize(c);
+    //
+    // Cluster all regions concurrently; the results keep the order of the regions
+    //
+    printf("Cluster %d regions\n", t_qListRegions.size());
+    t_qListRegions = QtConcurrent::blockingMapped(t_qListRegions, clusterRegion);
 
-//                VectorXi idcs_triplet = tripletSelection(idcs);//ToDo obsolete: use block instead
+    //
+    // Assemble the clustered forward solution
+    //
+    MatrixXd t_LF_new;
+    qint32 nClusters = 0;
+    for(qint32 r = 0; r < t_qListRegions.size(); ++r)
+        nClusters += t_qListRegions[r].vecSelIdcs.size();
+    t_LF_new.resize(this->sol.constData()->data.rows(), 3*nClusters);
+
+    QVector<qint32> count(this->src.size(), 0);
+    qint32 t_iCol = 0;
+    for(qint32 r = 0; r < t_qListRegions.size(); ++r)
+    {
+        const ClusterRegion &t_region = t_qListRegions[r];
+        qint32 h = t_region.iHemi;
 
-                //get selected LF
-                MatrixXd t_LF(this->sol->data.rows(), idcs.rows()*3);
+        if(t_region.vecSelIdcs.size() == 0)
+        {
+            printf("\t%s failed! Label contains no sources.\n", t_region.sName.toUtf8().constData());
+            continue;
+        }
+        printf("\t%s %d Cluster(s)\n", t_region.sName.toUtf8().constData(), (qint32)t_region.vecSelIdcs.size());
 
-                for(qint32 j = 0; j < idcs.rows(); ++j)
-                    t_LF.block(0, j*3, t_LF.rows(), 3) = this->sol->data.block(0, (idcs[j]+offset)*3, t_LF.rows(), 3);
+        for(qint32 j = 0; j < t_region.qListClusterIdcs.size(); ++j)
+        {
+            p_fwdOut.src[h].cluster_info.clusterVertnos.append(t_region.qListClusterIdcs[j]);
+            p_fwdOut.src[h].cluster_info.clusterDistances.append(t_region.qListClusterDistances[j]);
+            p_fwdOut.src[h].cluster_info.clusterLabelIds.append(t_region.iLabelId);
+        }
 
-                qint32 nSens = t_LF.rows();
-                qint32 nSources = t_LF.cols()/3;
-                qint32 nClusters = 0;
+        t_LF_new.block(0, t_iCol, t_LF_new.rows(), t_region.matLFPartial.cols()) = t_region.matLFPartial;
+        t_iCol += t_region.matLFPartial.cols();
 
-                if (nSources > 0)
-                {
-                    nClusters = ceil((double)nSources/(double)p_iClusterSize);
-
-                    printf("%d Cluster(s)... ", nClusters);
-
-                    t_LF_partial = MatrixXd::Zero(nSens,nClusters*3);
-
-                    // Reshape Input data -> sources rows; sensors columns
-                    MatrixXd t_sensLF(t_LF.cols()/3, 3*nSens);
-                    for(qint32 j = 0; j < nSens; ++j)
-                    {
-                        for(qint32 k = 0; k < t_sensLF.rows(); ++k)
-                            t_sensLF.block(k,j*3,1,3) = t_LF.block(j,k*3,1,3);
-                    }
-
-                    // Kmeans Reduction
-                    VectorXi roiIdx;
-                    MatrixXd ctrs;
-                    VectorXd sumd;
-                    MatrixXd D;
-
-                    t_kMeans.calculate(t_sensLF, nClusters, roiIdx, ctrs, sumd, D);
-
-                    //
-                    // Assign the centroid for each cluster to the partial LF
-                    //
-                    for(qint32 j = 0; j < nSens; ++j)
-                        for(qint32 k = 0; k < nClusters; ++k)
-                            t_LF_partial.block(j, k*3, 1, 3) = ctrs.block(k,j*3,1,3);
-
-                    //
-                    // Get cluster indizes and its distances to the centroid
-                    //
-                    for(qint32 j = 0; j < nClusters; ++j)
-                    {
-                        VectorXi clusterIdcs = VectorXi::Zero(roiIdx.rows());
-                        VectorXd clusterDistance = VectorXd::Zero(roiIdx.rows());
-                        qint32 nClusterIdcs = 0;
-                        for(qint32 k = 0; k < roiIdx.rows(); ++k)
-                        {
-                            if(roiIdx[k] == j)
-                            {
-                                clusterIdcs[nClusterIdcs] = idcs[k];
-                                clusterDistance[nClusterIdcs] = D(k,j);
-                                ++nClusterIdcs;
-                            }
-                        }
-                        clusterIdcs.conservativeResize(nClusterIdcs);
-                        p_fwdOut.src[h].cluster_info.clusterVertnos.append(clusterIdcs);
-                        p_fwdOut.src[h].cluster_info.clusterDistances.append(clusterDistance);
-                        p_fwdOut.src[h].cluster_info.clusterLabelIds.append(label_ids[i]);
-                    }
-
-                    //
-                    // Assign partial LF to new LeadField
-                    //
-                    if(t_LF_partial.rows() > 0 && t_LF_partial.cols() > 0)
-                    {
-                        t_LF_new.conservativeResize(t_LF_partial.rows(), t_LF_new.cols() + t_LF_partial.cols());
-                        t_LF_new.block(0, t_LF_new.cols() - t_LF_partial.cols(), t_LF_new.rows(), t_LF_partial.cols()) = t_LF_partial;
-
-                        // Map the centroids to the closest rr
-                        for(qint32 k = 0; k < nClusters; ++k)
-                        {
-                            qint32 j = 0;
-
-                            double sqec = sqrt((t_LF.block(0, j*3, t_LF.rows(), 3) - t_LF_partial.block(0, k*3, t_LF_partial.rows(), 3)).array().pow(2).sum());
-                            double sqec_min = sqec;
-                            double j_min = j;
-                            for(qint32 j = 1; j < idcs.rows(); ++j)
-                            {
-                                sqec = sqrt((t_LF.block(0, j*3, t_LF.rows(), 3) - t_LF_partial.block(0, k*3, t_LF_partial.rows(), 3)).array().pow(2).sum());
-                                if(sqec < sqec_min)
-                                {
-                                    sqec_min = sqec;
-                                    j_min = j;
-                                }
-                            }
-
-                            // Take the closest coordinates
-                            qint32 sel_idx = idcs[j_min];
-                            //ToDo store this in cluster info
-//                            p_fwdOut.src[h].rr.row(count) = this->src[h].rr.row(sel_idx);
-//                            p_fwdOut.src[h].nn.row(count) = MatrixXd::Zero(1,3);
-
-                            p_fwdOut.src[h].vertno[count] = this->src[h].vertno[sel_idx];
-                            ++count;
-                        }
-                    }
-                    printf("[done]\n");
-                }
-                else
-                {
-                    printf("failed! Label contains no sources.\n");
-                }
-            }
+        for(qint32 k = 0; k < t_region.vecSelIdcs.size(); ++k)
+        {
+            //ToDo store this in cluster info
+//            p_fwdOut.src[h].rr.row(count) = this->src[h].rr.row(sel_idx);
+//            p_fwdOut.src[h].nn.row(count) = MatrixXd::Zero(1,3);
+            p_fwdOut.src[h].vertno[count[h]] = this->src[h].vertno[t_region.vecSelIdcs[k]];
+            ++count[h];
         }
+    }
 
-        //
-        // Assemble new hemisphere information
-        //
+    //
+    // Assemble new hemisphere information
+    //
+    for(qint32 h = 0; h < this->src.size(); ++h)
+    {
 //ToDo store this in cluster info
 //        p_fwdOut.src[h].rr.conservativeResize(count, 3);
 //        p_fwdOut.src[h].nn.conservativeResize(count, 3);
-        p_fwdOut.src[h].vertno.conservativeResize(count);
+        p_fwdOut.src[h].vertno.conservativeResize(count[h]);
 
 //        p_fwdOut.src[h].nuse_tri = 0;
 //        p_fwdOut.src[h].use_tris = MatrixX3i(0,3);
-
-
-//        if(p_fwdOut.src[h].rr.rows() > 0 && p_fwdOut.src[h].rr.cols() > 0)
-//        {
-//            if(h == 0)
-//            {
-//                p_fwdOut.source_rr = MatrixX3d(0,3);
-//                p_fwdOut.source_nn = MatrixX3d(0,3);
-//            }
-
-//            p_fwdOut.source_rr.conservativeResize(p_fwdOut.source_rr.rows() + p_fwdOut.src[h].rr.rows(),3);
-//            p_fwdOut.source_rr.block(p_fwdOut.source_rr.rows() -  p_fwdOut.src[h].rr.rows(), 0,  p_fwdOut.src[h].rr.rows(), 3) = p_fwdOut.src[h].rr;
-
-//            p_fwdOut.source_nn.conservativeResize(p_fwdOut.source_nn.rows() + p_fwdOut.src[h].nn.rows(),3);
-//            p_fwdOut.source_nn.block(p_fwdOut.source_nn.rows() -  p_fwdOut.src[h].nn.rows(), 0,  p_fwdOut.src[h].nn.rows(), 3) = p_fwdOut.src[h].nn;
-//        }
-
-        printf("[done]\n");
     }
+    printf("[done]\n");
 
     //
     // Put it all together
@@ -694,41 +730,7 @@ void MNEForwardSolution::prepare_forward(const FiffInfo &p_info, const FiffCov &
     //
     p_outNoiseCov = p_noise_cov.prepare_noise_cov(p_info, ch_names);
 
-    //   Omit the zeroes due to projection
-    p_outNumNonZero = 0;
-    VectorXi t_vecNonZero = VectorXi::Zero(n_chan);
-    for(qint32 i = 0; i < p_outNoiseCov.eig.rows(); ++i)
-    {
-        if(p_outNoiseCov.eig[i] > 0)
-        {
-            t_vecNonZero[p_outNumNonZero] = i;
-            ++p_outNumNonZero;
-        }
-    }
-    if(p_outNumNonZero > 0)
-        t_vecNonZero.conservativeResize(p_outNumNonZero);
-
-    if(p_outNumNonZero > 0)
-    {
-        if (p_pca)
-        {
-            qWarning("Warning in MNEForwardSolution::prepare_forward: if (p_pca) havent been debugged.");
-            p_outWhitener = MatrixXd::Zero(n_chan, p_outNumNonZero);
-            // Rows of eigvec are the eigenvectors
-            for(qint32 i = 0; i < p_outNumNonZero; ++i)
-                p_outWhitener.col(t_vecNonZero[i]) = p_outNoiseCov.eigvec.col(t_vecNonZero[i]).array() / sqrt(p_outNoiseCov.eig(t_vecNonZero[i]));
-            printf("\tReducing data rank to %d.\n", p_outNumNonZero);
-        }
-        else
-        {
-            printf("Creating non pca whitener.\n");
-            p_outWhitener = MatrixXd::Zero(n_chan, n_chan);
-            for(qint32 i = 0; i < p_outNumNonZero; ++i)
-                p_outWhitener(t_vecNonZero[i],t_vecNonZero[i]) = 1.0 / sqrt(p_outNoiseCov.eig(t_vecNonZero[i]));
-            // Cols of eigvec are the eigenvectors
-            p_outWhitener *= p_outNoiseCov.eigvec;
-        }
-    }
+    compute_whitener(p_outNoiseCov, p_pca, p_outWhitener, p_outNumNonZero);
 
     VectorXi fwd_idx = VectorXi::Zero(ch_names.size());
     VectorXi info_idx = VectorXi::Zero(ch_names.size());
@@ -763,6 +765,48 @@ void MNEForwardSolution::prepare_forward(const FiffInfo &p_info, const FiffCov &
 }
 
 
+//*************************************************************************************************************
+
+void MNEForwardSolution::compute_whitener(const FiffCov &p_noise_cov, bool p_pca, MatrixXd &p_outWhitener, qint32 &p_outNumNonZero)
+{
+    //   Omit the zeroes due to projection
+    p_outNumNonZero = 0;
+    VectorXi t_vecNonZero = VectorXi::Zero(p_noise_cov.eig.rows());
+    for(qint32 i = 0; i < p_noise_cov.eig.rows(); ++i)
+    {
+        if(p_noise_cov.eig[i] > 0)
+        {
+            t_vecNonZero[p_outNumNonZero] = i;
+            ++p_outNumNonZero;
+        }
+    }
+    if(p_outNumNonZero > 0)
+        t_vecNonZero.conservativeResize(p_outNumNonZero);
+
+    if(p_outNumNonZero > 0)
+    {
+        if (p_pca)
+        {
+            qWarning("Warning in MNEForwardSolution::prepare_forward: if (p_pca) havent been debugged.");
+            p_outWhitener = MatrixXd::Zero(p_noise_cov.eig.rows(), p_outNumNonZero);
+            // Rows of eigvec are the eigenvectors
+            for(qint32 i = 0; i < p_outNumNonZero; ++i)
+                p_outWhitener.col(t_vecNonZero[i]) = p_noise_cov.eigvec.col(t_vecNonZero[i]).array() / sqrt(p_noise_cov.eig(t_vecNonZero[i]));
+            printf("\tReducing data rank to %d.\n", p_outNumNonZero);
+        }
+        else
+        {
+            printf("Creating non pca whitener.\n");
+            p_outWhitener = MatrixXd::Zero(p_noise_cov.eig.rows(), p_noise_cov.eig.rows());
+            for(qint32 i = 0; i < p_outNumNonZero; ++i)
+                p_outWhitener(t_vecNonZero[i],t_vecNonZero[i]) = 1.0 / sqrt(p_noise_cov.eig(t_vecNonZero[i]));
+            // Cols of eigvec are the eigenvectors
+            p_outWhitener *= p_noise_cov.eigvec;
+        }
+    }
+}
+
+
 //*************************************************************************************************************
 
 bool MNEForwardSolution::read(QIODevice& p_IODevice, MNEForwardSolution& fwd, bool force_fixed, bool surf_ori, const QStringList& include, const QStringList& exclude, bool bExcludeBads)
@@ -777,7 +821,7 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice, MNEForwardSolution& fwd, bo
     //
     //   Find all forward solutions
     //
-    QList<FiffDirTree> fwds = t_Tree.dir_tree_find(FIFFB_MNE_FORWARD_SOLUTION);
+    QList<const FiffDirTree*> fwds = t_Tree.dir_tree_find_nodes(FIFFB_MNE_FORWARD_SOLUTION);
 
     if (fwds.size() == 0)
     {
@@ -788,7 +832,7 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice, MNEForwardSolution& fwd, bo
     //
     //   Parent MRI data
     //
-    QList<FiffDirTree> parent_mri = t_Tree.dir_tree_find(FIFFB_MNE_PARENT_MRI_FILE);
+    QList<const FiffDirTree*> parent_mri = t_Tree.dir_tree_find_nodes(FIFFB_MNE_PARENT_MRI_FILE);
     if (parent_mri.size() == 0)
     {
         t_pStream->device()->close();
@@ -828,11 +872,12 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice, MNEForwardSolution& fwd, bo
     //   Locate and read the forward solutions
     //
     FiffTag::SPtr t_pTag;
-    FiffDirTree megnode;
-    FiffDirTree eegnode;
+    FiffDirTree t_emptyNode;
+    const FiffDirTree* megnode = &t_emptyNode;
+    const FiffDirTree* eegnode = &t_emptyNode;
     for(qint32 k = 0; k < fwds.size(); ++k)
     {
-        if(!fwds[k].find_tag(t_pStream.data(), FIFF_MNE_INCLUDED_METHODS, t_pTag))
+        if(!fwds[k]->find_tag(t_pStream.data(), FIFF_MNE_INCLUDED_METHODS, t_pTag))
         {
             t_pStream->device()->close();
             std::cout << "Methods not listed for one of the forward solutions\n"; // ToDo throw error
@@ -852,7 +897,7 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice, MNEForwardSolution& fwd, bo
 
     MNEForwardSolution megfwd;
     QString ori;
-    if (read_one(t_pStream.data(), megnode, megfwd))
+    if (read_one(t_pStream.data(), *megnode, megfwd))
     {
         if (megfwd.source_ori == FIFFV_MNE_FIXED_ORI)
             ori = QString("fixed");
@@ -861,7 +906,7 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice, MNEForwardSolution& fwd, bo
         printf("\tRead MEG forward solution (%d sources, %d channels, %s orientations)\n", megfwd.nsource,megfwd.nchan,ori.toUtf8().constData());
     }
     MNEForwardSolution eegfwd;
-    if (read_one(t_pStream.data(), eegnode, eegfwd))
+    if (read_one(t_pStream.data(), *eegnode, eegfwd))
     {
         if (eegfwd.source_ori == FIFFV_MNE_FIXED_ORI)
             ori = QString("fixed");
@@ -916,7 +961,7 @@ bool MNEForwardSolution::read(QIODevice& p_IODevice, MNEForwardSolution& fwd, bo
     //
     //   Get the MRI <-> head coordinate transformation
     //
-    if(!parent_mri[0].find_tag(t_pStream.data(), FIFF_COORD_TRANS, t_pTag))
+    if(!parent_mri[0]->find_tag(t_pStream.data(), FIFF_COORD_TRANS, t_pTag))
     {
         t_pStream->device()->close();
         std::cout << "MRI/head coordinate transformation not found\n"; // ToDo throw error
@@ -267,6 +267,18 @@ public:
     */
     void prepare_forward(const FiffInfo &p_info, const FiffCov &p_noise_cov, bool p_pca, FiffInfo &p_outFwdInfo, MatrixXd &gain, FiffCov &p_outNoiseCov, MatrixXd &p_outWhitener, qint32 &p_outNumNonZero) const;
 
+    //=========================================================================================================
+    /**
+    * Computes the whitener of a noise covariance matrix prepared by FiffCov::prepare_noise_cov. Zero
+    * eigenvalues, i.e. the directions removed by the projection, are omitted.
+    *
+    * @param[in] p_noise_cov        The prepared noise covariance matrix.
+    * @param[in] p_pca              Calculate pca or not.
+    * @param[out] p_outWhitener     Whitener
+    * @param[out] p_outNumNonZero   the rank (non zeros)
+    */
+    static void compute_whitener(const FiffCov &p_noise_cov, bool p_pca, MatrixXd &p_outWhitener, qint32 &p_outNumNonZero);
+
 //    //=========================================================================================================
 //    /**
 //    * Prepares a forward solution, Bad channels, after clustering etc ToDo...
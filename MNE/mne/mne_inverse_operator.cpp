@@ -42,6 +42,14 @@
 #include <fs/label.h>
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <limits>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -85,9 +93,9 @@ MNEInverseOperator::MNEInverseOperator(QIODevice& p_IODevice)
 
 //*************************************************************************************************************
 
-MNEInverseOperator::MNEInverseOperator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov& p_noise_cov, float loose, float depth, bool fixed, bool limit_depth_chs)
+MNEInverseOperator::MNEInverseOperator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov& p_noise_cov, float loose, float depth, bool fixed, bool limit_depth_chs, SvdMethod svd_method)
 {
-    *this = MNEInverseOperator::make_inverse_operator(info, forward, p_noise_cov, loose, depth, fixed, limit_depth_chs);
+    *this = MNEInverseOperator::make_inverse_operator(info, forward, p_noise_cov, loose, depth, fixed, limit_depth_chs, svd_method);
 }
 
 
@@ -135,67 +143,31 @@ MNEInverseOperator::~MNEInverseOperator()
 
 bool MNEInverseOperator::assemble_kernel(const Label &label, QString method, bool pick_normal, MatrixXd &K, SparseMatrix<double> &noise_norm, QList<VectorXi> &vertno) const
 {
-    MatrixXd t_eigen_leads = this->eigen_leads->data;
-    MatrixXd t_source_cov = this->source_cov->data;
-    if(method.compare("MNE") != 0)
-        noise_norm = this->noisenorm;
-
-    vertno = this->src.get_vertno();
-
-    typedef Eigen::Triplet<double> T;
-    std::vector<T> tripletList;
+    QList<Label> t_qListLabels;
+    t_qListLabels << label;
 
-    if(!label.isEmpty())
-    {
-        qDebug() << "ToDo: Label selection needs to be debugged - not done jet!";
-        VectorXi src_sel;
-        vertno = this->src.label_src_vertno_sel(label, src_sel);
+    QList<MatrixXd> t_qListK;
+    QList< SparseMatrix<double> > t_qListNoiseNorm;
+    QList< QList<VectorXi> > t_qListVertno;
 
-        if(method.compare("MNE") != 0)
-        {
-            tripletList.clear();
-            tripletList.reserve(noise_norm.nonZeros());
-
-            for (qint32 k = 0; k < noise_norm.outerSize(); ++k)
-            {
-                for (SparseMatrix<double>::InnerIterator it(noise_norm,k); it; ++it)
-                {
-                    //ToDo bad search - increase speed by using stl search
-                    qint32 row = -1;
-                    for(qint32 i = 0; i < src_sel.size(); ++i)
-                        if(src_sel[i] == it.row())
-                            row = i;
-                    if(row != -1)
-                        tripletList.push_back(T(it.row(), it.col(), it.value()));
-                }
-            }
+    if(!assemble_kernels(t_qListLabels, method, pick_normal, t_qListK, t_qListNoiseNorm, t_qListVertno))
+        return false;
 
-            noise_norm = SparseMatrix<double>(src_sel.size(),noise_norm.cols());
-            noise_norm.setFromTriplets(tripletList.begin(), tripletList.end());
-        }
+    K = t_qListK[0];
+    noise_norm = t_qListNoiseNorm[0];
+    vertno = t_qListVertno[0];
 
-        if(this->source_ori == FIFFV_MNE_FREE_ORI)
-        {
-            VectorXi src_sel_new(src_sel.size()*3);
+    return true;
+}
 
-            for(qint32 i = 0; i < src_sel.size(); ++i)
-            {
-                src_sel_new[i*3] = src_sel[i]*3;
-                src_sel_new[i*3+1] = src_sel[i]*3+1;
-                src_sel_new[i*3+2] = src_sel[i]*3+2;
-            }
-            src_sel = src_sel_new;
-        }
 
+//*************************************************************************************************************
 
-        for(qint32 i = 0; i < src_sel.size(); ++i)
-        {
-            t_eigen_leads.row(i) = t_eigen_leads.row(src_sel[i]);
-            t_source_cov = t_source_cov.row(src_sel[i]);
-        }
-        t_eigen_leads.conservativeResize(src_sel.size(), t_eigen_leads.cols());
-        t_source_cov.conservativeResize(src_sel.size(), t_source_cov.cols());
-    }
+bool MNEInverseOperator::assemble_kernels(const QList<Label> &labels, QString method, bool pick_normal, QList<MatrixXd> &K, QList< SparseMatrix<double> > &noise_norm, QList< QList<VectorXi> > &vertno) const
+{
+    K.clear();
+    noise_norm.clear();
+    vertno.clear();
 
     if(pick_normal)
     {
@@ -211,64 +183,106 @@ bool MNEInverseOperator::assemble_kernel(const Label &label, QString method, boo
             qWarning("The pick_normal parameter is only valid when working with loose orientations.\n");
             return false;
         }
+    }
 
-        // keep only the normal components
-        qint32 count = 0;
-        for(qint32 i = 2; i < t_eigen_leads.rows(); i+=3)
-        {
-            t_eigen_leads.row(count) = t_eigen_leads.row(i);
-            ++count;
-        }
-        t_eigen_leads.conservativeResize(count, t_eigen_leads.cols());
+    //
+    //   Source selection of each label, an empty label selects the whole source space
+    //
+    qint32 nsrc = this->src.size() > 0 ? this->src[0].nuse : 0;
+    for(qint32 h = 1; h < this->src.size(); ++h)
+        nsrc += this->src[h].nuse;
 
-        count = 0;
-        for(qint32 i = 2; i < t_source_cov.rows(); i+=3)
+    QList<VectorXi> t_qListSrcSel;
+    qint32 t_iNumSel = 0;
+    for(qint32 l = 0; l < labels.size(); ++l)
+    {
+        VectorXi src_sel;
+        if(labels[l].isEmpty())
         {
-            t_source_cov.row(count) = t_source_cov.row(i);
-            ++count;
+            src_sel = VectorXi::LinSpaced(nsrc, 0, nsrc-1);
+            vertno.push_back(this->src.get_vertno());
         }
-        t_source_cov.conservativeResize(count, t_source_cov.cols());
-    }
+        else
+            vertno.push_back(this->src.label_src_vertno_sel(labels[l], src_sel));
 
-    tripletList.clear();
-    tripletList.reserve(reginv.rows());
-    for(qint32 i = 0; i < reginv.rows(); ++i)
-        tripletList.push_back(T(i, i, reginv(i,0)));
-    SparseMatrix<double> t_reginv(reginv.rows(),reginv.rows());
-    t_reginv.setFromTriplets(tripletList.begin(), tripletList.end());
+        t_iNumSel += src_sel.size();
+        t_qListSrcSel.push_back(src_sel);
+    }
 
-    MatrixXd trans = t_reginv*eigen_fields->data*whitener*proj;
     //
-    //   Transformation into current distributions by weighting the eigenleads
-    //   with the weights computed above
+    //   Gather the eigenlead rows of all labels into one block (3 rows per source for free orientations, the
+    //   normal row only with pick_normal) and factor in R^0.5 if the eigenleads are not weighted yet
     //
-    if (eigen_leads_weighted)
+    const MatrixXd &t_matEigenLeads = this->eigen_leads->data;
+    const MatrixXd &t_matSourceCov = this->source_cov->data;
+
+    qint32 t_iRowsPerSrc = this->source_ori == FIFFV_MNE_FREE_ORI ? 3 : 1;
+    qint32 t_iOffset = pick_normal ? 2 : 0;
+    qint32 t_iNumOri = pick_normal ? 1 : t_iRowsPerSrc;
+
+    if(t_iRowsPerSrc*nsrc != t_matEigenLeads.rows())
     {
-        //
-        //     R^0.5 has been already factored in
-        //
-        printf("(eigenleads already weighted)...");
-        K = t_eigen_leads*trans;
+        qWarning("MNEInverseOperator::assemble_kernels - eigenleads (%d rows) do not match the source space (%d sources).", (qint32)t_matEigenLeads.rows(), nsrc);
+        return false;
     }
+
+    if (eigen_leads_weighted)
+        printf("(eigenleads already weighted)...");
     else
+        printf("(eigenleads need to be weighted)...");
+
+    MatrixXd t_matLeads(t_iNumSel*t_iNumOri, t_matEigenLeads.cols());
+    qint32 r = 0;
+    for(qint32 l = 0; l < t_qListSrcSel.size(); ++l)
     {
-        //
-        //     R^0.5 has to factored in
-        //
-       printf("(eigenleads need to be weighted)...");
+        const VectorXi &src_sel = t_qListSrcSel[l];
+        for(qint32 i = 0; i < src_sel.size(); ++i)
+        {
+            qint32 row = src_sel[i]*t_iRowsPerSrc + t_iOffset;
+            t_matLeads.middleRows(r, t_iNumOri) = t_matEigenLeads.middleRows(row, t_iNumOri);
+            if(!eigen_leads_weighted)
+                for(qint32 o = 0; o < t_iNumOri; ++o)
+                    t_matLeads.row(r+o) *= sqrt(t_matSourceCov(row+o,0));
+            r += t_iNumOri;
+        }
+    }
 
-       std::vector<T> tripletList2;
-       tripletList2.reserve(t_source_cov.rows());
-       for(qint32 i = 0; i < t_source_cov.rows(); ++i)
-           tripletList2.push_back(T(i, i, sqrt(t_source_cov(i,0))));
-       SparseMatrix<double> t_sourceCov(t_source_cov.rows(),t_source_cov.rows());
-       t_sourceCov.setFromTriplets(tripletList2.begin(), tripletList2.end());
+    //
+    //   One product for all labels
+    //
+    MatrixXd trans = reginv.asDiagonal()*eigen_fields->data*whitener*proj;
+    MatrixXd t_matK = t_matLeads*trans;
 
-       K = t_sourceCov*t_eigen_leads*trans;
-    }
+    //
+    //   Noise normalization factors, one per source
+    //
+    VectorXd t_vecNoiseNorm;
+    if(method.compare("MNE") != 0 && this->noisenorm.rows() == nsrc)
+        t_vecNoiseNorm = this->noisenorm.diagonal();
+
+    typedef Eigen::Triplet<double> T;
+
+    r = 0;
+    for(qint32 l = 0; l < t_qListSrcSel.size(); ++l)
+    {
+        const VectorXi &src_sel = t_qListSrcSel[l];
+        K.push_back(t_matK.middleRows(r, src_sel.size()*t_iNumOri));
+        r += src_sel.size()*t_iNumOri;
+
+        if(t_vecNoiseNorm.size() > 0)
+        {
+            std::vector<T> tripletList;
+            tripletList.reserve(src_sel.size());
+            for(qint32 i = 0; i < src_sel.size(); ++i)
+                tripletList.push_back(T(i, i, t_vecNoiseNorm[src_sel[i]]));
 
-    if(method.compare("MNE") == 0)
-        noise_norm = SparseMatrix<double>();
+            SparseMatrix<double> t_noiseNorm(src_sel.size(), src_sel.size());
+            t_noiseNorm.setFromTriplets(tripletList.begin(), tripletList.end());
+            noise_norm.push_back(t_noiseNorm);
+        }
+        else
+            noise_norm.push_back(SparseMatrix<double>());
+    }
 
     return true;
 }
@@ -322,150 +336,118 @@ bool MNEInverseOperator::check_ch_names(const FiffInfo &info) const
 
 //*************************************************************************************************************
 
-MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov &p_noise_cov, float loose, float depth, bool fixed, bool limit_depth_chs)
+MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov &p_noise_cov, float loose, float depth, bool fixed, bool limit_depth_chs, SvdMethod svd_method)
 {
-    bool is_fixed_ori = forward.isFixedOrient();
-    MNEInverseOperator p_MNEInverseOperator;
-
     qDebug() << "ToDo MNEInverseOperator::make_inverse_operator: do surf_ori check";
 
-    //Check parameters
-    if(fixed && loose > 0)
-    {
-        qWarning("Warning: When invoking make_inverse_operator with fixed = true, the loose parameter is ignored.\n");
-        loose = 0.0f;
-    }
+    MNEInverseSetup t_setup(info, forward, loose, depth, fixed, limit_depth_chs);
 
-    if(is_fixed_ori && !fixed)
-    {
-        qWarning("Warning: Setting fixed parameter = true. Because the given forward operator has fixed orientation and can only be used to make a fixed-orientation inverse operator.\n");
-        fixed = true;
-    }
+    return make_inverse_operator(t_setup, p_noise_cov, svd_method);
+}
 
-    if(forward.source_ori == -1 && loose > 0)
-    {
-        qCritical("Error: Forward solution is not oriented in surface coordinates. loose parameter should be 0 not %f.\n", loose);
-        return p_MNEInverseOperator;
-    }
 
-    if(loose < 0 || loose > 1)
-    {
-        qWarning("Warning: Loose value should be in interval [0,1] not %f.\n", loose);
-        loose = loose > 1 ? 1 : 0;
-        printf("Setting loose to %f.\n", loose);
-    }
+//*************************************************************************************************************
+
+MNEInverseOperator MNEInverseOperator::make_inverse_operator(const MNEInverseSetup &setup, const FiffCov &p_noise_cov, SvdMethod svd_method)
+{
+    MNEInverseOperator p_MNEInverseOperator;
 
-    if(depth < 0 || depth > 1)
+    if(setup.isEmpty())
     {
-        qWarning("Warning: Depth value should be in interval [0,1] not %f.\n", depth);
-        depth = depth > 1 ? 1 : 0;
-        printf("Setting depth to %f.\n", depth);
+        qWarning("Warning: MNEInverseOperator::make_inverse_operator - inverse setup is empty.\n");
+        return p_MNEInverseOperator;
     }
 
+    const FiffInfo &info = setup.info;
+
     //
-    // 1. Read the bad channels
-    // 2. Read the necessary data from the forward solution matrix file
     // 3. Load the projection data
     // 4. Load the sensor noise covariance matrix and attach it to the forward
     //
-    FiffInfo gain_info;
-    MatrixXd gain;
-    MatrixXd whitener;
-    qint32 n_nzero;
-    FiffCov p_outNoiseCov;
-    forward.prepare_forward(info, p_noise_cov, false, gain_info, gain, p_outNoiseCov, whitener, n_nzero);
+    QStringList ch_names;
+    VectorXi sel(setup.ch_names.size());
+    RowVectorXi info_idx(setup.ch_names.size());
+    qint32 nchan = 0;
+    for(qint32 i = 0; i < setup.ch_names.size(); ++i)
+    {
+        if(!p_noise_cov.bads.contains(setup.ch_names[i]))
+        {
+            ch_names << setup.ch_names[i];
+            sel[nchan] = i;
+            info_idx[nchan] = setup.info_idx[i];
+            ++nchan;
+        }
+    }
+    sel.conservativeResize(nchan);
+    info_idx.conservativeResize(nchan);
+    bool t_bAllChannels = nchan == setup.ch_names.size();
 
     //
-    // 5. Compose the depth weight matrix
+    // The depth prior depends on the channels, redo the setup without the channels the noise covariance drops
     //
-    FiffCov::SDPtr p_depth_prior;
-    MatrixXd patch_areas;
-    if(depth > 0)
+    if(!t_bAllChannels && setup.depth > 0)
     {
-        qDebug() << "ToDo: patch_areas";
-//        patch_areas = forward.get('patch_areas', None)
-        p_depth_prior = FiffCov::SDPtr(new FiffCov(MNEForwardSolution::compute_depth_prior(gain, gain_info, is_fixed_ori, depth, 10.0, patch_areas, limit_depth_chs)));
-    }
-    else
-    {
-        p_depth_prior->data = MatrixXd::Ones(gain.cols(), gain.cols());
-        p_depth_prior->kind = FIFFV_MNE_DEPTH_PRIOR_COV;
-        p_depth_prior->diag = true;
-        p_depth_prior->dim = gain.cols();
-        p_depth_prior->nfree = 1;
+        FiffInfo t_info = setup.info;
+        for(qint32 i = 0; i < p_noise_cov.bads.size(); ++i)
+            if(!t_info.bads.contains(p_noise_cov.bads[i]))
+                t_info.bads << p_noise_cov.bads[i];
+
+        MNEInverseSetup t_setup(t_info, setup.input_forward, setup.loose, setup.depth, setup.fixed, setup.limit_depth_chs);
+        p_MNEInverseOperator = make_inverse_operator(t_setup, p_noise_cov, svd_method);
+        p_MNEInverseOperator.info.bads = setup.info.bads;
+        return p_MNEInverseOperator;
     }
 
-    // Deal with fixed orientation forward / inverse
-    if(fixed)
-    {
-        if(depth < 0 || depth > 1)
-        {
-            // Convert the depth prior into a fixed-orientation one
-            printf("\tToDo: Picked elements from a free-orientation depth-weighting prior into the fixed-orientation one.\n");
-        }
-        if(!is_fixed_ori)
-        {
-            // Convert to the fixed orientation forward solution now
-            qint32 count = 0;
-            for(qint32 i = 2; i < p_depth_prior->data.rows(); i+=3)
-            {
-                p_depth_prior->data.row(count) = p_depth_prior->data.row(i);
-                ++count;
-            }
-            p_depth_prior->data.conservativeResize(count, 1);
+    printf("Computing inverse operator with %d channels.\n", nchan);
 
-//            forward = deepcopy(forward)
-            forward.to_fixed_ori();
-            is_fixed_ori = forward.isFixedOrient();
-            forward.prepare_forward(info, p_outNoiseCov, false, gain_info, gain, p_outNoiseCov, whitener, n_nzero);
-        }
-    }
-    printf("\tComputing inverse operator with %d channels.\n", gain_info.ch_names.size());
+    FiffCov p_outNoiseCov = p_noise_cov.prepare_noise_cov(info, ch_names);
+    MatrixXd whitener;
+    qint32 n_nzero;
+    MNEForwardSolution::compute_whitener(p_outNoiseCov, false, whitener, n_nzero);
+    printf("\tTotal rank is %d\n", n_nzero);
+
+    FiffInfo gain_info = info.pick_info(info_idx);
 
     //
-    // 6. Compose the source covariance matrix
+    // Without depth weighting the channels dropped by the noise covariance are just removed from the
+    // covariance independent stage
     //
-    printf("\tCreating the source covariance matrix\n");
-    FiffCov::SDPtr p_source_cov = p_depth_prior;
-
-    // apply loose orientations
-    FiffCov::SDPtr p_orient_prior;
-    if(!is_fixed_ori)
+    MatrixXd t_matGain;
+    MatrixXd t_matGainCov;
+    if(!t_bAllChannels)
     {
-        p_orient_prior = FiffCov::SDPtr(new FiffCov(forward.compute_orient_prior(loose)));
-        p_source_cov->data.array() *= p_orient_prior->data.array();
+        t_matGain.resize(nchan, setup.weighted_gain.cols());
+        t_matGainCov.resize(nchan, nchan);
+        for(qint32 i = 0; i < nchan; ++i)
+        {
+            t_matGain.row(i) = setup.weighted_gain.row(sel[i]);
+            for(qint32 j = 0; j < nchan; ++j)
+                t_matGainCov(i,j) = setup.gain_cov(sel[i], sel[j]);
+        }
     }
-
-    // 7. Apply fMRI weighting (not done)
+    const MatrixXd &gain = t_bAllChannels ? setup.weighted_gain : t_matGain;
+    const MatrixXd &gain_cov = t_bAllChannels ? setup.gain_cov : t_matGainCov;
 
     //
     // 8. Apply the linear projection to the forward solution
     // 9. Apply whitening to the forward computation matrix
+    // 11. Adjusting Source Covariance matrix to make trace of G*R*G' equal to number of sensors.
     //
-    printf("\tWhitening the forward solution.\n");
-    gain = whitener*gain;
-
-    // 10. Exclude the source space points within the labels (not done)
-
-    //
-    // 11. Do appropriate source weighting to the forward computation matrix
+    //     The whitened and weighted gain is not formed, everything derives from W*(G*R*G')*W'
     //
-
-    // Adjusting Source Covariance matrix to make trace of G*R*G' equal
-    // to number of sensors.
+    printf("\tWhitening the forward solution.\n");
     printf("\tAdjusting source covariance matrix.\n");
-    RowVectorXd source_std = p_source_cov->data.array().sqrt().transpose();
+    MatrixXd t_matWGain;
+    t_matWGain.noalias() = whitener * gain_cov;
+    MatrixXd t_matGram;
+    t_matGram.noalias() = t_matWGain * whitener.transpose();
 
-    for(qint32 i = 0; i < gain.rows(); ++i)
-        gain.row(i) = gain.row(i).array() * source_std.array();
-
-    double trace_GRGT = (gain * gain.transpose()).trace();//pow(gain.norm(), 2);
+    double trace_GRGT = t_matGram.trace();
     double scaling_source_cov = (double)n_nzero / trace_GRGT;
 
+    FiffCov::SDPtr p_source_cov = setup.source_cov;
     p_source_cov->data.array() *= scaling_source_cov;
 
-    gain.array() *= sqrt(scaling_source_cov);
-
     // now np.trace(np.dot(gain, gain.T)) == n_nzero
     // logger.info(np.trace(np.dot(gain, gain.T)), n_nzero)
 
@@ -473,22 +455,61 @@ MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &inf
     // 12. Decompose the combined matrix
     //
     printf("Computing SVD of whitened and weighted lead field matrix.\n");
-    JacobiSVD<MatrixXd> svd(gain, ComputeThinU | ComputeThinV);
-    qDebug("ToDo Sorting Necessary?");
-    VectorXd p_sing = svd.singularValues();
-    MatrixXd t_U = svd.matrixU();
-    MNEMath::sort<double>(p_sing, t_U);
-    FiffNamedMatrix::SDPtr p_eigen_fields = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( svd.matrixU().cols(),
-                                                                                        svd.matrixU().rows(),
+    VectorXd p_sing;
+    MatrixXd t_U;
+    MatrixXd t_V;
+    if(svd_method == SvdJacobi)
+    {
+        MatrixXd t_matWhitenedGain = whitener * gain;
+        t_matWhitenedGain.array() *= sqrt(scaling_source_cov);
+
+        JacobiSVD<MatrixXd> svd(t_matWhitenedGain, ComputeThinU | ComputeThinV);
+        p_sing = svd.singularValues();
+        t_U = svd.matrixU();
+        t_V = svd.matrixV();
+    }
+    else
+    {
+        //
+        // Gram matrix of the scaled whitened gain -> U and s, V = (sqrt(scaling)*W*G)'*U*diag(1/s)
+        //
+        t_matGram *= scaling_source_cov;
+
+        SelfAdjointEigenSolver<MatrixXd> t_eigenSolver(t_matGram);
+        p_sing.resize(nchan);
+        t_U.resize(nchan, nchan);
+        for(qint32 i = 0; i < nchan; ++i)
+        {
+            double t_dEig = t_eigenSolver.eigenvalues()[nchan-1-i];
+            p_sing[i] = t_dEig > 0 ? sqrt(t_dEig) : 0;
+            t_U.col(i) = t_eigenSolver.eigenvectors().col(nchan-1-i);
+        }
+
+        // see MNEMath::svd_gram
+        double t_dTol = nchan > 0 ? p_sing[0] * sqrt(std::numeric_limits<double>::epsilon()) : 0;
+        MatrixXd t_matWU;
+        t_matWU.noalias() = whitener.transpose() * t_U;
+        for(qint32 i = 0; i < nchan; ++i)
+        {
+            if(p_sing[i] > t_dTol)
+                t_matWU.col(i) *= sqrt(scaling_source_cov) / p_sing[i];
+            else
+            {
+                p_sing[i] = 0;
+                t_matWU.col(i).setZero();
+            }
+        }
+        t_V.noalias() = gain.transpose() * t_matWU;
+    }
+
+    FiffNamedMatrix::SDPtr p_eigen_fields = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( t_U.cols(),
+                                                                                        t_U.rows(),
                                                                                         defaultQStringList,
                                                                                         gain_info.ch_names,
                                                                                         t_U.transpose() ));
 
-    p_sing = svd.singularValues();
-    MatrixXd t_V = svd.matrixV();
-    MNEMath::sort<double>(p_sing, t_V);
-    FiffNamedMatrix::SDPtr p_eigen_leads = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( svd.matrixV().rows(),
-                                                                                       svd.matrixV().cols(),
+    FiffNamedMatrix::SDPtr p_eigen_leads = FiffNamedMatrix::SDPtr(new FiffNamedMatrix( t_V.rows(),
+                                                                                       t_V.cols(),
                                                                                        defaultQStringList,
                                                                                        defaultQStringList,
                                                                                        t_V ));
@@ -531,18 +552,16 @@ MNEInverseOperator MNEInverseOperator::make_inverse_operator(const FiffInfo &inf
     else
         p_iMethods = FIFFV_MNE_EEG;
 
-    // We set this for consistency with mne C code written inverses
-    if(depth == 0)
-        p_depth_prior = FiffCov::SDPtr();
+    const MNEForwardSolution &forward = setup.forward;
 
     p_MNEInverseOperator.eigen_fields = p_eigen_fields;
     p_MNEInverseOperator.eigen_leads = p_eigen_leads;
     p_MNEInverseOperator.sing = p_sing;
     p_MNEInverseOperator.nave = p_nave;
-    p_MNEInverseOperator.depth_prior = p_depth_prior;
+    p_MNEInverseOperator.depth_prior = setup.depth_prior; // null, if no depth weighting: for consistency with mne C code written inverses
     p_MNEInverseOperator.source_cov = p_source_cov;
     p_MNEInverseOperator.noise_cov = FiffCov::SDPtr(new FiffCov(p_outNoiseCov));
-    p_MNEInverseOperator.orient_prior = p_orient_prior;
+    p_MNEInverseOperator.orient_prior = setup.orient_prior;
     p_MNEInverseOperator.projs = info.projs;
     p_MNEInverseOperator.eigen_leads_weighted = false;
     p_MNEInverseOperator.source_ori = forward.source_ori;
@@ -698,9 +717,7 @@ MNEInverseOperator MNEInverseOperator::prepare_inverse_operator(qint32 nave ,flo
             //   Even in this case return only one noise-normalization factor
             //   per source location
             //
-            VectorXd* t = MNEMath::combine_xyz(noise_norm.transpose());
-            noise_norm_new = t->cwiseSqrt();//double otherwise values are getting too small
-            delete t;
+            noise_norm_new = MNEMath::combine_xyz_norm(noise_norm).col(0);//double otherwise values are getting too small
             //
             //   This would replicate the same value on three consequtive
             //   entries
@@ -751,17 +768,17 @@ bool MNEInverseOperator::read_inverse_operator(QIODevice& p_IODevice, MNEInverse
     //
     //   Find all inverse operators
     //
-    QList <FiffDirTree> invs_list = t_Tree.dir_tree_find(FIFFB_MNE_INVERSE_SOLUTION);
+    QList<const FiffDirTree*> invs_list = t_Tree.dir_tree_find_nodes(FIFFB_MNE_INVERSE_SOLUTION);
     if ( invs_list.size()== 0)
     {
         printf("No inverse solutions in %s\n", t_pStream->streamName().toUtf8().constData());
         return false;
     }
-    FiffDirTree* invs = &invs_list[0];
+    const FiffDirTree* invs = invs_list[0];
     //
     //   Parent MRI data
     //
-    QList <FiffDirTree> parent_mri = t_Tree.dir_tree_find(FIFFB_MNE_PARENT_MRI_FILE);
+    QList<const FiffDirTree*> parent_mri = t_Tree.dir_tree_find_nodes(FIFFB_MNE_PARENT_MRI_FILE);
     if (parent_mri.size() == 0)
     {
         printf("No parent MRI information in %s", t_pStream->streamName().toUtf8().constData());
@@ -919,7 +936,7 @@ bool MNEInverseOperator::read_inverse_operator(QIODevice& p_IODevice, MNEInverse
     //   Get the MRI <-> head coordinate transformation
     //
     FiffCoordTrans mri_head_t;// = NULL;
-    if (!parent_mri[0].find_tag(t_pStream.data(), FIFF_COORD_TRANS, t_pTag))
+    if (!parent_mri[0]->find_tag(t_pStream.data(), FIFF_COORD_TRANS, t_pTag))
     {
         printf("MRI/head coordinate transformation not found\n");
         return false;
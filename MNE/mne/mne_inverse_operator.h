@@ -44,6 +44,7 @@
 #include "mne_global.h"
 #include "mne_sourcespace.h"
 #include "mne_forwardsolution.h"
+#include "mne_inverse_setup.h"
 
 
 //*************************************************************************************************************
@@ -117,6 +118,15 @@ public:
     typedef QSharedPointer<MNEInverseOperator> SPtr;            /**< Shared pointer type for MNEInverseOperator. */
     typedef QSharedPointer<const MNEInverseOperator> ConstSPtr; /**< Const shared pointer type for MNEInverseOperator. */
 
+    /**
+    * Decomposition used by make_inverse_operator for the whitened and weighted lead field
+    */
+    enum SvdMethod
+    {
+        SvdJacobi,  /**< Two-sided JacobiSVD of the full lead field, slow reference implementation. */
+        SvdGram     /**< Eigendecomposition of the channel Gram matrix, see MNEMath::svd_gram. */
+    };
+
     //=========================================================================================================
     /**
     * Default constructor
@@ -142,8 +152,9 @@ public:
     * @param[in] depth              float in [0, 1]. Depth weighting coefficients. If None, no depth weighting is performed.
     * @param[in] fixed              Use fixed source orientations normal to the cortical mantle. If True, the loose parameter is ignored.
     * @param[in] limit_depth_chs    If True, use only grad channels in depth weighting (equivalent to MNE C code). If grad chanels aren't present, only mag channels will be used (if no mag, then eeg). If False, use all channels.
+    * @param[in] svd_method         Decomposition of the weighted lead field (optional, default SvdGram)
     */
-    MNEInverseOperator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov& p_noise_cov, float loose = 0.2f, float depth = 0.8f, bool fixed = false, bool limit_depth_chs = true);
+    MNEInverseOperator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov& p_noise_cov, float loose = 0.2f, float depth = 0.8f, bool fixed = false, bool limit_depth_chs = true, SvdMethod svd_method = SvdGram);
 
     //=========================================================================================================
     /**
@@ -178,6 +189,23 @@ public:
     */
     bool assemble_kernel(const Label &label, QString method, bool pick_normal, MatrixXd &K, SparseMatrix<double> &noise_norm, QList<VectorXi> &vertno) const;
 
+    //=========================================================================================================
+    /**
+    * Assembles the imaging kernels of several labels in one pass. The eigenlead rows of all labels are
+    * gathered into one block and multiplied with the whitened eigenfields once, the result is split per label.
+    * An empty label selects the whole source space.
+    *
+    * @param[in] labels         The labels.
+    * @param[in] method         The applied normals. ("MNE" | "dSPM" | "sLORETA")
+    * @param[in] pick_normal    Pick normals.
+    * @param[out] K             Kernel of each label.
+    * @param[out] noise_norm    Noise normals of each label, empty for "MNE".
+    * @param[out] vertno        Vertices of the hemispheres of each label.
+    *
+    * @return true when successful, false otherwise
+    */
+    bool assemble_kernels(const QList<Label> &labels, QString method, bool pick_normal, QList<MatrixXd> &K, QList< SparseMatrix<double> > &noise_norm, QList< QList<VectorXi> > &vertno) const;
+
     //=========================================================================================================
     /**
     * Check that channels in inverse operator are measurements.
@@ -199,10 +227,28 @@ public:
     * @param[in] depth              float in [0, 1]. Depth weighting coefficients. If None, no depth weighting is performed.
     * @param[in] fixed              Use fixed source orientations normal to the cortical mantle. If True, the loose parameter is ignored.
     * @param[in] limit_depth_chs    If True, use only grad channels in depth weighting (equivalent to MNE C code). If grad chanels aren't present, only mag channels will be used (if no mag, then eeg). If False, use all channels.
+    * @param[in] svd_method         Decomposition of the weighted lead field (optional, default SvdGram)
+    *
+    * @return the assembled inverse operator
+    */
+    static MNEInverseOperator make_inverse_operator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov& p_noise_cov, float loose = 0.2f, float depth = 0.8f, bool fixed = false, bool limit_depth_chs = true, SvdMethod svd_method = SvdGram);
+
+    //=========================================================================================================
+    /**
+    * Assembles the inverse operator from a precomputed, noise covariance independent inverse setup. Only
+    * the whitening, the trace scaling and the decomposition are done here, which makes this the method of
+    * choice when inverse operators for successive noise covariances are computed with the same forward
+    * solution. With SvdGram the decomposition is done in channel space on W*(G*R*G')*W' and the whitened
+    * gain matrix is never formed. If the noise covariance drops channels of the setup and depth weighting is
+    * used, the setup is redone without them, since the depth prior depends on the channels.
+    *
+    * @param[in] setup          The covariance independent stage (see MNEInverseSetup).
+    * @param[in] p_noise_cov    The noise covariance matrix.
+    * @param[in] svd_method     Decomposition of the weighted lead field (optional, default SvdGram)
     *
     * @return the assembled inverse operator
     */
-    static MNEInverseOperator make_inverse_operator(const FiffInfo &info, MNEForwardSolution forward, const FiffCov& p_noise_cov, float loose = 0.2f, float depth = 0.8f, bool fixed = false, bool limit_depth_chs = true);
+    static MNEInverseOperator make_inverse_operator(const MNEInverseSetup &setup, const FiffCov& p_noise_cov, SvdMethod svd_method = SvdGram);
 
     //=========================================================================================================
     /**
@@ -0,0 +1,245 @@
+//=============================================================================================================
+/**
+* @file     mne_inverse_setup.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    MNEInverseSetup class implementation
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "mne_inverse_setup.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QDebug>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace MNELIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+MNEInverseSetup::MNEInverseSetup()
+: loose(0.0f)
+, depth(0.0f)
+, fixed(false)
+, limit_depth_chs(true)
+{
+}
+
+
+//*************************************************************************************************************
+
+MNEInverseSetup::MNEInverseSetup(const FiffInfo &p_info, const MNEForwardSolution &p_forward, float loose, float depth, bool fixed, bool limit_depth_chs)
+: info(p_info)
+, forward(p_forward)
+, input_forward(p_forward)
+, loose(0.0f)
+, depth(0.0f)
+, fixed(false)
+, limit_depth_chs(limit_depth_chs)
+{
+    bool is_fixed_ori = forward.isFixedOrient();
+
+    //Check parameters
+    if(fixed && loose > 0)
+    {
+        qWarning("Warning: When invoking make_inverse_operator with fixed = true, the loose parameter is ignored.\n");
+        loose = 0.0f;
+    }
+
+    if(is_fixed_ori && !fixed)
+    {
+        qWarning("Warning: Setting fixed parameter = true. Because the given forward operator has fixed orientation and can only be used to make a fixed-orientation inverse operator.\n");
+        fixed = true;
+    }
+
+    if(forward.source_ori == -1 && loose > 0)
+    {
+        qCritical("Error: Forward solution is not oriented in surface coordinates. loose parameter should be 0 not %f.\n", loose);
+        clear();
+        return;
+    }
+
+    if(loose < 0 || loose > 1)
+    {
+        qWarning("Warning: Loose value should be in interval [0,1] not %f.\n", loose);
+        loose = loose > 1 ? 1 : 0;
+        printf("Setting loose to %f.\n", loose);
+    }
+
+    if(depth < 0 || depth > 1)
+    {
+        qWarning("Warning: Depth value should be in interval [0,1] not %f.\n", depth);
+        depth = depth > 1 ? 1 : 0;
+        printf("Setting depth to %f.\n", depth);
+    }
+
+    this->loose = loose;
+    this->depth = depth;
+    this->fixed = fixed;
+
+    //
+    // 1. Read the bad channels
+    // 2. Read the necessary data from the forward solution matrix file
+    //
+    QStringList fwd_ch_names;
+    for(qint32 i = 0; i < forward.info.chs.size(); ++i)
+        fwd_ch_names << forward.info.chs[i].ch_name;
+
+    RowVectorXi fwd_idx(info.chs.size());
+    info_idx.resize(info.chs.size());
+    qint32 count = 0;
+    for(qint32 i = 0; i < info.chs.size(); ++i)
+    {
+        qint32 idx = fwd_ch_names.indexOf(info.chs[i].ch_name);
+        if(!info.bads.contains(info.chs[i].ch_name) && idx > -1)
+        {
+            ch_names << info.chs[i].ch_name;
+            fwd_idx[count] = idx;
+            info_idx[count] = i;
+            ++count;
+        }
+    }
+    fwd_idx.conservativeResize(count);
+    info_idx.conservativeResize(count);
+
+    // read through a const reference, the shared solution matrix must not be detached
+    const MNEForwardSolution &t_forward = forward;
+    MatrixXd gain(count, t_forward.sol->data.cols());
+    for(qint32 i = 0; i < count; ++i)
+        gain.row(i) = t_forward.sol->data.row(fwd_idx[i]);
+
+    FiffInfo gain_info = info.pick_info(info_idx);
+
+    //
+    // 5. Compose the depth weight matrix
+    //
+    MatrixXd patch_areas;
+    if(depth > 0)
+    {
+        qDebug() << "ToDo: patch_areas";
+//        patch_areas = forward.get('patch_areas', None)
+        depth_prior = FiffCov::SDPtr(new FiffCov(MNEForwardSolution::compute_depth_prior(gain, gain_info, is_fixed_ori, depth, 10.0, patch_areas, limit_depth_chs)));
+        source_cov = depth_prior;
+    }
+    else
+    {
+        source_cov = FiffCov::SDPtr(new FiffCov);
+        source_cov->data = MatrixXd::Ones(gain.cols(), 1);
+        source_cov->kind = FIFFV_MNE_DEPTH_PRIOR_COV;
+        source_cov->diag = true;
+        source_cov->dim = gain.cols();
+        source_cov->nfree = 1;
+    }
+
+    // Deal with fixed orientation forward / inverse
+    if(fixed && !is_fixed_ori)
+    {
+        // Convert to the fixed orientation forward solution now
+        qint32 nsrc = 0;
+        for(qint32 i = 2; i < source_cov->data.rows(); i+=3)
+        {
+            source_cov->data.row(nsrc) = source_cov->data.row(i);
+            ++nsrc;
+        }
+        source_cov->data.conservativeResize(nsrc, 1);
+        source_cov->dim = nsrc;
+        if(depth_prior.constData())
+            depth_prior = source_cov;
+
+        forward.to_fixed_ori();
+        is_fixed_ori = forward.isFixedOrient();
+
+        gain.resize(fwd_idx.size(), t_forward.sol->data.cols());
+        for(qint32 i = 0; i < fwd_idx.size(); ++i)
+            gain.row(i) = t_forward.sol->data.row(fwd_idx[i]);
+    }
+    printf("\tComputing inverse operator with %d channels.\n", ch_names.size());
+
+    //
+    // 6. Compose the source covariance matrix
+    //
+    printf("\tCreating the source covariance matrix\n");
+
+    // apply loose orientations
+    if(!is_fixed_ori)
+    {
+        orient_prior = FiffCov::SDPtr(new FiffCov(forward.compute_orient_prior(loose)));
+        source_cov->data.array() *= orient_prior->data.array();
+    }
+
+    // 7. Apply fMRI weighting (not done)
+    // 10. Exclude the source space points within the labels (not done)
+
+    //
+    // 11. Do appropriate source weighting to the forward computation matrix, the scaling to the trace of the
+    //     whitened G*R*G' is done with the noise covariance
+    //
+    RowVectorXd source_std = source_cov->data.array().sqrt().transpose();
+    weighted_gain = gain * source_std.asDiagonal();
+
+    MatrixXd t_matGainCov = MatrixXd::Zero(weighted_gain.rows(), weighted_gain.rows());
+    t_matGainCov.selfadjointView<Lower>().rankUpdate(weighted_gain);
+    gain_cov = t_matGainCov.selfadjointView<Lower>();
+}
+
+
+//*************************************************************************************************************
+
+void MNEInverseSetup::clear()
+{
+    info.clear();
+    forward.clear();
+    input_forward.clear();
+    ch_names.clear();
+    info_idx = RowVectorXi();
+    weighted_gain = MatrixXd();
+    gain_cov = MatrixXd();
+    depth_prior = FiffCov::SDPtr();
+    orient_prior = FiffCov::SDPtr();
+    source_cov = FiffCov::SDPtr();
+}
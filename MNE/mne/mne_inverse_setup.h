@@ -0,0 +1,170 @@
+//=============================================================================================================
+/**
+* @file     mne_inverse_setup.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    MNEInverseSetup class declaration, which holds the noise covariance independent part of an inverse operator.
+*
+*/
+
+#ifndef MNE_INVERSE_SETUP_H
+#define MNE_INVERSE_SETUP_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "mne_global.h"
+#include "mne_forwardsolution.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// FIFF INCLUDES
+//=============================================================================================================
+
+#include <fiff/fiff_cov.h>
+#include <fiff/fiff_info.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QSharedPointer>
+#include <QStringList>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE MNELIB
+//=============================================================================================================
+
+namespace MNELIB
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace Eigen;
+using namespace FIFFLIB;
+
+
+//=============================================================================================================
+/**
+* Everything make_inverse_operator derives from the forward solution alone: the channel restricted and
+* source weighted gain matrix, the depth, orientation and source covariance priors and the product
+* G*R*G'. It is computed once per forward solution and measurement info, so an inverse operator for a new
+* noise covariance only needs the whitening and a decomposition in channel space
+* (see MNEInverseOperator::make_inverse_operator(const MNEInverseSetup&, ...)).
+*
+* @brief Noise covariance independent stage of the inverse operator construction
+*/
+class MNESHARED_EXPORT MNEInverseSetup
+{
+public:
+    typedef QSharedPointer<MNEInverseSetup> SPtr;            /**< Shared pointer type for MNEInverseSetup. */
+    typedef QSharedPointer<const MNEInverseSetup> ConstSPtr; /**< Const shared pointer type for MNEInverseSetup. */
+
+    //=========================================================================================================
+    /**
+    * Default constructor.
+    */
+    MNEInverseSetup();
+
+    //=========================================================================================================
+    /**
+    * Computes the noise covariance independent part of an inverse operator.
+    *
+    * @param[in] info               The measurement info to specify the channels to include. Bad channels in info['bads'] are not used.
+    * @param[in] forward            Forward operator.
+    * @param[in] loose              float in [0, 1]. Value that weights the source variances of the dipole components defining the tangent space of the cortical surfaces.
+    * @param[in] depth              float in [0, 1]. Depth weighting coefficients. If None, no depth weighting is performed.
+    * @param[in] fixed              Use fixed source orientations normal to the cortical mantle. If True, the loose parameter is ignored.
+    * @param[in] limit_depth_chs    If True, use only grad channels in depth weighting (equivalent to MNE C code). If grad chanels aren't present, only mag channels will be used (if no mag, then eeg). If False, use all channels.
+    */
+    MNEInverseSetup(const FiffInfo &info, const MNEForwardSolution &forward, float loose = 0.2f, float depth = 0.8f, bool fixed = false, bool limit_depth_chs = true);
+
+    //=========================================================================================================
+    /**
+    * Initializes the inverse setup.
+    */
+    void clear();
+
+    //=========================================================================================================
+    /**
+    * Returns true if the inverse setup contains no data, e.g. because of invalid parameters.
+    *
+    * @return true if the inverse setup is empty.
+    */
+    inline bool isEmpty() const;
+
+public:
+    FiffInfo info;                  /**< Measurement info the setup was computed for. */
+    MNEForwardSolution forward;     /**< Forward solution, converted to fixed orientation if requested. */
+    QStringList ch_names;           /**< Channels of the gain matrix rows. */
+    RowVectorXi info_idx;           /**< Indices of ch_names in info. */
+    MatrixXd weighted_gain;         /**< Gain matrix restricted to ch_names and weighted by the square root of the source covariance. */
+    MatrixXd gain_cov;              /**< weighted_gain * weighted_gain', i.e. G*R*G'. */
+    FiffCov::SDPtr depth_prior;     /**< Depth weighting prior, null if no depth weighting is done. */
+    FiffCov::SDPtr orient_prior;    /**< Orientation prior, null for fixed orientations. */
+    FiffCov::SDPtr source_cov;      /**< Source covariance R, not yet scaled to the trace of the whitened G*R*G'. */
+
+    MNEForwardSolution input_forward;   /**< Forward solution as passed in, to redo the setup for fewer channels. */
+    float loose;                    /**< Effective loose parameter. */
+    float depth;                    /**< Effective depth weighting exponent, 0 if no depth weighting is done. */
+    bool fixed;                     /**< Whether fixed orientations are used. */
+    bool limit_depth_chs;           /**< Whether the depth prior is limited to one channel type. */
+};
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline bool MNEInverseSetup::isEmpty() const
+{
+    return this->weighted_gain.size() == 0;
+}
+
+} // NAMESPACE
+
+#endif // MNE_INVERSE_SETUP_H
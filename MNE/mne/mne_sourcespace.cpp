@@ -119,7 +119,7 @@ QList<VectorXi> MNESourceSpace::label_src_vertno_sel(const Label &p_label, Vecto
     else if (p_label.hemi == 1) //rh
     {
         VectorXi vertno_sel = MNEMath::intersect(vertno[1], p_label.vertices, src_sel);
-        src_sel.array() += p_label.vertices.size();
+        src_sel.array() += vertno[0].size(); // rh sources follow the lh ones
         vertno[0] = VectorXi();
         vertno[1] = vertno_sel;
     }
@@ -188,7 +188,7 @@ bool MNESourceSpace::readFromStream(FiffStream::SPtr& p_pStream, bool add_geom,
     //
     //   Find all source spaces
     //
-    QList<FiffDirTree> spaces = p_Tree.dir_tree_find(FIFFB_MNE_SOURCE_SPACE);
+    QList<const FiffDirTree*> spaces = p_Tree.dir_tree_find_nodes(FIFFB_MNE_SOURCE_SPACE);
     if (spaces.size() == 0)
     {
         if(open_here)
@@ -201,7 +201,7 @@ bool MNESourceSpace::readFromStream(FiffStream::SPtr& p_pStream, bool add_geom,
     {
         MNEHemisphere p_Hemisphere;
         printf("\tReading a source space...");
-        MNESourceSpace::read_source_space(p_pStream.data(), spaces[k], p_Hemisphere);
+        MNESourceSpace::read_source_space(p_pStream.data(), *spaces[k], p_Hemisphere);
         printf("\t[done]\n" );
         if (add_geom)
             complete_source_space_info(p_Hemisphere);
@@ -53,12 +53,14 @@ LIBS += -L$${MNE_LIBRARY_DIR}
 CONFIG(debug, debug|release) {
     LIBS += -lMNE$${MNE_LIB_VERSION}Genericsd \
             -lMNE$${MNE_LIB_VERSION}RtCommandd \
-            -lMNE$${MNE_LIB_VERSION}Fiffd
+            -lMNE$${MNE_LIB_VERSION}Fiffd \
+            -lMNE$${MNE_LIB_VERSION}Utilsd
 }
 else {
     LIBS += -lMNE$${MNE_LIB_VERSION}Generics \
             -lMNE$${MNE_LIB_VERSION}RtCommand \
-            -lMNE$${MNE_LIB_VERSION}Fiff
+            -lMNE$${MNE_LIB_VERSION}Fiff \
+            -lMNE$${MNE_LIB_VERSION}Utils
 }
 
 DESTDIR = $${MNE_LIBRARY_DIR}
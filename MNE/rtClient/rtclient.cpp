@@ -170,6 +170,12 @@ void RtClient::run()
 
     m_pFiffInfo = t_dataClient.readInfo();
 
+    if(!m_pFiffInfo)
+    {
+        printf("Connection lost while reading the measurement info\n");
+        m_bIsRunning = false;
+    }
+
     // start measurement
     t_cmdClient["start"].pValues()[0].setValue(clientId);
     t_cmdClient["start"].send();
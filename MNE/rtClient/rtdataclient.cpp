@@ -51,6 +51,14 @@
 using namespace RTCLIENTLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define REPLY_TIMEOUT   1000    /**< Milliseconds to wait for the reply of mne_rt_server to a command */
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -59,6 +67,7 @@ using namespace RTCLIENTLIB;
 RtDataClient::RtDataClient(QObject *parent)
 : QTcpSocket(parent)
 , m_clientID(-1)
+, m_iShmGeneration(-1)
 {
     getClientId();
 }
@@ -86,17 +95,49 @@ qint32 RtDataClient::getClientId()
         t_fiffStream.write_rt_command(1, t_sCommand);
 
 
-        this->waitForReadyRead(100);
+        this->flush();
+
         // ID is send as answer
         FiffTag::SPtr t_pTag;
-        FiffTag::read_tag(&t_fiffStream, t_pTag);
-        if (t_pTag->kind == FIFF_MNE_RT_CLIENT_ID)
+        if (readTag(t_pTag, REPLY_TIMEOUT) && t_pTag->kind == FIFF_MNE_RT_CLIENT_ID)
+        {
             m_clientID = *t_pTag->toInt();
+
+            //
+            // Same host: the raw buffers are passed through shared memory
+            //
+            if(this->peerAddress() == this->localAddress())
+                requestSharedMemory();
+        }
     }
     return m_clientID;
 }
 
 
+//*************************************************************************************************************
+
+bool RtDataClient::requestSharedMemory()
+{
+    FiffStream t_fiffStream(this);
+
+    QString t_sCommand("");
+    t_fiffStream.write_rt_command(3, t_sCommand);//MNE_RT.MNE_RT_REQUEST_SHM
+    this->flush();
+
+    m_sShmKey = QString("");
+    m_iShmGeneration = -1;
+
+    //
+    // An older mne_rt_server does not answer, raw buffers are sent as tags then
+    //
+    FiffTag::SPtr t_pTag;
+    if (readTag(t_pTag, REPLY_TIMEOUT) && t_pTag->kind == FIFF_MNE_RT_SHM_KEY)
+        m_sShmKey = t_pTag->toString();
+
+    return !m_sShmKey.isEmpty();
+}
+
+
 //*************************************************************************************************************
 
 FiffInfo::SPtr RtDataClient::readInfo()
@@ -105,14 +146,14 @@ FiffInfo::SPtr RtDataClient::readInfo()
     bool t_bReadMeasBlockStart = false;
     bool t_bReadMeasBlockEnd = false;
 
-    FiffStream t_fiffStream(this);
     //
-    // Find the start
+    // Find the start, a null pointer is returned if the connection is lost
     //
     FiffTag::SPtr t_pTag;
     while(!t_bReadMeasBlockStart)
     {
-        FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+        if(!readTag(t_pTag))
+            return FiffInfo::SPtr();
         if(t_pTag->kind == FIFF_BLOCK_START && *(t_pTag->toInt()) == FIFFB_MEAS_INFO)
         {
             printf("FIFF_BLOCK_START FIFFB_MEAS_INFO\n");
@@ -129,7 +170,8 @@ FiffInfo::SPtr RtDataClient::readInfo()
 
     while(!t_bReadMeasBlockEnd)
     {
-        FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+        if(!readTag(t_pTag))
+            return FiffInfo::SPtr();
         //
         //  megacq parameters
         //
@@ -137,7 +179,8 @@ FiffInfo::SPtr RtDataClient::readInfo()
         {
             while(t_pTag->kind != FIFF_BLOCK_END || *(t_pTag->toInt()) != FIFFB_DACQ_PARS)
             {
-                FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+                if(!readTag(t_pTag))
+                    return FiffInfo::SPtr();
                 if(t_pTag->kind == FIFF_DACQ_PARS)
                     p_pFiffInfo->acq_pars = t_pTag->toString();
                 else if(t_pTag->kind == FIFF_DACQ_STIM)
@@ -167,7 +210,8 @@ FiffInfo::SPtr RtDataClient::readInfo()
         {
             while(t_pTag->kind != FIFF_BLOCK_END || *(t_pTag->toInt()) != FIFFB_ISOTRAK)
             {
-                FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+                if(!readTag(t_pTag))
+                    return FiffInfo::SPtr();
 
                 if(t_pTag->kind == FIFF_DIG_POINT)
                     p_pFiffInfo->dig.append(t_pTag->toDigPoint());
@@ -180,14 +224,16 @@ FiffInfo::SPtr RtDataClient::readInfo()
         {
             while(t_pTag->kind != FIFF_BLOCK_END || *(t_pTag->toInt()) != FIFFB_PROJ)
             {
-                FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+                if(!readTag(t_pTag))
+                    return FiffInfo::SPtr();
                 if(t_pTag->kind == FIFF_BLOCK_START && *(t_pTag->toInt()) == FIFFB_PROJ_ITEM)
                 {
                     FiffProj proj;
                     qint32 countProj = p_pFiffInfo->projs.size();
                     while(t_pTag->kind != FIFF_BLOCK_END || *(t_pTag->toInt()) != FIFFB_PROJ_ITEM)
                     {
-                        FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+                        if(!readTag(t_pTag))
+                            return FiffInfo::SPtr();
                         switch (t_pTag->kind)
                         {
                         case FIFF_NAME: // First proj -> Proj is created
@@ -233,14 +279,16 @@ FiffInfo::SPtr RtDataClient::readInfo()
         {
             while(t_pTag->kind != FIFF_BLOCK_END || *(t_pTag->toInt()) != FIFFB_MNE_CTF_COMP)
             {
-                FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+                if(!readTag(t_pTag))
+                    return FiffInfo::SPtr();
                 if(t_pTag->kind == FIFF_BLOCK_START && *(t_pTag->toInt()) == FIFFB_MNE_CTF_COMP_DATA)
                 {
                     FiffCtfComp comp;
                     qint32 countComp = p_pFiffInfo->comps.size();
                     while(t_pTag->kind != FIFF_BLOCK_END || *(t_pTag->toInt()) != FIFFB_MNE_CTF_COMP_DATA)
                     {
-                        FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+                        if(!readTag(t_pTag))
+                            return FiffInfo::SPtr();
                         switch (t_pTag->kind)
                         {
                         case FIFF_MNE_CTF_COMP_KIND: //First comp -> create comp
@@ -266,7 +314,8 @@ FiffInfo::SPtr RtDataClient::readInfo()
         {
             while(t_pTag->kind != FIFF_BLOCK_END || *(t_pTag->toInt()) != FIFFB_MNE_BAD_CHANNELS)
             {
-                FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+                if(!readTag(t_pTag))
+                    return FiffInfo::SPtr();
                 if(t_pTag->kind == FIFF_MNE_CH_NAME_LIST)
                     p_pFiffInfo->bads = FiffStream::split_name_list(t_pTag->data());
             }
@@ -322,26 +371,92 @@ void RtDataClient::readRawBuffer(qint32 p_nChannels, MatrixXf& data, fiff_int_t&
 {
 //        data = [];
 
-    FiffStream t_fiffStream(this);
     //
     // Find the start
     //
     FiffTag::SPtr t_pTag;
 
-    FiffTag::read_rt_tag(&t_fiffStream, t_pTag);
+    if(!readTag(t_pTag))
+    {
+        kind = -1;
+        return;
+    }
 
     kind = t_pTag->kind;
 
-    if(kind == FIFF_DATA_BUFFER)
+    if(kind == FIFF_DATA_BUFFER || kind == FIFF_MNE_RT_DATA_BUFFER_LE || kind == FIFF_MNE_RT_DATA_BUFFER_INT16 || kind == FIFF_MNE_RT_DATA_BUFFER_DELTA)
     {
-        qint32 nSamples = (t_pTag->size()/4)/p_nChannels;
-        data = MatrixXf(Map< MatrixXf >(t_pTag->toFloat(), p_nChannels, nSamples));
+        //
+        // Raw buffers of all stream formats are returned as FIFF_DATA_BUFFER
+        //
+        if(t_pTag->toRawBuffer(p_nChannels, data))
+            kind = FIFF_DATA_BUFFER;
+        else
+            printf("RtDataClient: raw buffer could not be decoded, skipped.\n");
+    }
+    else if(kind == FIFF_MNE_RT_SHM_BUFFER && t_pTag->toInt() && t_pTag->size() >= 3*4)
+    {
+        //
+        // Generation of the ring, sequence number and size of the buffer in the ring
+        //
+        qint32* t_pNotification = t_pTag->toInt();
+        qint32 t_iGeneration = t_pNotification[0];
+        qint32 t_iSeq = t_pNotification[1];
+        qint32 t_iSize = t_pNotification[2];
+
+        if(t_iGeneration != m_iShmGeneration)
+            m_iShmGeneration = m_shmRing.attach(QString("%1_%2").arg(m_sShmKey).arg(t_iGeneration)) ? t_iGeneration : -1;
+
+        qint32 nSamples = (t_iSize/4)/p_nChannels;
+        data.resize(p_nChannels, nSamples);
+        if(m_iShmGeneration == t_iGeneration && m_shmRing.read(t_iSeq, (char*)data.data(), data.size()*4) == t_iSize)
+            kind = FIFF_DATA_BUFFER;
+        else
+            printf("RtDataClient: raw buffer %d is not available in shared memory anymore, skipped.\n", t_iSeq);
     }
+
+    m_tagDecoder.recycle(t_pTag);
 //        else
 //            data = tag.data;
 }
 
 
+//*************************************************************************************************************
+
+bool RtDataClient::readTag(FiffTag::SPtr& p_pTag, int msecs)
+{
+    //
+    // Wait for the socket instead of polling, the decoder completes partially received tags
+    //
+    while(!m_tagDecoder.hasTag())
+    {
+        if(this->bytesAvailable() == 0 && !this->waitForReadyRead(msecs))
+            return false;
+
+        if(m_tagDecoder.readFrom(this) < 0)
+        {
+            printf("RtDataClient: corrupt tag stream, disconnecting.\n");
+            this->abort();
+            m_tagDecoder.clear();
+            return false;
+        }
+    }
+
+    p_pTag = m_tagDecoder.takeTag();
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void RtDataClient::setStreamFormat(fiff_int_t p_iFormat)
+{
+    FiffStream t_fiffStream(this);
+    t_fiffStream.write_rt_command(4, QString::number(p_iFormat));//MNE_RT.MNE_RT_SET_STREAM_FORMAT, format);
+    this->flush();
+}
+
+
 //*************************************************************************************************************
 
 void RtDataClient::setClientAlias(const QString &p_sAlias)
@@ -54,6 +54,15 @@
 #include <fiff/fiff_stream.h>
 #include <fiff/fiff_info.h>
 #include <fiff/fiff_tag.h>
+#include <fiff/fiff_tag_decoder.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// UTILS INCLUDES
+//=============================================================================================================
+
+#include <utils/shmringbuffer.h>
 
 
 //*************************************************************************************************************
@@ -81,6 +90,7 @@ namespace RTCLIENTLIB
 //=============================================================================================================
 
 using namespace FIFFLIB;
+using namespace UTILSLIB;
 
 
 //=============================================================================================================
@@ -114,7 +124,8 @@ public:
 
     //=========================================================================================================
     /**
-    * Requests the ID at mne_rt_server and returns it
+    * Requests the ID at mne_rt_server and returns it. If mne_rt_server runs on the same host, the shared
+    * memory transport of the raw buffers is requested as well.
     *
     * @return the requested id
     */
@@ -124,13 +135,15 @@ public:
     /**
     * Reads fiff measurement information of a data the connection
     *
-    * @return the read fiff measurement information
+    * @return the read fiff measurement information, a null pointer if the connection was lost before it was complete
     */
     FiffInfo::SPtr readInfo();
 
     //=========================================================================================================
     /**
-    * Reads fiff measurement information of a data the connection
+    * Reads a raw buffer of the data connection. Raw buffers of all stream formats are decoded and returned as
+    * FIFF_DATA_BUFFER. Raw buffers passed through shared memory are copied out of the ring, a buffer which was
+    * overwritten meanwhile is skipped and its kind is FIFF_MNE_RT_SHM_BUFFER.
     *
     * @param[in] p_nChannels    Number of channels to reshape the received data
     * @param[out] data          The read data - ToDo change this to raw buffer data object
@@ -146,8 +159,42 @@ public:
     */
     void setClientAlias(const QString &p_sAlias);
 
+    //=========================================================================================================
+    /**
+    * Sets the stream format in which mne_rt_server sends the raw buffers. FIFFV_MNE_RT_FORMAT_FIFF is the
+    * default, FIFFV_MNE_RT_FORMAT_INT16 and FIFFV_MNE_RT_FORMAT_COMPRESSED reduce the bandwidth to remote
+    * hosts. Ignored for raw buffers passed through shared memory.
+    *
+    * @param[in] p_iFormat  The stream format, FIFFV_MNE_RT_FORMAT_*
+    */
+    void setStreamFormat(fiff_int_t p_iFormat);
+
 private:
-    qint32 m_clientID;  /**< Corresponding client id of the data client at mne_rt_server */
+    //=========================================================================================================
+    /**
+    * Requests the shared memory transport of the raw buffers at mne_rt_server.
+    *
+    * @return true if mne_rt_server accepted, false otherwise
+    */
+    bool requestSharedMemory();
+
+    //=========================================================================================================
+    /**
+    * Reads the next tag of the data connection, waits until it is received completely.
+    *
+    * @param[out] p_pTag    The read tag.
+    * @param[in] msecs      Milliseconds to wait for further bytes, -1 waits without timeout.
+    *
+    * @return true if a tag was read, false on timeout or error
+    */
+    bool readTag(FiffTag::SPtr& p_pTag, int msecs = -1);
+
+    qint32 m_clientID;          /**< Corresponding client id of the data client at mne_rt_server */
+    FiffTagDecoder m_tagDecoder;/**< Decodes the received bytes into tags */
+
+    ShmRingBuffer m_shmRing;    /**< Shared memory ring of mne_rt_server, attached on the first raw buffer */
+    QString m_sShmKey;          /**< Base key of the shared memory rings, empty if raw buffers are sent as tags */
+    qint32 m_iShmGeneration;    /**< Generation of the attached ring */
 
 signals:
     
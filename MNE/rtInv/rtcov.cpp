@@ -52,6 +52,7 @@
 //=============================================================================================================
 
 #include <QDebug>
+#include <QMutexLocker>
 
 
 //*************************************************************************************************************
@@ -63,6 +64,14 @@ using namespace RTINVLIB;
 using namespace FIFFLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define RTCOV_MAX_QUEUED 32     /**< Maximal number of data segments waiting to be processed. */
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -90,12 +99,31 @@ RtCov::~RtCov()
 
 void RtCov::append(const MatrixXd &p_DataSegment)
 {
-//    if(m_pRawMatrixBuffer) // ToDo handle change buffersize
+    QMutexLocker locker(&mutex);
+
+    while(m_bIsRunning && m_qQueueRawData.size() >= RTCOV_MAX_QUEUED)
+        m_waitNotFull.wait(&mutex);
+
+    // not running: keep only the most recent segments
+    if(m_qQueueRawData.size() >= RTCOV_MAX_QUEUED)
+        m_qQueueRawData.dequeue();
+
+    m_qQueueRawData.enqueue(p_DataSegment);
+    m_waitNotEmpty.wakeOne();
+}
+
+
+//*************************************************************************************************************
+
+bool RtCov::start()
+{
+    mutex.lock();
+    m_bIsRunning = true;
+    mutex.unlock();
 
-    if(!m_pRawMatrixBuffer)
-        m_pRawMatrixBuffer = CircularMatrixBuffer<double>::SPtr(new CircularMatrixBuffer<double>(32, p_DataSegment.rows(), p_DataSegment.cols()));
+    QThread::start();
 
-    m_pRawMatrixBuffer->push(&p_DataSegment);
+    return true;
 }
 
 
@@ -103,7 +131,13 @@ void RtCov::append(const MatrixXd &p_DataSegment)
 
 bool RtCov::stop()
 {
+    mutex.lock();
     m_bIsRunning = false;
+    m_qQueueRawData.clear();
+    m_waitNotEmpty.wakeAll();
+    m_waitNotFull.wakeAll();
+    mutex.unlock();
+
     QThread::wait();
 
     return true;
@@ -114,56 +148,63 @@ bool RtCov::stop()
 
 void RtCov::run()
 {
-    m_bIsRunning = true;
-
-
     quint32 n_samples = 0;
 
     FiffCov::SPtr cov(new FiffCov());
     VectorXd mu;
 
-    while(m_bIsRunning)
+    while(true)
     {
-        if(m_pRawMatrixBuffer)
+        mutex.lock();
+        while(m_bIsRunning && m_qQueueRawData.isEmpty())
+            m_waitNotEmpty.wait(&mutex);
+
+        if(!m_bIsRunning)
+        {
+            mutex.unlock();
+            break;
+        }
+
+        MatrixXd rawSegment = m_qQueueRawData.dequeue();
+        m_waitNotFull.wakeOne();
+        mutex.unlock();
+
+        if(n_samples == 0)
+        {
+            mu = rawSegment.rowwise().sum();
+            cov->data = rawSegment * rawSegment.transpose();
+        }
+        else
         {
-            MatrixXd rawSegment = m_pRawMatrixBuffer->pop();
-
-            if(n_samples == 0)
-            {
-                mu = rawSegment.rowwise().sum();
-                cov->data = rawSegment * rawSegment.transpose();
-            }
-            else
-            {
-                mu.array() += rawSegment.rowwise().sum().array();
-                cov->data += rawSegment * rawSegment.transpose();
-            }
-            n_samples += rawSegment.cols();
-
-            if(n_samples > m_iMaxSamples)
-            {
-                mu /= (float)n_samples;
-                cov->data.array() -= n_samples * (mu * mu.transpose()).array();
-                cov->data.array() /= (n_samples - 1);
-
-                cov->kind = FIFFV_MNE_NOISE_COV;
-                cov->diag = false;
-                cov->dim = cov->data.rows();
-
-                //ToDo do picks
-                cov->names = m_pFiffInfo->ch_names;
-                cov->projs = m_pFiffInfo->projs;
-                cov->bads  = m_pFiffInfo->bads;
-                cov->nfree  = n_samples;
-
-                // regularize noise covariance
-                *cov.data() = cov->regularize(*m_pFiffInfo, 0.05, 0.05, 0.1, true);
-
-                emit covCalculated(cov);
-
-                cov = FiffCov::SPtr(new FiffCov());
-                n_samples = 0;
-            }
+            mu.array() += rawSegment.rowwise().sum().array();
+            cov->data += rawSegment * rawSegment.transpose();
+        }
+        n_samples += rawSegment.cols();
+
+        if(n_samples > m_iMaxSamples)
+        {
+            mu /= (float)n_samples;
+            cov->data.array() -= n_samples * (mu * mu.transpose()).array();
+            cov->data.array() /= (n_samples - 1);
+
+            cov->kind = FIFFV_MNE_NOISE_COV;
+            cov->diag = false;
+            cov->dim = cov->data.rows();
+
+            //ToDo do picks
+            cov->names = m_pFiffInfo->ch_names;
+            cov->projs = m_pFiffInfo->projs;
+            cov->bads  = m_pFiffInfo->bads;
+            cov->nfree  = n_samples;
+
+            // regularize noise covariance
+            *cov.data() = cov->regularize(*m_pFiffInfo, 0.05, 0.05, 0.1, true);
+
+            emit covCalculated(cov);
+
+            cov = FiffCov::SPtr(new FiffCov());
+            n_samples = 0;
+        }
 
 
 //            qint32 samples = rawSegment.cols();
@@ -176,7 +217,5 @@ void RtCov::run()
 //            std::cout << "Noise Covariance:\n" << noise_covariance.block(0,0,10,10) << std::endl;
 
 //            printf("%d raw buffer (%d x %d) generated\r\n", count, tmp.rows(), tmp.cols());
-
-        }
     }
 }
@@ -53,13 +53,6 @@
 #include <fiff/fiff_info.h>
 
 
-//*************************************************************************************************************
-//=============================================================================================================
-// Generics INCLUDES
-//=============================================================================================================
-
-#include <generics/circularmatrixbuffer.h>
-
 
 //*************************************************************************************************************
 //=============================================================================================================
@@ -68,6 +61,8 @@
 
 #include <QThread>
 #include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
 #include <QSharedPointer>
 
 
@@ -94,7 +89,6 @@ namespace RTINVLIB
 //=============================================================================================================
 
 using namespace Eigen;
-using namespace IOBuffer;
 using namespace FIFFLIB;
 
 
@@ -129,7 +123,7 @@ public:
 
     //=========================================================================================================
     /**
-    * Slot to receive incoming data.
+    * Slot to receive incoming data. Blocks while the estimation is running and the queue is full.
     *
     * @param[in] p_DataSegment  Data to estimate the covariance from -> ToDo Replace this by shared data pointer
     */
@@ -137,7 +131,15 @@ public:
 
     //=========================================================================================================
     /**
-    * Stops the RtCov by stopping the producer's thread.
+    * Starts the RtCov by starting the producer's thread.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    virtual bool start();
+
+    //=========================================================================================================
+    /**
+    * Stops the RtCov by stopping the producer's thread. Blocked append calls return, queued data is discarded.
     *
     * @return true if succeeded, false otherwise
     */
@@ -177,7 +179,9 @@ private:
 
     quint32      m_iMaxSamples;         /**< Maximal amount of samples received, before covariance is estimated.*/
 
-    CircularMatrixBuffer<double>::SPtr m_pRawMatrixBuffer;   /**< The Circular Raw Matrix Buffer. */
+    QQueue<MatrixXd> m_qQueueRawData;   /**< Data segments waiting to be processed. */
+    QWaitCondition m_waitNotEmpty;      /**< Wakes the worker on new data or on stop. */
+    QWaitCondition m_waitNotFull;       /**< Wakes a blocked append when a segment was taken or on stop. */
 };
 
 //*************************************************************************************************************
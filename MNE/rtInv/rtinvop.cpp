@@ -49,6 +49,7 @@
 
 
 #include <QDebug>
+#include <QMutexLocker>
 
 
 //*************************************************************************************************************
@@ -65,6 +66,7 @@ using namespace RTINVLIB;
 
 RtInvOp::RtInvOp(FiffInfo::SPtr &p_pFiffInfo, MNEForwardSolution::SPtr &p_pFwd, QObject *parent)
 : QThread(parent)
+, m_bIsRunning(false)
 , m_pFiffInfo(p_pFiffInfo)
 , m_pFwd(p_pFwd)
 {
@@ -84,11 +86,25 @@ RtInvOp::~RtInvOp()
 
 void RtInvOp::appendNoiseCov(FiffCov::SPtr p_pNoiseCov)
 {
-    mutex.lock();
-    //Use here a circular buffer
-    m_vecNoiseCov.push_back(p_pNoiseCov);
+    QMutexLocker locker(&mutex);
+
+    // an older covariance which is still pending is outdated now
+    m_pNoiseCov = p_pNoiseCov;
+    m_waitNoiseCov.wakeOne();
+}
+
 
+//*************************************************************************************************************
+
+bool RtInvOp::start()
+{
+    mutex.lock();
+    m_bIsRunning = true;
     mutex.unlock();
+
+    QThread::start();
+
+    return true;
 }
 
 
@@ -96,7 +112,12 @@ void RtInvOp::appendNoiseCov(FiffCov::SPtr p_pNoiseCov)
 
 bool RtInvOp::stop()
 {
+    mutex.lock();
     m_bIsRunning = false;
+    m_pNoiseCov.clear();
+    m_waitNoiseCov.wakeAll();
+    mutex.unlock();
+
     QThread::wait();
 
     return true;
@@ -107,22 +128,35 @@ bool RtInvOp::stop()
 
 void RtInvOp::run()
 {
-    m_bIsRunning = true;
-
-    while(m_bIsRunning)
+    while(true)
     {
-        if(m_vecNoiseCov.size() > 0)
+        mutex.lock();
+        while(m_bIsRunning && !m_pNoiseCov)
+            m_waitNoiseCov.wait(&mutex);
+
+        if(!m_bIsRunning)
+        {
+            mutex.unlock();
+            break;
+        }
+
+        FiffCov::SPtr t_pNoiseCov = m_pNoiseCov;
+        m_pNoiseCov.clear();
+        mutex.unlock();
+
+        //
+        // The covariance independent part is computed once per forward solution
+        //
+        if(!m_pInvSetup)
         {
             // Restrict forward solution as necessary for MEG
             MNEForwardSolution t_forwardMeg = m_pFwd->pick_types(true, false);
 
-            MNEInverseOperator::SPtr t_invOpMeg(new MNEInverseOperator(*m_pFiffInfo.data(), t_forwardMeg, *m_vecNoiseCov[0].data(), 0.2f, 0.8f));
+            m_pInvSetup = MNEInverseSetup::SPtr(new MNEInverseSetup(*m_pFiffInfo.data(), t_forwardMeg, 0.2f, 0.8f));
+        }
 
-            mutex.lock();
-            m_vecNoiseCov.pop_front();
-            mutex.unlock();
+        MNEInverseOperator::SPtr t_invOpMeg(new MNEInverseOperator(MNEInverseOperator::make_inverse_operator(*m_pInvSetup.data(), *t_pNoiseCov.data())));
 
-            emit invOperatorCalculated(t_invOpMeg);
-        }
+        emit invOperatorCalculated(t_invOpMeg);
     }
 }
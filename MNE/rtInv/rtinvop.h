@@ -58,6 +58,7 @@
 
 #include <mne/mne_forwardsolution.h>
 #include <mne/mne_inverse_operator.h>
+#include <mne/mne_inverse_setup.h>
 
 
 //*************************************************************************************************************
@@ -67,6 +68,7 @@
 
 #include <QThread>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QSharedPointer>
 
 
@@ -128,7 +130,9 @@ public:
 
     //=========================================================================================================
     /**
-    * Slot to receive incoming noise covariance estimations.
+    * Slot to receive incoming noise covariance estimations. Only the newest covariance is kept: covariances
+    * which arrive while an inverse operator is computed replace each other and just the latest one is
+    * processed.
     *
     * @param[in] p_pNoiseCov     Noise covariance estimation
     */
@@ -136,7 +140,16 @@ public:
 
     //=========================================================================================================
     /**
-    * Stops the RtInv by stopping the producer's thread.
+    * Starts the RtInvOp by starting the producer's thread.
+    *
+    * @return true if succeeded, false otherwise
+    */
+    virtual bool start();
+
+    //=========================================================================================================
+    /**
+    * Stops the RtInv by stopping the producer's thread. An inverse operator which is currently computed is
+    * finished, pending covariances are discarded.
     *
     * @return true if succeeded, false otherwise
     */
@@ -170,12 +183,14 @@ protected:
 
 private:
     QMutex      mutex;                  /**< Provides access serialization between threads. */
+    QWaitCondition m_waitNoiseCov;      /**< Wakes the worker on a new covariance or on stop. */
     bool        m_bIsRunning;           /**< Whether RtInv is running. */
 
-    QVector<FiffCov::SPtr> m_vecNoiseCov;/**< Noise covariance matrices. */
+    FiffCov::SPtr m_pNoiseCov;          /**< Newest noise covariance which is not processed yet, null if none. */
 
     FiffInfo::SPtr m_pFiffInfo;         /**< The fiff measurement information. */
     MNEForwardSolution::SPtr m_pFwd;    /**< The forward solution. */
+    MNEInverseSetup::SPtr m_pInvSetup;  /**< Noise covariance independent stage of the inverse operator, computed for m_pFwd on first use. */
 };
 
 //*************************************************************************************************************
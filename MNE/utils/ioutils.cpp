@@ -47,6 +47,7 @@
 //=============================================================================================================
 
 #include <QDataStream>
+#include <QtEndian>
 
 
 //*************************************************************************************************************
@@ -66,6 +67,218 @@ using namespace Eigen;
 using namespace UTILSLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// SIMD INCLUDES
+//=============================================================================================================
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define IOUTILS_X86_SIMD
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(IOUTILS_X86_SIMD) && (defined(__GNUC__) || defined(__clang__))
+#define IOUTILS_TARGET(x) __attribute__((target(x)))
+#else
+#define IOUTILS_TARGET(x)
+#endif
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// BYTE SHUFFLE KERNELS
+//=============================================================================================================
+
+namespace
+{
+
+typedef void (*SwapKernel)(uchar* p_pData, qint32 nel, qint32 width);
+
+//=============================================================================================================
+// Reference kernel, also used for the tails of the vector kernels
+void swap_scalar(uchar* p_pData, qint32 nel, qint32 width)
+{
+    qint32 k;
+    if(width == 2) {
+        quint16* data = reinterpret_cast<quint16*>(p_pData);
+        for(k = 0; k < nel; ++k)
+            data[k] = qbswap<quint16>(data[k]);
+    }
+    else if(width == 4) {
+        quint32* data = reinterpret_cast<quint32*>(p_pData);
+        for(k = 0; k < nel; ++k)
+            data[k] = qbswap<quint32>(data[k]);
+    }
+    else if(width == 8) {
+        quint64* data = reinterpret_cast<quint64*>(p_pData);
+        for(k = 0; k < nel; ++k)
+            data[k] = qbswap<quint64>(data[k]);
+    }
+}
+
+#ifdef IOUTILS_X86_SIMD
+
+//=============================================================================================================
+// Shuffle mask which reverses the bytes of each width wide element within a register of len bytes
+void make_shuffle_mask(uchar* p_pMask, qint32 len, qint32 width)
+{
+    for(qint32 i = 0; i < len; ++i)
+        p_pMask[i] = (uchar)((i/width)*width + (width-1-i%width));
+}
+
+//=============================================================================================================
+// Swaps the bytes of each 16 bit word
+inline __m128i swap_words_sse2(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+//=============================================================================================================
+
+void swap_sse2(uchar* p_pData, qint32 nel, qint32 width)
+{
+    qint64 nbytes = (qint64)nel*width;
+    qint64 i = 0;
+    for(; i + 16 <= nbytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pData + i));
+        if(width == 4) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2,3,0,1));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2,3,0,1));
+        }
+        else if(width == 8) {
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0,1,2,3));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0,1,2,3));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pData + i), swap_words_sse2(v));
+    }
+    swap_scalar(p_pData + i, (qint32)((nbytes - i)/width), width);
+}
+
+//=============================================================================================================
+
+IOUTILS_TARGET("ssse3")
+void swap_ssse3(uchar* p_pData, qint32 nel, qint32 width)
+{
+    uchar t_aMask[16];
+    make_shuffle_mask(t_aMask, 16, width);
+    const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t_aMask));
+
+    qint64 nbytes = (qint64)nel*width;
+    qint64 i = 0;
+    for(; i + 32 <= nbytes; i += 32) {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pData + i));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pData + i + 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pData + i), _mm_shuffle_epi8(v0, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pData + i + 16), _mm_shuffle_epi8(v1, mask));
+    }
+    for(; i + 16 <= nbytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pData + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pData + i), _mm_shuffle_epi8(v, mask));
+    }
+    swap_scalar(p_pData + i, (qint32)((nbytes - i)/width), width);
+}
+
+//=============================================================================================================
+// The 256 bit shuffle works per 128 bit lane, which is fine since elements never cross a lane
+IOUTILS_TARGET("avx2")
+void swap_avx2(uchar* p_pData, qint32 nel, qint32 width)
+{
+    uchar t_aMask[32];
+    make_shuffle_mask(t_aMask, 32, width);
+    const __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t_aMask));
+
+    qint64 nbytes = (qint64)nel*width;
+    qint64 i = 0;
+    for(; i + 64 <= nbytes; i += 64) {
+        __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pData + i));
+        __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pData + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pData + i), _mm256_shuffle_epi8(v0, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pData + i + 32), _mm256_shuffle_epi8(v1, mask));
+    }
+    for(; i + 32 <= nbytes; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p_pData + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_pData + i), _mm256_shuffle_epi8(v, mask));
+    }
+    swap_scalar(p_pData + i, (qint32)((nbytes - i)/width), width);
+}
+
+//=============================================================================================================
+
+bool cpu_has_ssse3()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+//=============================================================================================================
+
+bool cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if(!osxsave || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // IOUTILS_X86_SIMD
+
+//=============================================================================================================
+// Picks the kernel once; concurrent first calls all select the same kernel
+struct SwapDispatch
+{
+    SwapDispatch()
+    : kernel(swap_scalar)
+    , name("scalar")
+    {
+#ifdef IOUTILS_X86_SIMD
+#if !defined(_MSC_VER)
+        __builtin_cpu_init();
+#endif
+        kernel = swap_sse2;
+        name = "sse2";
+        if(cpu_has_ssse3()) {
+            kernel = swap_ssse3;
+            name = "ssse3";
+        }
+        if(cpu_has_avx2()) {
+            kernel = swap_avx2;
+            name = "avx2";
+        }
+#endif
+    }
+
+    SwapKernel kernel;
+    const char* name;
+};
+
+//=============================================================================================================
+
+const SwapDispatch& swap_dispatch()
+{
+    static SwapDispatch t_dispatch;
+    return t_dispatch;
+}
+
+} // NAMESPACE
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -236,3 +449,51 @@ void IOUtils::swap_doublep(double *source)
 
     return;
 }
+
+
+//*************************************************************************************************************
+
+void IOUtils::swap_short_array(qint16 *source, qint32 nel)
+{
+    swap_dispatch().kernel(reinterpret_cast<uchar*>(source), nel, 2);
+}
+
+
+//*************************************************************************************************************
+
+void IOUtils::swap_int_array(qint32 *source, qint32 nel)
+{
+    swap_dispatch().kernel(reinterpret_cast<uchar*>(source), nel, 4);
+}
+
+
+//*************************************************************************************************************
+
+void IOUtils::swap_long_array(qint64 *source, qint32 nel)
+{
+    swap_dispatch().kernel(reinterpret_cast<uchar*>(source), nel, 8);
+}
+
+
+//*************************************************************************************************************
+
+void IOUtils::swap_float_array(float *source, qint32 nel)
+{
+    swap_dispatch().kernel(reinterpret_cast<uchar*>(source), nel, 4);
+}
+
+
+//*************************************************************************************************************
+
+void IOUtils::swap_double_array(double *source, qint32 nel)
+{
+    swap_dispatch().kernel(reinterpret_cast<uchar*>(source), nel, 8);
+}
+
+
+//*************************************************************************************************************
+
+const char* IOUtils::swap_kernel()
+{
+    return swap_dispatch().name;
+}
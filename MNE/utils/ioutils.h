@@ -194,6 +194,60 @@ public:
     * @return swapped double
     */
     static void swap_doublep(double *source);
+
+    //=========================================================================================================
+    /**
+    * Swaps the byte order of a short array in place, using the fastest byte shuffle kernel of the cpu.
+    *
+    * @param[in, out] source    shorts to swap
+    * @param[in] nel            number of elements
+    */
+    static void swap_short_array(qint16 *source, qint32 nel);
+
+    //=========================================================================================================
+    /**
+    * Swaps the byte order of an integer array in place, using the fastest byte shuffle kernel of the cpu.
+    *
+    * @param[in, out] source    integers to swap
+    * @param[in] nel            number of elements
+    */
+    static void swap_int_array(qint32 *source, qint32 nel);
+
+    //=========================================================================================================
+    /**
+    * Swaps the byte order of a long array in place, using the fastest byte shuffle kernel of the cpu.
+    *
+    * @param[in, out] source    longs to swap
+    * @param[in] nel            number of elements
+    */
+    static void swap_long_array(qint64 *source, qint32 nel);
+
+    //=========================================================================================================
+    /**
+    * Swaps the byte order of a float array in place, using the fastest byte shuffle kernel of the cpu.
+    *
+    * @param[in, out] source    floats to swap
+    * @param[in] nel            number of elements
+    */
+    static void swap_float_array(float *source, qint32 nel);
+
+    //=========================================================================================================
+    /**
+    * Swaps the byte order of a double array in place, using the fastest byte shuffle kernel of the cpu.
+    *
+    * @param[in, out] source    doubles to swap
+    * @param[in] nel            number of elements
+    */
+    static void swap_double_array(double *source, qint32 nel);
+
+    //=========================================================================================================
+    /**
+    * Returns the name of the byte shuffle kernel used by the swap_*_array functions ("avx2", "ssse3", "sse2"
+    * or "scalar"). The kernel is selected once at runtime depending on the capabilities of the cpu.
+    *
+    * @return name of the selected kernel
+    */
+    static const char* swap_kernel();
 };
 
 //*************************************************************************************************************
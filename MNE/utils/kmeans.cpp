@@ -33,6 +33,7 @@
 *
 */
 
+
 //*************************************************************************************************************
 //=============================================================================================================
 // INCLUDES
@@ -47,8 +48,9 @@
 //=============================================================================================================
 
 #include <math.h>
-#include <iostream>
+#include <stdio.h>
 #include <algorithm>
+#include <limits>
 #include <vector>
 #include <time.h>
 
@@ -59,6 +61,8 @@
 //=============================================================================================================
 
 #include <QDebug>
+#include <QList>
+#include <QtConcurrent>
 
 
 //*************************************************************************************************************
@@ -71,955 +75,1173 @@ using namespace UTILSLIB;
 
 //*************************************************************************************************************
 //=============================================================================================================
-// DEFINE MEMBER METHODS
+// DEFINE LOCAL TYPES
 //=============================================================================================================
 
-KMeans::KMeans(QString distance, QString start, qint32 replicates, QString emptyact, bool online, qint32 maxit)
-: m_sDistance(distance)
-, m_sStart(start)
-, m_iReps(replicates)
-, m_sEmptyact(emptyact)
-, m_iMaxit(maxit)
-, m_bOnline(online)
+namespace
 {
-    // Assume one replicate
-    if (m_iReps < 1)
-        m_iReps = 1;
-}
-
 
-//*************************************************************************************************************
+//=========================================================================================================
+/**
+* Distance measures of the clustering engine. "correlation" is "cosine" on row centered data.
+*/
+enum KMeansDistance
+{
+    KMeansSqEuclidean,
+    KMeansCityBlock,
+    KMeansCosine
+};
 
-bool KMeans::calculate( MatrixXd X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D)
+//=========================================================================================================
+/**
+* Centroid initializations.
+*/
+enum KMeansStart
 {
-    if (kClusters < 1)
-        return false;
+    KMeansStartSample,
+    KMeansStartUniform,
+    KMeansStartPlus
+};
 
-    //Init random generator
-    srand ( time(NULL) );
+//=========================================================================================================
+/**
+* Actions taken when a cluster looses all its members.
+*/
+enum KMeansEmptyAct
+{
+    KMeansEmptyError,
+    KMeansEmptyDrop,
+    KMeansEmptySingleton
+};
 
-// n points in p dimensional space
-    k = kClusters;
-    n = X.rows();
-    p = X.cols();
 
-    if(m_sDistance.compare("cosine") == 0)
-    {
-//        Xnorm = sqrt(sum(X.^2, 2));
-//        if any(min(Xnorm) <= eps(max(Xnorm)))
-//            error(['Some points have small relative magnitudes, making them ', ...
-//                   'effectively zero.\nEither remove those points, or choose a ', ...
-//                   'distance other than ''cosine''.']);
-//        end
-//        X = X ./ Xnorm(:,ones(1,p));
-    }
-    else if(m_sDistance.compare("correlation")==0)
+//=========================================================================================================
+/**
+* Small xorshift64* generator. Every replicate owns one, so concurrently computed replicates are reproducible
+* for a given seed independent of the thread they are scheduled on.
+*/
+class KMeansRandom
+{
+public:
+    explicit KMeansRandom(quint64 seed)
+    : m_uiState(seed * Q_UINT64_C(0x9E3779B97F4A7C15) + Q_UINT64_C(0x2545F4914F6CDD1D))
     {
-        X.array() -= (X.rowwise().sum().array() / (double)p).replicate(1,p); //X - X.rowwise().sum();//.repmat(mean(X,2),1,p);
-        MatrixXd Xnorm = (X.array().pow(2).rowwise().sum()).sqrt();//sqrt(sum(X.^2, 2));
-//        if any(min(Xnorm) <= eps(max(Xnorm)))
-//            error(['Some points have small relative standard deviations, making them ', ...
-//                   'effectively constant.\nEither remove those points, or choose a ', ...
-//                   'distance other than ''correlation''.']);
-//        end
-        X.array() /= Xnorm.replicate(1,p).array();
+        if(m_uiState == 0)
+            m_uiState = Q_UINT64_C(0x2545F4914F6CDD1D);
     }
-//    else if(m_sDistance.compare('hamming')==0)
-//    {
-//        if ~all(ismember(X(:),[0 1]))
-//            error(message('NonbinaryDataForHamm'));
-//        end
-//    }
-
-    // Start
-    RowVectorXd Xmins;
-    RowVectorXd Xmaxs;
-    if (m_sStart.compare("uniform") == 0)
+
+    inline quint64 next()
     {
-        if (m_sDistance.compare("hamming") == 0)
-        {
-            printf("Error: Uniform Start For Hamming\n");
-            return false;
-        }
-        Xmins = X.colwise().minCoeff();
-        Xmaxs = X.colwise().maxCoeff();
+        m_uiState ^= m_uiState >> 12;
+        m_uiState ^= m_uiState << 25;
+        m_uiState ^= m_uiState >> 27;
+        return m_uiState * Q_UINT64_C(0x2545F4914F6CDD1D);
     }
 
-    //
-    // Done with input argument processing, begin clustering
-    //
-    if (m_bOnline)
+    /** @return uniform random number in [0, 1) */
+    inline double uniform()
     {
-        Del = MatrixXd(n,k);
-        Del.fill(std::numeric_limits<double>::quiet_NaN());// reassignment criterion
+        return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
     }
 
-    double totsumDBest = std::numeric_limits<double>::max();
-    emptyErrCnt = 0;
-
-    VectorXi idxBest;
-    MatrixXd Cbest;
-    VectorXd sumDBest;
-    MatrixXd Dbest;
-
-    for(qint32 rep = 0; rep < m_iReps; ++rep)
+    /** @return uniform random index in [0, n) */
+    inline qint32 index(qint32 n)
     {
-        if (m_sStart.compare("uniform") == 0)
-        {
-            C = MatrixXd::Zero(k,p);
-            for(qint32 i = 0; i < k; ++i)
-                for(qint32 j = 0; j < p; ++j)
-                    C(i,j) = unifrnd(Xmins[j], Xmaxs[j]);
-            // For 'cosine' and 'correlation', these are uniform inside a subset
-            // of the unit hypersphere.  Still need to center them for
-            // 'correlation'.  (Re)normalization for 'cosine'/'correlation' is
-            // done at each iteration.
-            if (m_sDistance.compare("correlation") == 0)
-                C.array() -= (C.array().rowwise().sum()/p).replicate(1, p).array();
-        }
-        else if (m_sStart.compare("sample") == 0)
-        {
-            C = MatrixXd::Zero(k,p);
-            for(qint32 i = 0; i < k; ++i)
-                C.block(i,0,1,p) = X.block(rand() % n, 0, 1, p);
-            // DEBUG
-//            C.block(0,0,1,p) = X.block(2, 0, 1, p);
-//            C.block(1,0,1,p) = X.block(7, 0, 1, p);
-//            C.block(2,0,1,p) = X.block(17, 0, 1, p);
-        }
-    //    else if (start.compare("cluster") == 0)
-    //    {
-    //        Xsubset = X(randsample(n,floor(.1*n)),:);
-    //        [dum, C] = kmeans(Xsubset, k, varargin{:}, 'start','sample', 'replicates',1);
-    //    }
-    //    else if (start.compare("numeric") == 0)
-    //    {
-    //        C = CC(:,:,rep);
-    //    }
-
-        // Compute the distance from every point to each cluster centroid and the
-        // initial assignment of points to clusters
-        D = distfun(X, C);//, 0);
-        idx = VectorXi::Zero(D.rows());
-        d = VectorXd::Zero(D.rows());
-
-        for(qint32 i = 0; i < D.rows(); ++i)
-            d[i] = D.row(i).minCoeff(&idx[i]);
-
-        m = VectorXi::Zero(k);
-        for(qint32 i = 0; i < k; ++i)
-            for (qint32 j = 0; j < idx.rows(); ++j)
-                if(idx[j] == i)
-                    ++ m[i];
-
-        try // catch empty cluster errors and move on to next rep
-        {
-            // Begin phase one:  batch reassignments
-            bool converged = batchUpdate(X, C, idx);
+        return std::min((qint32)(uniform() * n), n - 1);
+    }
 
-            // Begin phase two:  single reassignments
-            if (m_bOnline)
-                converged = onlineUpdate(X, C, idx);
+private:
+    quint64 m_uiState;
+};
 
-            if (!converged)
-                printf("Failed To Converge during replicate %d\n", rep);
 
-            // Calculate cluster-wise sums of distances
-            VectorXi nonempties = VectorXi::Zero(m.rows());
-            quint32 count = 0;
-            for(qint32 i = 0; i < m.rows(); ++i)
-            {
-                if(m[i] > 0)
-                {
-                    nonempties[i] = 1;
-                    ++count;
-                }
-            }
-            MatrixXd C_tmp(count,C.cols());
-            count = 0;
-            for(qint32 i = 0; i < nonempties.rows(); ++i)
-            {
-                if(nonempties[i])
-                {
-                    C_tmp.row(count) = C.row(i);
-                    ++count;
-                }
-            }
-
-            MatrixXd D_tmp = distfun(X, C_tmp);//, iter);
-            count = 0;
-            for(qint32 i = 0; i < nonempties.rows(); ++i)
-            {
-                if(nonempties[i])
-                {
-                    D.col(i) = D_tmp.col(count);
-                    C.row(i) = C_tmp.row(count);
-                    ++count;
-                }
-            }
-
-            d = VectorXd::Zero(n);
-            for(qint32 i = 0; i < n; ++i)
-                d[i] += D.array()(idx[i]*n+i);//Colum Major
+//=========================================================================================================
+/**
+* Settings shared by all replicates.
+*/
+struct KMeansSettings
+{
+    qint32 k;           /**< Number of clusters */
+    qint32 start;       /**< KMeansStart */
+    qint32 emptyact;    /**< KMeansEmptyAct */
+    bool online;        /**< If the online phase is performed */
+    qint32 maxit;       /**< Maximal number of iterations */
+    qint32 batchSize;   /**< Mini-batch size, 0 for full batch */
+    bool centerStart;   /**< If uniform start centroids have to be row centered ("correlation") */
+    quint64 seed;       /**< Base seed, replicate r is seeded with seed + r */
+};
+
+
+//=========================================================================================================
+/**
+* Read-only input data, prepared once and shared by all replicates.
+*/
+struct KMeansData
+{
+    MatrixXd X;         /**< Points n x p */
+    MatrixXd Xt;        /**< Transposed points p x n -> contiguous access per point */
+    VectorXd xx;        /**< Squared norm of each point */
+    RowVectorXd Xmins;  /**< Lower bounding box corner, used by the uniform start */
+    RowVectorXd Xmaxs;  /**< Upper bounding box corner, used by the uniform start */
+};
 
-            sumD = VectorXd::Zero(k);
-            for(qint32 i = 0; i < k; ++i)
-                for (qint32 j = 0; j < idx.rows(); ++j)
-                    if(idx[j] == i)
-                        sumD[i] += d[j];
 
-            totsumD = sumD.array().sum();
+//=========================================================================================================
+/**
+* Result of one replicate.
+*/
+struct KMeansResult
+{
+    bool ok;            /**< false if the replicate was terminated by an empty cluster */
+    bool converged;     /**< If the replicate converged */
+    qint32 iter;        /**< Number of iterations */
+    double totsumD;     /**< Total sum of distances */
+    VectorXi idx;       /**< Cluster index of each point */
+    MatrixXd C;         /**< Centroids k x p */
+    VectorXd sumD;      /**< Within cluster sums of distances */
+    MatrixXd D;         /**< Point to centroid distances n x k */
+};
+
+
+//=========================================================================================================
+/**
+* Working state of one replicate.
+*/
+struct KMeansState
+{
+    explicit KMeansState(quint64 seed)
+    : iter(0)
+    , totsumD(0)
+    , failed(false)
+    , rng(seed)
+    {}
+
+    MatrixXd C;         /**< Centroids k x p */
+    MatrixXd D;         /**< Point to centroid distances n x k */
+    VectorXi idx;       /**< Cluster index of each point */
+    VectorXi m;         /**< Number of points of each cluster */
+    VectorXd d;         /**< Distance of each point to its centroid */
+    qint32 iter;        /**< Current iteration */
+    double totsumD;     /**< Total sum of distances */
+    bool failed;        /**< Set when an empty cluster terminates the replicate */
+    MatrixXd Xmid1;     /**< Lower medians k x p ("cityblock" online phase) */
+    MatrixXd Xmid2;     /**< Upper medians k x p ("cityblock" online phase) */
+    KMeansRandom rng;   /**< Random generator of this replicate */
+};
+
+
+//=========================================================================================================
+/**
+* Sets all negative entries, caused by cancellation, to zero.
+*/
+inline void clampNonNegative(MatrixXd& D)
+{
+    D = (D.array() < 0.0).select(0.0, D);
+}
 
-//            printf("%d iterations, total sum of distances = %f\n", iter, totsumD);
 
-            // Save the best solution so far
-            if (totsumD < totsumDBest)
+//=========================================================================================================
+/**
+* Nearest centroid of each point, ties are resolved in favor of the lower cluster index.
+*/
+inline void nearest(const MatrixXd& D, VectorXd& d, VectorXi& idx)
+{
+    d = D.col(0);
+    idx = VectorXi::Zero(D.rows());
+    for(qint32 c = 1; c < D.cols(); ++c)
+    {
+        for(qint32 i = 0; i < D.rows(); ++i)
+        {
+            if(D(i,c) < d[i])
             {
-                totsumDBest = totsumD;
-                idxBest = idx;
-                Cbest = C;
-                sumDBest = sumD;
-                Dbest = D;
+                d[i] = D(i,c);
+                idx[i] = c;
             }
         }
-        catch (int e)
-        {
-            if(e == 0)
-            {
-                // If an empty cluster error occurred in one of multiple replicates, catch
-                // it, warn, and move on to next replicate.  Error only when all replicates
-                // fail.  Rethrow an other kind of error.
-                if (m_iReps == 1)
-                    return false;
-                else
-                {
-                    emptyErrCnt = emptyErrCnt + 1;
-//                    printf("Replicate %d terminated: empty cluster created at iteration %d.\n", rep, iter);
-                    if (emptyErrCnt == m_iReps)
-                    {
-//                        error(message('EmptyClusterAllReps'));
-                        return false;
-                    }
+    }
+}
 
-                }
-            }
-        } // catch
 
-    } // replicates
+//=========================================================================================================
+/**
+* MATLAB compatible K-Means clustering of one replicate. The distance measure is a template parameter,
+* hence no distance dispatch happens inside the iterations. The engine is a functor over the replicate
+* number, so replicates can be mapped concurrently; all mutable data lives in a per replicate KMeansState.
+*/
+template<int DIST>
+class KMeansEngine
+{
+public:
+    typedef KMeansResult result_type;
+
+    KMeansEngine(const KMeansData* p_pData, const KMeansSettings& p_settings)
+    : m_pData(p_pData)
+    , m_settings(p_settings)
+    {}
+
+    //=========================================================================================================
+    /**
+    * Computes replicate rep.
+    */
+    KMeansResult operator()(qint32 rep) const;
+
+private:
+    //=========================================================================================================
+    /**
+    * Distances of the points X (n x p, squared norms xx) to the centroids C (q x p) -> D (n x q).
+    */
+    void distances(const MatrixXd& X, const VectorXd& xx, const MatrixXd& C, MatrixXd& D) const;
+
+    //=========================================================================================================
+    /**
+    * Recomputes the distance columns of the clusters clusts.
+    */
+    void updateDistances(KMeansState& st, const std::vector<qint32>& clusts) const;
+
+    //=========================================================================================================
+    /**
+    * Centroids and counts of the clusters clusts, computed in one pass over the points.
+    */
+    void centroids(KMeansState& st, const std::vector<qint32>& clusts) const;
+
+    //=========================================================================================================
+    /**
+    * Component-wise median of the points members, including the lower and upper medians.
+    */
+    void median(const std::vector<qint32>& members, RowVectorXd& c, RowVectorXd& lo, RowVectorXd& hi) const;
+
+    void initialize(KMeansState& st) const;
+    bool handleEmpties(KMeansState& st, std::vector<qint32>& changed) const;
+    bool batchUpdate(KMeansState& st) const;
+    bool onlineUpdate(KMeansState& st) const;
+    void miniBatchUpdate(KMeansState& st) const;
+
+    const KMeansData* m_pData;  /**< Shared input data */
+    KMeansSettings m_settings;  /**< Shared settings */
+};
 
-    // Return the best solution
-    idx = idxBest;
-    C = Cbest;
-    sumD = sumDBest;
-    D = Dbest;
 
-//if hadNaNs
-//    idx = statinsertnan(wasnan, idx);
-//end
-    return true;
+//*************************************************************************************************************
+
+template<int DIST>
+void KMeansEngine<DIST>::distances(const MatrixXd& X, const VectorXd& xx, const MatrixXd& C, MatrixXd& D) const
+{
+    if(DIST == KMeansSqEuclidean)
+    {
+        // ||x - c||^2 = ||x||^2 - 2 x*c' + ||c||^2
+        D.noalias() = X * C.transpose();
+        D *= -2.0;
+        D.colwise() += xx;
+        D.rowwise() += C.rowwise().squaredNorm().transpose();
+        clampNonNegative(D);
+    }
+    else if(DIST == KMeansCityBlock)
+    {
+        D.resize(X.rows(), C.rows());
+        for(qint32 i = 0; i < C.rows(); ++i)
+            D.col(i) = (X.rowwise() - C.row(i)).cwiseAbs().rowwise().sum();
+    }
+    else // KMeansCosine, X is normalized
+    {
+        MatrixXd Cn(C.rows(), C.cols());
+        for(qint32 i = 0; i < C.rows(); ++i)
+            Cn.row(i) = C.row(i) / C.row(i).norm();
+        D.noalias() = X * Cn.transpose();
+        D = (1.0 - D.array()).matrix();
+        clampNonNegative(D);
+    }
 }
 
 
 //*************************************************************************************************************
 
-bool KMeans::batchUpdate(const MatrixXd& X, MatrixXd& C, VectorXi& idx)
+template<int DIST>
+void KMeansEngine<DIST>::updateDistances(KMeansState& st, const std::vector<qint32>& clusts) const
 {
-    // Every point moved, every cluster will need an update
-    qint32 i = 0;
-    VectorXi moved(n);
-    for(i = 0; i < n; ++i)
-        moved[i] = i;
-
-    VectorXi changed(k);
-    for(i = 0; i < k; ++i)
-        changed[i] = i;
+    if(clusts.empty())
+        return;
 
-    previdx = VectorXi::Zero(n);
+    MatrixXd C_sub(clusts.size(), st.C.cols());
+    for(size_t i = 0; i < clusts.size(); ++i)
+        C_sub.row(i) = st.C.row(clusts[i]);
 
-    prevtotsumD = std::numeric_limits<double>::max();//max double
+    MatrixXd D_sub;
+    distances(m_pData->X, m_pData->xx, C_sub, D_sub);
 
+    for(size_t i = 0; i < clusts.size(); ++i)
+        st.D.col(clusts[i]) = D_sub.col(i);
+}
 
-    MatrixXd D = MatrixXd::Zero(X.rows(), k);
 
-    //
-    // Begin phase one:  batch reassignments
-    //
-    iter = 0;
-    bool converged = false;
-    while(true)
-    {
-        ++iter;
-
-        // Calculate the new cluster centroids and counts, and update the
-        // distance from every point to those new cluster centroids
-        MatrixXd C_new;
-        VectorXi m_new;
-        KMeans::gcentroids(X, idx, changed, C_new, m_new);
-        MatrixXd D_new = distfun(X, C_new);//, iter);
+//*************************************************************************************************************
 
-        for(qint32 i = 0; i < changed.rows(); ++i)
-        {
-            C.row(changed[i]) = C_new.row(i);
-            D.col(changed[i]) = D_new.col(i);
-            m[changed[i]] = m_new[i];
-        }
+template<int DIST>
+void KMeansEngine<DIST>::centroids(KMeansState& st, const std::vector<qint32>& clusts) const
+{
+    const qint32 n = m_pData->X.rows();
+    const qint32 p = m_pData->X.cols();
+    const qint32 k = m_settings.k;
 
-        // Deal with clusters that have just lost all their members
-        VectorXi empties = VectorXi::Zero(changed.rows());
-        for(qint32 i = 0; i < changed.rows(); ++i)
-            if(m(i) == 0)
-                empties[i] = 1;
+    std::vector<bool> selected(k, false);
+    for(size_t i = 0; i < clusts.size(); ++i)
+        selected[clusts[i]] = true;
 
-        if (empties.sum() > 0)
+    if(DIST == KMeansCityBlock)
+    {
+        // Bucket the members of the selected clusters in one pass, then take component-wise medians
+        std::vector< std::vector<qint32> > members(k);
+        for(qint32 j = 0; j < n; ++j)
+            if(selected[st.idx[j]])
+                members[st.idx[j]].push_back(j);
+
+        RowVectorXd c, lo, hi;
+        for(size_t i = 0; i < clusts.size(); ++i)
         {
-            if (m_sEmptyact.compare("error") == 0)
-            {
-                throw 0;
-            }
-            else if (m_sEmptyact.compare("drop") == 0)
+            qint32 cl = clusts[i];
+            st.m[cl] = members[cl].size();
+            if(st.m[cl] > 0)
             {
-    //            // Remove the empty cluster from any further processing
-    //            D(:,empties) = NaN;
-    //            changed = changed(m(changed) > 0);
-    //            warning('Empty cluster created at iteration %d during replicate %d.',iter, rep,);
+                median(members[cl], c, lo, hi);
+                st.C.row(cl) = c;
             }
-            else if (m_sEmptyact.compare("singleton") == 0)
+            else
+                st.C.row(cl).fill(std::numeric_limits<double>::quiet_NaN());
+        }
+    }
+    else
+    {
+        // Accumulate the sums of the selected clusters in one pass over the points
+        MatrixXd S = MatrixXd::Zero(p, k);
+        VectorXi counts = VectorXi::Zero(k);
+        for(qint32 j = 0; j < n; ++j)
+        {
+            qint32 cl = st.idx[j];
+            if(selected[cl])
             {
-    //            warning('Empty cluster created at iteration %d during replicate %d.', iter, rep);
-
-    //            for i = empties
-    //                d = D((idx-1)*n + (1:n)'); // use newly updated distances
-
-    //                % Find the point furthest away from its current cluster.
-    //                % Take that point out of its cluster and use it to create
-    //                % a new singleton cluster to replace the empty one.
-    //                [dlarge, lonely] = max(d);
-    //                from = idx(lonely); % taking from this cluster
-    //                if m(from) < 2
-    //                    % In the very unusual event that the cluster had only
-    //                    % one member, pick any other non-singleton point.
-    //                    from = find(m>1,1,'first');
-    //                    lonely = find(idx==from,1,'first');
-    //                end
-    //                C(i,:) = X(lonely,:);
-    //                m(i) = 1;
-    //                idx(lonely) = i;
-    //                D(:,i) = distfun(X, C(i,:), distance, iter);
-
-    //                % Update clusters from which points are taken
-    //                [C(from,:), m(from)] = gcentroids(X, idx, from, distance);
-    //                D(:,from) = distfun(X, C(from,:), distance, iter);
-    //                changed = unique([changed from]);
-    //            end
+                S.col(cl) += m_pData->Xt.col(j);
+                ++counts[cl];
             }
         }
 
-        // Compute the total sum of distances for the current configuration.
-        totsumD = 0;
-        for(qint32 i = 0; i < n; ++i)
-            totsumD += D.array()(idx[i]*n+i);//Colum Major
-        // Test for a cycle: if objective is not decreased, back out
-        // the last step and move on to the single update phase
-        if(prevtotsumD <= totsumD)
+        for(size_t i = 0; i < clusts.size(); ++i)
         {
-            idx = previdx;
-            MatrixXd C_new;
-            VectorXi m_new;
-            gcentroids(X, idx, changed, C_new, m_new);
-            C.block(0,0,k,C.cols()) = C_new;
-            m.block(0,0,k,1) = m_new;
-            --iter;
-            break;
+            qint32 cl = clusts[i];
+            st.m[cl] = counts[cl];
+            if(counts[cl] > 0)
+                st.C.row(cl) = S.col(cl).transpose() / (double)counts[cl];
+            else
+                st.C.row(cl).fill(std::numeric_limits<double>::quiet_NaN());
         }
+    }
+}
 
-//        printf("%6d\t%6d\t%8d\t%12g\n",iter,1,moved.rows(),totsumD);
-        if (iter >= m_iMaxit)
-            break;
 
-        // Determine closest cluster for each point and reassign points to clusters
-        previdx = idx;
-        prevtotsumD = totsumD;
+//*************************************************************************************************************
 
-        VectorXi nidx(D.rows());
-        for(qint32 i = 0; i < D.rows(); ++i)
-            d[i] = D.row(i).minCoeff(&nidx[i]);
+template<int DIST>
+void KMeansEngine<DIST>::median(const std::vector<qint32>& members, RowVectorXd& c, RowVectorXd& lo, RowVectorXd& hi) const
+{
+    const qint32 p = m_pData->X.cols();
+    const qint32 mi = members.size();
+    const qint32 nn = mi / 2;
 
-        // Determine which points moved
-        VectorXi moved = VectorXi::Zero(nidx.rows());
-        qint32 count = 0;
-        for(qint32 i = 0; i < nidx.rows(); ++i)
+    c.resize(p);
+    lo.resize(p);
+    hi.resize(p);
+
+    std::vector<double> vals(mi);
+    for(qint32 j = 0; j < p; ++j)
+    {
+        for(qint32 r = 0; r < mi; ++r)
+            vals[r] = m_pData->X(members[r], j);
+
+        if(mi == 1)
         {
-            if(nidx[i] != previdx[i])
-            {
-                moved[count] = i;
-                ++count;
-            }
+            c[j] = lo[j] = hi[j] = vals[0];
+            continue;
         }
-        moved.conservativeResize(count);
 
-        if (moved.rows() > 0)
+        std::nth_element(vals.begin(), vals.begin() + nn, vals.end());
+        double kth = vals[nn];
+        double below = *std::max_element(vals.begin(), vals.begin() + nn);
+
+        if(mi % 2 == 0)
         {
-            // Resolve ties in favor of not moving
-            VectorXi moved_new = VectorXi::Zero(moved.rows());
-            count = 0;
-            for(qint32 i = 0; i < moved.rows(); ++i)
-            {
-                if(D.array()(previdx[moved[i]] * n + moved[i]) > d[moved[i]])
-                {
-                    moved_new[count] = moved[i];
-                    ++count;
-                }
-            }
-            moved_new.conservativeResize(count);
-            moved = moved_new;
+            lo[j] = below;
+            hi[j] = kth;
+            c[j] = 0.5 * (lo[j] + hi[j]);
         }
-
-        if (moved.rows() == 0)
+        else
         {
-            converged = true;
-            break;
+            lo[j] = below;
+            hi[j] = *std::min_element(vals.begin() + nn + 1, vals.end());
+            c[j] = kth;
         }
-
-        for(qint32 i = 0; i < moved.rows(); ++i)
-            if(moved[i] >= 0)
-                idx[ moved[i] ] = nidx[ moved[i] ];
-
-        // Find clusters that gained or lost members
-        std::vector<int> tmp;
-        for(qint32 i = 0; i < moved.rows(); ++i)
-            tmp.push_back(idx[moved[i]]);
-        for(qint32 i = 0; i < moved.rows(); ++i)
-            tmp.push_back(previdx[moved[i]]);
-
-        std::sort(tmp.begin(),tmp.end());
-
-        std::vector<int>::iterator it;
-        it = std::unique(tmp.begin(),tmp.end());
-        tmp.resize( it - tmp.begin() );
-
-        changed.conservativeResize(tmp.size());
-
-        for(quint32 i = 0; i < tmp.size(); ++i)
-            changed[i] = tmp[i];
-    } // phase one
-    return converged;
-} // nested function
-
+    }
+}
 
 
 //*************************************************************************************************************
 
-bool KMeans::onlineUpdate(const MatrixXd& X, MatrixXd& C, VectorXi& idx)
+template<int DIST>
+void KMeansEngine<DIST>::initialize(KMeansState& st) const
 {
-    // Initialize some cluster information prior to phase two
-    MatrixXd Xmid1;
-    MatrixXd Xmid2;
-    if (m_sDistance.compare("cityblock") == 0)
+    const MatrixXd& X = m_pData->X;
+    const qint32 n = X.rows();
+    const qint32 p = X.cols();
+    const qint32 k = m_settings.k;
+
+    st.C = MatrixXd::Zero(k, p);
+
+    if(m_settings.start == KMeansStartUniform)
     {
-        Xmid1 = MatrixXd::Zero(k,p);
-        Xmid2 = MatrixXd::Zero(k,p);
         for(qint32 i = 0; i < k; ++i)
+            for(qint32 j = 0; j < p; ++j)
+                st.C(i,j) = m_pData->Xmins[j] + (m_pData->Xmaxs[j] - m_pData->Xmins[j]) * st.rng.uniform();
+        // For 'cosine' and 'correlation', these are uniform inside a subset of the unit hypersphere. Still need
+        // to center them for 'correlation'. (Re)normalization is done in distances.
+        if(m_settings.centerStart)
+            st.C.colwise() -= st.C.rowwise().mean();
+    }
+    else if(m_settings.start == KMeansStartPlus)
+    {
+        // k-means++: every further centroid is drawn with a probability proportional to the distance of the
+        // point to its closest already chosen centroid
+        st.C.row(0) = X.row(st.rng.index(n));
+        MatrixXd D_new;
+        distances(X, m_pData->xx, st.C.row(0), D_new);
+        VectorXd minD = D_new.col(0);
+
+        for(qint32 i = 1; i < k; ++i)
         {
-            if (m[i] > 0)
+            double total = minD.sum();
+            qint32 next = n - 1;
+            if(total > 0.0)
             {
-                // Separate out sorted coords for points in i'th cluster,
-                // and save values above and below median, component-wise
-                MatrixXd Xsorted(m[i],p);
-                qint32 c = 0;
-                for(qint32 j = 0; j < idx.rows(); ++j)
+                double r = st.rng.uniform() * total;
+                double cum = 0.0;
+                for(qint32 j = 0; j < n; ++j)
                 {
-                    if(idx[j] == i)
+                    cum += minD[j];
+                    if(cum > r)
                     {
-                        Xsorted.row(c) = X.row(j);
-                        ++c;
+                        next = j;
+                        break;
                     }
                 }
-                for(qint32 j = 0; j < Xsorted.cols(); ++j)
-                    std::sort(Xsorted.col(j).data(),Xsorted.col(j).data()+Xsorted.rows());
-
-                qint32 nn = floor(0.5*m[i])-1;
-                if ((m[i] % 2) == 0)
-                {
-                    Xmid1.row(i) = Xsorted.row(nn);
-                    Xmid2.row(i) = Xsorted.row(nn+1);
-                }
-                else if (m[i] > 1)
-                {
-                    Xmid1.row(i) = Xsorted.row(nn);
-                    Xmid2.row(i) = Xsorted.row(nn+2);
-                }
-                else
-                {
-                    Xmid1.row(i) = Xsorted.row(0);
-                    Xmid2.row(i) = Xsorted.row(0);
-                }
             }
+            else
+                next = st.rng.index(n);
+
+            st.C.row(i) = X.row(next);
+            distances(X, m_pData->xx, st.C.row(i), D_new);
+            minD = minD.cwiseMin(D_new.col(0));
         }
     }
-    else if (m_sDistance.compare("hamming") == 0)
+    else // KMeansStartSample
     {
-//    Xsum = zeros(k,p);
-//    for i = 1:k
-//        if m(i) > 0
-//            % Sum coords for points in i'th cluster, component-wise
-//            Xsum(i,:) = sum(X(idx==i,:), 1);
-//        end
-//    end
-    }
-
-    //
-    // Begin phase two:  single reassignments
-    //
-    VectorXi changed = VectorXi(m.rows());
-    qint32 count = 0;
-    for(qint32 i = 0; i < m.rows(); ++i)
-    {
-        if(m[i] > 0)
+        // k distinct points, partial Fisher-Yates shuffle
+        std::vector<qint32> perm(n);
+        for(qint32 j = 0; j < n; ++j)
+            perm[j] = j;
+        for(qint32 i = 0; i < k; ++i)
         {
-            changed[count] = i;
-            ++count;
+            std::swap(perm[i], perm[i + st.rng.index(n - i)]);
+            st.C.row(i) = X.row(perm[i]);
         }
     }
-    changed.conservativeResize(count);
 
-    qint32 lastmoved = 0;
-    qint32 nummoved = 0;
-    qint32 iter1 = iter;
-    bool converged = false;
-    while (iter < m_iMaxit)
-    {
-        // Calculate distances to each cluster from each point, and the
-        // potential change in total sum of errors for adding or removing
-        // each point from each cluster.  Clusters that have not changed
-        // membership need not be updated.
-        //
-        // Singleton clusters are a special case for the sum of dists
-        // calculation.  Removing their only point is never best, so the
-        // reassignment criterion had better guarantee that a singleton
-        // point will stay in its own cluster.  Happily, we get
-        // Del(i,idx(i)) == 0 automatically for them.
-
-        if (m_sDistance.compare("sqeuclidean") == 0)
-        {
-            for(qint32 j = 0; j < changed.rows(); ++j)
-            {
-                qint32 i = changed[j];
-                VectorXi mbrs = VectorXi::Zero(idx.rows());
-                for(qint32 l = 0; l < idx.rows(); ++l)
-                    if(idx[l] == i)
-                        mbrs[l] = 1;
+    // Compute the distance from every point to each cluster centroid and the initial assignment of points
+    // to clusters
+    distances(X, m_pData->xx, st.C, st.D);
+    nearest(st.D, st.d, st.idx);
 
-                VectorXi sgn = 1 - 2 * mbrs.array(); // -1 for members, 1 for nonmembers
+    st.m = VectorXi::Zero(k);
+    for(qint32 j = 0; j < n; ++j)
+        ++st.m[st.idx[j]];
+}
 
-                if (m[i] == 1)
-                    for(qint32 l = 0; l < mbrs.rows(); ++l)
-                        if(mbrs[l])
-                            sgn[l] = 0; // prevent divide-by-zero for singleton mbrs
 
-                Del.col(i) = ((double)m[i] / ((double)m[i] + sgn.cast<double>().array()));
+//*************************************************************************************************************
 
-                Del.col(i).array() *= (X - C.row(i).replicate(n,1)).array().pow(2).rowwise().sum().array();
-            }
+template<int DIST>
+bool KMeansEngine<DIST>::handleEmpties(KMeansState& st, std::vector<qint32>& changed) const
+{
+    std::vector<qint32> empties;
+    for(size_t i = 0; i < changed.size(); ++i)
+        if(st.m[changed[i]] == 0)
+            empties.push_back(changed[i]);
+
+    if(empties.empty())
+        return true;
+
+    if(m_settings.emptyact == KMeansEmptyError)
+    {
+        st.failed = true;
+        return false;
+    }
+    else if(m_settings.emptyact == KMeansEmptyDrop)
+    {
+        // Remove the empty clusters from any further processing
+        std::vector<qint32> nonempties;
+        for(size_t i = 0; i < changed.size(); ++i)
+        {
+            if(st.m[changed[i]] == 0)
+                st.D.col(changed[i]).fill(std::numeric_limits<double>::infinity());
+            else
+                nonempties.push_back(changed[i]);
         }
-        else if (m_sDistance.compare("cityblock") == 0)
+        changed = nonempties;
+    }
+    else // KMeansEmptySingleton
+    {
+        const qint32 n = m_pData->X.rows();
+        for(size_t e = 0; e < empties.size(); ++e)
         {
-            for(qint32 j = 0; j < changed.rows(); ++j)
+            qint32 i = empties[e];
+
+            // Find the point furthest away from its current cluster. Take that point out of its cluster and
+            // use it to create a new singleton cluster to replace the empty one.
+            qint32 lonely = 0;
+            for(qint32 j = 0; j < n; ++j)
+                if(st.D(j, st.idx[j]) > st.D(lonely, st.idx[lonely]))
+                    lonely = j;
+            qint32 from = st.idx[lonely];
+            if(st.m[from] < 2)
             {
-                qint32 i = changed[j];
-                if (m(i) % 2 == 0) // this will never catch singleton clusters
+                // In the very unusual event that the cluster had only one member, pick any other non-singleton
+                // point.
+                for(from = 0; from < st.m.size() && st.m[from] < 2; ++from) ;
+                if(from == st.m.size())
                 {
-                    MatrixXd ldist = Xmid1.row(i).replicate(n,1) - X;
-                    MatrixXd rdist = X - Xmid2.row(i).replicate(n,1);
-                    VectorXd mbrs = VectorXd::Zero(idx.rows());
+                    st.failed = true;
+                    return false;
+                }
+                for(lonely = 0; st.idx[lonely] != from; ++lonely) ;
+            }
 
-                    for(qint32 l = 0; l < idx.rows(); ++l)
-                        if(idx[l] == i)
-                            mbrs[l] = 1;
-                    MatrixXd sgn = ((-2*mbrs).array() + 1).replicate(1, p); // -1 for members, 1 for nonmembers
-                    rdist = sgn.array()*rdist.array(); ldist = sgn.array()*ldist.array();
+            st.C.row(i) = m_pData->X.row(lonely);
+            st.m[i] = 1;
+            st.idx[lonely] = i;
 
-                    for(qint32 l = 0; l < idx.rows(); ++l)
-                    {
-                        double sum = 0;
-                        for(qint32 h = 0; h < rdist.cols(); ++h)
-                            sum += rdist(l,h) > ldist(l,h) ? rdist(l,h) < 0 ? 0 : rdist(l,h) : ldist(l,h) < 0 ? 0 : ldist(l,h);
-                        Del(l,i) = sum;
-                    }
-                }
-                else
-                    Del.col(i) = ((X - C.row(i).replicate(n,1)).array().abs()).rowwise().sum();
+            // Update clusters from which points are taken
+            std::vector<qint32> update;
+            update.push_back(from);
+            centroids(st, update);
+            update.push_back(i);
+            updateDistances(st, update);
+
+            if(std::find(changed.begin(), changed.end(), from) == changed.end())
+            {
+                changed.push_back(from);
+                std::sort(changed.begin(), changed.end());
             }
         }
-        else if (m_sDistance.compare("cosine") == 0 || m_sDistance.compare("correlation") == 0)
-        {
-            // The points are normalized, centroids are not, so normalize them
-            MatrixXd normC = C.array().pow(2).rowwise().sum().sqrt();
-//            if any(normC < eps(class(normC))) % small relative to unit-length data points
-//                error('Zero cluster centroid created at iteration %d during replicate %d.',iter, rep);
-//            end
-            // This can be done without a loop, but the loop saves memory allocations
-            MatrixXd XCi;
-            qint32 i;
-            for(qint32 j = 0; j < changed.rows(); ++j)
-            {
-                i = changed[j];
-                XCi = X * C.row(i).transpose();
+    }
+    return true;
+}
 
-                VectorXi mbrs = VectorXi::Zero(idx.rows());
-                for(qint32 l = 0; l < idx.rows(); ++l)
-                    if(idx[l] == i)
-                        mbrs[l] = 1;
 
-                VectorXi sgn = 1 - 2 * mbrs.array(); // -1 for members, 1 for nonmembers
+//*************************************************************************************************************
 
+template<int DIST>
+bool KMeansEngine<DIST>::batchUpdate(KMeansState& st) const
+{
+    const qint32 n = m_pData->X.rows();
+    const qint32 k = m_settings.k;
 
-                double A = (double)m[i] * normC(i,0);
-                double B = pow(((double)m[i] * normC(i,0)),2);
+    // Every point moved, every cluster will need an update
+    std::vector<qint32> changed(k);
+    for(qint32 i = 0; i < k; ++i)
+        changed[i] = i;
 
-                Del.col(i) = 1 + sgn.cast<double>().array()*
-                        (A - (B + 2 * sgn.cast<double>().array() * m[i] * XCi.array() + 1).sqrt());
+    VectorXi previdx = VectorXi::Constant(n, -1);
+    double prevtotsumD = std::numeric_limits<double>::infinity();
 
-                std::cout << "Del.col(i)\n" << Del.col(i) << std::endl;
+    st.iter = 0;
+    while(true)
+    {
+        // Calculate the new cluster centroids and counts, and update the distance from every point to those
+        // new cluster centroids
+        centroids(st, changed);
+        updateDistances(st, changed);
 
+        // Deal with clusters that have just lost all their members
+        if(!handleEmpties(st, changed))
+            return false;
 
+        // Compute the total sum of distances for the current configuration.
+        st.totsumD = 0;
+        for(qint32 j = 0; j < n; ++j)
+            st.totsumD += st.D(j, st.idx[j]);
 
-//                Del(:,i) = 1 + sgn .*...
-//                      (m(i).*normC(i) - sqrt((m(i).*normC(i)).^2 + 2.*sgn.*m(i).*XCi + 1));
-            }
-        }
-        else if (m_sDistance.compare("hamming") == 0)
+        // Test for a cycle: if objective is not decreased, back out the last step and move on to the single
+        // update phase
+        if(prevtotsumD <= st.totsumD)
         {
-//            for i = changed
-//                if mod(m(i),2) == 0 % this will never catch singleton clusters
-//                    % coords with an unequal number of 0s and 1s have a
-//                    % different contribution than coords with an equal
-//                    % number
-//                    unequal01 = find(2*Xsum(i,:) ~= m(i));
-//                    numequal01 = p - length(unequal01);
-//                    mbrs = (idx == i);
-//                    Di = abs(X(:,unequal01) - C(repmat(i,n,1),unequal01));
-//                    Del(:,i) = (sum(Di, 2) + mbrs*numequal01) / p;
-//                else
-//                    Del(:,i) = sum(abs(X - C(repmat(i,n,1),:)), 2) / p;
-//                end
-//            end
+            st.idx = previdx;
+            centroids(st, changed);
+            --st.iter;
+            return false;
         }
 
-        // Determine best possible move, if any, for each point.  Next we
-        // will pick one from those that actually did move.
-        previdx = idx;
-        prevtotsumD = totsumD;
+        ++st.iter;
+        if(st.iter >= m_settings.maxit)
+            return false;
 
-        VectorXi nidx = VectorXi::Zero(Del.rows());
-        VectorXd minDel = VectorXd::Zero(Del.rows());
+        // Determine closest cluster for each point and reassign points to clusters
+        previdx = st.idx;
+        prevtotsumD = st.totsumD;
 
-        for(qint32 i = 0; i < Del.rows(); ++i)
-            minDel[i] = Del.row(i).minCoeff(&nidx[i]);
+        VectorXi nidx;
+        nearest(st.D, st.d, nidx);
 
-        VectorXi moved = VectorXi::Zero(previdx.rows());
-        qint32 count = 0;
-        for(qint32 i = 0; i < moved.rows(); ++i)
+        // Determine which points moved, resolve ties in favor of not moving
+        std::vector<bool> touched(k, false);
+        bool moved = false;
+        for(qint32 j = 0; j < n; ++j)
         {
-            if(previdx[i] != nidx[i])
+            if(nidx[j] != previdx[j] && st.D(j, previdx[j]) > st.d[j])
             {
-                moved[count] = i;
-                ++count;
+                st.idx[j] = nidx[j];
+                touched[nidx[j]] = true;
+                touched[previdx[j]] = true;
+                moved = true;
             }
         }
-        moved.conservativeResize(count);
 
-        if (moved.sum() > 0)
-        {
-            // Resolve ties in favor of not moving
-            VectorXi moved_new = VectorXi::Zero(moved.rows());
-            count = 0;
-            for(qint32 i = 0; i < moved.rows(); ++i)
-            {
-                if ( Del.array()(previdx[moved(i)]*n + moved(i)) > minDel(moved(i)))
-                {
-                    moved_new[count] = moved[i];
-                    ++count;
-                }
-            }
-            moved_new.conservativeResize(count);
-            moved = moved_new;
-        }
+        if(!moved)
+            return true;
 
-        if (moved.rows() <= 0)
-        {
-            // Count an iteration if phase 2 did nothing at all, or if we're
-            // in the middle of a pass through all the points
-            if ((iter == iter1) || nummoved > 0)
-            {
-                ++iter;
+        // Find clusters that gained or lost members
+        changed.clear();
+        for(qint32 i = 0; i < k; ++i)
+            if(touched[i])
+                changed.push_back(i);
+    }
+}
 
-//                printf("%6d\t%6d\t%8d\t%12g\n",iter,2,nummoved,totsumD);
-            }
-            converged = true;
-            break;
-        }
 
-        // Pick the next move in cyclic order
-        VectorXi moved_new(moved.rows());
-        for(qint32 i = 0; i < moved.rows(); ++i)
-            moved_new[i] = ((moved[i] - lastmoved) % n) + lastmoved;
+//*************************************************************************************************************
 
-        moved[0] = moved_new.minCoeff() % n;//+1
-        moved.conservativeResize(1);
+template<int DIST>
+bool KMeansEngine<DIST>::onlineUpdate(KMeansState& st) const
+{
+    const MatrixXd& X = m_pData->X;
+    const qint32 n = X.rows();
+    const qint32 p = X.cols();
+    const qint32 k = m_settings.k;
 
-        // If we've gone once through all the points, that's an iteration
-        if (moved[0] <= lastmoved)
+    // Initialize some cluster information prior to phase two
+    if(DIST == KMeansCityBlock)
+    {
+        st.Xmid1 = MatrixXd::Zero(k, p);
+        st.Xmid2 = MatrixXd::Zero(k, p);
+
+        std::vector< std::vector<qint32> > members(k);
+        for(qint32 j = 0; j < n; ++j)
+            members[st.idx[j]].push_back(j);
+
+        RowVectorXd c, lo, hi;
+        for(qint32 i = 0; i < k; ++i)
         {
-            ++iter;
-//            printf("%6d\t%6d\t%8d\t%12g\n",iter,2,nummoved,totsumD);
-            if(iter >= m_iMaxit)
-                break;
-            nummoved = 0;
+            if(st.m[i] > 0)
+            {
+                median(members[i], c, lo, hi);
+                st.Xmid1.row(i) = lo;
+                st.Xmid2.row(i) = hi;
+            }
         }
-        ++nummoved;
-        lastmoved = moved[0];
+    }
 
-        qint32 oidx = idx(moved[0]);
-        nidx[0] = nidx(moved[0]);
-        nidx.conservativeResize(1);
-        totsumD += Del(moved[0],nidx[0]) - Del(moved[0],oidx);
+    // Point centroid products X*C', kept up to date by the centroid updates below. Each move then costs a
+    // single product with the moved point instead of one product per changed centroid.
+    MatrixXd XC;
+    if(DIST != KMeansCityBlock)
+        XC.noalias() = X * st.C.transpose();
+    VectorXd xm;
 
-        // Update the cluster index vector, and the old and new cluster
-        // counts and centroids
-        idx[ moved[0] ] = nidx[0];
-        m( nidx[0] ) = m( nidx[0] ) + 1;
-        m( oidx ) = m( oidx ) - 1;
+    // Reassignment criterion, never computed for empty clusters
+    MatrixXd Del = MatrixXd::Constant(n, k, std::numeric_limits<double>::infinity());
 
+    std::vector<qint32> changed;
+    for(qint32 i = 0; i < k; ++i)
+        if(st.m[i] > 0)
+            changed.push_back(i);
 
-        if (m_sDistance.compare("sqeuclidean") == 0)
-        {
-            C.row(nidx[0]) = C.row(nidx[0]).array() + (X.row(moved[0]) - C.row(nidx[0])).array() / m[nidx[0]];
-            C.row(oidx) = C.row(oidx).array() - (X.row(moved[0]) - C.row(oidx)).array() / m[oidx];
-        }
-        else if (m_sDistance.compare("cityblock") == 0)
-        {
-            VectorXi onidx(2);
-            onidx << oidx, nidx[0];//ToDo always right?
+    VectorXd minDel = VectorXd::Constant(n, std::numeric_limits<double>::infinity());
+    VectorXi nidx = VectorXi::Zero(n);
+    bool initial = true;
 
-            qint32 i;
-            for(qint32 h = 0; h < 2; ++h)
+    qint32 lastmoved = -1;
+    qint32 nummoved = 0;
+    qint32 iter1 = st.iter;
+    while(st.iter < m_settings.maxit)
+    {
+        // Calculate distances to each cluster from each point, and the potential change in total sum of errors
+        // for adding or removing each point from each cluster. Clusters that have not changed membership need
+        // not be updated.
+        for(size_t c = 0; c < changed.size(); ++c)
+        {
+            qint32 i = changed[c];
+            double mi = st.m[i];
+            if(DIST == KMeansSqEuclidean)
             {
-                i = onidx[h];
-                // Separate out sorted coords for points in each cluster.
-                // New centroid is the coord median, save values above and
-                // below median.  All done component-wise.
-                MatrixXd Xsorted(m[i],p);
-                qint32 c = 0;
-                for(qint32 j = 0; j < idx.rows(); ++j)
+                double cc = st.C.row(i).squaredNorm();
+                for(qint32 j = 0; j < n; ++j)
                 {
-                    if(idx[j] == i)
+                    // -1 for members, 1 for nonmembers, prevent divide-by-zero for singleton members
+                    double sgn = st.idx[j] == i ? (st.m[i] == 1 ? 0.0 : -1.0) : 1.0;
+                    Del(j,i) = mi / (mi + sgn) * std::max(0.0, m_pData->xx[j] - 2.0*XC(j,i) + cc);
+                }
+            }
+            else if(DIST == KMeansCityBlock)
+            {
+                if(st.m[i] % 2 == 0) // this will never catch singleton clusters
+                {
+                    for(qint32 j = 0; j < n; ++j)
                     {
-                        Xsorted.row(c) = X.row(j);
-                        ++c;
+                        double sgn = st.idx[j] == i ? -1.0 : 1.0;
+                        double sum = 0;
+                        for(qint32 l = 0; l < p; ++l)
+                        {
+                            double ldist = sgn * (st.Xmid1(i,l) - X(j,l));
+                            double rdist = sgn * (X(j,l) - st.Xmid2(i,l));
+                            sum += std::max(0.0, std::max(ldist, rdist));
+                        }
+                        Del(j,i) = sum;
                     }
                 }
-                for(qint32 j = 0; j < Xsorted.cols(); ++j)
-                    std::sort(Xsorted.col(j).data(),Xsorted.col(j).data()+Xsorted.rows());
+                else
+                    Del.col(i) = (X.rowwise() - st.C.row(i)).cwiseAbs().rowwise().sum();
+            }
+            else // KMeansCosine
+            {
+                // Use a 'distance' that will work in the below reassignment criterion
+                double normC = st.C.row(i).norm();
+                for(qint32 j = 0; j < n; ++j)
+                {
+                    double sgn = st.idx[j] == i ? -1.0 : 1.0;
+                    Del(j,i) = 1.0 + sgn * (mi*normC - sqrt((mi*normC)*(mi*normC) + 2.0*sgn*mi*XC(j,i) + 1.0));
+                }
+            }
+        }
 
+        // Determine best possible move, if any, for each point. Only the changed columns differ from the last
+        // iteration, a full row scan is needed only when the row minimum was located in one of them.
+        if(initial)
+        {
+            nearest(Del, minDel, nidx);
+            initial = false;
+        }
+        else
+        {
+            std::vector<bool> isChanged(k, false);
+            for(size_t c = 0; c < changed.size(); ++c)
+                isChanged[changed[c]] = true;
 
-                qint32 nn = floor(0.5*m[i])-1;
-                if ((m[i] % 2) == 0)
+            for(qint32 j = 0; j < n; ++j)
+            {
+                if(isChanged[nidx[j]])
                 {
-                    C.row(i) = 0.5 * (Xsorted.row(nn) + Xsorted.row(nn+1));
-                    Xmid1.row(i) = Xsorted.row(nn);
-                    Xmid2.row(i) = Xsorted.row(nn+1);
+                    minDel[j] = Del.row(j).minCoeff(&nidx[j]);
                 }
                 else
                 {
-                    C.row(i) = Xsorted.row(nn+1);
-                    if (m(i) > 1)
-                    {
-                        Xmid1.row(i) = Xsorted.row(nn);
-                        Xmid2.row(i) = Xsorted.row(nn+2);
-                    }
-                    else
+                    for(size_t c = 0; c < changed.size(); ++c)
                     {
-                        Xmid1.row(i) = Xsorted.row(0);
-                        Xmid2.row(i) = Xsorted.row(0);
+                        qint32 i = changed[c];
+                        if(Del(j,i) < minDel[j] || (Del(j,i) == minDel[j] && i < nidx[j]))
+                        {
+                            minDel[j] = Del(j,i);
+                            nidx[j] = i;
+                        }
                     }
                 }
             }
         }
-        else if (m_sDistance.compare("cosine") == 0 || m_sDistance.compare("correlation") == 0)
+
+        // Determine which points moved, resolve ties in favor of not moving. Pick the next move in cyclic
+        // order.
+        qint32 moved = -1;
+        qint32 bestOffset = n;
+        for(qint32 j = 0; j < n; ++j)
         {
-            C.row(nidx[0]).array() += (X.row(moved[0]) - C.row(nidx[0])).array() / m[nidx[0]];
-            C.row(oidx).array() += (X.row(moved[0]) - C.row(oidx)).array() / m[oidx];
+            if(nidx[j] != st.idx[j] && Del(j, st.idx[j]) > minDel[j])
+            {
+                qint32 offset = ((j - lastmoved - 1) % n + n) % n;
+                if(offset < bestOffset)
+                {
+                    bestOffset = offset;
+                    moved = j;
+                }
+            }
         }
-        else if (m_sDistance.compare("hamming") == 0)
+
+        if(moved < 0)
         {
-//                % Update summed coords for points in each cluster.  New
-//                % centroid is the coord median.  All done component-wise.
-//                Xsum(nidx,:) = Xsum(nidx,:) + X(moved,:);
-//                Xsum(oidx,:) = Xsum(oidx,:) - X(moved,:);
-//                C(nidx,:) = .5*sign(2*Xsum(nidx,:) - m(nidx)) + .5;
-//                C(oidx,:) = .5*sign(2*Xsum(oidx,:) - m(oidx)) + .5;
+            // Count an iteration if phase 2 did nothing at all, or if we're in the middle of a pass through all
+            // the points
+            if((st.iter == iter1) || nummoved > 0)
+                ++st.iter;
+            return true;
         }
 
-        VectorXi sorted_onidx(1+nidx.rows());
-        sorted_onidx << oidx, nidx;
-        std::sort(sorted_onidx.data(), sorted_onidx.data()+sorted_onidx.rows());
-        changed = sorted_onidx;
-    } // phase two
-
-    return converged;
+        if(moved <= lastmoved)
+        {
+            ++st.iter;
+            if(st.iter >= m_settings.maxit)
+                break;
+            nummoved = 0;
+        }
+        ++nummoved;
+        lastmoved = moved;
 
-} // nested function
+        qint32 oidx = st.idx[moved];
+        qint32 nidx_moved = nidx[moved];
+        st.totsumD += Del(moved, nidx_moved) - Del(moved, oidx);
 
+        // Update the cluster index vector, and the old and new cluster counts and centroids
+        st.idx[moved] = nidx_moved;
+        ++st.m[nidx_moved];
+        --st.m[oidx];
 
-//*************************************************************************************************************
-//DISTFUN Calculate point to cluster centroid distances.
-MatrixXd KMeans::distfun(const MatrixXd& X, MatrixXd& C)//, qint32 iter)
-{
-    MatrixXd D = MatrixXd::Zero(n,C.rows());
-    qint32 nclusts = C.rows();
+        if(DIST == KMeansCityBlock)
+        {
+            std::vector<qint32> members_o, members_n;
+            for(qint32 j = 0; j < n; ++j)
+            {
+                if(st.idx[j] == oidx)
+                    members_o.push_back(j);
+                else if(st.idx[j] == nidx_moved)
+                    members_n.push_back(j);
+            }
 
-    if (m_sDistance.compare("sqeuclidean") == 0)
-    {
-        for(qint32 i = 0; i < nclusts; ++i)
+            RowVectorXd c, lo, hi;
+            median(members_o, c, lo, hi);
+            st.C.row(oidx) = c;
+            st.Xmid1.row(oidx) = lo;
+            st.Xmid2.row(oidx) = hi;
+            median(members_n, c, lo, hi);
+            st.C.row(nidx_moved) = c;
+            st.Xmid1.row(nidx_moved) = lo;
+            st.Xmid2.row(nidx_moved) = hi;
+        }
+        else
         {
-            D.col(i) = (X.col(0).array() - C(i,0)).pow(2);
+            st.C.row(nidx_moved) += (X.row(moved) - st.C.row(nidx_moved)) / (double)st.m[nidx_moved];
+            st.C.row(oidx) -= (X.row(moved) - st.C.row(oidx)) / (double)st.m[oidx];
 
-            for(qint32 j = 1; j < p; ++j)
-                D.col(i) = D.col(i).array() + (X.col(j).array() - C(i,j)).pow(2);
+            xm.noalias() = X * m_pData->Xt.col(moved);
+            XC.col(nidx_moved) += (xm - XC.col(nidx_moved)) / (double)st.m[nidx_moved];
+            XC.col(oidx) -= (xm - XC.col(oidx)) / (double)st.m[oidx];
         }
+
+        changed.clear();
+        changed.push_back(std::min(oidx, nidx_moved));
+        changed.push_back(std::max(oidx, nidx_moved));
     }
-    else if (m_sDistance.compare("cityblock") == 0)
+
+    return false;
+}
+
+
+//*************************************************************************************************************
+
+template<int DIST>
+void KMeansEngine<DIST>::miniBatchUpdate(KMeansState& st) const
+{
+    const MatrixXd& X = m_pData->X;
+    const qint32 n = X.rows();
+    const qint32 p = X.cols();
+    const qint32 b = std::min(m_settings.batchSize, n);
+
+    // Per centroid learning rates 1/v, v = number of batch points assigned so far
+    VectorXi v = VectorXi::Zero(m_settings.k);
+
+    MatrixXd X_b(b, p);
+    VectorXd xx_b(b);
+    std::vector<qint32> sel(b);
+    MatrixXd D_b;
+    VectorXd d_b;
+    VectorXi idx_b;
+
+    for(st.iter = 0; st.iter < m_settings.maxit; ++st.iter)
     {
-        for(qint32 i = 0; i < nclusts; ++i)
+        for(qint32 j = 0; j < b; ++j)
         {
-            D.col(i) = (X.col(0).array() - C(i,0)).array().abs();
-            for(qint32 j = 1; j < p; ++j)
-            {
-                D.col(i).array() += (X.col(j).array() - C(i,j)).array().abs();
-            }
+            sel[j] = st.rng.index(n);
+            X_b.row(j) = X.row(sel[j]);
+            xx_b[j] = m_pData->xx[sel[j]];
         }
-    }
-    else if (m_sDistance.compare("cosine") == 0 || m_sDistance.compare("correlation") == 0)
-    {
-        // The points are normalized, centroids are not, so normalize them
-        MatrixXd normC = C.array().pow(2).rowwise().sum().sqrt();
-//        if any(normC < eps(class(normC))) % small relative to unit-length data points
-//            error('Zero cluster centroid created at iteration %d.',iter);
-        for (qint32 i = 0; i < nclusts; ++i)
+
+        // Assign the batch to the current centroids, then take gradient steps
+        distances(X_b, xx_b, st.C, D_b);
+        nearest(D_b, d_b, idx_b);
+
+        for(qint32 j = 0; j < b; ++j)
         {
-            MatrixXd C_tmp = (C.row(i).array() / normC(i,0)).transpose();
-            D.col(i) = X * C_tmp;//max(1 - X * (C(i,:)./normC(i))', 0);
-            for(qint32 j = 0; j < D.rows(); ++j)
-                if(D(j,i) < 0)
-                    D(j,i) = 0;
+            qint32 cl = idx_b[j];
+            ++v[cl];
+            st.C.row(cl) += (X_b.row(j) - st.C.row(cl)) / (double)v[cl];
         }
     }
-//case 'hamming'
-//    for i = 1:nclusts
-//        D(:,i) = abs(X(:,1) - C(i,1));
-//        for j = 2:p
-//            D(:,i) = D(:,i) + abs(X(:,j) - C(i,j));
-//        end
-//        D(:,i) = D(:,i) / p;
-//        % D(:,i) = sum(abs(X - C(repmat(i,n,1),:)), 2) / p;
-//    end
-//end
-    return D;
-} // function
+
+    // Final assignment of all points
+    distances(X, m_pData->xx, st.C, st.D);
+    nearest(st.D, st.d, st.idx);
+}
 
 
 //*************************************************************************************************************
-//GCENTROIDS Centroids and counts stratified by group.
-void KMeans::gcentroids(const MatrixXd& X, const VectorXi& index, const VectorXi& clusts,
-                                          MatrixXd& centroids, VectorXi& counts)
+
+template<int DIST>
+KMeansResult KMeansEngine<DIST>::operator()(qint32 rep) const
 {
-    qint32 num = clusts.rows();
-    centroids = MatrixXd::Zero(num,p);
-    centroids.fill(std::numeric_limits<double>::quiet_NaN());
-    counts = VectorXi::Zero(num);
+    const qint32 n = m_pData->X.rows();
+    const qint32 k = m_settings.k;
 
-    VectorXi members;
+    KMeansState st(m_settings.seed + (quint64)rep);
 
-    qint32 c;
+    KMeansResult res;
+    res.ok = false;
+    res.converged = false;
+    res.iter = 0;
+    res.totsumD = std::numeric_limits<double>::infinity();
 
-    for(qint32 i = 0; i < num; ++i)
+    initialize(st);
+
+    bool converged;
+    if(m_settings.batchSize > 0)
     {
-        c = 0;
-        members = VectorXi::Zero(index.rows());
-        for(qint32 j = 0; j < index.rows(); ++j)
-        {
-            if(index[j] == clusts[i])
-            {
-                members[c] = j;
-                ++c;
-            }
-        }
-        members.conservativeResize(c);
-        if (c > 0)
-        {
-            counts[i] = c;
-            if(m_sDistance.compare("sqeuclidean") == 0)
-            {
-                //Initialize
-                if(members.rows() > 0)
-                    centroids.row(i) = RowVectorXd::Zero(centroids.cols());
+        miniBatchUpdate(st);
 
-                for(qint32 j = 0; j < members.rows(); ++j)
-                    centroids.row(i).array() += X.row(members[j]).array() / counts[i];
-            }
-            else if(m_sDistance.compare("cityblock") == 0)
-            {
-                // Separate out sorted coords for points in i'th cluster,
-                // and use to compute a fast median, component-wise
-                MatrixXd Xsorted(counts[i],p);
-                c = 0;
+        std::vector<qint32> all(k);
+        for(qint32 i = 0; i < k; ++i)
+            all[i] = i;
+        centroids(st, all);
+        updateDistances(st, all);
+        if(!handleEmpties(st, all))
+            return res;
+        converged = true;
+    }
+    else
+    {
+        // Begin phase one:  batch reassignments
+        converged = batchUpdate(st);
+        if(st.failed)
+            return res;
+
+        // Begin phase two:  single reassignments
+        if(m_settings.online)
+            converged = onlineUpdate(st);
+    }
 
-                for(qint32 j = 0; j < index.rows(); ++j)
-                {
-                    if(index[j] == clusts[i])
-                    {
-                        Xsorted.row(c) = X.row(j);
-                        ++c;
-                    }
-                }
+    if(!converged)
+        printf("Failed To Converge during replicate %d\n", rep);
 
-                for(qint32 j = 0; j < Xsorted.cols(); ++j)
-                    std::sort(Xsorted.col(j).data(),Xsorted.col(j).data()+Xsorted.rows());
+    // Calculate cluster-wise sums of distances
+    std::vector<qint32> nonempties;
+    for(qint32 i = 0; i < k; ++i)
+    {
+        if(st.m[i] > 0)
+            nonempties.push_back(i);
+        else
+            st.D.col(i).fill(std::numeric_limits<double>::quiet_NaN());
+    }
+    updateDistances(st, nonempties);
 
-                qint32 nn = floor(0.5*(counts(i)))-1;
-                if (counts[i] % 2 == 0)
-                    centroids.row(i) = .5 * (Xsorted.row(nn) + Xsorted.row(nn+1));
-                else
-                    centroids.row(i) = Xsorted.row(nn+1);
-            }
-            else if(m_sDistance.compare("cosine") == 0 || m_sDistance.compare("correlation") == 0)
-            {
-                for(qint32 j = 0; j < members.rows(); ++j)
-                    centroids.row(i).array() += X.row(members[j]).array() / counts[i]; // unnormalized
-            }
-//            else if(m_sDistance.compare("hamming") == 0)
-//            {
-//                % Compute a fast median for binary data, component-wise
-//                centroids(i,:) = .5*sign(2*sum(X(members,:), 1) - counts(i)) + .5;
-//            }
-        }
+    res.sumD = VectorXd::Zero(k);
+    for(qint32 j = 0; j < n; ++j)
+        res.sumD[st.idx[j]] += st.D(j, st.idx[j]);
+
+    res.ok = true;
+    res.converged = converged;
+    res.iter = st.iter;
+    res.totsumD = res.sumD.sum();
+    res.idx = st.idx;
+    res.C = st.C;
+    res.D = st.D;
+
+    return res;
+}
+
+
+//=========================================================================================================
+/**
+* Computes all replicates, concurrently if there is more than one.
+*/
+template<class Engine>
+QList<KMeansResult> runReplicates(const Engine& engine, qint32 reps)
+{
+    if(reps == 1)
+    {
+        QList<KMeansResult> results;
+        results.append(engine(0));
+        return results;
     }
-}// function
+
+    QList<qint32> replicates;
+    for(qint32 rep = 0; rep < reps; ++rep)
+        replicates.append(rep);
+
+    return QtConcurrent::blockingMapped< QList<KMeansResult> >(replicates, engine);
+}
+
+} // NAMESPACE
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+KMeans::KMeans(QString distance, QString start, qint32 replicates, QString emptyact, bool online, qint32 maxit, qint32 seed)
+: m_sDistance(distance)
+, m_sStart(start)
+, m_iReps(replicates)
+, m_sEmptyact(emptyact)
+, m_iMaxit(maxit)
+, m_bOnline(online)
+, m_iSeed(seed)
+, m_iBatchSize(0)
+{
+    // Assume one replicate
+    if (m_iReps < 1)
+        m_iReps = 1;
+}
 
 
 //*************************************************************************************************************
 
-double KMeans::unifrnd(double a, double b)
+void KMeans::setMiniBatch(qint32 batchSize)
 {
-    if (a > b)
-        return std::numeric_limits<double>::quiet_NaN();
+    m_iBatchSize = batchSize > 0 ? batchSize : 0;
+}
+
+
+//*************************************************************************************************************
+
+bool KMeans::calculate( MatrixXd X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D)
+{
+    // n points in p dimensional space
+    qint32 n = X.rows();
+    qint32 p = X.cols();
+
+    if (kClusters < 1 || kClusters > n || p < 1)
+    {
+        printf("Error: Number of clusters (%d) has to be in between 1 and the number of points (%d).\n", kClusters, n);
+        return false;
+    }
+
+    KMeansSettings settings;
+    settings.k = kClusters;
+    settings.online = m_bOnline;
+    settings.maxit = m_iMaxit;
+    settings.batchSize = m_iBatchSize;
+    settings.centerStart = false;
+    settings.seed = m_iSeed < 0 ? (quint64)time(NULL) : (quint64)m_iSeed;
+
+    KMeansDistance distance;
+    if(m_sDistance.compare("sqeuclidean") == 0)
+        distance = KMeansSqEuclidean;
+    else if(m_sDistance.compare("cityblock") == 0)
+        distance = KMeansCityBlock;
+    else if(m_sDistance.compare("cosine") == 0 || m_sDistance.compare("correlation") == 0)
+        distance = KMeansCosine;
+    else
+    {
+        printf("Error: Unknown distance %s.\n", m_sDistance.toLatin1().constData());
+        return false;
+    }
+
+    if(m_sStart.compare("uniform") == 0)
+        settings.start = KMeansStartUniform;
+    else if(m_sStart.compare("plus") == 0)
+        settings.start = KMeansStartPlus;
+    else if(m_sStart.compare("sample") == 0)
+        settings.start = KMeansStartSample;
+    else
+    {
+        printf("Error: Unknown start %s.\n", m_sStart.toLatin1().constData());
+        return false;
+    }
+
+    if(m_sEmptyact.compare("drop") == 0)
+        settings.emptyact = KMeansEmptyDrop;
+    else if(m_sEmptyact.compare("singleton") == 0)
+        settings.emptyact = KMeansEmptySingleton;
+    else
+        settings.emptyact = KMeansEmptyError;
+
+    if(distance == KMeansCityBlock && settings.batchSize > 0)
+    {
+        printf("Warning: Mini-batch mode is not available for cityblock distances, using full batches.\n");
+        settings.batchSize = 0;
+    }
 
-    double a2 = a/2.0;
-    double b2 = b/2.0;
-    double mu = a2+b2;
-    double sig = b2-a2;
+    if(m_sDistance.compare("correlation") == 0)
+    {
+        X.colwise() -= X.rowwise().mean();
+        settings.centerStart = true;
+    }
+
+    if(distance == KMeansCosine)
+    {
+        VectorXd Xnorm = X.rowwise().norm();
+        if(Xnorm.minCoeff() <= std::numeric_limits<double>::epsilon() * Xnorm.maxCoeff())
+        {
+            printf("Error: Some points have small relative magnitudes, making them effectively zero. Either remove those points, or choose a distance other than %s.\n", m_sDistance.toLatin1().constData());
+            return false;
+        }
+        for(qint32 j = 0; j < n; ++j)
+            X.row(j) /= Xnorm[j];
+    }
+
+    //
+    // Done with input argument processing, begin clustering
+    //
+    KMeansData data;
+    data.X = X;
+    data.Xt = X.transpose();
+    data.xx = X.rowwise().squaredNorm();
+    if(settings.start == KMeansStartUniform)
+    {
+        data.Xmins = X.colwise().minCoeff();
+        data.Xmaxs = X.colwise().maxCoeff();
+    }
+
+    QList<KMeansResult> results;
+    switch(distance)
+    {
+        case KMeansSqEuclidean:
+            results = runReplicates(KMeansEngine<KMeansSqEuclidean>(&data, settings), m_iReps);
+            break;
+        case KMeansCityBlock:
+            results = runReplicates(KMeansEngine<KMeansCityBlock>(&data, settings), m_iReps);
+            break;
+        case KMeansCosine:
+            results = runReplicates(KMeansEngine<KMeansCosine>(&data, settings), m_iReps);
+            break;
+    }
 
-    double r = mu + sig * (2.0* (rand() % 1000)/1000 -1.0);
+    // Return the best solution, if an empty cluster error occurred in one of multiple replicates move on to
+    // the next replicate. Error only when all replicates fail.
+    qint32 best = -1;
+    for(qint32 rep = 0; rep < results.size(); ++rep)
+        if(results[rep].ok && (best < 0 || results[rep].totsumD < results[best].totsumD))
+            best = rep;
 
-    return r;
+    if(best < 0)
+    {
+        printf("Error: An empty cluster was created in all %d replicates.\n", m_iReps);
+        return false;
+    }
+
+    idx = results[best].idx;
+    C = results[best].C;
+    sumD = results[best].sumD;
+    D = results[best].D;
+
+    return true;
 }
@@ -89,22 +89,34 @@ public:
     typedef QSharedPointer<KMeans> SPtr;            /**< Shared pointer type for KMeans. */
     typedef QSharedPointer<const KMeans> ConstSPtr; /**< Const shared pointer type for KMeans. */
 
-    //distance {'sqeuclidean','cityblock','cosine','correlation','hamming'};
-    //startNames = {'uniform','sample','cluster'};
+    //distance {'sqeuclidean','cityblock','cosine','correlation'};
+    //startNames = {'uniform','sample','plus'};
     //emptyactNames = {'error','drop','singleton'};
 
     //=========================================================================================================
     /**
     * Constructs a KMeans algorithm object.
     *
-    * @param[in] distance   (optional) K-Means distance measure: "sqeuclidean" (default), "cityblock" , "cosine", "correlation", "hamming"
-    * @param[in] start      (optional) Cluster initialization: "sample" (default), "uniform", "cluster"
-    * @param[in] replicates (optional) Number of K-Means replicates, which are generated. Best is returned.
+    * @param[in] distance   (optional) K-Means distance measure: "sqeuclidean" (default), "cityblock" , "cosine", "correlation"
+    * @param[in] start      (optional) Cluster initialization: "sample" (default), "uniform", "plus" (k-means++)
+    * @param[in] replicates (optional) Number of K-Means replicates, which are generated concurrently. Best is returned.
     * @param[in] emptyact   (optional) What happens if a cluster wents empty: "error" (default), "drop", "singleton"
     * @param[in] online     (optional) If centroids should be updated during iterations: true (default), false
     * @param[in] maxit      (optional) maximal number of iterations per replicate; 100 by default
+    * @param[in] seed       (optional) seed of the random generator, which makes the result reproducible; negative (default): seeded with the current time
     */
-    explicit KMeans(QString distance = QString("sqeuclidean") , QString start = QString("sample"), qint32 replicates = 1, QString emptyact = QString("error"), bool online = true, qint32 maxit = 100);
+    explicit KMeans(QString distance = QString("sqeuclidean") , QString start = QString("sample"), qint32 replicates = 1, QString emptyact = QString("error"), bool online = true, qint32 maxit = 100, qint32 seed = -1);
+
+    //=========================================================================================================
+    /**
+    * Switches to mini-batch K-Means: each of the maxit iterations updates the centroids with a random batch
+    * of points instead of the whole data set. The final assignment is done once on all points, the batch and
+    * the online phase are skipped. Only available for mean based distances ("sqeuclidean", "cosine",
+    * "correlation").
+    *
+    * @param[in] batchSize  Number of points per mini-batch; 0 (default) disables the mini-batch mode
+    */
+    void setMiniBatch(qint32 batchSize);
 
     //=========================================================================================================
     /**
@@ -116,96 +128,20 @@ public:
     * @param[out] C         Cluster centroids k x p
     * @param[out] sumD      Summation of the distances to the centroid within one cluster
     * @param[out] D         Cluster distances to the centroid
+    *
+    * @return true if at least one replicate succeeded, false otherwise
     */
     bool calculate( MatrixXd X, qint32 kClusters, VectorXi& idx, MatrixXd& C, VectorXd& sumD, MatrixXd& D);
 
-
 private:
-    //=========================================================================================================
-    /**
-    * Calculate point to cluster centroid distances.
-    *
-    * @param[in] X  Input data (rows = points; cols = p dimensional space)
-    * @param[in] C  Cluster centroids
-    *
-    * @return Cluster centroid distances
-    */
-    MatrixXd distfun(const MatrixXd& X, MatrixXd& C);//, qint32 iter);
-
-    //=========================================================================================================
-    /**
-    * Updates clusters when points moved
-    *
-    * @param[in] X          Input data
-    * @param[in, out] C     Cluster centroids
-    * @param[in, out] idx   The cluster indeces to which cluster the input points belong to
-    *
-    * @return true if converged, false otherwise
-    */
-    bool batchUpdate(const MatrixXd& X, MatrixXd& C, VectorXi& idx);
-
-    //=========================================================================================================
-    /**
-    * Centroids and counts stratified by group.
-    *
-    * @param[in] X          Input data
-    * @param[in] index      The cluster indeces to which cluster the input points belong to
-    * @param[in] clusts     Cluster indeces
-    * @param[out] centroids The new centroids
-    * @param[out] counts    Number of points belonging to the new centroids
-    */
-    void gcentroids(const MatrixXd& X, const VectorXi& index, const VectorXi& clusts,
-                                        MatrixXd& centroids, VectorXi& counts);
-
-    //=========================================================================================================
-    /**
-    * Centroids and counts stratified by group.
-    *
-    * @param[in] X          Input data
-    * @param[out] C         The new centroids
-    * @param[out] idx       The new indeces
-    *
-    * @return true if converged, false otherwise
-    */
-    bool onlineUpdate(const MatrixXd& X, MatrixXd& C,  VectorXi& idx);
-
-
-    //=========================================================================================================
-    /**
-    * Uniform random generator in the intervall [a, b]
-    *
-    * @param[in] a      lower boundary
-    * @param[in] b      upper boundary
-    *
-    * @return random number
-    */
-    double unifrnd(double a, double b);
-
-
-    QString m_sDistance;    /**< Distance measurement to use: "sqeuclidean" (default), "cityblock" , "cosine", "correlation", "hamming". */
-    QString m_sStart;       /**< Initialization to use: "sample" (default), "uniform", "cluster". */
+    QString m_sDistance;    /**< Distance measurement to use: "sqeuclidean" (default), "cityblock" , "cosine", "correlation". */
+    QString m_sStart;       /**< Initialization to use: "sample" (default), "uniform", "plus". */
     qint32 m_iReps;         /**< Number of K-Means replicates, which should be generated. */
     QString m_sEmptyact;    /**< What should be done if a cluster wents empty: "error" (default), "drop", "singleton" */
     qint32 m_iMaxit;        /**< Maximal number of iterations per replicate */
     bool m_bOnline;         /**< If online update should be performed */
-
-    qint32 emptyErrCnt;     /**< Counts the occurence of empty errors */
-
-    qint32 iter;            /**< Current iteration */
-    qint32 k;               /**< Number of clusters */
-    qint32 n;               /**< Number of points to be clustered */
-    qint32 p;               /**< dimension of space in which the clustering is performed */
-
-    MatrixXd Del;           /**< reassignment criterion */
-    VectorXd d;             /**< Minimal distances of each point to its centroid */
-    VectorXi m;             /**< m number of points belonging to the cluster */
-
-    double totsumD;         /**< Total sum of centroid distances */
-
-    double prevtotsumD;     /**< Sum of centroid distances of the previous iteration */
-
-    VectorXi previdx;       /**< Previous point cluster indeces */
-
+    qint32 m_iSeed;         /**< Seed of the random generator, negative if seeded with the current time */
+    qint32 m_iBatchSize;    /**< Mini-batch size, 0 if the full data set is used in every iteration */
 };
 
 } // NAMESPACE
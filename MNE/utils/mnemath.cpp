@@ -49,6 +49,7 @@
 #include <iostream>
 #include <algorithm>    // std::sort
 #include <vector>       // std::vector
+#include <limits>
 
 //DEBUG fstream
 //#include <fstream>
@@ -71,6 +72,15 @@
 using namespace UTILSLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define XYZ_CHUNK_SOURCES   256     /**< Sources per block of the fused kernel product */
+#define XYZ_CHUNK_SAMPLES   512     /**< Samples per block of the fused kernel product */
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -84,20 +94,77 @@ VectorXd* MNEMath::combine_xyz(const VectorXd& vec)
         return NULL;
     }
 
-    MatrixXd tmp = MatrixXd(vec.transpose());
-    SparseMatrix<double>* s = make_block_diag(tmp,3);
-
-    SparseMatrix<double> sC = *s*s->transpose();
-    VectorXd* comb = new VectorXd(sC.rows());
+    VectorXd* comb = new VectorXd(vec.size()/3);
 
-    for(qint32 i = 0; i < sC.rows(); ++i)
-        (*comb)[i] = sC.coeff(i,i);
+    for(qint32 i = 0; i < comb->size(); ++i)
+        (*comb)[i] = vec[3*i]*vec[3*i] + vec[3*i+1]*vec[3*i+1] + vec[3*i+2]*vec[3*i+2];
 
-    delete s;
     return comb;
 }
 
 
+//*************************************************************************************************************
+
+MatrixXd MNEMath::combine_xyz_norm(const MatrixXd& mat)
+{
+    if (mat.rows() % 3 != 0)
+    {
+        printf("Input must be a matrix with 3N rows");
+        return MatrixXd();
+    }
+
+    //
+    //   Strided views on the x, y and z rows, evaluated in a single pass
+    //
+    typedef Map<const MatrixXd, 0, Stride<Dynamic,3> > XyzMap;
+    Stride<Dynamic,3> t_stride(mat.rows(), 3);
+    qint32 n = mat.rows()/3;
+
+    XyzMap x(mat.data(), n, mat.cols(), t_stride);
+    XyzMap y(mat.data()+1, n, mat.cols(), t_stride);
+    XyzMap z(mat.data()+2, n, mat.cols(), t_stride);
+
+    return (x.array().square() + y.array().square() + z.array().square()).sqrt().matrix();
+}
+
+
+//*************************************************************************************************************
+
+MatrixXd MNEMath::combine_xyz_norm(const MatrixXd& K, const MatrixXd& data, const VectorXd& scale)
+{
+    if (K.rows() % 3 != 0 || K.cols() != data.rows())
+    {
+        printf("Kernel must have 3N rows and match the data rows");
+        return MatrixXd();
+    }
+
+    qint32 n = K.rows()/3;
+    qint32 nsamp = data.cols();
+    bool t_bScale = scale.size() == n;
+
+    MatrixXd p_matRes(n, nsamp);
+    MatrixXd t_matBlock;
+
+    for(qint32 t0 = 0; t0 < nsamp; t0 += XYZ_CHUNK_SAMPLES)
+    {
+        qint32 nt = std::min(XYZ_CHUNK_SAMPLES, nsamp - t0);
+        for(qint32 s0 = 0; s0 < n; s0 += XYZ_CHUNK_SOURCES)
+        {
+            qint32 ns = std::min(XYZ_CHUNK_SOURCES, n - s0);
+
+            t_matBlock.noalias() = K.middleRows(3*s0, 3*ns) * data.middleCols(t0, nt);
+
+            if(t_bScale)
+                p_matRes.block(s0, t0, ns, nt) = scale.segment(s0, ns).asDiagonal() * combine_xyz_norm(t_matBlock);
+            else
+                p_matRes.block(s0, t0, ns, nt) = combine_xyz_norm(t_matBlock);
+        }
+    }
+
+    return p_matRes;
+}
+
+
 //*************************************************************************************************************
 
 void MNEMath::get_whitener(MatrixXd &A, bool pca, QString ch_type, VectorXd &eig, MatrixXd &eigvec)
@@ -131,31 +198,44 @@ void MNEMath::get_whitener(MatrixXd &A, bool pca, QString ch_type, VectorXd &eig
 
 VectorXi MNEMath::intersect(const VectorXi &v1, const VectorXi &v2, VectorXi &idx_sel)
 {
-    std::vector<int> tmp;
-
-    std::vector< std::pair<int,int> > t_vecIntIdxValue;
-
-    //ToDo:Slow; map VectorXi to stl container
+    //
+    // Sorted merge: (value, index) pairs of v1 sorted by value (ties by index -> first occurrence) against the
+    // sorted unique values of v2
+    //
+    std::vector< std::pair<int,int> > t_vecValueIdx(v1.size());
     for(qint32 i = 0; i < v1.size(); ++i)
-        tmp.push_back(v1[i]);
+        t_vecValueIdx[i] = std::pair<int,int>(v1[i], i);
+    std::sort(t_vecValueIdx.begin(), t_vecValueIdx.end());
+
+    std::vector<int> t_vecV2(v2.data(), v2.data() + v2.size());
+    std::sort(t_vecV2.begin(), t_vecV2.end());
+    t_vecV2.erase(std::unique(t_vecV2.begin(), t_vecV2.end()), t_vecV2.end());
 
-    std::vector<int>::iterator it;
-    for(qint32 i = 0; i < v2.size(); ++i)
+    std::vector< std::pair<int,int> > t_vecIntIdxValue;
+    size_t i = 0, j = 0;
+    while(i < t_vecValueIdx.size() && j < t_vecV2.size())
     {
-        it = std::search(tmp.begin(), tmp.end(), &v2[i], &v2[i]+1);
-        if(it != tmp.end())
-            t_vecIntIdxValue.push_back(std::pair<int,int>(v2[i], it-tmp.begin()));//Index and int value are swapped // to sort using the idx
+        if(t_vecValueIdx[i].first < t_vecV2[j])
+            ++i;
+        else if(t_vecV2[j] < t_vecValueIdx[i].first)
+            ++j;
+        else
+        {
+            t_vecIntIdxValue.push_back(t_vecValueIdx[i]);
+            int value = t_vecV2[j];
+            while(i < t_vecValueIdx.size() && t_vecValueIdx[i].first == value)
+                ++i;
+            ++j;
+        }
     }
 
-    std::sort(t_vecIntIdxValue.begin(), t_vecIntIdxValue.end(), MNEMath::compareIdxValuePairSmallerThan<int>);
-
     VectorXi p_res(t_vecIntIdxValue.size());
     idx_sel = VectorXi(t_vecIntIdxValue.size());
 
-    for(quint32 i = 0; i < t_vecIntIdxValue.size(); ++i)
+    for(quint32 k = 0; k < t_vecIntIdxValue.size(); ++k)
     {
-        p_res[i] = t_vecIntIdxValue[i].first;
-        idx_sel[i] = t_vecIntIdxValue[i].second;
+        p_res[k] = t_vecIntIdxValue[k].first;
+        idx_sel[k] = t_vecIntIdxValue[k].second;
     }
 
     return p_res;
@@ -301,6 +381,71 @@ qint32 MNEMath::rank(const MatrixXd& A, double tol)
 }
 
 
+//*************************************************************************************************************
+
+void MNEMath::svd_gram(const MatrixXd& A, VectorXd& sing, MatrixXd& U, MatrixXd& V)
+{
+    bool t_bWide = A.rows() <= A.cols();
+    qint32 n = t_bWide ? A.rows() : A.cols();
+
+    //
+    // Gram matrix of the smaller dimension, only the lower triangle is computed
+    //
+    MatrixXd t_matGram = MatrixXd::Zero(n, n);
+    if(t_bWide)
+        t_matGram.selfadjointView<Lower>().rankUpdate(A);
+    else
+        t_matGram.selfadjointView<Lower>().rankUpdate(A.transpose());
+
+    SelfAdjointEigenSolver<MatrixXd> t_eigenSolver(t_matGram);
+
+    //
+    // Eigenvalues are ascending -> reverse to get descending singular values
+    //
+    MatrixXd t_matSmall(n, n);
+    sing.resize(n);
+    for(qint32 i = 0; i < n; ++i)
+    {
+        double t_dEig = t_eigenSolver.eigenvalues()[n-1-i];
+        sing[i] = t_dEig > 0 ? sqrt(t_dEig) : 0;
+        t_matSmall.col(i) = t_eigenSolver.eigenvectors().col(n-1-i);
+    }
+
+    //
+    // Vectors of the larger dimension: A'*U*diag(1/s) resp. A*V*diag(1/s)
+    //
+    MatrixXd t_matLarge;
+    if(t_bWide)
+        t_matLarge.noalias() = A.transpose() * t_matSmall;
+    else
+        t_matLarge.noalias() = A * t_matSmall;
+
+    // below sqrt(eps) the eigenvalues of the Gram matrix do not resolve the singular values anymore
+    double t_dTol = n > 0 ? sing[0] * sqrt(std::numeric_limits<double>::epsilon()) : 0;
+    for(qint32 i = 0; i < n; ++i)
+    {
+        if(sing[i] > t_dTol)
+            t_matLarge.col(i) /= sing[i];
+        else
+        {
+            sing[i] = 0;
+            t_matLarge.col(i).setZero();
+        }
+    }
+
+    if(t_bWide)
+    {
+        U = t_matSmall;
+        V = t_matLarge;
+    }
+    else
+    {
+        U = t_matLarge;
+        V = t_matSmall;
+    }
+}
+
+
 //*************************************************************************************************************
 
 MatrixXd MNEMath::rescale(const MatrixXd &data, const RowVectorXf &times, QPair<QVariant,QVariant> baseline, QString mode)
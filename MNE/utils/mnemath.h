@@ -126,6 +126,31 @@ public:
     */
     static VectorXd* combine_xyz(const VectorXd& vec);
 
+    //=========================================================================================================
+    /**
+    * Pools the three Cartesian components of every column of a 3N x T block in one pass, e.g. of a free
+    * orientation source estimate. Equivalent to combine_xyz followed by a square root for every column.
+    *
+    * @param[in] mat    Input block with the rows [ x1 y1 z1 ... x_n y_n z_n ]
+    *
+    * @return Output block (N x T) with the rows [ sqrt(x1^2+y1^2+z1^2) ... sqrt(x_n^2+y_n^2+z_n^2) ]
+    */
+    static MatrixXd combine_xyz_norm(const MatrixXd& mat);
+
+    //=========================================================================================================
+    /**
+    * Fused version of scale.asDiagonal() * combine_xyz_norm(K * data). The product is computed block by block
+    * of sources and samples and pooled right away, the full 3N x T product is never held in memory.
+    *
+    * @param[in] K      Free orientation kernel (3N x channels), e.g. an imaging kernel.
+    * @param[in] data   Data (channels x T).
+    * @param[in] scale  Factor per source applied after pooling, e.g. the noise normalization. Ignored if its
+    *                   size does not match N.
+    *
+    * @return Pooled and scaled result (N x T)
+    */
+    static MatrixXd combine_xyz_norm(const MatrixXd& K, const MatrixXd& data, const VectorXd& scale = VectorXd());
+
 //    //=========================================================================================================
 //    /**
 //    * ### MNE toolbox root function ###: Implementation of the mne_block_diag function - decoding part
@@ -198,6 +223,21 @@ public:
     */
     static qint32 rank(const MatrixXd& A, double tol = 1e-8);
 
+    //=========================================================================================================
+    /**
+    * Computes the thin singular value decomposition A = U * diag(sing) * V' by an eigendecomposition of the
+    * smaller Gram matrix (A*A' for wide, A'*A for tall matrices). For strongly rectangular matrices, e.g.
+    * lead fields, this is orders of magnitude faster than JacobiSVD. Singular values below
+    * sqrt(machine epsilon) relative to the largest one are not resolved and are returned as zero, together
+    * with zero singular vectors of the larger dimension.
+    *
+    * @param[in] A      Matrix to decompose
+    * @param[out] sing  Singular values, sorted in descending order
+    * @param[out] U     Left singular vectors (rows(A) x min(rows(A),cols(A)))
+    * @param[out] V     Right singular vectors (cols(A) x min(rows(A),cols(A)))
+    */
+    static void svd_gram(const MatrixXd& A, VectorXd& sing, MatrixXd& U, MatrixXd& V);
+
     //=========================================================================================================
     /**
     * ToDo: Maybe new processing class
@@ -0,0 +1,291 @@
+//=============================================================================================================
+/**
+* @file     shmringbuffer.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Contains the implementation of the ShmRingBuffer class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "shmringbuffer.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <string.h>
+#include <stdio.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QAtomicInt>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace UTILSLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define SHM_RING_MAGIC      0x4d4e4552      /**< Marks a valid ring segment */
+#define SHM_RING_ALIGN      16              /**< Alignment of the block headers and data */
+#define SHM_RING_WRITING    -1              /**< Sequence number of a block which is being written */
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE LOCAL TYPES
+//=============================================================================================================
+
+namespace
+{
+
+/**
+* Header at the start of the segment, followed by the blocks
+*/
+struct RingHeader
+{
+    qint32 magic;
+    qint32 numBlocks;
+    qint32 blockSize;
+    qint32 blockStride;
+};
+
+/**
+* Header of each block, followed by the block data
+*/
+struct BlockHeader
+{
+    QAtomicInt seq;     /**< Sequence number of the block data, SHM_RING_WRITING while it is written */
+    qint32 size;
+    qint32 reserved[2];
+};
+
+inline qint32 align(qint32 p_iSize)
+{
+    return (p_iSize + SHM_RING_ALIGN - 1) / SHM_RING_ALIGN * SHM_RING_ALIGN;
+}
+
+inline BlockHeader* blockAt(void* p_pSegment, qint32 p_iSeq)
+{
+    RingHeader* t_pHeader = static_cast<RingHeader*>(p_pSegment);
+    char* t_pBlocks = static_cast<char*>(p_pSegment) + align(sizeof(RingHeader));
+    return reinterpret_cast<BlockHeader*>(t_pBlocks + (qint64)(p_iSeq % t_pHeader->numBlocks) * t_pHeader->blockStride);
+}
+
+} // NAMESPACE
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+ShmRingBuffer::ShmRingBuffer()
+: m_iNextSeq(0)
+{
+}
+
+
+//*************************************************************************************************************
+
+ShmRingBuffer::~ShmRingBuffer()
+{
+    detach();
+}
+
+
+//*************************************************************************************************************
+
+bool ShmRingBuffer::create(const QString &p_sKey, qint32 p_iNumBlocks, qint32 p_iBlockSize)
+{
+    detach();
+
+    if(p_iNumBlocks < 1 || p_iBlockSize < 1)
+    {
+        printf("ShmRingBuffer: invalid ring size.\n");
+        return false;
+    }
+
+    qint32 t_iBlockStride = align(sizeof(BlockHeader)) + align(p_iBlockSize);
+    qint64 t_iSize = align(sizeof(RingHeader)) + (qint64)p_iNumBlocks * t_iBlockStride;
+
+    m_qSharedMemory.setKey(p_sKey);
+    if(!m_qSharedMemory.create(t_iSize))
+    {
+        //
+        // A crashed process may have left the segment behind: release it and retry
+        //
+        if(m_qSharedMemory.error() == QSharedMemory::AlreadyExists && m_qSharedMemory.attach())
+        {
+            m_qSharedMemory.detach();
+            m_qSharedMemory.create(t_iSize);
+        }
+        if(!m_qSharedMemory.isAttached())
+        {
+            printf("ShmRingBuffer: could not create '%s', %s\n", p_sKey.toUtf8().constData(), m_qSharedMemory.errorString().toUtf8().constData());
+            return false;
+        }
+    }
+
+    memset(m_qSharedMemory.data(), 0, m_qSharedMemory.size());
+
+    RingHeader* t_pHeader = static_cast<RingHeader*>(m_qSharedMemory.data());
+    t_pHeader->numBlocks = p_iNumBlocks;
+    t_pHeader->blockSize = p_iBlockSize;
+    t_pHeader->blockStride = t_iBlockStride;
+
+    for(qint32 i = 0; i < p_iNumBlocks; ++i)
+        blockAt(m_qSharedMemory.data(), i)->seq.storeRelease(SHM_RING_WRITING);
+
+    //
+    // Readers check the magic number last
+    //
+    reinterpret_cast<QAtomicInt*>(&t_pHeader->magic)->storeRelease(SHM_RING_MAGIC);
+
+    m_iNextSeq = 0;
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool ShmRingBuffer::attach(const QString &p_sKey)
+{
+    detach();
+
+    m_qSharedMemory.setKey(p_sKey);
+    if(!m_qSharedMemory.attach())
+    {
+        printf("ShmRingBuffer: could not attach to '%s', %s\n", p_sKey.toUtf8().constData(), m_qSharedMemory.errorString().toUtf8().constData());
+        return false;
+    }
+
+    RingHeader* t_pHeader = static_cast<RingHeader*>(m_qSharedMemory.data());
+    if(m_qSharedMemory.size() < align(sizeof(RingHeader))
+            || reinterpret_cast<QAtomicInt*>(&t_pHeader->magic)->loadAcquire() != SHM_RING_MAGIC
+            || t_pHeader->numBlocks < 1
+            || align(sizeof(RingHeader)) + (qint64)t_pHeader->numBlocks * t_pHeader->blockStride > m_qSharedMemory.size())
+    {
+        printf("ShmRingBuffer: '%s' is not a valid ring.\n", p_sKey.toUtf8().constData());
+        m_qSharedMemory.detach();
+        return false;
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+void ShmRingBuffer::detach()
+{
+    if(m_qSharedMemory.isAttached())
+        m_qSharedMemory.detach();
+}
+
+
+//*************************************************************************************************************
+
+qint32 ShmRingBuffer::blockSize() const
+{
+    if(!m_qSharedMemory.isAttached())
+        return 0;
+
+    return static_cast<const RingHeader*>(m_qSharedMemory.constData())->blockSize;
+}
+
+
+//*************************************************************************************************************
+
+qint32 ShmRingBuffer::write(const char *p_pData, qint32 p_iSize)
+{
+    if(!m_qSharedMemory.isAttached() || p_iSize < 0 || p_iSize > blockSize())
+        return -1;
+
+    qint32 t_iSeq = m_iNextSeq;
+    m_iNextSeq = (m_iNextSeq + 1) & 0x7fffffff;
+
+    //
+    // Sequence lock: mark the block before touching the data, publish the new sequence number after it
+    //
+    BlockHeader* t_pBlock = blockAt(m_qSharedMemory.data(), t_iSeq);
+    t_pBlock->seq.fetchAndStoreOrdered(SHM_RING_WRITING);
+    t_pBlock->size = p_iSize;
+    memcpy(reinterpret_cast<char*>(t_pBlock) + align(sizeof(BlockHeader)), p_pData, p_iSize);
+    t_pBlock->seq.storeRelease(t_iSeq);
+
+    return t_iSeq;
+}
+
+
+//*************************************************************************************************************
+
+qint32 ShmRingBuffer::read(qint32 p_iSeq, char *p_pData, qint32 p_iMaxSize) const
+{
+    if(!m_qSharedMemory.isAttached() || p_iSeq < 0)
+        return -1;
+
+    BlockHeader* t_pBlock = blockAt(const_cast<void*>(m_qSharedMemory.constData()), p_iSeq);
+    if(t_pBlock->seq.loadAcquire() != p_iSeq)
+        return -1;
+
+    qint32 t_iSize = t_pBlock->size;
+    if(t_iSize < 0 || t_iSize > p_iMaxSize || t_iSize > blockSize())
+        return -1;
+
+    memcpy(p_pData, reinterpret_cast<const char*>(t_pBlock) + align(sizeof(BlockHeader)), t_iSize);
+
+    //
+    // The copy is valid only if the writer did not start on the block meanwhile
+    //
+    if(t_pBlock->seq.fetchAndAddOrdered(0) != p_iSeq)
+        return -1;
+
+    return t_iSize;
+}
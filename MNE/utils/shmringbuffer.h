@@ -0,0 +1,193 @@
+//=============================================================================================================
+/**
+* @file     shmringbuffer.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Contains the declaration of the ShmRingBuffer class.
+*
+*/
+
+#ifndef SHMRINGBUFFER_H
+#define SHMRINGBUFFER_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "utils_global.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QSharedPointer>
+#include <QSharedMemory>
+#include <QString>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE UTILSLIB
+//=============================================================================================================
+
+namespace UTILSLIB
+{
+
+//=============================================================================================================
+/**
+* A ring of fixed size blocks in shared memory with a single writer and any number of readers in other
+* processes. Every written block gets a sequence number, a reader copies the block of a sequence number it was
+* notified about. Blocks are guarded by a per block sequence lock, neither the writer nor the readers ever wait:
+* a reader which is lapped by the writer gets an error instead of torn data.
+*
+* @brief Shared memory ring buffer of fixed size blocks
+*/
+class UTILSSHARED_EXPORT ShmRingBuffer
+{
+public:
+    typedef QSharedPointer<ShmRingBuffer> SPtr;            /**< Shared pointer type for ShmRingBuffer. */
+    typedef QSharedPointer<const ShmRingBuffer> ConstSPtr; /**< Const shared pointer type for ShmRingBuffer. */
+
+    //=========================================================================================================
+    /**
+    * Constructs a detached ShmRingBuffer.
+    */
+    ShmRingBuffer();
+
+    //=========================================================================================================
+    /**
+    * Detaches from the shared memory and destroys the ShmRingBuffer.
+    */
+    ~ShmRingBuffer();
+
+    //=========================================================================================================
+    /**
+    * Creates the shared memory segment of the ring and attaches to it as writer.
+    *
+    * @param[in] p_sKey         Key of the shared memory segment.
+    * @param[in] p_iNumBlocks   Number of blocks in the ring.
+    * @param[in] p_iBlockSize   Capacity of a block in bytes.
+    *
+    * @return true if the segment was created, false otherwise
+    */
+    bool create(const QString &p_sKey, qint32 p_iNumBlocks, qint32 p_iBlockSize);
+
+    //=========================================================================================================
+    /**
+    * Attaches to the shared memory segment of a ring created by another process as reader.
+    *
+    * @param[in] p_sKey     Key of the shared memory segment.
+    *
+    * @return true if the segment was attached and is a valid ring, false otherwise
+    */
+    bool attach(const QString &p_sKey);
+
+    //=========================================================================================================
+    /**
+    * Detaches from the shared memory segment. The segment is released when the last process detached.
+    */
+    void detach();
+
+    //=========================================================================================================
+    /**
+    * Returns whether the ring is attached to a shared memory segment.
+    *
+    * @return true if attached, false otherwise
+    */
+    inline bool isAttached() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the key of the shared memory segment.
+    *
+    * @return the key
+    */
+    inline QString key() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the capacity of a block in bytes.
+    *
+    * @return the block capacity, 0 if detached
+    */
+    qint32 blockSize() const;
+
+    //=========================================================================================================
+    /**
+    * Copies data into the next block of the ring. Only the creator of the ring may write.
+    *
+    * @param[in] p_pData    The data to write.
+    * @param[in] p_iSize    Number of bytes, at most the block size.
+    *
+    * @return the sequence number of the written block, -1 if the data could not be written
+    */
+    qint32 write(const char *p_pData, qint32 p_iSize);
+
+    //=========================================================================================================
+    /**
+    * Copies a block out of the ring.
+    *
+    * @param[in] p_iSeq     Sequence number of the block.
+    * @param[out] p_pData   Destination of the block data.
+    * @param[in] p_iMaxSize Size of the destination in bytes.
+    *
+    * @return the number of copied bytes, -1 if the block was overwritten meanwhile or does not fit
+    */
+    qint32 read(qint32 p_iSeq, char *p_pData, qint32 p_iMaxSize) const;
+
+private:
+    QSharedMemory   m_qSharedMemory;    /**< The shared memory segment */
+    qint32          m_iNextSeq;         /**< Sequence number of the next written block, writer only */
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INLINE DEFINITIONS
+//=============================================================================================================
+
+inline bool ShmRingBuffer::isAttached() const
+{
+    return m_qSharedMemory.isAttached();
+}
+
+
+//*************************************************************************************************************
+
+inline QString ShmRingBuffer::key() const
+{
+    return m_qSharedMemory.key();
+}
+
+} // NAMESPACE
+
+#endif // SHMRINGBUFFER_H
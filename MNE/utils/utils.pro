@@ -38,6 +38,7 @@ include(../../mne-cpp.pri)
 TEMPLATE = lib
 
 QT       -= gui
+QT       += concurrent
 
 DEFINES += UTILS_LIBRARY
 
@@ -63,12 +64,14 @@ win32 {
 
 SOURCES += kmeans.cpp \
     mnemath.cpp \
-    ioutils.cpp
+    ioutils.cpp \
+    shmringbuffer.cpp
 
 HEADERS +=  kmeans.h\
             utils_global.h \
     mnemath.h \
-    ioutils.h
+    ioutils.h \
+    shmringbuffer.h
 
 INCLUDEPATH += $${EIGEN_INCLUDE_DIR}
 INCLUDEPATH += $${MNE_INCLUDE_DIR}
@@ -101,8 +101,13 @@ void FiffProducer::run()
     // reopen file in this thread
     QFile t_File(m_pFiffSimulator->m_RawInfo.info.filename);
     FiffStream::SPtr p_pStream(new FiffStream(&t_File));
+    m_pFiffSimulator->m_RawInfo.set_prefetch(0);
     m_pFiffSimulator->m_RawInfo.file = p_pStream;
 
+    // decode straight from the mapped file and read ahead while the simulator is sleeping
+    m_pFiffSimulator->m_RawInfo.file->map_file();
+    m_pFiffSimulator->m_RawInfo.set_prefetch(QThread::idealThreadCount());
+
     //
     //   Set up the reading parameters
     //
@@ -123,7 +128,7 @@ void FiffProducer::run()
     //
 
     fiff_int_t first, last;
-    MatrixXd data;
+    MatrixXf data;
     MatrixXd times;
 
     first = from;
@@ -159,7 +164,7 @@ void FiffProducer::run()
             printf("error during read_raw_segment\n");
         }
 
-        MatrixXf tmp = data.cast<float>();//(inv_calsMat*data).cast<float>();
+        MatrixXf tmp = data;
 
         if(t_bRestart)
         {
@@ -176,12 +181,10 @@ void FiffProducer::run()
                 printf("error during read_raw_segment\n");
             }
 
-            MatrixXf tmp2 = data.cast<float>();//(inv_calsMat*data).cast<float>();
-
-            MatrixXf tmp3(tmp.rows(), tmp.cols()+tmp2.cols());
+            MatrixXf tmp3(tmp.rows(), tmp.cols()+data.cols());
 
             tmp3.block(0,0,tmp.rows(),tmp.cols()) = tmp;
-            tmp3.block(0,tmp.cols(),tmp.rows(),tmp2.cols()) = tmp2;
+            tmp3.block(0,tmp.cols(),tmp.rows(),data.cols()) = data;
 
             tmp = tmp3;
 
@@ -196,7 +199,10 @@ void FiffProducer::run()
         m_pFiffSimulator->m_pRawMatrixBuffer->push(&tmp);
     }
 
-    // close datastream in this thread
-//    delete m_pFiffSimulator->m_RawInfo.file;
-//    m_pFiffSimulator->m_RawInfo.file = NULL;
+    // pending prefetches must not outlive the file of this thread
+    m_pFiffSimulator->m_RawInfo.set_prefetch(0);
+
+    // close datastream in this thread, the mapping and the stream refer to t_File which goes out of scope
+    m_pFiffSimulator->m_RawInfo.file->unmap_file();
+    m_pFiffSimulator->m_RawInfo.file.clear();
 }
@@ -44,7 +44,7 @@
 #include "mne_rt_server.h"
 
 #include "fiffstreamserver.h"
-#include "fiffstreamthread.h"
+#include "fiffstreamclient.h"
 #include "mne_rt_server.h"
 #include "connectormanager.h"
 
@@ -0,0 +1,488 @@
+//=============================================================================================================
+/**
+* @file     fiffstreamclient.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     July, 2012
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief     implementation of the FiffStreamClient Class.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "fiffstreamclient.h"
+#include "fiffstreamserver.h"
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Fiff INCLUDES
+//=============================================================================================================
+
+#include <utils/ioutils.h>
+#include <fiff/fiff_constants.h>
+#include <fiff/fiff_tag.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtNetwork>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace UTILSLIB;
+using namespace RTSERVER;
+using namespace FIFFLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define WRITE_WATERMARK         1048576     /**< Bytes in the socket write buffer up to which queued tags are handed over */
+#define MAX_DOWNSAMPLING        64          /**< Maximal raw buffer downsampling of a slow client */
+#define MAX_COMMAND_TAG_SIZE    1048576     /**< Maximal size of a tag received from a client, clients only send commands */
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE MEMBER METHODS
+//=============================================================================================================
+
+FiffStreamClient::FiffStreamClient(qint32 id, qintptr socketDescriptor, FiffStreamServer *p_pServer)
+: QObject()
+, m_iDataClientId(id)
+, m_sDataClientAlias(QString(""))
+, m_iSocketDescriptor(socketDescriptor)
+, m_pTcpSocket(NULL)
+, m_tagDecoder(8, MAX_COMMAND_TAG_SIZE)
+, m_iNumQueuedBuffers(0)
+, m_iMaxQueuedBuffers(p_pServer->getMaxQueuedBuffers())
+, m_slowClientPolicy(p_pServer->getSlowClientPolicy())
+, m_iDownsampling(1)
+, m_iBufferCount(0)
+, m_bIsSendingRawBuffer(0)
+, m_sShmKey(p_pServer->getShmKey())
+, m_bUseSharedMemory(0)
+, m_iStreamFormat(FIFFV_MNE_RT_FORMAT_FIFF)
+{
+    //
+    // The client is moved to a worker thread, the server signals are delivered queued to its event loop
+    //
+    connect(p_pServer, &FiffStreamServer::remitMeasInfo,
+            this, &FiffStreamClient::sendMeasurementInfo);
+    connect(p_pServer, &FiffStreamServer::remitRawBuffer,
+            this, &FiffStreamClient::sendRawBuffer);
+    connect(p_pServer, &FiffStreamServer::startMeasFiffStreamClient,
+            this, &FiffStreamClient::startMeas);
+    connect(p_pServer, &FiffStreamServer::stopMeasFiffStreamClient,
+            this, &FiffStreamClient::stopMeas);
+    connect(p_pServer, &FiffStreamServer::setStreamFormatFiffStreamClient,
+            this, &FiffStreamClient::setStreamFormat);
+    connect(p_pServer, &FiffStreamServer::closeFiffStreamServer,
+            this, &FiffStreamClient::close);
+}
+
+
+//*************************************************************************************************************
+
+FiffStreamClient::~FiffStreamClient()
+{
+    if(m_pTcpSocket)
+    {
+        m_pTcpSocket->disconnect(this);
+        m_pTcpSocket->abort();
+        delete m_pTcpSocket;
+    }
+}
+
+
+//*************************************************************************************************************
+
+QString FiffStreamClient::getAlias()
+{
+    QMutexLocker locker(&m_qMutex);
+    return m_sDataClientAlias;
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::setBufferPolicy(qint32 p_iMaxQueuedBuffers, SlowClientPolicy p_policy)
+{
+    QMutexLocker locker(&m_qMutex);
+    m_iMaxQueuedBuffers = p_iMaxQueuedBuffers > 0 ? p_iMaxQueuedBuffers : 1;
+    m_slowClientPolicy = p_policy;
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::start()
+{
+    m_pTcpSocket = new QTcpSocket;
+    if (!m_pTcpSocket->setSocketDescriptor(m_iSocketDescriptor)) {
+        emit error(m_pTcpSocket->error());
+        emit disconnected(m_iDataClientId);
+        return;
+    }
+
+    printf("FiffStreamClient (assigned ID %d) accepted from\n\tIP:\t%s\n\tPort:\t%d\n\n",
+           m_iDataClientId,
+           QHostAddress(m_pTcpSocket->peerAddress()).toString().toUtf8().constData(),
+           m_pTcpSocket->peerPort());
+
+    connect(m_pTcpSocket, &QTcpSocket::readyRead, this, &FiffStreamClient::readTags);
+    connect(m_pTcpSocket, &QTcpSocket::bytesWritten, this, &FiffStreamClient::writeQueued);
+    connect(m_pTcpSocket, &QTcpSocket::disconnected, this, &FiffStreamClient::socketDisconnected);
+
+    readTags();
+    writeQueued();
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::startMeas(qint32 ID)
+{
+    if(ID == m_iDataClientId)
+    {
+        qDebug() << "Activate raw buffer sending.";
+
+        QByteArray t_blobTag;
+        FiffStream t_FiffStreamOut(&t_blobTag, QIODevice::WriteOnly);
+        t_FiffStreamOut.start_block(FIFFB_RAW_DATA);
+        enqueue(t_blobTag, false);
+        m_iDownsampling = 1;
+        m_iBufferCount = 0;
+        m_bIsSendingRawBuffer.storeRelease(1);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::stopMeas(qint32 ID)
+{
+    if(ID == m_iDataClientId || ID == -1)
+    {
+        qDebug() << "stop raw buffer sending.";
+
+        m_bIsSendingRawBuffer.storeRelease(0);
+        QByteArray t_blobTag;
+        FiffStream t_FiffStreamOut(&t_blobTag, QIODevice::WriteOnly);
+        t_FiffStreamOut.end_block(FIFFB_RAW_DATA);
+        enqueue(t_blobTag, false);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::parseCommand(FiffTag::SPtr p_pTag)
+{
+    if(p_pTag->size() >= 4)
+    {
+        qint32* t_pInt = (qint32*)p_pTag->data();
+        IOUtils::swap_intp(t_pInt);
+        qint32 t_iCmd = t_pInt[0];
+
+        if(t_iCmd == MNE_RT_SET_CLIENT_ALIAS)
+        {
+            //
+            // Set Client Alias
+            //
+            m_qMutex.lock();
+            m_sDataClientAlias = QString(p_pTag->mid(4, p_pTag->size()-4));
+            m_qMutex.unlock();
+            printf("FiffStreamClient (ID %d): new alias = '%s'\r\n\n", m_iDataClientId, getAlias().toUtf8().constData());
+        }
+        else if(t_iCmd == MNE_RT_GET_CLIENT_ID)
+        {
+            //
+            // Send Client ID
+            //
+            printf("FiffStreamClient (ID %d): send client ID %d\r\n\n", m_iDataClientId, m_iDataClientId);
+            writeClientId();
+        }
+        else if(t_iCmd == MNE_RT_REQUEST_SHM)
+        {
+            //
+            // Shared memory transport, only for a client on the same host
+            //
+            bool t_bLocal = m_pTcpSocket->peerAddress() == m_pTcpSocket->localAddress() && !m_sShmKey.isEmpty();
+            m_bUseSharedMemory.storeRelease(t_bLocal ? 1 : 0);
+            printf("FiffStreamClient (ID %d): shared memory transport %s\r\n\n", m_iDataClientId, t_bLocal ? "accepted" : "refused, client is not local");
+            writeShmKey();
+        }
+        else if(t_iCmd == MNE_RT_SET_STREAM_FORMAT)
+        {
+            //
+            // Stream format of the raw buffers
+            //
+            bool t_bIsInt;
+            qint32 t_iFormat = QString(p_pTag->mid(4, p_pTag->size()-4)).toInt(&t_bIsInt);
+            if(t_bIsInt)
+                setStreamFormat(m_iDataClientId, t_iFormat);
+            else
+                printf("FiffStreamClient (ID %d): invalid stream format\r\n\n", m_iDataClientId);
+        }
+        else
+        {
+            printf("FiffStreamClient (ID %d): unknown command\r\n\n", m_iDataClientId);
+        }
+    }
+    else
+    {
+        printf("FiffStreamClient (ID %d): unknown command\r\n\n", m_iDataClientId);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::setStreamFormat(qint32 ID, fiff_int_t p_iFormat)
+{
+    if(ID == m_iDataClientId)
+    {
+        if(p_iFormat != FIFFV_MNE_RT_FORMAT_FIFF && p_iFormat != FIFFV_MNE_RT_FORMAT_NATIVE
+                && p_iFormat != FIFFV_MNE_RT_FORMAT_INT16 && p_iFormat != FIFFV_MNE_RT_FORMAT_COMPRESSED)
+        {
+            printf("FiffStreamClient (ID %d): unknown stream format %d\r\n\n", m_iDataClientId, p_iFormat);
+            return;
+        }
+
+        m_iStreamFormat.storeRelease(p_iFormat);
+        printf("FiffStreamClient (ID %d): stream format %d\r\n\n", m_iDataClientId, p_iFormat);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::sendRawBuffer(fiff_int_t p_iTransportFormat, QByteArray p_blobRawBufferTag)
+{
+    //
+    // The tags are encoded once per transport format by the server, only a reference is queued
+    //
+    if(isSendingRawBuffer() && p_iTransportFormat == getTransportFormat())
+        enqueue(p_blobRawBufferTag, true);
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::sendMeasurementInfo(qint32 ID, FiffInfo p_fiffInfo)
+{
+    if(ID == m_iDataClientId)
+    {
+        QByteArray t_blobTags;
+        FiffStream t_FiffStreamOut(&t_blobTags, QIODevice::WriteOnly);
+
+        p_fiffInfo.writeToStream(&t_FiffStreamOut);
+
+        enqueue(t_blobTags, false);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::writeClientId()
+{
+    QByteArray t_blobTag;
+    FiffStream t_FiffStreamOut(&t_blobTag, QIODevice::WriteOnly);
+
+    t_FiffStreamOut.write_int(FIFF_MNE_RT_CLIENT_ID, &m_iDataClientId);
+
+    enqueue(t_blobTag, false);
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::writeShmKey()
+{
+    QByteArray t_blobTag;
+    FiffStream t_FiffStreamOut(&t_blobTag, QIODevice::WriteOnly);
+
+    t_FiffStreamOut.write_string(FIFF_MNE_RT_SHM_KEY, isUsingSharedMemory() ? m_sShmKey : QString(""));
+
+    enqueue(t_blobTag, false);
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::close()
+{
+    if(m_pTcpSocket)
+        m_pTcpSocket->disconnectFromHost();
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::readTags()
+{
+    if(!m_pTcpSocket)
+        return;
+
+    if(m_tagDecoder.readFrom(m_pTcpSocket) < 0)
+    {
+        printf("FiffStreamClient (ID %d): corrupt tag stream - disconnecting\r\n\n", m_iDataClientId);
+        m_pTcpSocket->abort();
+        return;
+    }
+
+    //
+    // Parse the tags
+    //
+    FiffTag::SPtr t_pTag;
+    while((t_pTag = m_tagDecoder.takeTag()))
+    {
+        if(t_pTag->kind == FIFF_MNE_RT_COMMAND)
+            parseCommand(t_pTag);
+
+        m_tagDecoder.recycle(t_pTag);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::writeQueued()
+{
+    if(!m_pTcpSocket || m_pTcpSocket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    //
+    // Non-blocking: the socket buffers what is written and flushes it from the event loop
+    //
+    while(!m_qQueueSend.isEmpty() && m_pTcpSocket->bytesToWrite() < WRITE_WATERMARK)
+    {
+        QPair<QByteArray, bool> t_pairTags = m_qQueueSend.dequeue();
+        if(t_pairTags.second)
+            --m_iNumQueuedBuffers;
+
+        if(m_pTcpSocket->write(t_pairTags.first) != t_pairTags.first.size())
+        {
+            printf("FiffStreamClient (ID %d): write failed, %s\r\n\n", m_iDataClientId, m_pTcpSocket->errorString().toUtf8().constData());
+            m_pTcpSocket->abort();
+            return;
+        }
+    }
+
+    //
+    // Caught up again: relax the downsampling
+    //
+    if(m_qQueueSend.isEmpty() && m_iDownsampling > 1)
+    {
+        m_iDownsampling /= 2;
+        printf("FiffStreamClient (ID %d): sending every %d. raw buffer\r\n\n", m_iDataClientId, m_iDownsampling);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::enqueue(const QByteArray &p_blobTags, bool p_bRawBuffer)
+{
+    if(p_bRawBuffer)
+    {
+        m_qMutex.lock();
+        qint32 t_iMaxQueuedBuffers = m_iMaxQueuedBuffers;
+        SlowClientPolicy t_policy = m_slowClientPolicy;
+        m_qMutex.unlock();
+
+        if(t_policy == Downsample && (m_iBufferCount++ % m_iDownsampling) != 0)
+            return;
+
+        if(m_iNumQueuedBuffers >= t_iMaxQueuedBuffers)
+        {
+            switch(t_policy)
+            {
+            case Disconnect:
+                printf("FiffStreamClient (ID %d): too slow, %d raw buffers queued - disconnecting\r\n\n", m_iDataClientId, m_iNumQueuedBuffers);
+                if(m_pTcpSocket)
+                    m_pTcpSocket->abort();
+                return;
+            case Downsample:
+                if(m_iDownsampling < MAX_DOWNSAMPLING)
+                {
+                    m_iDownsampling *= 2;
+                    printf("FiffStreamClient (ID %d): too slow, sending every %d. raw buffer\r\n\n", m_iDataClientId, m_iDownsampling);
+                }
+                //fall through: make room for the current buffer
+            case DropOldest:
+            default:
+                for(qint32 i = 0; i < m_qQueueSend.size(); ++i)
+                {
+                    if(m_qQueueSend[i].second)
+                    {
+                        m_qQueueSend.removeAt(i);
+                        --m_iNumQueuedBuffers;
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+
+        ++m_iNumQueuedBuffers;
+    }
+
+    m_qQueueSend.enqueue(QPair<QByteArray, bool>(p_blobTags, p_bRawBuffer));
+
+    writeQueued();
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamClient::socketDisconnected()
+{
+    printf("FiffStreamClient (ID %d) disconnected\r\n\n", m_iDataClientId);
+
+    m_bIsSendingRawBuffer.storeRelease(0);
+    m_qQueueSend.clear();
+    m_iNumQueuedBuffers = 0;
+
+    emit disconnected(m_iDataClientId);
+}
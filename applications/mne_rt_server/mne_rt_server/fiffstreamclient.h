@@ -0,0 +1,268 @@
+//=============================================================================================================
+/**
+* @file     fiffstreamclient.h
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     July, 2012
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief     declaration of the FiffStreamClient Class.
+*
+*/
+
+#ifndef FIFFSTREAMCLIENT_H
+#define FIFFSTREAMCLIENT_H
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include "mne_rt_commands.h"
+
+#include <fiff/fiff_stream.h>
+#include <fiff/fiff_info.h>
+#include <fiff/fiff_tag.h>
+#include <fiff/fiff_tag_decoder.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QQueue>
+#include <QPair>
+#include <QByteArray>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE NAMESPACE RTSERVER
+//=============================================================================================================
+
+namespace RTSERVER
+{
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// FORWARD DECLARATIONS
+//=============================================================================================================
+
+class FiffStreamServer;
+
+
+//=============================================================================================================
+/**
+* DECLARE CLASS FiffStreamClient
+*
+* A data client of the fiff stream server. The client lives in one of the worker threads of the server and is
+* driven by the socket signals of that thread's event loop, writes never block. Raw buffers are queued up to a
+* bound, a slow client is handled according to its slow client policy without affecting the other clients.
+*
+* @brief The FiffStreamClient class serves one data client
+*/
+class FiffStreamClient : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+    * What to do with a client whose raw buffer queue is full.
+    */
+    enum SlowClientPolicy
+    {
+        DropOldest,     /**< Drop the oldest queued raw buffer */
+        Disconnect,     /**< Disconnect the client */
+        Downsample      /**< Send only every n-th raw buffer, n is doubled each time the queue is full and halved when it is empty */
+    };
+
+    //=========================================================================================================
+    /**
+    * Constructs the FiffStreamClient and connects it to the server signals. The socket is created by start in
+    * the thread the client was moved to.
+    *
+    * @param[in] id                 Client ID.
+    * @param[in] socketDescriptor   Descriptor of the accepted connection.
+    * @param[in] p_pServer          The fiff stream server.
+    */
+    FiffStreamClient(qint32 id, qintptr socketDescriptor, FiffStreamServer *p_pServer);
+
+    //=========================================================================================================
+    /**
+    * Destroys the FiffStreamClient.
+    */
+    ~FiffStreamClient();
+
+    inline qint32 getID();
+
+    QString getAlias();
+
+    inline bool isSendingRawBuffer();
+
+    inline bool isUsingSharedMemory();
+
+    //=========================================================================================================
+    /**
+    * Switches the client from the shared memory transport back to raw buffer tags, e.g. when the server
+    * could not create the ring. Can be called from the server thread.
+    */
+    inline void disableSharedMemory();
+
+    //=========================================================================================================
+    /**
+    * Returns how raw buffers are sent to the client: its stream format, or MNE_RT_SHM_TRANSPORT if they are
+    * passed through shared memory.
+    *
+    * @return the transport format, FIFFV_MNE_RT_FORMAT_* or MNE_RT_SHM_TRANSPORT
+    */
+    inline fiff_int_t getTransportFormat();
+
+    //=========================================================================================================
+    /**
+    * Sets the bound of the raw buffer queue and the slow client policy.
+    *
+    * @param[in] p_iMaxQueuedBuffers    Maximal number of queued raw buffers.
+    * @param[in] p_policy               What to do when the queue is full.
+    */
+    void setBufferPolicy(qint32 p_iMaxQueuedBuffers, SlowClientPolicy p_policy);
+
+public slots:
+    //=========================================================================================================
+    /**
+    * Creates the socket for the accepted connection, has to run in the thread of the client.
+    */
+    void start();
+
+signals:
+    void error(QTcpSocket::SocketError socketError);
+    void disconnected(qint32 id);
+
+private:
+    void parseCommand(QSharedPointer<FiffTag> p_pTag);
+    void writeClientId();
+
+    void startMeas(qint32 ID);
+    void stopMeas(qint32 ID);
+    void setStreamFormat(qint32 ID, fiff_int_t p_iFormat);
+    void sendMeasurementInfo(qint32 ID, FiffInfo p_fiffInfo);
+    void sendRawBuffer(fiff_int_t p_iTransportFormat, QByteArray p_blobRawBufferTag);
+    void writeShmKey();
+    void close();
+
+    //=========================================================================================================
+    /**
+    * Reads all received bytes and parses the complete tags, a partially received tag is completed by a later call.
+    */
+    void readTags();
+
+    //=========================================================================================================
+    /**
+    * Hands queued tags to the socket as long as its write buffer is below the watermark.
+    */
+    void writeQueued();
+
+    //=========================================================================================================
+    /**
+    * Appends encoded tags to the send queue and applies the slow client policy to raw buffers.
+    *
+    * @param[in] p_blobTags     The encoded tags.
+    * @param[in] p_bRawBuffer   Whether the tags are a raw buffer, which may be dropped.
+    */
+    void enqueue(const QByteArray &p_blobTags, bool p_bRawBuffer);
+
+    void socketDisconnected();
+
+    qint32 m_iDataClientId;
+    QString m_sDataClientAlias;
+
+    qintptr m_iSocketDescriptor;
+    QTcpSocket* m_pTcpSocket;
+    FiffTagDecoder m_tagDecoder;                        /**< Decodes the received bytes into tags */
+
+    QMutex m_qMutex;                                    /**< Guards the alias and the buffer policy */
+    QQueue<QPair<QByteArray, bool> > m_qQueueSend;      /**< Encoded tags and whether they are raw buffers */
+    qint32 m_iNumQueuedBuffers;                         /**< Number of raw buffers in the send queue */
+    qint32 m_iMaxQueuedBuffers;                         /**< Bound of the raw buffers in the send queue */
+    SlowClientPolicy m_slowClientPolicy;                /**< What to do when the raw buffer queue is full */
+    qint32 m_iDownsampling;                             /**< Every n-th raw buffer is sent */
+    qint32 m_iBufferCount;                              /**< Number of raw buffers received since the start */
+
+    //
+    // Read by the server thread in FiffStreamServer::forwardRawBuffer, hence atomic
+    //
+    QAtomicInt m_bIsSendingRawBuffer;                   /**< Whether raw buffers are sent (bool) */
+
+    QString m_sShmKey;                                  /**< Base key of the shared memory rings of the server */
+    QAtomicInt m_bUseSharedMemory;                      /**< Whether raw buffers are passed through the shared memory ring (bool) */
+    QAtomicInt m_iStreamFormat;                         /**< Stream format of the raw buffers, FIFFV_MNE_RT_FORMAT_* */
+};
+
+
+inline qint32 FiffStreamClient::getID()
+{
+    return m_iDataClientId;
+}
+
+
+inline bool FiffStreamClient::isSendingRawBuffer()
+{
+    return m_bIsSendingRawBuffer.loadAcquire() != 0;
+}
+
+
+inline bool FiffStreamClient::isUsingSharedMemory()
+{
+    return m_bUseSharedMemory.loadAcquire() != 0;
+}
+
+
+inline void FiffStreamClient::disableSharedMemory()
+{
+    m_bUseSharedMemory.storeRelease(0);
+}
+
+
+inline fiff_int_t FiffStreamClient::getTransportFormat()
+{
+    return isUsingSharedMemory() ? MNE_RT_SHM_TRANSPORT : m_iStreamFormat.loadAcquire();
+}
+
+} // NAMESPACE
+
+#endif //FIFFSTREAMCLIENT_H
@@ -39,11 +39,20 @@
 //=============================================================================================================
 
 #include "fiffstreamserver.h"
-#include "fiffstreamthread.h"
+#include "fiffstreamclient.h"
 
 #include "mne_rt_server.h"
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// Fiff INCLUDES
+//=============================================================================================================
+
+#include <fiff/fiff_constants.h>
+#include <fiff/fiff_stream.h>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // STL INCLUDES
@@ -52,6 +61,14 @@
 #include <stdlib.h>
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QCoreApplication>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // USED NAMESPACES
@@ -61,6 +78,16 @@ using namespace RTSERVER;
 using namespace FIFFLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINES
+//=============================================================================================================
+
+#define MAX_WORKER_THREADS      4       /**< Maximal number of threads serving the data clients */
+#define MAX_QUEUED_BUFFERS      50      /**< Default bound of the raw buffer queue per client */
+#define SHM_RING_BLOCKS         64      /**< Minimal number of raw buffers in the shared memory ring */
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -69,8 +96,22 @@ using namespace FIFFLIB;
 FiffStreamServer::FiffStreamServer(QObject *parent)
 : QTcpServer(parent)
 , m_iNextClientId(0)
+, m_iMaxQueuedBuffers(MAX_QUEUED_BUFFERS)
+, m_slowClientPolicy(FiffStreamClient::DropOldest)
+, m_sShmKey(QString("mne_rt_server_%1").arg(QCoreApplication::applicationPid()))
+, m_iShmGeneration(-1)
+, m_bShmFailed(false)
 {
-
+    //
+    // A small fixed pool of event loops serves all clients
+    //
+    qint32 t_iNumThreads = qBound(1, QThread::idealThreadCount(), MAX_WORKER_THREADS);
+    for(qint32 i = 0; i < t_iNumThreads; ++i)
+    {
+        QThread* t_pThread = new QThread(this);
+        t_pThread->start();
+        m_qListWorkerThreads.append(t_pThread);
+    }
 }
 
 
@@ -79,6 +120,15 @@ FiffStreamServer::FiffStreamServer(QObject *parent)
 FiffStreamServer::~FiffStreamServer()
 {
     emit closeFiffStreamServer();
+
+    //
+    // The clients are deleted when their worker thread finishes
+    //
+    for(qint32 i = 0; i < m_qListWorkerThreads.size(); ++i)
+    {
+        m_qListWorkerThreads[i]->quit();
+        m_qListWorkerThreads[i]->wait();
+    }
 }
 
 
@@ -89,7 +139,7 @@ void FiffStreamServer::comClist(Command p_command)
     //ToDo JSON
     QString t_sOutput("");
     t_sOutput.append("\tID\tAlias\r\n");
-    QMap<qint32, FiffStreamThread*>::iterator i;
+    QMap<qint32, FiffStreamClient*>::iterator i;
     for (i = this->m_qClientList.begin(); i != this->m_qClientList.end(); ++i)
     {
         QString str = QString("\t%1\t%2\r\n").arg(i.key()).arg(i.value()->getAlias());
@@ -169,6 +219,74 @@ void FiffStreamServer::comStopAll(Command p_command)
 }
 
 
+//*************************************************************************************************************
+
+void FiffStreamServer::comBufferPolicy(Command p_command)
+{
+    QString t_sPolicy = p_command.pValues()[0].toString();
+    qint32 t_iMaxQueuedBuffers = p_command.pValues()[1].toInt();
+
+    FiffStreamClient::SlowClientPolicy t_policy;
+    if(t_sPolicy.compare("drop-oldest", Qt::CaseInsensitive) == 0)
+        t_policy = FiffStreamClient::DropOldest;
+    else if(t_sPolicy.compare("disconnect", Qt::CaseInsensitive) == 0)
+        t_policy = FiffStreamClient::Disconnect;
+    else if(t_sPolicy.compare("downsample", Qt::CaseInsensitive) == 0)
+        t_policy = FiffStreamClient::Downsample;
+    else
+    {
+        QString str = QString("\tunknown policy '%1', use drop-oldest, disconnect or downsample\r\n\n").arg(t_sPolicy);
+        qobject_cast<MNERTServer*>(this->parent())->getCommandManager()["bufferpolicy"].reply(str);
+        return;
+    }
+
+    if(t_iMaxQueuedBuffers < 1)
+        t_iMaxQueuedBuffers = m_iMaxQueuedBuffers;
+
+    setBufferPolicy(t_iMaxQueuedBuffers, t_policy);
+
+    QString str = QString("\tslow FiffStreamClients: %1 when %2 raw buffers are queued\r\n\n").arg(t_sPolicy).arg(t_iMaxQueuedBuffers);
+    qobject_cast<MNERTServer*>(this->parent())->getCommandManager()["bufferpolicy"].reply(str);
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamServer::comFormat(Command p_command)
+{
+    qint32 t_id = -1;
+    QString t_sOutput("");
+    QString t_sAlias(p_command.pValues()[0].toString());
+    QString t_sFormat(p_command.pValues()[1].toString());
+    t_sOutput.append(parseToId(t_sAlias,t_id));
+
+    fiff_int_t t_iFormat;
+    if(t_sFormat.compare("fiff", Qt::CaseInsensitive) == 0)
+        t_iFormat = FIFFV_MNE_RT_FORMAT_FIFF;
+    else if(t_sFormat.compare("native", Qt::CaseInsensitive) == 0)
+        t_iFormat = FIFFV_MNE_RT_FORMAT_NATIVE;
+    else if(t_sFormat.compare("int16", Qt::CaseInsensitive) == 0)
+        t_iFormat = FIFFV_MNE_RT_FORMAT_INT16;
+    else if(t_sFormat.compare("compressed", Qt::CaseInsensitive) == 0)
+        t_iFormat = FIFFV_MNE_RT_FORMAT_COMPRESSED;
+    else
+    {
+        t_sOutput.append(QString("\tunknown format '%1', use fiff, native, int16 or compressed\r\n\n").arg(t_sFormat));
+        qobject_cast<MNERTServer*>(this->parent())->getCommandManager()["format"].reply(t_sOutput);
+        return;
+    }
+
+    if(t_id != -1)
+    {
+        emit setStreamFormatFiffStreamClient(t_id, t_iFormat);
+
+        QString str = QString("\tFiffStreamClient (ID: %1) receives raw buffers as %2\r\n\n").arg(t_id).arg(t_sFormat);
+        t_sOutput.append(str);
+    }
+    qobject_cast<MNERTServer*>(this->parent())->getCommandManager()["format"].reply(t_sOutput);
+}
+
+
 //*************************************************************************************************************
 
 void FiffStreamServer::connectCommands()
@@ -181,6 +299,8 @@ void FiffStreamServer::connectCommands()
     QObject::connect(&t_pMNERTServer->getCommandManager()["start"], &Command::executed, this, &FiffStreamServer::comStart);
     QObject::connect(&t_pMNERTServer->getCommandManager()["stop"], &Command::executed, this, &FiffStreamServer::comStop);
     QObject::connect(&t_pMNERTServer->getCommandManager()["stop-all"], &Command::executed, this, &FiffStreamServer::comStopAll);
+    QObject::connect(&t_pMNERTServer->getCommandManager()["bufferpolicy"], &Command::executed, this, &FiffStreamServer::comBufferPolicy);
+    QObject::connect(&t_pMNERTServer->getCommandManager()["format"], &Command::executed, this, &FiffStreamServer::comFormat);
 
 //    t_pMNERTServer->getCommandManager().connectSlot(QString("clist"), this, &FiffStreamServer::comClist);
 //    t_pMNERTServer->getCommandManager().connectSlot(QString("measinfo"), this, &FiffStreamServer::comMeasinfo);
@@ -204,7 +324,7 @@ void FiffStreamServer::connectCommands()
 //        printf("clist\n");
 
 //        p_blockOutputInfo.append("\tID\tAlias\r\n");
-//        QMap<qint32, FiffStreamThread*>::iterator i;
+//        QMap<qint32, FiffStreamClient*>::iterator i;
 //        for (i = this->m_qClientList.begin(); i != this->m_qClientList.end(); ++i)
 //        {
 //            QString str = QString("\t%1\t%2\r\n").arg(i.key()).arg(i.value()->getAlias());
@@ -318,7 +438,7 @@ QByteArray FiffStreamServer::parseToId(QString& p_sRawId, qint32& p_iParsedId)
         }
         else
         {
-            QMap<qint32, FiffStreamThread*>::iterator i;
+            QMap<qint32, FiffStreamClient*>::iterator i;
             for (i = this->m_qClientList.begin(); i != this->m_qClientList.end(); ++i)
             {
                 if(i.value()->getAlias().compare(p_sRawId) == 0)
@@ -350,7 +470,7 @@ QByteArray FiffStreamServer::parseToId(QString& p_sRawId, qint32& p_iParsedId)
 
 //void FiffStreamServer::clearClients()
 //{
-//    QMap<qint32, FiffStreamThread*>::const_iterator i = m_qClientList.constBegin();
+//    QMap<qint32, FiffStreamClient*>::const_iterator i = m_qClientList.constBegin();
 //    while (i != m_qClientList.constEnd()) {
 //        if(i.value())
 //            delete i.value();
@@ -369,10 +489,91 @@ void FiffStreamServer::forwardMeasInfo(qint32 ID, FiffInfo p_fiffInfo)
 
 
 //*************************************************************************************************************
-//ToDo increase preformance --> try inline
+
 void FiffStreamServer::forwardRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRawData)
 {
-    emit remitRawBuffer(m_pMatRawData);
+    //
+    // Skip the encoding of formats no client receives
+    //
+    QList<fiff_int_t> t_qListFormats;
+    QMap<qint32, FiffStreamClient*>::const_iterator i;
+    for (i = this->m_qClientList.constBegin(); i != this->m_qClientList.constEnd(); ++i)
+    {
+        // clients which were accepted for shared memory before the ring failed get tags
+        if(m_bShmFailed && i.value()->isUsingSharedMemory())
+            i.value()->disableSharedMemory();
+
+        if(i.value()->isSendingRawBuffer() && !t_qListFormats.contains(i.value()->getTransportFormat()))
+            t_qListFormats.append(i.value()->getTransportFormat());
+    }
+
+    //
+    // Encode once per format, the clients share the tag
+    //
+    for(qint32 k = 0; k < t_qListFormats.size(); ++k)
+    {
+        QByteArray t_blobRawBufferTag;
+        FiffStream t_FiffStreamOut(&t_blobRawBufferTag, QIODevice::WriteOnly);
+
+        if(t_qListFormats[k] == MNE_RT_SHM_TRANSPORT)
+        {
+            //
+            // Local clients: write the buffer once into the ring and notify them of its sequence number
+            //
+            qint32 t_iSize = m_pMatRawData->rows()*m_pMatRawData->cols()*sizeof(float);
+            if(!m_shmRing.isAttached() || t_iSize > m_shmRing.blockSize())
+            {
+                ++m_iShmGeneration;
+                if(!m_shmRing.create(QString("%1_%2").arg(m_sShmKey).arg(m_iShmGeneration), qMax(SHM_RING_BLOCKS, 2*m_iMaxQueuedBuffers), t_iSize))
+                {
+                    //
+                    // Don't retry on every buffer: new clients are refused and the current ones get tags from now on
+                    //
+                    printf("FiffStreamServer: shared memory ring could not be created, raw buffers are sent as tags\r\n");
+                    m_bShmFailed = true;
+                    m_sShmKey.clear();
+                    for (i = this->m_qClientList.constBegin(); i != this->m_qClientList.constEnd(); ++i)
+                        i.value()->disableSharedMemory();
+                }
+            }
+
+            qint32 t_iSeq = m_bShmFailed ? -1 : m_shmRing.write((const char*)m_pMatRawData->data(), t_iSize);
+            if(t_iSeq >= 0)
+            {
+                fiff_int_t t_pNotification[3] = {m_iShmGeneration, t_iSeq, t_iSize};
+                t_FiffStreamOut.write_int(FIFF_MNE_RT_SHM_BUFFER, t_pNotification, 3);
+            }
+            else
+                t_FiffStreamOut.write_rt_raw_buffer(*m_pMatRawData, FIFFV_MNE_RT_FORMAT_FIFF); // no ring, fall back to the tag
+        }
+        else
+            t_FiffStreamOut.write_rt_raw_buffer(*m_pMatRawData, t_qListFormats[k]);
+
+        emit remitRawBuffer(t_qListFormats[k], t_blobRawBufferTag);
+    }
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamServer::setBufferPolicy(qint32 p_iMaxQueuedBuffers, FiffStreamClient::SlowClientPolicy p_policy)
+{
+    m_iMaxQueuedBuffers = p_iMaxQueuedBuffers;
+    m_slowClientPolicy = p_policy;
+
+    QMap<qint32, FiffStreamClient*>::const_iterator i;
+    for (i = this->m_qClientList.constBegin(); i != this->m_qClientList.constEnd(); ++i)
+        i.value()->setBufferPolicy(m_iMaxQueuedBuffers, m_slowClientPolicy);
+}
+
+
+//*************************************************************************************************************
+
+void FiffStreamServer::removeClient(qint32 id)
+{
+    FiffStreamClient* t_pClient = m_qClientList.take(id);
+    if(t_pClient)
+        t_pClient->deleteLater();
 }
 
 
@@ -380,14 +581,20 @@ void FiffStreamServer::forwardRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRa
 
 void FiffStreamServer::incomingConnection(qintptr socketDescriptor)
 {
-    FiffStreamThread* t_pStreamThread = new FiffStreamThread(m_iNextClientId, socketDescriptor, this);
+    FiffStreamClient* t_pClient = new FiffStreamClient(m_iNextClientId, socketDescriptor, this);
 
-    m_qClientList.insert(m_iNextClientId, t_pStreamThread);
+    m_qClientList.insert(m_iNextClientId, t_pClient);
+
+    //
+    // Distribute the clients over the worker threads
+    //
+    QThread* t_pThread = m_qListWorkerThreads[m_iNextClientId % m_qListWorkerThreads.size()];
     ++m_iNextClientId;
 
-    //when thread has finished it gets deleted
-    connect(t_pStreamThread, SIGNAL(finished()), t_pStreamThread, SLOT(deleteLater()));
-    connect(this, SIGNAL(closeFiffStreamServer()), t_pStreamThread, SLOT(deleteLater()));
+    t_pClient->moveToThread(t_pThread);
+
+    connect(t_pClient, &FiffStreamClient::disconnected, this, &FiffStreamServer::removeClient);
+    connect(t_pThread, &QThread::finished, t_pClient, &QObject::deleteLater);
 
-    t_pStreamThread->start();
+    QMetaObject::invokeMethod(t_pClient, "start", Qt::QueuedConnection);
 }
@@ -41,8 +41,11 @@
 // MNE INCLUDES
 //=============================================================================================================
 
+#include "fiffstreamclient.h"
+
 #include <fiff/fiff_info.h>
 #include <rtCommand/commandmanager.h>
+#include <utils/shmringbuffer.h>
 
 
 //*************************************************************************************************************
@@ -52,6 +55,8 @@
 
 #include <QStringList>
 #include <QTcpServer>
+#include <QThread>
+#include <QList>
 
 
 //*************************************************************************************************************
@@ -69,6 +74,7 @@ namespace RTSERVER
 
 using namespace FIFFLIB;
 using namespace RTCOMMANDLIB;
+using namespace UTILSLIB;
 
 
 //*************************************************************************************************************
@@ -76,8 +82,6 @@ using namespace RTCOMMANDLIB;
 // FORWARD DECLARATIONS
 //=============================================================================================================
 
-class FiffStreamThread;
-
 //=============================================================================================================
 /**
 * DECLARE CLASS FiffStreamServer
@@ -88,8 +92,6 @@ class FiffStreamServer : public QTcpServer//, public ICommandParser //OLD remove
 {
     Q_OBJECT
 
-    friend class FiffStreamThread;
-
 public:
 
     FiffStreamServer(QObject *parent = 0);
@@ -104,7 +106,41 @@ public:
     /**
     * ToDo...
     */
-    inline FiffStreamThread* getClient(qint32 id);
+    inline FiffStreamClient* getClient(qint32 id);
+
+    //=========================================================================================================
+    /**
+    * Returns the bound of the raw buffer queue of new clients.
+    *
+    * @return the maximal number of queued raw buffers per client
+    */
+    inline qint32 getMaxQueuedBuffers() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the slow client policy of new clients.
+    *
+    * @return the slow client policy
+    */
+    inline FiffStreamClient::SlowClientPolicy getSlowClientPolicy() const;
+
+    //=========================================================================================================
+    /**
+    * Returns the base key of the shared memory rings, the key of a ring is the base key followed by the ring
+    * generation.
+    *
+    * @return the shared memory base key
+    */
+    inline QString getShmKey() const;
+
+    //=========================================================================================================
+    /**
+    * Sets the bound of the raw buffer queue and the slow client policy of all clients.
+    *
+    * @param[in] p_iMaxQueuedBuffers    Maximal number of queued raw buffers per client.
+    * @param[in] p_policy               What to do with a client whose queue is full.
+    */
+    void setBufferPolicy(qint32 p_iMaxQueuedBuffers, FiffStreamClient::SlowClientPolicy p_policy);
 
     //=========================================================================================================
     /**
@@ -123,6 +159,15 @@ public:
 
 //public slots: --> in Qt 5 not anymore declared as slot
     void forwardMeasInfo(qint32 ID, FiffInfo p_fiffInfo);
+    //=========================================================================================================
+    /**
+    * Encodes a raw buffer once per stream format in use and passes the encoded tags to all clients. The tags
+    * are implicitly shared and never modified, so every client only holds a reference to the tag of its
+    * format. For clients on the same host the buffer is written once into the shared memory ring, these
+    * clients only receive a small FIFF_MNE_RT_SHM_BUFFER notification.
+    *
+    * @param[in] m_pMatRawData  The raw buffer.
+    */
     void forwardRawBuffer(QSharedPointer<Eigen::MatrixXf> m_pMatRawData);
 
 signals:
@@ -130,9 +175,10 @@ signals:
 
     void startMeasFiffStreamClient(qint32 ID);
     void stopMeasFiffStreamClient(qint32 ID);
+    void setStreamFormatFiffStreamClient(qint32 ID, fiff_int_t p_iFormat);
 
     void remitMeasInfo(qint32 ID, FIFFLIB::FiffInfo p_fiffInfo);
-    void remitRawBuffer(QSharedPointer<Eigen::MatrixXf>);
+    void remitRawBuffer(fiff_int_t p_iTransportFormat, QByteArray p_blobRawBufferTag);
 
     void closeFiffStreamServer();
 
@@ -181,11 +227,44 @@ private:
     */
     void comStopAll(Command p_command);
 
+    //=========================================================================================================
+    /**
+    * Sets the raw buffer queue bound and the slow client policy of the clients
+    *
+    * @param[in] p_command  The buffer policy command.
+    */
+    void comBufferPolicy(Command p_command);
+
+    //=========================================================================================================
+    /**
+    * Sets the stream format of the raw buffers sent to a client
+    *
+    * @param[in] p_command  The format command.
+    */
+    void comFormat(Command p_command);
+
+    //=========================================================================================================
+    /**
+    * Removes a disconnected client and deletes it in its worker thread
+    *
+    * @param[in] id     The client ID.
+    */
+    void removeClient(qint32 id);
+
     QByteArray parseToId(QString& p_sRawId, qint32& p_iParsedId);
 
-    QMap<qint32, FiffStreamThread*> m_qClientList;
+    QMap<qint32, FiffStreamClient*> m_qClientList;
     qint32                          m_iNextClientId;
 
+    QList<QThread*>                     m_qListWorkerThreads;   /**< Worker threads running the event loops of the clients */
+    qint32                              m_iMaxQueuedBuffers;    /**< Bound of the raw buffer queue per client */
+    FiffStreamClient::SlowClientPolicy  m_slowClientPolicy;     /**< What to do with a client whose queue is full */
+
+    ShmRingBuffer                       m_shmRing;              /**< Shared memory ring of the raw buffers for local clients */
+    QString                             m_sShmKey;              /**< Base key of the shared memory rings */
+    qint32                              m_iShmGeneration;       /**< Generation of the ring, increased when it is recreated */
+    bool                                m_bShmFailed;           /**< The ring could not be created, shared memory is not offered anymore */
+
 };
 
 
@@ -194,11 +273,35 @@ private:
 // INLINE DEFINITIONS
 //=============================================================================================================
 
-FiffStreamThread* FiffStreamServer::getClient(qint32 id)
+FiffStreamClient* FiffStreamServer::getClient(qint32 id)
 {
     return m_qClientList[id];
 }
 
+
+//*************************************************************************************************************
+
+inline qint32 FiffStreamServer::getMaxQueuedBuffers() const
+{
+    return m_iMaxQueuedBuffers;
+}
+
+
+//*************************************************************************************************************
+
+inline FiffStreamClient::SlowClientPolicy FiffStreamServer::getSlowClientPolicy() const
+{
+    return m_slowClientPolicy;
+}
+
+
+//*************************************************************************************************************
+
+inline QString FiffStreamServer::getShmKey() const
+{
+    return m_sShmKey;
+}
+
 } // NAMESPACE
 
 #endif //FIFFSTREAMSERVER_H
@@ -51,6 +51,10 @@ namespace RTSERVER
 
 #define MNE_RT_GET_CLIENT_ID        1       /**< Request client id at mne_rt_server */
 #define MNE_RT_SET_CLIENT_ALIAS     2       /**< Set client alias at mne_rt_server */
+#define MNE_RT_REQUEST_SHM          3       /**< Request the shared memory transport of raw buffers at mne_rt_server */
+#define MNE_RT_SET_STREAM_FORMAT    4       /**< Set the stream format of raw buffers at mne_rt_server, FIFFV_MNE_RT_FORMAT_* */
+
+#define MNE_RT_SHM_TRANSPORT        -1      /**< Transport of raw buffers passed through shared memory */
 
 } // NAMESPACE
 
@@ -324,10 +324,36 @@ void MNERTServer::init()
             "           \"description\": \"Closes mne_rt_server.\","
             "           \"parameters\": {}"
             "        },"
+            "       \"bufferpolicy\": {"
+            "           \"description\": \"Sets what happens to FiffStreamClients which do not keep up with the raw buffers.\","
+            "           \"parameters\": {"
+            "               \"policy\": {"
+            "                   \"description\": \"drop-oldest, disconnect or downsample\","
+            "                   \"type\": \"QString\" "
+            "               },"
+            "               \"size\": {"
+            "                   \"description\": \"Number of raw buffers which may be queued per client\","
+            "                   \"type\": \"int\" "
+            "               }"
+            "           }"
+            "        },"
             "       \"conlist\": {"
             "           \"description\": \"Prints and sends all available connectors.\","
             "           \"parameters\": {}"
             "        },"
+            "       \"format\": {"
+            "           \"description\": \"Sets the stream format of the raw buffers sent to the specified FiffStreamClient.\","
+            "           \"parameters\": {"
+            "               \"id\": {"
+            "                   \"description\": \"ID/Alias\","
+            "                   \"type\": \"QString\" "
+            "               },"
+            "               \"format\": {"
+            "                   \"description\": \"fiff (big-endian float), native (little-endian float), int16 (scaled per channel) or compressed (lossless)\","
+            "                   \"type\": \"QString\" "
+            "               }"
+            "           }"
+            "        },"
             "       \"help\": {"
             "           \"description\": \"Prints and sends this list.\","
             "           \"parameters\": {}"
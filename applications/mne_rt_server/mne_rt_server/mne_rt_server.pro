@@ -74,7 +74,7 @@ SOURCES += \
     connectormanager.cpp \
     mne_rt_server.cpp \
     fiffstreamserver.cpp \
-    fiffstreamthread.cpp \
+    fiffstreamclient.cpp \
     commandserver.cpp \
     commandthread.cpp
 
@@ -86,7 +86,7 @@ HEADERS += \
     mne_rt_server.h \
     mne_rt_server.h \
     fiffstreamserver.h \
-    fiffstreamthread.h \
+    fiffstreamclient.h \
     commandserver.h \
     commandthread.h \
     mne_rt_commands.h
@@ -174,7 +174,8 @@ void BabyMegProducer::run()
         {
             m_pBabyMeg->rtServerMutex.lock();
             m_pBabyMeg->m_pFiffInfo = m_pRtDataClient->readInfo();
-            emit m_pBabyMeg->fiffInfoAvailable();
+            if(m_pBabyMeg->m_pFiffInfo)
+                emit m_pBabyMeg->fiffInfoAvailable();
             m_pBabyMeg->rtServerMutex.unlock();
 
             producerMutex.lock();
@@ -182,7 +183,7 @@ void BabyMegProducer::run()
             producerMutex.unlock();
         }
 
-        if(m_bFlagMeasuring)
+        if(m_bFlagMeasuring && m_pBabyMeg->m_pFiffInfo)
         {
             m_pRtDataClient->readRawBuffer(m_pBabyMeg->m_pFiffInfo->nchan, t_matRawBuffer, kind);
 
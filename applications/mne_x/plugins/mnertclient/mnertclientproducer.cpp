@@ -174,7 +174,8 @@ void MneRtClientProducer::run()
         {
             m_pMneRtClient->rtServerMutex.lock();
             m_pMneRtClient->m_pFiffInfo = m_pRtDataClient->readInfo();
-            emit m_pMneRtClient->fiffInfoAvailable();
+            if(m_pMneRtClient->m_pFiffInfo)
+                emit m_pMneRtClient->fiffInfoAvailable();
             m_pMneRtClient->rtServerMutex.unlock();
 
             producerMutex.lock();
@@ -182,7 +183,7 @@ void MneRtClientProducer::run()
             producerMutex.unlock();
         }
 
-        if(m_bFlagMeasuring)
+        if(m_bFlagMeasuring && m_pMneRtClient->m_pFiffInfo)
         {
             m_pRtDataClient->readRawBuffer(m_pMneRtClient->m_pFiffInfo->nchan, t_matRawBuffer, kind);
 
@@ -54,7 +54,7 @@
 //=============================================================================================================
 
 #include <QtCore/QtPlugin>
-//#include <QtConcurrent>
+#include <QtConcurrent>
 #include <QDebug>
 
 
@@ -69,6 +69,27 @@ using namespace MNEX;
 using namespace XMEASLIB;
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE LOCAL TYPES
+//=============================================================================================================
+
+namespace
+{
+
+//=============================================================================================================
+/**
+* Clusters the given forward solution. The shared pointer is taken by value, so the forward solution stays
+* alive for as long as the clustering is running.
+*/
+MNEForwardSolution clusterForwardSolution(MNEForwardSolution::SPtr p_pFwd, AnnotationSet p_annotationSet, qint32 p_iClusterSize)
+{
+    return p_pFwd->cluster_forward_solution(p_annotationSet, p_iClusterSize);
+}
+
+} // NAMESPACE
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // DEFINE MEMBER METHODS
@@ -116,10 +137,14 @@ bool SourceLab::stop()
     QThread::terminate();
     QThread::wait();
 
-    if(m_pRtCov->isRunning())
+    // The clustering can't be cancelled, wait for it so it doesn't outlive the plugin
+    if(m_qFutureClusteredFwd.isRunning())
+        m_qFutureClusteredFwd.waitForFinished();
+
+    if(m_pRtCov && m_pRtCov->isRunning())
         m_pRtCov->stop();
 
-    if(m_pRtInvOp->isRunning())
+    if(m_pRtInvOp && m_pRtInvOp->isRunning())
         m_pRtInvOp->stop();
 
     if(m_pSourceLabBuffer)
@@ -224,10 +249,12 @@ void SourceLab::appendEvoked(FiffEvoked::SPtr p_pEvoked)
 
 void SourceLab::updateFiffCov(FiffCov::SPtr p_pFiffCov)
 {
+    mutex.lock();
     m_pFiffCov = p_pFiffCov;
 
     if(m_pRtInvOp)
         m_pRtInvOp->appendNoiseCov(m_pFiffCov);
+    mutex.unlock();
 }
 
 
@@ -255,17 +282,14 @@ void SourceLab::run()
     m_bIsRunning = true;
 
     //
-    // Cluster forward solution;
+    // Cluster forward solution in the background, the inverse operator estimation is started when it's done
     //
-//    qDebug() << "Start Clustering";
-//    QFuture<MNEForwardSolution> future = QtConcurrent::run(this->m_pFwd.data(), &MNEForwardSolution::cluster_forward_solution, m_annotationSet, 40);
-//    qDebug() << "Run Clustering";
-//    future.waitForFinished();
-//    m_pClusteredFwd = MNEForwardSolution::SPtr(new MNEForwardSolution(future.result()));
-
-    emit statMsg("Start Clustering");
-    m_pClusteredFwd = MNEForwardSolution::SPtr(new MNEForwardSolution(m_pFwd->cluster_forward_solution(m_annotationSet, 40)));
-    emit statMsg("Clustering finished");
+    // On a restart the clustering is only started again if there is no result yet
+    if(!m_pClusteredFwd && !m_qFutureClusteredFwd.isRunning() && m_qFutureClusteredFwd.resultCount() == 0)
+    {
+        emit statMsg("Start Clustering");
+        m_qFutureClusteredFwd = QtConcurrent::run(clusterForwardSolution, m_pFwd, m_annotationSet, 40);
+    }
 
     //
     // start receiving data
@@ -289,12 +313,6 @@ void SourceLab::run()
     m_pRtCov = RtCov::SPtr(new RtCov(5000, m_pFiffInfo));
     connect(m_pRtCov.data(), &RtCov::covCalculated, this, &SourceLab::updateFiffCov);
 
-    //
-    // Init Real-Time inverse estimator
-    //
-    m_pRtInvOp = RtInvOp::SPtr(new RtInvOp(m_pFiffInfo, m_pClusteredFwd));
-    connect(m_pRtInvOp.data(), &RtInvOp::invOperatorCalculated, this, &SourceLab::updateInvOp);
-
     //
     // Init Real-Time average
     //
@@ -305,7 +323,6 @@ void SourceLab::run()
     // Start the rt helpers
     //
     m_pRtCov->start();
-    m_pRtInvOp->start();
     m_pRtAve->start();
 
 //    // Replace this with a rt average class
@@ -327,6 +344,26 @@ void SourceLab::run()
 
     while(m_bIsRunning)
     {
+        //
+        // Init Real-Time inverse estimator, as soon as the clustered forward solution is available
+        //
+        if(!m_pRtInvOp && (m_pClusteredFwd || m_qFutureClusteredFwd.isFinished()))
+        {
+            if(!m_pClusteredFwd)
+            {
+                m_pClusteredFwd = MNEForwardSolution::SPtr(new MNEForwardSolution(m_qFutureClusteredFwd.result()));
+                emit statMsg("Clustering finished");
+            }
+
+            mutex.lock();
+            m_pRtInvOp = RtInvOp::SPtr(new RtInvOp(m_pFiffInfo, m_pClusteredFwd));
+            connect(m_pRtInvOp.data(), &RtInvOp::invOperatorCalculated, this, &SourceLab::updateInvOp);
+            m_pRtInvOp->start();
+            if(m_pFiffCov)
+                m_pRtInvOp->appendNoiseCov(m_pFiffCov);
+            mutex.unlock();
+        }
+
         qint32 nrows = m_pSourceLabBuffer->rows();
 
         if(nrows > 0) // check if init
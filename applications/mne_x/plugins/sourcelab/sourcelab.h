@@ -67,6 +67,7 @@
 
 #include <QtWidgets>
 #include <QFile>
+#include <QFuture>
 
 
 //*************************************************************************************************************
@@ -190,6 +191,7 @@ private:
     QFile                       m_qFileFwdSolution; /**< File to forward solution. */
     MNEForwardSolution::SPtr    m_pFwd;             /**< Forward solution. */
     MNEForwardSolution::SPtr    m_pClusteredFwd;    /**< Clustered forward solution. */
+    QFuture<MNEForwardSolution> m_qFutureClusteredFwd;  /**< Background clustering of the forward solution. */
 
     AnnotationSet               m_annotationSet;    /**< Annotation set. */
 
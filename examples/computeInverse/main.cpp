@@ -182,15 +182,7 @@ int main(int argc, char *argv[])
         if (inv.source_ori == FIFFV_MNE_FREE_ORI)
         {
             printf("combining the current components...");
-            MatrixXd sol1(sol.rows()/3,sol.cols());
-            for(i = 0; i < sol.cols(); ++i)
-            {
-                VectorXd* tmp = MNE::combine_xyz(sol.block(0,i,sol.rows(),1));
-                sol1.block(0,i,sol.rows()/3,1) = tmp->cwiseSqrt();
-                delete tmp;
-            }
-            sol.resize(sol1.rows(),sol1.cols());
-            sol = sol1;
+            sol = MNEMath::combine_xyz_norm(sol);
         }
         if (dSPM)
         {
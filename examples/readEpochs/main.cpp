@@ -153,7 +153,9 @@ int main(int argc, char *argv[])
         //   Create the projector
         //
 //        fiff_int_t nproj = MNE::make_projector_info(raw.info, raw.proj); Using the member function instead
-        fiff_int_t nproj = raw.info.make_projector(raw.proj);
+        MatrixXd t_matProj;
+        fiff_int_t nproj = raw.info.make_projector(t_matProj);
+        raw.set_proj(t_matProj);
 
         if (nproj == 0)
         {
@@ -179,8 +181,10 @@ int main(int argc, char *argv[])
     if (current_comp != dest_comp)
     {
         qDebug() << "This part needs to be debugged";
-        if(MNE::make_compensator(raw.info, current_comp, dest_comp, raw.comp))
+        FiffCtfComp t_comp;
+        if(MNE::make_compensator(raw.info, current_comp, dest_comp, t_comp))
         {
+            raw.set_comp(t_comp);
 //            raw.info.chs = MNE::set_current_comp(raw.info.chs,dest_comp);
             raw.info.set_current_comp(dest_comp);
             printf("Appropriate compensator added to change to grade %d.\n",dest_comp);
@@ -127,7 +127,9 @@ int main(int argc, char *argv[])
         //
         //   Create the projector
         //
-        fiff_int_t nproj = raw.info.make_projector(raw.proj);
+        MatrixXd t_matProj;
+        fiff_int_t nproj = raw.info.make_projector(t_matProj);
+        raw.set_proj(t_matProj);
 
         if (nproj == 0)
             printf("The projection vectors do not apply to these channels\n");
@@ -150,8 +152,10 @@ int main(int argc, char *argv[])
     if (current_comp != dest_comp)
     {
         qDebug() << "This part needs to be debugged";
-        if(MNE::make_compensator(raw.info, current_comp, dest_comp, raw.comp))
+        FiffCtfComp t_comp;
+        if(MNE::make_compensator(raw.info, current_comp, dest_comp, t_comp))
         {
+            raw.set_comp(t_comp);
             raw.info.set_current_comp(dest_comp);
             printf("Appropriate compensator added to change to grade %d.\n",dest_comp);
         }
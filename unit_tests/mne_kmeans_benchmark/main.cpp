@@ -0,0 +1,208 @@
+//=============================================================================================================
+/**
+* @file     main.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Benchmarks the KMeans engine on lead field sized inputs.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <utils/kmeans.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <stdio.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtCore/QCoreApplication>
+#include <QElapsedTimer>
+#include <QThreadPool>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace UTILSLIB;
+using namespace Eigen;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Methods
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* Generates a lead field like clustering problem: every row holds the 3 x nchan lead field of one source, sources
+* are scattered around a smaller number of smooth patterns.
+*
+* @param[in] p_iSources     Number of sources (points)
+* @param[in] p_iChannels    Number of channels, the dimension is 3 x p_iChannels
+* @param[in] p_iPatterns    Number of underlying patterns
+*
+* @return the lead field rows
+*/
+MatrixXd leadField(qint32 p_iSources, qint32 p_iChannels, qint32 p_iPatterns)
+{
+    MatrixXd patterns = MatrixXd::Random(p_iPatterns, 3*p_iChannels) * 1e-8;
+    MatrixXd LF = MatrixXd::Random(p_iSources, 3*p_iChannels) * 2e-9;
+    for(qint32 i = 0; i < p_iSources; ++i)
+        LF.row(i) += patterns.row(i % p_iPatterns);
+    return LF;
+}
+
+
+//*************************************************************************************************************
+
+/**
+* Clusters X with the given configuration and prints run time and total sum of distances.
+*
+* @param[in] p_sName        Configuration name
+* @param[in] p_kMeans       The configured KMeans
+* @param[in] X              Points
+* @param[in] k              Number of clusters
+*
+* @return true if the clustering succeeded
+*/
+bool run(const char* p_sName, KMeans& p_kMeans, const MatrixXd& X, qint32 k)
+{
+    VectorXi idx;
+    MatrixXd C, D;
+    VectorXd sumD;
+
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = p_kMeans.calculate(X, k, idx, C, sumD, D);
+    qint64 t_iMs = timer.elapsed();
+
+    printf("%5d x %5d  k %4d   %-28s %8lld ms   sumD %.6e   %s\n",
+           (int)X.rows(), (int)X.cols(), k, p_sName, t_iMs, ok ? sumD.sum() : 0.0, ok ? "ok" : "FAILED");
+
+    return ok;
+}
+
+
+//*************************************************************************************************************
+
+/**
+* Runs all configurations on one problem size.
+*
+* @param[in] p_iSources     Number of sources (points)
+* @param[in] p_iChannels    Number of channels
+* @param[in] p_iClusters    Number of clusters
+*
+* @return true if all configurations succeeded
+*/
+bool benchmark(qint32 p_iSources, qint32 p_iChannels, qint32 p_iClusters)
+{
+    MatrixXd X = leadField(p_iSources, p_iChannels, p_iClusters);
+    bool ok = true;
+
+    qint32 t_iMaxThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+    KMeans t_kSample(QString("sqeuclidean"), QString("sample"), 5, QString("drop"), true, 100, 0);
+
+    QThreadPool::globalInstance()->setMaxThreadCount(1);
+    ok &= run("sample, 5 reps, 1 thread", t_kSample, X, p_iClusters);
+    QThreadPool::globalInstance()->setMaxThreadCount(t_iMaxThreads);
+    ok &= run("sample, 5 reps", t_kSample, X, p_iClusters);
+
+    KMeans t_kBatch(QString("sqeuclidean"), QString("sample"), 5, QString("drop"), false, 100, 0);
+    ok &= run("sample, 5 reps, batch only", t_kBatch, X, p_iClusters);
+
+    KMeans t_kPlus(QString("sqeuclidean"), QString("plus"), 5, QString("drop"), true, 100, 0);
+    ok &= run("k-means++, 5 reps", t_kPlus, X, p_iClusters);
+
+    KMeans t_kMiniBatch(QString("sqeuclidean"), QString("plus"), 5, QString("drop"), true, 100, 0);
+    t_kMiniBatch.setMiniBatch(256);
+    ok &= run("k-means++, 5 reps, batch 256", t_kMiniBatch, X, p_iClusters);
+
+    KMeans t_kCityBlock(QString("cityblock"), QString("sample"), 5, QString("drop"), true, 100, 0);
+    ok &= run("cityblock, 5 reps", t_kCityBlock, X, p_iClusters);
+
+    printf("\n");
+
+    return ok;
+}
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* The function main marks the entry point of the program.
+* By default, main has the storage class extern.
+*
+* @param [in] argc (argument count) is an integer that indicates how many arguments were entered on the command line when the program was started.
+* @param [in] argv (argument vector) is an array of pointers to arrays of character objects. The array objects are null-terminated strings, representing the arguments that were entered on the command line when the program was started.
+* @return the value that was set to exit() (which is 0 if exit() is called via quit()).
+*/
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    bool ok = true;
+
+    //
+    //   Region sizes as they occur in cluster_forward_solution (sources of one label, 306 channels) up to a
+    //   whole hemisphere
+    //
+    ok &= benchmark(200, 306, 10);
+    ok &= benchmark(1000, 306, 50);
+    ok &= benchmark(4000, 306, 200);
+
+    return ok ? 0 : 1;
+}
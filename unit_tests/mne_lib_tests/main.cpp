@@ -113,5 +113,68 @@ int main(int argc, char *argv[])
     testStart(testName);
     testResult = t_MneLibTests.checkFwdRead();
     testEnd(testName,testResult);
+    //
+    // Raw writer test
+    //
+    testName = QString("Raw Writer");
+    testStart(testName);
+    testResult = t_MneLibTests.checkRawWriter();
+    testEnd(testName,testResult);
+    //
+    // Tag decoder test
+    //
+    testName = QString("Tag Decoder");
+    testStart(testName);
+    testResult = t_MneLibTests.checkTagDecoder();
+    testEnd(testName,testResult);
+    //
+    // Real-time raw buffer formats test
+    //
+    testName = QString("Raw Buffer Formats");
+    testStart(testName);
+    testResult = t_MneLibTests.checkRawBufferFormats();
+    testEnd(testName,testResult);
+    //
+    // Inverse operator decomposition test
+    //
+    testName = QString("Inverse SVD");
+    testStart(testName);
+    testResult = t_MneLibTests.checkInverseSvd();
+    testEnd(testName,testResult);
+    //
+    // Swap Arrays test
+    //
+    testName = QString("Swap Arrays");
+    testStart(testName);
+    testResult = t_MneLibTests.checkSwapArrays();
+    testEnd(testName,testResult);
+    //
+    // Matrix Buffers test
+    //
+    testName = QString("Matrix Buffers");
+    testStart(testName);
+    testResult = t_MneLibTests.checkMatrixBuffers();
+    testEnd(testName,testResult);
+    //
+    // SVD Gram test
+    //
+    testName = QString("SVD Gram");
+    testStart(testName);
+    testResult = t_MneLibTests.checkSvdGram();
+    testEnd(testName,testResult);
+    //
+    // KMeans test
+    //
+    testName = QString("KMeans");
+    testStart(testName);
+    testResult = t_MneLibTests.checkKMeans();
+    testEnd(testName,testResult);
+    //
+    // RAP MUSIC test
+    //
+    testName = QString("RAP MUSIC");
+    testStart(testName);
+    testResult = t_MneLibTests.checkRapMusic();
+    testEnd(testName,testResult);
     return a.exec();
 }
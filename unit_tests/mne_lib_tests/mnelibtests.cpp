@@ -41,12 +41,53 @@
 #include "mnelibtests.h"
 
 
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+
 //*************************************************************************************************************
 //=============================================================================================================
 // MNE INCLUDES
 //=============================================================================================================
 
 #include <mne/mne.h>
+#include <fiff/fiff.h>
+#include <fiff/fiff_cov.h>
+#include <fiff/fiff_evoked.h>
+#include <fiff/fiff_raw_writer.h>
+#include <fiff/fiff_tag_decoder.h>
+#include <fs/label.h>
+#include <generics/circularmatrixbuffer.h>
+#include <generics/spscmatrixbuffer.h>
+#include <inverse/rapMusic/rapmusic.h>
+#include <utils/ioutils.h>
+#include <utils/kmeans.h>
+#include <utils/mnemath.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// EIGEN INCLUDES
+//=============================================================================================================
+
+#include <Eigen/SVD>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtEndian>
+#include <QtNumeric>
+#include <QThread>
+#include <QVector>
 
 
 //*************************************************************************************************************
@@ -56,6 +97,149 @@
 
 using namespace MNEUNITTESTS;
 using namespace MNELIB;
+using namespace FIFFLIB;
+using namespace FSLIB;
+using namespace INVERSELIB;
+using namespace UTILSLIB;
+using namespace IOBuffer;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// DEFINE LOCAL TYPES
+//=============================================================================================================
+
+namespace
+{
+
+//=============================================================================================================
+/**
+* Swaps nel elements of p_iSize bytes, starting p_iOffset elements behind a 64 byte boundary, with the bulk swap
+* of IOUtils and compares the whole buffer, including the guard bytes around the swapped range, with a byte wise
+* reversal.
+*
+* @param[in] p_iSize    Element size in bytes (2, 4 or 8)
+* @param[in] p_iOffset  Offset of the first element to the 64 byte boundary in elements
+* @param[in] nel        Number of elements to swap
+*
+* @return true if the buffers match
+*/
+bool checkSwapRange(qint32 p_iSize, qint32 p_iOffset, qint32 nel)
+{
+    qint32 t_iBytes = 64 + (p_iOffset + nel + 16) * p_iSize;
+    QByteArray t_Buffer(t_iBytes + 64, 0);
+    uchar* t_pBase = reinterpret_cast<uchar*>(t_Buffer.data());
+    t_pBase += (64 - (reinterpret_cast<quintptr>(t_pBase) & 63)) & 63;
+    for(qint32 i = 0; i < t_iBytes; ++i)
+        t_pBase[i] = (uchar)(i*7 + 1);
+
+    QByteArray t_Expected(reinterpret_cast<const char*>(t_pBase), t_iBytes);
+    uchar* t_pExpected = reinterpret_cast<uchar*>(t_Expected.data());
+    for(qint32 k = 0; k < nel; ++k)
+        std::reverse(t_pExpected + 64 + (p_iOffset + k) * p_iSize, t_pExpected + 64 + (p_iOffset + k + 1) * p_iSize);
+
+    uchar* t_pData = t_pBase + 64 + p_iOffset * p_iSize;
+    switch(p_iSize)
+    {
+        case 2:
+            IOUtils::swap_short_array(reinterpret_cast<qint16*>(t_pData), nel);
+            break;
+        case 4:
+            IOUtils::swap_float_array(reinterpret_cast<float*>(t_pData), nel);
+            break;
+        default:
+            IOUtils::swap_double_array(reinterpret_cast<double*>(t_pData), nel);
+    }
+
+    return memcmp(t_pBase, t_pExpected, t_iBytes) == 0;
+}
+
+
+//=============================================================================================================
+/**
+* Pushes p_iCount matrices filled with their sequence number into a CircularMatrixBuffer or a SpscMatrixBuffer.
+*/
+class SequenceProducer : public QThread
+{
+public:
+    SequenceProducer(CircularMatrixBuffer<float>::SPtr p_pCircular, SpscMatrixBuffer<float>::SPtr p_pSpsc, qint32 p_iRows, qint32 p_iCols, qint32 p_iCount, bool p_bInPlace)
+    : m_pCircular(p_pCircular), m_pSpsc(p_pSpsc), m_iRows(p_iRows), m_iCols(p_iCols), m_iCount(p_iCount), m_bInPlace(p_bInPlace) {}
+
+protected:
+    virtual void run()
+    {
+        MatrixXf t_mat(m_iRows, m_iCols);
+        for(qint32 i = 0; i < m_iCount; ++i)
+        {
+            t_mat.setConstant((float)i);
+            if(m_pCircular)
+                m_pCircular->push(&t_mat);
+            else if(m_bInPlace)
+            {
+                m_pSpsc->acquireWriteSlot().setConstant((float)i);
+                m_pSpsc->commitWriteSlot();
+            }
+            else
+                m_pSpsc->push(&t_mat);
+        }
+    }
+
+private:
+    CircularMatrixBuffer<float>::SPtr   m_pCircular;    /**< The circular buffer to fill, if set. */
+    SpscMatrixBuffer<float>::SPtr       m_pSpsc;        /**< The single producer single consumer buffer to fill otherwise. */
+    qint32                              m_iRows;        /**< Rows of the pushed matrices. */
+    qint32                              m_iCols;        /**< Columns of the pushed matrices. */
+    qint32                              m_iCount;       /**< Number of pushes. */
+    bool                                m_bInPlace;     /**< Whether the acquire/commit interface is used. */
+};
+
+
+//=============================================================================================================
+/**
+* Checks that every cluster found by KMeans holds the points of exactly one of the p_iPatterns underlying patterns,
+* point i belongs to pattern i % p_iPatterns.
+*
+* @param[in] p_sName        Configuration name
+* @param[in] p_kMeans       The configured KMeans
+* @param[in] X              Points
+* @param[in] p_iPatterns    Number of patterns and clusters
+*
+* @return true if the clusters match the patterns
+*/
+bool checkClusters(const char* p_sName, KMeans& p_kMeans, const MatrixXd& X, qint32 p_iPatterns)
+{
+    VectorXi idx;
+    MatrixXd C, D;
+    VectorXd sumD;
+    if(!p_kMeans.calculate(X, p_iPatterns, idx, C, sumD, D) || idx.size() != X.rows())
+    {
+        printf("%s: clustering failed!\n", p_sName);
+        return false;
+    }
+
+    QVector<qint32> t_vecPatternOfCluster(p_iPatterns, -1);
+    for(qint32 i = 0; i < X.rows(); ++i)
+    {
+        if(idx[i] < 0 || idx[i] >= p_iPatterns)
+        {
+            printf("%s: invalid cluster index %d!\n", p_sName, idx[i]);
+            return false;
+        }
+        qint32& t_iPattern = t_vecPatternOfCluster[idx[i]];
+        if(t_iPattern == -1)
+            t_iPattern = i % p_iPatterns;
+        else if(t_iPattern != i % p_iPatterns)
+        {
+            printf("%s: cluster %d mixes patterns %d and %d!\n", p_sName, idx[i], t_iPattern, i % p_iPatterns);
+            return false;
+        }
+    }
+
+    printf("%s: ok\n", p_sName);
+    return true;
+}
+
+} // NAMESPACE
 
 
 //*************************************************************************************************************
@@ -132,3 +316,685 @@ bool MNELibTests::checkFwdRead()
         return false;
     }
 }
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkRawWriter()
+{
+    QFile t_fileIn("./MNE-sample-data/MEG/sample/sample_audvis_raw.fif");
+    QFile t_fileOut("./MNE-sample-data/MEG/sample/test_raw_writer.fif");
+
+    FiffRawData raw(t_fileIn);
+    if(raw.isEmpty())
+    {
+        emit checkupFailed(2);
+        return false;
+    }
+
+    QStringList include;
+    MatrixXi picks = raw.info.pick_types(true, false, false, include, raw.info.bads);
+
+    //
+    // Write a few seconds with a small batch size, so batches are written while the writer is running
+    //
+    MatrixXd cals;
+    FiffStream::SPtr outfid = Fiff::start_writing_raw(t_fileOut, raw.info, cals, picks);
+    if(!outfid)
+    {
+        emit checkupFailed(2);
+        return false;
+    }
+
+    fiff_int_t first = raw.first_samp;
+    fiff_int_t quantum = 1000;
+    qint32 nbuffers = 5;
+    outfid->write_int(FIFF_FIRST_SAMPLE, &first);
+
+    FiffRawWriter t_writer(outfid, cals.row(0), 4, 64*1024);
+    t_writer.start();
+
+    MatrixXd data, times, t_matWritten(picks.cols(), nbuffers*quantum);
+    for(qint32 i = 0; i < nbuffers; ++i)
+    {
+        if(!raw.read_raw_segment(data, times, first + i*quantum, first + (i+1)*quantum - 1, picks))
+        {
+            t_writer.stop();
+            emit checkupFailed(2);
+            return false;
+        }
+        t_matWritten.block(0, i*quantum, data.rows(), data.cols()) = data;
+        t_writer.write_raw_buffer(data);
+    }
+
+    bool t_bWritten = t_writer.stop();
+    outfid->finish_writing_raw();
+
+    if(!t_bWritten)
+    {
+        printf("Writing the raw buffers failed!\n");
+        emit checkupFailed(2);
+        return false;
+    }
+
+    //
+    // Read it back, the samples went through single precision
+    //
+    FiffRawData rawWritten(t_fileOut);
+    if(rawWritten.isEmpty() || rawWritten.first_samp != first || rawWritten.last_samp != first + nbuffers*quantum - 1)
+    {
+        printf("Written file has wrong sample range!\n");
+        emit checkupFailed(2);
+        return false;
+    }
+
+    if(!rawWritten.read_raw_segment(data, times, rawWritten.first_samp, rawWritten.last_samp))
+    {
+        emit checkupFailed(2);
+        return false;
+    }
+
+    if(data.rows() != t_matWritten.rows() || data.cols() != t_matWritten.cols())
+    {
+        printf("Written data has wrong dimensions!\n");
+        emit checkupFailed(2);
+        return false;
+    }
+
+    double t_dMaxDiff = 0;
+    for(qint32 r = 0; r < data.rows(); ++r)
+    {
+        double t_dScale = t_matWritten.row(r).cwiseAbs().maxCoeff();
+        if(t_dScale > 0)
+            t_dMaxDiff = qMax(t_dMaxDiff, (data.row(r) - t_matWritten.row(r)).cwiseAbs().maxCoeff() / t_dScale);
+    }
+
+    printf("\nMaximal relative difference of the written samples: %g\n", t_dMaxDiff);
+
+    if(t_dMaxDiff > 1e-6)
+    {
+        printf("Written samples differ!\n");
+        emit checkupFailed(2);
+        return false;
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkTagDecoder()
+{
+    //
+    // Encode a short tag stream
+    //
+    fiff_int_t t_iValues[3] = {1, -2, 3};
+    float t_fValues[4] = {0.5f, -1.25f, 3.0e-12f, 1.0e7f};
+
+    QByteArray t_blobStream;
+    {
+        FiffStream t_stream(&t_blobStream, QIODevice::WriteOnly);
+        t_stream.write_int(FIFF_MNE_RT_COMMAND, t_iValues, 3);
+        t_stream.write_float(FIFF_DATA_BUFFER, t_fValues, 4);
+        t_stream.write_string(FIFF_COMMENT, QString("decoder test"));
+    }
+
+    //
+    // All bytes at once and byte by byte have to give the same tags
+    //
+    for(qint32 t_iChunk = 0; t_iChunk < 2; ++t_iChunk)
+    {
+        FiffTagDecoder t_decoder;
+        if(t_iChunk == 0)
+            t_decoder.feed(t_blobStream.constData(), t_blobStream.size());
+        else
+            for(qint32 i = 0; i < t_blobStream.size(); ++i)
+                t_decoder.feed(t_blobStream.constData() + i, 1);
+
+        FiffTag::SPtr t_pTagInt = t_decoder.takeTag();
+        FiffTag::SPtr t_pTagFloat = t_decoder.takeTag();
+        FiffTag::SPtr t_pTagString = t_decoder.takeTag();
+
+        if(!t_pTagInt || !t_pTagFloat || !t_pTagString || t_decoder.hasTag())
+        {
+            printf("Wrong number of decoded tags!\n");
+            emit checkupFailed(3);
+            return false;
+        }
+
+        if(t_pTagInt->kind != FIFF_MNE_RT_COMMAND || t_pTagInt->type != FIFFT_INT || t_pTagInt->size() != 3*4
+                || memcmp(t_pTagInt->toInt(), t_iValues, sizeof(t_iValues)) != 0
+                || t_pTagFloat->kind != FIFF_DATA_BUFFER || t_pTagFloat->type != FIFFT_FLOAT
+                || memcmp(t_pTagFloat->toFloat(), t_fValues, sizeof(t_fValues)) != 0
+                || t_pTagString->kind != FIFF_COMMENT || t_pTagString->toString() != QString("decoder test"))
+        {
+            printf("Decoded tags differ (%s)!\n", t_iChunk == 0 ? "single feed" : "byte wise feed");
+            emit checkupFailed(3);
+            return false;
+        }
+    }
+
+    //
+    // A recycled tag is reused for the next tag
+    //
+    {
+        FiffTagDecoder t_decoder;
+        qint32 t_iFirstTag = 16 + 3*4; // header and the three ints
+        t_decoder.feed(t_blobStream.constData(), t_iFirstTag);
+        FiffTag::SPtr t_pTag = t_decoder.takeTag();
+        FiffTag* t_pRecycled = t_pTag.data();
+
+        t_decoder.recycle(t_pTag);
+        t_pTag.clear();
+
+        t_decoder.feed(t_blobStream.constData() + t_iFirstTag, t_blobStream.size() - t_iFirstTag);
+        t_pTag = t_decoder.takeTag();
+
+        if(!t_pTag || t_pTag.data() != t_pRecycled || t_pTag->kind != FIFF_DATA_BUFFER
+                || memcmp(t_pTag->toFloat(), t_fValues, sizeof(t_fValues)) != 0)
+        {
+            printf("Recycled tag was not reused correctly!\n");
+            emit checkupFailed(3);
+            return false;
+        }
+    }
+
+    //
+    // Negative and oversized tags put the decoder into the error state
+    //
+    {
+        FiffTagDecoder t_decoder(8, 8);
+        if(t_decoder.feed(t_blobStream.constData(), t_blobStream.size()))
+        {
+            printf("Oversized tag was accepted!\n");
+            emit checkupFailed(3);
+            return false;
+        }
+
+        QByteArray t_blobInvalid(16, 0);
+        qToBigEndian<qint32>(-4, (uchar*)t_blobInvalid.data() + 8);
+        FiffTagDecoder t_decoderInvalid;
+        if(t_decoderInvalid.feed(t_blobInvalid.constData(), t_blobInvalid.size()))
+        {
+            printf("Negative tag size was accepted!\n");
+            emit checkupFailed(3);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkRawBufferFormats()
+{
+    //
+    // MEG like noise, large values, a zero channel, a channel with NaN and infinite samples, denormals
+    //
+    qint32 nchan = 6;
+    qint32 nsamp = 300;
+    MatrixXf t_matData(nchan, nsamp);
+    qsrand(42);
+    for(qint32 s = 0; s < nsamp; ++s)
+    {
+        t_matData(0,s) = 1e-12f*sinf(0.01f*s) + 1e-14f*((qrand() % 2000) - 1000)/1000.0f;
+        t_matData(1,s) = 1e-6f*((qrand() % 2000) - 1000);
+        t_matData(2,s) = 0.0f;
+        if(s % 7 == 0)
+            t_matData(3,s) = qQNaN();
+        else if(s % 11 == 0)
+            t_matData(3,s) = qInf();
+        else if(s % 13 == 0)
+            t_matData(3,s) = -qInf();
+        else
+            t_matData(3,s) = 0.5f*s;
+        t_matData(4,s) = (s % 2) ? -0.0f : 1e-40f;
+        t_matData(5,s) = (float)s;
+    }
+
+    fiff_int_t t_iFormats[4] = {FIFFV_MNE_RT_FORMAT_FIFF, FIFFV_MNE_RT_FORMAT_NATIVE, FIFFV_MNE_RT_FORMAT_INT16, FIFFV_MNE_RT_FORMAT_COMPRESSED};
+    FiffTag::SPtr t_pTag;
+    MatrixXf t_matDecoded;
+
+    for(qint32 f = 0; f < 4; ++f)
+    {
+        QByteArray t_blobStream;
+        {
+            FiffStream t_stream(&t_blobStream, QIODevice::WriteOnly);
+            t_stream.write_rt_raw_buffer(t_matData, t_iFormats[f]);
+        }
+
+        FiffTagDecoder t_decoder;
+        t_decoder.feed(t_blobStream.constData(), t_blobStream.size());
+        t_pTag = t_decoder.takeTag();
+
+        if(!t_pTag || !t_pTag->toRawBuffer(nchan, t_matDecoded) || t_matDecoded.rows() != nchan || t_matDecoded.cols() != nsamp)
+        {
+            printf("Raw buffer of format %d could not be decoded!\n", t_iFormats[f]);
+            emit checkupFailed(4);
+            return false;
+        }
+
+        if(t_iFormats[f] != FIFFV_MNE_RT_FORMAT_INT16)
+        {
+            if(memcmp(t_matDecoded.data(), t_matData.data(), nchan*nsamp*sizeof(float)) != 0)
+            {
+                printf("Raw buffer of format %d is not bit-exact!\n", t_iFormats[f]);
+                emit checkupFailed(4);
+                return false;
+            }
+            continue;
+        }
+
+        for(qint32 c = 0; c < nchan; ++c)
+        {
+            float t_fMax = 0.0f;
+            for(qint32 s = 0; s < nsamp; ++s)
+                if(qIsFinite(t_matData(c,s)))
+                    t_fMax = qMax(t_fMax, qAbs(t_matData(c,s)));
+            float t_fScale = t_fMax / 32767;
+
+            for(qint32 s = 0; s < nsamp; ++s)
+            {
+                if(!qIsFinite(t_matDecoded(c,s))
+                        || (qIsFinite(t_matData(c,s)) && qAbs(t_matDecoded(c,s) - t_matData(c,s)) > 0.5f*t_fScale*(1.0f + 1e-5f)))
+                {
+                    printf("int16 sample %d of channel %d is off: %g instead of %g!\n", s, c, t_matDecoded(c,s), t_matData(c,s));
+                    emit checkupFailed(4);
+                    return false;
+                }
+            }
+        }
+    }
+
+    //
+    // Forged channel numbers and compressed sizes
+    //
+    QByteArray t_blobStream;
+    {
+        FiffStream t_stream(&t_blobStream, QIODevice::WriteOnly);
+        t_stream.write_rt_raw_buffer(t_matData, FIFFV_MNE_RT_FORMAT_NATIVE);
+        t_stream.write_rt_raw_buffer(t_matData, FIFFV_MNE_RT_FORMAT_COMPRESSED);
+    }
+
+    FiffTagDecoder t_decoder;
+    t_decoder.feed(t_blobStream.constData(), t_blobStream.size());
+    FiffTag::SPtr t_pTagNative = t_decoder.takeTag();
+    FiffTag::SPtr t_pTagCompressed = t_decoder.takeTag();
+
+    qToLittleEndian<qint32>(0x10000000, (uchar*)t_pTagNative->data());
+    qToBigEndian<quint32>(0x7fffffff, (uchar*)t_pTagCompressed->data() + 8);
+
+    if(t_pTagNative->toRawBuffer(nchan, t_matDecoded) || t_pTagCompressed->toRawBuffer(nchan, t_matDecoded))
+    {
+        printf("Forged raw buffer was accepted!\n");
+        emit checkupFailed(4);
+        return false;
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkInverseSvd()
+{
+    QFile t_fileFwd("./MNE-sample-data/MEG/sample/sample_audvis-meg-eeg-oct-6-fwd.fif");
+    QFile t_fileCov("./MNE-sample-data/MEG/sample/sample_audvis-cov.fif");
+    QFile t_fileEvoked("./MNE-sample-data/MEG/sample/sample_audvis-ave.fif");
+
+    QPair<QVariant, QVariant> baseline(QVariant(), 0);
+    FiffEvoked evoked(t_fileEvoked, 0, baseline);
+    MNEForwardSolution t_forwardMeeg(t_fileFwd, false, true);
+    FiffCov noise_cov(t_fileCov);
+    if(evoked.isEmpty() || t_forwardMeeg.isEmpty() || noise_cov.isEmpty())
+    {
+        emit checkupFailed(5);
+        return false;
+    }
+
+    noise_cov = noise_cov.regularize(evoked.info, 0.05, 0.05, 0.1, true);
+    MNEForwardSolution t_forwardMeg = t_forwardMeeg.pick_types(true, false);
+
+    MNEInverseOperator t_invGram(evoked.info, t_forwardMeg, noise_cov, 0.2f, 0.8f, false, true, MNEInverseOperator::SvdGram);
+    MNEInverseOperator t_invJacobi(evoked.info, t_forwardMeg, noise_cov, 0.2f, 0.8f, false, true, MNEInverseOperator::SvdJacobi);
+
+    //
+    // Singular values, the Gram matrix resolves them up to eps relative to the largest one
+    //
+    if(t_invGram.sing.size() != t_invJacobi.sing.size() || t_invGram.sing.size() == 0)
+    {
+        printf("Number of singular values differs!\n");
+        emit checkupFailed(5);
+        return false;
+    }
+
+    qint32 nsing = t_invJacobi.sing.size();
+    double t_dSingMax = t_invJacobi.sing[0];
+    double t_dSingDiff = (t_invGram.sing - t_invJacobi.sing).cwiseAbs().maxCoeff() / t_dSingMax;
+    printf("Max. singular value difference (relative): %e\n", t_dSingDiff);
+    if(t_dSingDiff > 1e-6)
+    {
+        printf("Singular values differ!\n");
+        emit checkupFailed(5);
+        return false;
+    }
+
+    //
+    // Eigenfields and eigenleads up to sign. Only components which are well above the noise floor and well
+    // separated from their neighbours are unique.
+    //
+    double t_dFieldDiff = 0;
+    double t_dLeadDiff = 0;
+    qint32 t_iCompared = 0;
+    for(qint32 i = 0; i < nsing; ++i)
+    {
+        double s = t_invJacobi.sing[i];
+        if(s < 1e-3 * t_dSingMax)
+            break;
+        if((i > 0 && t_invJacobi.sing[i-1] - s < 1e-2 * s) || (i < nsing-1 && s - t_invJacobi.sing[i+1] < 1e-2 * s))
+            continue;
+
+        VectorXd t_vecFieldGram = t_invGram.eigen_fields->data.row(i).transpose();
+        VectorXd t_vecFieldJacobi = t_invJacobi.eigen_fields->data.row(i).transpose();
+        double t_dSign = t_vecFieldGram.dot(t_vecFieldJacobi) < 0 ? -1.0 : 1.0;
+
+        t_dFieldDiff = std::max(t_dFieldDiff, (t_dSign * t_vecFieldGram - t_vecFieldJacobi).norm());
+        t_dLeadDiff = std::max(t_dLeadDiff, (t_dSign * t_invGram.eigen_leads->data.col(i) - t_invJacobi.eigen_leads->data.col(i)).norm()
+                                            / t_invJacobi.eigen_leads->data.col(i).norm());
+        ++t_iCompared;
+    }
+    printf("Compared %d components, max. eigenfield difference: %e, max. eigenlead difference (relative): %e\n", t_iCompared, t_dFieldDiff, t_dLeadDiff);
+    if(t_iCompared == 0 || t_dFieldDiff > 1e-5 || t_dLeadDiff > 1e-5)
+    {
+        printf("Eigenfields or eigenleads differ!\n");
+        emit checkupFailed(5);
+        return false;
+    }
+
+    //
+    // Kernel, the regularization damps the components below the noise floor
+    //
+    double lambda2 = 1.0 / pow(3.0, 2);
+    MNEInverseOperator t_invGramPrep = t_invGram.prepare_inverse_operator(evoked.nave, lambda2, true);
+    MNEInverseOperator t_invJacobiPrep = t_invJacobi.prepare_inverse_operator(evoked.nave, lambda2, true);
+
+    Label t_label;
+    MatrixXd t_matKernelGram, t_matKernelJacobi;
+    SparseMatrix<double> t_noiseNormGram, t_noiseNormJacobi;
+    QList<VectorXi> t_vertnoGram, t_vertnoJacobi;
+    if(!t_invGramPrep.assemble_kernel(t_label, "dSPM", false, t_matKernelGram, t_noiseNormGram, t_vertnoGram) ||
+       !t_invJacobiPrep.assemble_kernel(t_label, "dSPM", false, t_matKernelJacobi, t_noiseNormJacobi, t_vertnoJacobi) ||
+       t_matKernelGram.rows() != t_matKernelJacobi.rows() || t_matKernelGram.cols() != t_matKernelJacobi.cols())
+    {
+        printf("Kernels could not be assembled!\n");
+        emit checkupFailed(5);
+        return false;
+    }
+
+    double t_dKernelDiff = (t_matKernelGram - t_matKernelJacobi).norm() / t_matKernelJacobi.norm();
+    double t_dNoiseNormDiff = (t_noiseNormGram - t_noiseNormJacobi).norm() / t_noiseNormJacobi.norm();
+    printf("Kernel difference (relative): %e, noise normalization difference (relative): %e\n", t_dKernelDiff, t_dNoiseNormDiff);
+    if(t_dKernelDiff > 1e-5 || t_dNoiseNormDiff > 1e-5)
+    {
+        printf("Kernels differ!\n");
+        emit checkupFailed(5);
+        return false;
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkSwapArrays()
+{
+    printf("Byte swap kernel: %s\n", IOUtils::swap_kernel());
+
+    //
+    // Every head misalignment to a 32 byte vector, tails shorter than one vector, n = 0 and a long run
+    //
+    qint32 sizes[3] = {2, 4, 8};
+    for(qint32 s = 0; s < 3; ++s)
+    {
+        for(qint32 offset = 0; offset < 32/sizes[s]; ++offset)
+        {
+            for(qint32 nel = 0; nel <= 72; ++nel)
+            {
+                if(!checkSwapRange(sizes[s], offset, nel))
+                {
+                    printf("%d byte swap of %d elements at offset %d is wrong!\n", sizes[s], nel, offset);
+                    emit checkupFailed(6);
+                    return false;
+                }
+            }
+
+            if(!checkSwapRange(sizes[s], offset, 4099))
+            {
+                printf("%d byte swap of 4099 elements at offset %d is wrong!\n", sizes[s], offset);
+                emit checkupFailed(6);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkMatrixBuffers()
+{
+    qint32 rows = 37;
+    qint32 cols = 11;
+    qint32 slots = 4;
+    qint32 count = 2000;
+
+    for(qint32 mode = 0; mode < 3; ++mode)
+    {
+        CircularMatrixBuffer<float>::SPtr t_pCircular;
+        SpscMatrixBuffer<float>::SPtr t_pSpsc;
+        if(mode == 0)
+            t_pCircular = CircularMatrixBuffer<float>::SPtr(new CircularMatrixBuffer<float>(slots, rows, cols));
+        else
+            t_pSpsc = SpscMatrixBuffer<float>::SPtr(new SpscMatrixBuffer<float>(slots, rows, cols));
+
+        SequenceProducer t_Producer(t_pCircular, t_pSpsc, rows, cols, count, mode == 2);
+        t_Producer.start();
+
+        bool ok = true;
+        MatrixXf t_mat;
+        for(qint32 i = 0; i < count; ++i)
+        {
+            if(mode == 0)
+                t_mat = t_pCircular->pop();
+            else if(mode == 1)
+                t_pSpsc->pop(t_mat);
+            else
+            {
+                t_mat = t_pSpsc->acquireReadSlot();
+                t_pSpsc->releaseReadSlot();
+            }
+
+            if(ok && (t_mat.rows() != rows || t_mat.cols() != cols || t_mat.minCoeff() != (float)i || t_mat.maxCoeff() != (float)i))
+            {
+                printf("Matrix %d of buffer mode %d is out of order or corrupted!\n", i, mode);
+                ok = false;
+            }
+        }
+        t_Producer.wait();
+
+        if(!ok)
+        {
+            emit checkupFailed(7);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkSvdGram()
+{
+    //
+    // Wide and tall matrices with a decaying, lead field like spectrum
+    //
+    qint32 sizes[3][2] = {{60, 600}, {306, 1500}, {400, 50}};
+    for(qint32 s = 0; s < 3; ++s)
+    {
+        MatrixXd A = MatrixXd::Random(sizes[s][0], sizes[s][1]);
+        if(A.rows() <= A.cols())
+            for(qint32 i = 0; i < A.rows(); ++i)
+                A.row(i) *= 1.0/(1.0 + i);
+        else
+            for(qint32 i = 0; i < A.cols(); ++i)
+                A.col(i) *= 1.0/(1.0 + i);
+
+        VectorXd sing;
+        MatrixXd U, V;
+        MNEMath::svd_gram(A, sing, U, V);
+        JacobiSVD<MatrixXd> svd(A, ComputeThinU | ComputeThinV);
+
+        double lambda2 = 1.0/9.0 * sing[0] * sing[0] * 1e-2;
+        VectorXd reg = sing.array() / (sing.array().square() + lambda2);
+        VectorXd regJacobi = svd.singularValues().array() / (svd.singularValues().array().square() + lambda2);
+
+        MatrixXd K = V * reg.asDiagonal() * U.transpose();
+        MatrixXd KJacobi = svd.matrixV() * regJacobi.asDiagonal() * svd.matrixU().transpose();
+
+        double t_dSingErr = (sing - svd.singularValues()).norm() / svd.singularValues().norm();
+        double t_dReconErr = (A - U * sing.asDiagonal() * V.transpose()).norm() / A.norm();
+        double t_dKernelErr = (K - KJacobi).norm() / KJacobi.norm();
+
+        printf("%4d x %4d: singular values %.2e, reconstruction %.2e, kernel %.2e\n", (int)A.rows(), (int)A.cols(), t_dSingErr, t_dReconErr, t_dKernelErr);
+        if(t_dSingErr > 1e-8 || t_dReconErr > 1e-8 || t_dKernelErr > 1e-8)
+        {
+            emit checkupFailed(8);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkKMeans()
+{
+    //
+    // Lead field like rows scattered tightly around well separated patterns
+    //
+    qint32 nsources = 600;
+    qint32 npatterns = 12;
+    MatrixXd patterns = MatrixXd::Random(npatterns, 3*306) * 1e-8;
+    MatrixXd X = MatrixXd::Random(nsources, 3*306) * 1e-11;
+    for(qint32 i = 0; i < nsources; ++i)
+        X.row(i) += patterns.row(i % npatterns);
+
+    KMeans t_kSample(QString("sqeuclidean"), QString("sample"), 5, QString("drop"), true, 100, 0);
+    KMeans t_kBatch(QString("sqeuclidean"), QString("plus"), 5, QString("drop"), false, 100, 0);
+    KMeans t_kPlus(QString("sqeuclidean"), QString("plus"), 5, QString("drop"), true, 100, 0);
+    KMeans t_kMiniBatch(QString("sqeuclidean"), QString("plus"), 5, QString("drop"), true, 100, 0);
+    t_kMiniBatch.setMiniBatch(64);
+    KMeans t_kCityBlock(QString("cityblock"), QString("plus"), 5, QString("drop"), true, 100, 0);
+
+    if(!checkClusters("sample", t_kSample, X, npatterns) ||
+       !checkClusters("k-means++, batch only", t_kBatch, X, npatterns) ||
+       !checkClusters("k-means++", t_kPlus, X, npatterns) ||
+       !checkClusters("k-means++, mini batch", t_kMiniBatch, X, npatterns) ||
+       !checkClusters("cityblock", t_kCityBlock, X, npatterns))
+    {
+        emit checkupFailed(9);
+        return false;
+    }
+
+    return true;
+}
+
+
+//*************************************************************************************************************
+
+bool MNELibTests::checkRapMusic()
+{
+    QFile t_fileFwd("./MNE-sample-data/MEG/sample/sample_audvis-meg-eeg-oct-6-fwd.fif");
+    QFile t_fileEvoked("./MNE-sample-data/MEG/sample/sample_audvis-ave.fif");
+
+    QPair<QVariant, QVariant> baseline(QVariant(), 0);
+    FiffEvoked evoked(t_fileEvoked, 0, baseline);
+    MNEForwardSolution t_Fwd(t_fileFwd);
+    if(evoked.isEmpty() || t_Fwd.isEmpty())
+    {
+        emit checkupFailed(10);
+        return false;
+    }
+
+    MNEForwardSolution t_FwdMeg = t_Fwd.pick_types(true, false);
+
+    //
+    // Gain of the good channels in the order of the forward solution
+    //
+    const FiffNamedMatrix& sol = *t_FwdMeg.sol.constData();
+    QList<qint32> t_qListDataSel;
+    MatrixXd G(0, sol.data.cols());
+    for(qint32 i = 0; i < sol.row_names.size(); ++i)
+    {
+        qint32 idx = evoked.info.ch_names.indexOf(sol.row_names[i]);
+        if(idx >= 0 && !evoked.info.bads.contains(sol.row_names[i]))
+        {
+            t_qListDataSel.append(idx);
+            G.conservativeResize(G.rows() + 1, G.cols());
+            G.row(G.rows() - 1) = sol.data.row(i);
+        }
+    }
+
+    //
+    // Noise free data of three free dipoles with different time courses, RAP MUSIC has to find exactly them
+    //
+    qint32 nsrc = G.cols()/3;
+    qint32 t_iSources[3] = {nsrc/7, nsrc/2, nsrc - nsrc/5};
+    qint32 nsamp = 200;
+    MatrixXd M = MatrixXd::Zero(G.rows(), nsamp);
+    for(qint32 d = 0; d < 3; ++d)
+    {
+        VectorXd ori = Vector3d::Random().normalized();
+        VectorXd topo = G.middleCols(3*t_iSources[d], 3) * ori;
+        for(qint32 t = 0; t < nsamp; ++t)
+            M.col(t) += topo * sin(0.05*(d + 1)*t + d);
+    }
+
+    MatrixXd t_matData = MatrixXd::Zero(evoked.info.nchan, nsamp);
+    for(qint32 i = 0; i < t_qListDataSel.size(); ++i)
+        t_matData.row(t_qListDataSel[i]) = M.row(i);
+
+    RapMusic t_rapMusic(t_FwdMeg, 3, 0.5);
+    QList<RapDipole> dipoles;
+    if(!t_rapMusic.doInverseSetup(evoked.info) || !t_rapMusic.calculateDipoles(t_matData, dipoles) || dipoles.size() != 3)
+    {
+        printf("RAP MUSIC found %d instead of 3 dipoles!\n", dipoles.size());
+        emit checkupFailed(10);
+        return false;
+    }
+
+    for(qint32 i = 0; i < dipoles.size(); ++i)
+    {
+        printf("Dipole %d: source %d, correlation %f\n", i, dipoles[i].source, dipoles[i].correlation);
+        if(dipoles[i].source != t_iSources[0] && dipoles[i].source != t_iSources[1] && dipoles[i].source != t_iSources[2])
+        {
+            printf("Source %d was not simulated!\n", dipoles[i].source);
+            emit checkupFailed(10);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -90,6 +90,103 @@ public:
     */
     bool checkFwdRead();
 
+    //=========================================================================================================
+    /**
+    * Test ID #2
+    *
+    * Writes raw data through the asynchronous FiffRawWriter, reads the file back and compares the samples
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkRawWriter();
+
+    //=========================================================================================================
+    /**
+    * Test ID #3
+    *
+    * Feeds a tag stream to FiffTagDecoder at once and byte by byte, checks tag recycling and the rejection of
+    * invalid and oversized tags
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkTagDecoder();
+
+    //=========================================================================================================
+    /**
+    * Test ID #4
+    *
+    * Encodes raw buffers in all real-time stream formats and decodes them again. The lossless formats have to
+    * be bit-exact, including zero, denormal, NaN and infinite samples, the int16 format has to be within half
+    * a quantization step. Forged buffer headers have to be rejected.
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkRawBufferFormats();
+
+    //=========================================================================================================
+    /**
+    * Test ID #5
+    *
+    * Computes the MEG inverse operator of the sample data with the Gram matrix and the JacobiSVD decomposition
+    * and compares the singular values, the eigenfields and eigenleads (up to sign) and the dSPM kernel
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkInverseSvd();
+
+    //=========================================================================================================
+    /**
+    * Test ID #6
+    *
+    * Checks the bulk byte swaps of IOUtils against a byte wise reversal for all head misalignments, tails
+    * shorter than one vector and empty arrays
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkSwapArrays();
+
+    //=========================================================================================================
+    /**
+    * Test ID #7
+    *
+    * Streams numbered matrices through a CircularMatrixBuffer and a SpscMatrixBuffer (copying and in place)
+    * from a producer thread and checks order and content
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkMatrixBuffers();
+
+    //=========================================================================================================
+    /**
+    * Test ID #8
+    *
+    * Compares MNEMath::svd_gram with JacobiSVD on wide and tall matrices
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkSvdGram();
+
+    //=========================================================================================================
+    /**
+    * Test ID #9
+    *
+    * Clusters points around well separated patterns with all KMeans configurations and checks that every
+    * cluster holds exactly one pattern
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkKMeans();
+
+    //=========================================================================================================
+    /**
+    * Test ID #10
+    *
+    * Localizes three simulated, noise free dipoles of the sample forward solution with RAP MUSIC
+    *
+    * @return true if successful false otherwise
+    */
+    bool checkRapMusic();
+
 signals:
     void checkupFailed(int ID);
 
@@ -0,0 +1,231 @@
+//=============================================================================================================
+/**
+* @file     main.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Throughput benchmark of SpscMatrixBuffer against CircularMatrixBuffer. Order and content of the
+*           transferred matrices are checked by mne_lib_tests.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <generics/circularmatrixbuffer.h>
+#include <generics/spscmatrixbuffer.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <stdio.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtCore/QCoreApplication>
+#include <QElapsedTimer>
+#include <QThread>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace IOBuffer;
+using namespace Eigen;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Producer threads
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* Pushes p_iCount matrices into a CircularMatrixBuffer.
+*/
+class CircularProducer : public QThread
+{
+public:
+    CircularProducer(CircularMatrixBuffer<float>::SPtr p_pBuffer, const MatrixXf& p_matData, qint32 p_iCount)
+    : m_pBuffer(p_pBuffer), m_matData(p_matData), m_iCount(p_iCount) {}
+
+protected:
+    virtual void run()
+    {
+        for(qint32 i = 0; i < m_iCount; ++i)
+            m_pBuffer->push(&m_matData);
+    }
+
+private:
+    CircularMatrixBuffer<float>::SPtr   m_pBuffer;  /**< The buffer to fill. */
+    MatrixXf                            m_matData;  /**< The pushed matrix. */
+    qint32                              m_iCount;   /**< Number of pushes. */
+};
+
+
+//=============================================================================================================
+/**
+* Pushes p_iCount matrices into a SpscMatrixBuffer, either copying or writing in place.
+*/
+class SpscProducer : public QThread
+{
+public:
+    SpscProducer(SpscMatrixBuffer<float>::SPtr p_pBuffer, const MatrixXf& p_matData, qint32 p_iCount, bool p_bInPlace)
+    : m_pBuffer(p_pBuffer), m_matData(p_matData), m_iCount(p_iCount), m_bInPlace(p_bInPlace) {}
+
+protected:
+    virtual void run()
+    {
+        for(qint32 i = 0; i < m_iCount; ++i)
+        {
+            if(m_bInPlace)
+            {
+                m_pBuffer->acquireWriteSlot() = m_matData;
+                m_pBuffer->commitWriteSlot();
+            }
+            else
+                m_pBuffer->push(&m_matData);
+        }
+    }
+
+private:
+    SpscMatrixBuffer<float>::SPtr   m_pBuffer;  /**< The buffer to fill. */
+    MatrixXf                        m_matData;  /**< The pushed matrix. */
+    qint32                          m_iCount;   /**< Number of pushes. */
+    bool                            m_bInPlace; /**< Whether the acquire/commit interface is used. */
+};
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Methods
+//=============================================================================================================
+
+/**
+* Prints time and throughput of one run.
+*/
+void printResult(const char* p_sName, qint64 p_iNs, qint32 p_iCount, qint32 p_iRows, qint32 p_iCols)
+{
+    double mbytes = (double)p_iCount*p_iRows*p_iCols*sizeof(float)/(1024.0*1024.0);
+    printf("%-28s %8.1f ms  %10.1f matrices/s  %9.1f MB/s\n", p_sName, p_iNs*1e-6,
+           p_iCount/(p_iNs*1e-9), mbytes/(p_iNs*1e-9));
+}
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* The function main marks the entry point of the program.
+* By default, main has the storage class extern.
+*
+* @param [in] argc (argument count) is an integer that indicates how many arguments were entered on the command line when the program was started.
+* @param [in] argv (argument vector) is an array of pointers to arrays of character objects. The array objects are null-terminated strings, representing the arguments that were entered on the command line when the program was started.
+* @return the value that was set to exit() (which is 0 if exit() is called via quit()).
+*/
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    //
+    //   400 channels, 100 samples per block, 32 blocks of buffer
+    //
+    qint32 rows = 400;
+    qint32 cols = 100;
+    qint32 slots = 32;
+    qint32 count = 5000;
+
+    MatrixXf t_matData = MatrixXf::Random(rows, cols);
+    QElapsedTimer timer;
+
+    printf("%d x %d float matrices, %d slots, %d transfers\n\n", rows, cols, slots, count);
+
+    //
+    //   CircularMatrixBuffer
+    //
+    {
+        CircularMatrixBuffer<float>::SPtr t_pBuffer(new CircularMatrixBuffer<float>(slots, rows, cols));
+        CircularProducer t_Producer(t_pBuffer, t_matData, count);
+        MatrixXf t_mat;
+        timer.start();
+        t_Producer.start();
+        for(qint32 i = 0; i < count; ++i)
+            t_mat = t_pBuffer->pop();
+        t_Producer.wait();
+        printResult("CircularMatrixBuffer", timer.nsecsElapsed(), count, rows, cols);
+    }
+
+    //
+    //   SpscMatrixBuffer push/pop
+    //
+    {
+        SpscMatrixBuffer<float>::SPtr t_pBuffer(new SpscMatrixBuffer<float>(slots, rows, cols));
+        SpscProducer t_Producer(t_pBuffer, t_matData, count, false);
+        MatrixXf t_mat;
+        timer.start();
+        t_Producer.start();
+        for(qint32 i = 0; i < count; ++i)
+            t_pBuffer->pop(t_mat);
+        t_Producer.wait();
+        printResult("SpscMatrixBuffer push/pop", timer.nsecsElapsed(), count, rows, cols);
+    }
+
+    //
+    //   SpscMatrixBuffer acquire/commit
+    //
+    {
+        SpscMatrixBuffer<float>::SPtr t_pBuffer(new SpscMatrixBuffer<float>(slots, rows, cols));
+        SpscProducer t_Producer(t_pBuffer, t_matData, count, true);
+        float t_fSum = 0;
+        timer.start();
+        t_Producer.start();
+        for(qint32 i = 0; i < count; ++i)
+        {
+            t_fSum += t_pBuffer->acquireReadSlot()(rows-1, cols-1);
+            t_pBuffer->releaseReadSlot();
+        }
+        t_Producer.wait();
+        printResult("SpscMatrixBuffer in place", timer.nsecsElapsed(), count, rows, cols);
+    }
+
+    return 0;
+}
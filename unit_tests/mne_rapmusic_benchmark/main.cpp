@@ -0,0 +1,271 @@
+//=============================================================================================================
+/**
+* @file     main.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Compares the run time of RAP MUSIC with a naive subspace scan on the sample forward solution. The
+*           localization itself is checked by mne_lib_tests.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <fiff/fiff_evoked.h>
+#include <mne/mne_forwardsolution.h>
+#include <inverse/rapMusic/rapmusic.h>
+#include <inverse/sourceestimate.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <stdio.h>
+#include <math.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Eigen INCLUDES
+//=============================================================================================================
+
+#include <Eigen/Core>
+#include <Eigen/SVD>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtCore/QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace FIFFLIB;
+using namespace MNELIB;
+using namespace INVERSELIB;
+using namespace Eigen;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Methods
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* Textbook RAP MUSIC: forms the projector explicitly and decomposes the projected gain of every source in every
+* recursion.
+*
+* @param[in] G          Gain of the selected channels (channels x 3*nsource)
+* @param[in] M          Data of the selected channels
+* @param[in] p_iN       Dimension of the signal subspace
+* @param[in] p_dThr     Subspace correlation threshold
+*
+* @return the found sources
+*/
+QList<qint32> naiveRapMusic(const MatrixXd& G, const MatrixXd& M, qint32 p_iN, double p_dThr)
+{
+    QList<qint32> sources;
+    qint32 nchan = G.rows();
+    qint32 nsrc = G.cols()/3;
+
+    JacobiSVD<MatrixXd> t_svdData(M, ComputeThinU);
+    MatrixXd Us = t_svdData.matrixU().leftCols(p_iN);
+
+    MatrixXd A(nchan, 0);
+    for(qint32 k = 0; k < p_iN; ++k)
+    {
+        MatrixXd P = MatrixXd::Identity(nchan, nchan);
+        if(A.cols() > 0)
+            P -= A * (A.transpose() * A).inverse() * A.transpose();
+        MatrixXd PUs = P * Us;
+
+        double best = -1;
+        qint32 t_iBest = -1;
+        VectorXd t_vecOri;
+        for(qint32 i = 0; i < nsrc; ++i)
+        {
+            JacobiSVD<MatrixXd> t_svdGain(P * G.middleCols(3*i, 3), ComputeThinU | ComputeThinV);
+            qint32 rank = 0;
+            for(qint32 j = 0; j < 3; ++j)
+                if(t_svdGain.singularValues()[j] > t_svdGain.singularValues()[0] * 1e-6)
+                    ++rank;
+            MatrixXd Ug = t_svdGain.matrixU().leftCols(rank);
+            JacobiSVD<MatrixXd> t_svdCorr(Ug.transpose() * PUs, ComputeThinU);
+            if(t_svdCorr.singularValues()[0] > best)
+            {
+                best = t_svdCorr.singularValues()[0];
+                t_iBest = i;
+                t_vecOri = t_svdGain.matrixV().leftCols(rank) * t_svdGain.singularValues().head(rank).cwiseInverse().asDiagonal() * t_svdCorr.matrixU().col(0);
+            }
+        }
+
+        if(best < p_dThr)
+            break;
+
+        sources.append(t_iBest);
+        A.conservativeResize(nchan, A.cols() + 1);
+        A.col(A.cols() - 1) = G.middleCols(3*t_iBest, 3) * t_vecOri.normalized();
+    }
+
+    return sources;
+}
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* The function main marks the entry point of the program.
+* By default, main has the storage class extern.
+*
+* @param [in] argc (argument count) is an integer that indicates how many arguments were entered on the command line when the program was started.
+* @param [in] argv (argument vector) is an array of pointers to arrays of character objects. The array objects are null-terminated strings, representing the arguments that were entered on the command line when the program was started.
+* @return the value that was set to exit() (which is 0 if exit() is called via quit()).
+*/
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QFile t_fileFwd("./MNE-sample-data/MEG/sample/sample_audvis-meg-eeg-oct-6-fwd.fif");
+    QFile t_fileEvoked("./MNE-sample-data/MEG/sample/sample_audvis-ave.fif");
+
+    qint32 t_iN = 3;
+    double t_dThr = 0.5;
+
+    fiff_int_t setno = 0;
+    QPair<QVariant, QVariant> baseline(QVariant(), 0);
+    FiffEvoked evoked(t_fileEvoked, setno, baseline);
+    if(evoked.isEmpty())
+        return 1;
+
+    MNEForwardSolution t_Fwd(t_fileFwd);
+    if(t_Fwd.isEmpty())
+        return 1;
+
+    //MEG only, EEG is on a different scale and would dominate the subspaces
+    MNEForwardSolution t_FwdMeg = t_Fwd.pick_types(true, false);
+
+    //
+    //   Gain of the good channels in the order of the forward solution
+    //
+    const FiffNamedMatrix& sol = *t_FwdMeg.sol.constData();
+    QList<qint32> t_qListDataSel;
+    MatrixXd G(0, sol.data.cols());
+    for(qint32 i = 0; i < sol.row_names.size(); ++i)
+    {
+        qint32 idx = evoked.info.ch_names.indexOf(sol.row_names[i]);
+        if(idx >= 0 && !evoked.info.bads.contains(sol.row_names[i]))
+        {
+            t_qListDataSel.append(idx);
+            G.conservativeResize(G.rows() + 1, G.cols());
+            G.row(G.rows() - 1) = sol.data.row(i);
+        }
+    }
+
+    //
+    //   Simulated evoked data: three free dipoles with different time courses plus 5% noise
+    //
+    qint32 nsrc = G.cols()/3;
+    qint32 t_iSources[3] = {nsrc/7, nsrc/2, nsrc - nsrc/5};
+    qint32 nsamp = evoked.data.cols();
+    MatrixXd M = MatrixXd::Zero(G.rows(), nsamp);
+    for(qint32 d = 0; d < 3; ++d)
+    {
+        VectorXd ori = Vector3d::Random().normalized();
+        VectorXd topo = G.middleCols(3*t_iSources[d], 3) * ori;
+        for(qint32 t = 0; t < nsamp; ++t)
+            M.col(t) += topo * sin(0.05*(d + 1)*t + d);
+    }
+    M += MatrixXd::Random(M.rows(), M.cols()) * 0.05 * M.cwiseAbs().maxCoeff();
+
+    MatrixXd t_matData = MatrixXd::Zero(evoked.info.nchan, nsamp);
+    for(qint32 i = 0; i < t_qListDataSel.size(); ++i)
+        t_matData.row(t_qListDataSel[i]) = M.row(i);
+
+    printf("%d channels, %d sources, %d samples, simulated sources %d %d %d\n\n", (int)G.rows(), nsrc, nsamp, t_iSources[0], t_iSources[1], t_iSources[2]);
+
+    //
+    //   RAP MUSIC
+    //
+    QElapsedTimer timer;
+    timer.start();
+    RapMusic t_rapMusic(t_FwdMeg, t_iN, t_dThr);
+    if(!t_rapMusic.doInverseSetup(evoked.info))
+        return 1;
+    printf("RAP MUSIC setup %lld ms\n", timer.elapsed());
+
+    QList<RapDipole> dipoles;
+    timer.start();
+    t_rapMusic.calculateDipoles(t_matData, dipoles);
+    qint64 t_iFastMs = timer.elapsed();
+
+    printf("RAP MUSIC  %6lld ms:", t_iFastMs);
+    for(qint32 i = 0; i < dipoles.size(); ++i)
+        printf(" %d (%.4f)", dipoles[i].source, dipoles[i].correlation);
+    printf("\n");
+
+    //
+    //   Naive scan
+    //
+    timer.start();
+    QList<qint32> t_qListNaive = naiveRapMusic(G, M, t_iN, t_dThr);
+    qint64 t_iNaiveMs = timer.elapsed();
+
+    printf("naive scan %6lld ms:", t_iNaiveMs);
+    for(qint32 i = 0; i < t_qListNaive.size(); ++i)
+        printf(" %d", t_qListNaive[i]);
+    printf("\n\n");
+
+    //
+    //   Repeated evoked updates with the cached setup, as done for every average of RtAve
+    //
+    qint32 t_iReps = 20;
+    timer.start();
+    for(qint32 i = 0; i < t_iReps; ++i)
+        t_rapMusic.calculateInverse(evoked);
+    printf("RAP MUSIC on the measured evoked: %.1f ms per call\n", (double)timer.elapsed() / t_iReps);
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+//=============================================================================================================
+/**
+* @file     main.cpp
+* @author   Christoph Dinh <chdinh@nmr.mgh.harvard.edu>;
+*           Matti Hamalainen <msh@nmr.mgh.harvard.edu>
+* @version  1.0
+* @date     April, 2013
+*
+* @section  LICENSE
+*
+* Copyright (C) 2012, Christoph Dinh and Matti Hamalainen. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that
+* the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this list of conditions and the
+*       following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and
+*       the following disclaimer in the documentation and/or other materials provided with the distribution.
+*     * Neither the name of the Massachusetts General Hospital nor the names of its contributors may be used
+*       to endorse or promote products derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+* PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL MASSACHUSETTS GENERAL HOSPITAL BE LIABLE FOR ANY DIRECT,
+* INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+* PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+* HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+* NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+* POSSIBILITY OF SUCH DAMAGE.
+*
+*
+* @brief    Micro benchmark of the bulk byte swap kernels of IOUtils against the element wise scalar swap. The
+*           correctness of the kernels is checked by mne_lib_tests.
+*
+*/
+
+//*************************************************************************************************************
+//=============================================================================================================
+// INCLUDES
+//=============================================================================================================
+
+#include <utils/ioutils.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// STL INCLUDES
+//=============================================================================================================
+
+#include <stdio.h>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// QT INCLUDES
+//=============================================================================================================
+
+#include <QtCore/QCoreApplication>
+#include <QElapsedTimer>
+#include <QVector>
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// USED NAMESPACES
+//=============================================================================================================
+
+using namespace UTILSLIB;
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// Methods
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* Swaps a float array element by element, the way FiffTag::convert_tag_data used to.
+*
+* @param[in, out] source    floats to swap
+* @param[in] nel            number of elements
+*/
+void swap_float_scalar(float *source, qint32 nel)
+{
+    for(qint32 k = 0; k < nel; ++k)
+        IOUtils::swap_floatp(source+k);
+}
+
+
+//*************************************************************************************************************
+
+void swap_short_scalar(qint16 *source, qint32 nel)
+{
+    for(qint32 k = 0; k < nel; ++k)
+        source[k] = IOUtils::swap_short(source[k]);
+}
+
+
+//*************************************************************************************************************
+
+void swap_double_scalar(double *source, qint32 nel)
+{
+    for(qint32 k = 0; k < nel; ++k)
+        IOUtils::swap_doublep(source+k);
+}
+
+
+//*************************************************************************************************************
+/**
+* Runs both swap variants p_iRepeats times on the same data and prints the throughput.
+*
+* @param[in] p_sName        Name of the data type
+* @param[in] p_Data         Data to swap
+* @param[in] nel            Number of elements
+* @param[in] p_iRepeats     Number of repetitions
+* @param[in] scalar         Element wise swap
+* @param[in] bulk           Bulk swap of IOUtils
+*/
+template<typename T>
+void benchmark(const char* p_sName, QVector<T>& p_Data, qint32 p_iRepeats, void (*scalar)(T*, qint32), void (*bulk)(T*, qint32))
+{
+    QVector<T> t_Scalar = p_Data;
+    QVector<T> t_Bulk = p_Data;
+    qint32 nel = p_Data.size();
+    double mbytes = (double)nel*sizeof(T)*p_iRepeats/(1024.0*1024.0);
+
+    QElapsedTimer timer;
+
+    timer.start();
+    for(qint32 i = 0; i < p_iRepeats; ++i)
+        scalar(t_Scalar.data(), nel);
+    qint64 t_iScalarNs = timer.nsecsElapsed();
+
+    timer.start();
+    for(qint32 i = 0; i < p_iRepeats; ++i)
+        bulk(t_Bulk.data(), nel);
+    qint64 t_iBulkNs = timer.nsecsElapsed();
+
+    printf("%-8s scalar %9.1f MB/s   %-6s %9.1f MB/s   speedup %5.2f\n", p_sName,
+           mbytes/(t_iScalarNs*1e-9), IOUtils::swap_kernel(), mbytes/(t_iBulkNs*1e-9),
+           (double)t_iScalarNs/(double)t_iBulkNs);
+}
+
+
+//*************************************************************************************************************
+//=============================================================================================================
+// MAIN
+//=============================================================================================================
+
+//=============================================================================================================
+/**
+* The function main marks the entry point of the program.
+* By default, main has the storage class extern.
+*
+* @param [in] argc (argument count) is an integer that indicates how many arguments were entered on the command line when the program was started.
+* @param [in] argv (argument vector) is an array of pointers to arrays of character objects. The array objects are null-terminated strings, representing the arguments that were entered on the command line when the program was started.
+* @return the value that was set to exit() (which is 0 if exit() is called via quit()).
+*/
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    //
+    //   One raw buffer of 400 channels x 5000 samples, plus an odd size to exercise the tails
+    //
+    qint32 sizes[2] = {400*5000, 400*5000 + 7};
+    qint32 repeats = 50;
+
+    printf("Byte swap kernel: %s\n\n", IOUtils::swap_kernel());
+
+    for(qint32 s = 0; s < 2; ++s)
+    {
+        printf("%d elements, %d repetitions\n", sizes[s], repeats);
+
+        QVector<float> t_Float(sizes[s]);
+        QVector<qint16> t_Short(sizes[s]);
+        QVector<double> t_Double(sizes[s]);
+        for(qint32 i = 0; i < sizes[s]; ++i)
+        {
+            t_Float[i] = (float)i*0.5f;
+            t_Short[i] = (qint16)(i*31);
+            t_Double[i] = (double)i*0.25;
+        }
+
+        benchmark<float>("float", t_Float, repeats, swap_float_scalar, IOUtils::swap_float_array);
+        benchmark<qint16>("short", t_Short, repeats, swap_short_scalar, IOUtils::swap_short_array);
+        benchmark<double>("double", t_Double, repeats, swap_double_scalar, IOUtils::swap_double_array);
+        printf("\n");
+    }
+
+    return 0;
+}
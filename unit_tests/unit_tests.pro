@@ -39,6 +39,11 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     mne_lib_tests \
+    mne_swap_benchmark \
+    mne_matrixbuffer_benchmark \
+    mne_svd_benchmark \
+    mne_kmeans_benchmark \
+    mne_rapmusic_benchmark \
     mne_rt_tests
 
 contains(MNECPP_CONFIG, isGui) {